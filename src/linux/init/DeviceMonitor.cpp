@@ -0,0 +1,416 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/sysmacros.h>
+#include <linux/netlink.h>
+#include "DeviceMonitor.h"
+#include "util.h"
+
+constexpr auto c_sysClassBlock = "/sys/class/block";
+constexpr int c_receiveBufferSize = 1024 * 1024;
+
+DeviceMonitor::DeviceMonitor()
+{
+    m_socket.reset(socket(AF_NETLINK, (SOCK_DGRAM | SOCK_CLOEXEC), NETLINK_KOBJECT_UEVENT));
+    THROW_LAST_ERROR_IF(!m_socket);
+
+    if (setsockopt(m_socket.get(), SOL_SOCKET, SO_RCVBUF, &c_receiveBufferSize, sizeof(c_receiveBufferSize)) < 0)
+    {
+        LOG_ERROR("setsockopt(SO_RCVBUF) failed {}", errno);
+    }
+
+    sockaddr_nl address{};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1;
+    THROW_LAST_ERROR_IF(bind(m_socket.get(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0);
+
+    // The socket is bound before sysfs is enumerated, so no device can be missed.
+    {
+        std::scoped_lock<std::mutex> lock{m_lock};
+        Enumerate();
+    }
+
+    m_shutdownPipe = wil::unique_pipe::create(O_CLOEXEC);
+    m_thread = std::thread([this]() { Run(); });
+}
+
+DeviceMonitor::~DeviceMonitor()
+{
+    m_shutdownPipe.write().reset();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+bool DeviceMonitor::WaitForBlockDevice(const std::string& name, std::chrono::milliseconds timeout)
+{
+    return WaitFor(
+               [&]() -> std::optional<std::string> {
+                   if (m_devices.find(name) == m_devices.end())
+                   {
+                       return {};
+                   }
+
+                   return name;
+               },
+               timeout)
+        .has_value();
+}
+
+std::optional<std::string> DeviceMonitor::WaitForScsiDisk(const std::string& address, std::chrono::milliseconds timeout)
+{
+    return WaitFor(
+        [&]() -> std::optional<std::string> {
+            const auto it = m_scsiDisks.find(address);
+            if (it == m_scsiDisks.end())
+            {
+                return {};
+            }
+
+            return it->second;
+        },
+        timeout);
+}
+
+std::vector<DeviceMonitor::BlockDevice> DeviceMonitor::GetDiskAndPartitions(const std::string& disk)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+    Update();
+
+    const auto it = m_devices.find(disk);
+    if (it == m_devices.end() || !it->second.Disk.empty())
+    {
+        LOG_ERROR("Disk {} not found", disk);
+        THROW_ERRNO(ENOENT);
+    }
+
+    std::vector<BlockDevice> devices;
+
+    devices.emplace_back(it->second);
+    if (const auto partitions = m_partitions.find(disk); partitions != m_partitions.end())
+    {
+        for (const auto& e : partitions->second)
+        {
+            devices.emplace_back(m_devices.at(e));
+        }
+    }
+
+    return devices;
+}
+
+void DeviceMonitor::Apply(const std::string& event)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+    ApplyLocked(event);
+    m_changed.notify_all();
+}
+
+std::optional<std::string> DeviceMonitor::WaitFor(const Predicate& predicate, std::chrono::milliseconds timeout)
+{
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    std::unique_lock<std::mutex> lock{m_lock};
+    for (;;)
+    {
+        Update();
+
+        auto result = predicate();
+        if (result.has_value() || std::chrono::steady_clock::now() >= deadline)
+        {
+            return result;
+        }
+
+        m_changed.wait_until(lock, deadline);
+    }
+}
+
+void DeviceMonitor::Run() noexcept
+{
+    UtilSetThreadName("DeviceMonitor");
+
+    pollfd pollDescriptors[2];
+    pollDescriptors[0] = {.fd = m_socket.get(), .events = POLLIN, .revents = 0};
+    pollDescriptors[1] = {.fd = m_shutdownPipe.read().get(), .events = POLLIN, .revents = 0};
+
+    for (;;)
+    {
+        try
+        {
+            if (poll(pollDescriptors, std::size(pollDescriptors), -1) <= 0)
+            {
+                THROW_LAST_ERROR_IF(errno != EINTR);
+                continue;
+            }
+
+            if (pollDescriptors[1].revents != 0)
+            {
+                return;
+            }
+
+            if (WI_IsFlagSet(pollDescriptors[0].revents, POLLIN))
+            {
+                std::scoped_lock<std::mutex> lock{m_lock};
+                Update();
+            }
+        }
+        CATCH_LOG()
+    }
+}
+
+void DeviceMonitor::Update()
+{
+    std::vector<std::string> events;
+    if (!Receive(events))
+    {
+        LOG_ERROR("uevents were lost, rebuilding the block device table");
+        Enumerate();
+        m_changed.notify_all();
+        return;
+    }
+
+    for (const auto& e : events)
+    {
+        ApplyLocked(e);
+    }
+
+    if (!events.empty())
+    {
+        m_changed.notify_all();
+    }
+}
+
+void DeviceMonitor::Enumerate()
+{
+    m_devices.clear();
+    m_scsiDisks.clear();
+    m_partitions.clear();
+
+    for (const auto& e : std::filesystem::directory_iterator(c_sysClassBlock))
+    {
+        try
+        {
+            // Entries are links to the sysfs path of the device (../../devices/...). Names use '!' instead of '/'.
+            BlockDevice device{};
+            device.DevPath = std::filesystem::read_symlink(e.path()).string();
+            const auto devices = device.DevPath.find("/devices/");
+            if (devices != std::string::npos)
+            {
+                device.DevPath.erase(0, devices);
+            }
+
+            device.Name = e.path().filename().string();
+            std::ranges::replace(device.Name, '!', '/');
+
+            unsigned int major = 0;
+            unsigned int minor = 0;
+            char separator{};
+            std::ifstream number{e.path() / "dev"};
+            if (number >> major >> separator >> minor && separator == ':')
+            {
+                device.Number = makedev(major, minor);
+            }
+
+            if (std::filesystem::exists(e.path() / "partition"))
+            {
+                device.Disk = GetPartitionDisk(device.DevPath);
+            }
+
+            Insert(std::move(device));
+        }
+        CATCH_LOG()
+    }
+}
+
+bool DeviceMonitor::Receive(std::vector<std::string>& events)
+{
+    bool complete = true;
+    char buffer[8192];
+    for (;;)
+    {
+        sockaddr_nl address{};
+        socklen_t addressLength = sizeof(address);
+        const auto bytes =
+            recvfrom(m_socket.get(), buffer, sizeof(buffer), MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&address), &addressLength);
+        if (bytes < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return complete;
+            }
+            else if (errno == ENOBUFS)
+            {
+                // The queued uevents are older than the table that will be rebuilt, so they are drained and dropped.
+                complete = false;
+                continue;
+            }
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+
+            THROW_LAST_ERROR();
+        }
+
+        // Only process uevents sent by the kernel.
+        if (complete && address.nl_pid == 0)
+        {
+            events.emplace_back(buffer, bytes);
+        }
+    }
+}
+
+void DeviceMonitor::ApplyLocked(const std::string& event)
+{
+    // A uevent is a "<action>@<devpath>" header followed by KEY=VALUE strings, separated by null characters.
+    std::map<std::string_view, std::string_view> values;
+    std::string_view remaining{event};
+    while (!remaining.empty())
+    {
+        const auto end = std::min(remaining.find('\0'), remaining.size());
+        const auto entry = remaining.substr(0, end);
+        const auto separator = entry.find('=');
+        if (separator != std::string_view::npos)
+        {
+            values.emplace(entry.substr(0, separator), entry.substr(separator + 1));
+        }
+
+        remaining.remove_prefix(std::min(end + 1, remaining.size()));
+    }
+
+    auto get = [&](std::string_view key) {
+        const auto it = values.find(key);
+        return it == values.end() ? std::string{} : std::string{it->second};
+    };
+
+    const auto name = get("DEVNAME");
+    if (get("SUBSYSTEM") != "block" || name.empty())
+    {
+        return;
+    }
+
+    if (get("ACTION") == "remove")
+    {
+        Erase(name);
+        return;
+    }
+
+    // A renamed device (move) is published again with its new name.
+    const auto oldPath = get("DEVPATH_OLD");
+    if (!oldPath.empty())
+    {
+        const auto it = std::ranges::find_if(m_devices, [&](const auto& e) { return e.second.DevPath == oldPath; });
+        if (it != m_devices.end())
+        {
+            Erase(std::string{it->first});
+        }
+    }
+
+    BlockDevice device{.Name = name, .DevPath = get("DEVPATH")};
+    device.Number = makedev(std::strtoul(get("MAJOR").c_str(), nullptr, 10), std::strtoul(get("MINOR").c_str(), nullptr, 10));
+    if (get("DEVTYPE") == "partition")
+    {
+        device.Disk = GetPartitionDisk(device.DevPath);
+    }
+
+    Insert(std::move(device));
+}
+
+void DeviceMonitor::Insert(BlockDevice&& device)
+{
+    Erase(device.Name);
+
+    if (!device.Disk.empty())
+    {
+        m_partitions[device.Disk].emplace(device.Name);
+    }
+    else
+    {
+        device.ScsiAddress = GetScsiAddress(device.DevPath);
+        if (!device.ScsiAddress.empty())
+        {
+            m_scsiDisks[device.ScsiAddress] = device.Name;
+        }
+    }
+
+    auto name = device.Name;
+    m_devices.emplace(std::move(name), std::move(device));
+}
+
+void DeviceMonitor::Erase(const std::string& name)
+{
+    const auto it = m_devices.find(name);
+    if (it == m_devices.end())
+    {
+        return;
+    }
+
+    const auto& device = it->second;
+    if (!device.Disk.empty())
+    {
+        if (const auto partitions = m_partitions.find(device.Disk); partitions != m_partitions.end())
+        {
+            partitions->second.erase(name);
+            if (partitions->second.empty())
+            {
+                m_partitions.erase(partitions);
+            }
+        }
+    }
+    else if (!device.ScsiAddress.empty())
+    {
+        // The address may already have been reused by another disk if uevents were reordered.
+        if (const auto disk = m_scsiDisks.find(device.ScsiAddress); disk != m_scsiDisks.end() && disk->second == name)
+        {
+            m_scsiDisks.erase(disk);
+        }
+    }
+
+    m_devices.erase(it);
+}
+
+std::string DeviceMonitor::GetScsiAddress(const std::string& devPath)
+{
+    // The sysfs path of a SCSI disk ends with .../<host>:<channel>:<target>:<lun>/block/<name>.
+    const auto block = devPath.rfind("/block/");
+    if (block == std::string::npos || block == 0)
+    {
+        return {};
+    }
+
+    const auto start = devPath.rfind('/', block - 1);
+    if (start == std::string::npos)
+    {
+        return {};
+    }
+
+    auto address = devPath.substr(start + 1, block - start - 1);
+    if (address.empty() || std::ranges::count(address, ':') != 3 ||
+        !std::ranges::all_of(address, [](char c) { return c == ':' || (c >= '0' && c <= '9'); }))
+    {
+        return {};
+    }
+
+    return address;
+}
+
+std::string DeviceMonitor::GetPartitionDisk(const std::string& devPath)
+{
+    // The sysfs path of a partition is the sysfs path of its disk followed by the name of the partition.
+    const auto end = devPath.rfind('/');
+    if (end == std::string::npos || end == 0)
+    {
+        return {};
+    }
+
+    const auto start = devPath.rfind('/', end - 1);
+    auto disk = devPath.substr(start + 1, end - start - 1);
+    std::ranges::replace(disk, '!', '/');
+    return disk;
+}
@@ -0,0 +1,145 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include "common.h"
+
+// Table of the block devices present in the VM, kept current with the kernel uevents.
+//
+// The table is built by enumerating /sys/class/block, then updated with the uevents received on a NETLINK_KOBJECT_UEVENT
+// socket, so callers can wait for a device to appear without polling. The kernel creates the devtmpfs node of a device
+// and scans the partitions of a disk before it publishes the device, so a device is ready to be opened once it's in the
+// table.
+//
+// SCSI disks are indexed by address and partitions by disk, so looking up the disk of a LUN doesn't scan sysfs.
+//
+// The socket receives the uevents of every subsystem, so a thread of the monitor drains it as uevents arrive, instead of
+// letting them queue up until the next lookup. The pending uevents are also applied before each lookup, so a lookup
+// sees the partitions published with a disk.
+//
+// An instance must only be used by the process that created it: mini_init creates children with CLONE(), which doesn't
+// run the pthread_atfork() handlers, so a child can inherit the lock held by a thread of its parent.
+class DeviceMonitor
+{
+public:
+    struct BlockDevice
+    {
+        // Name of the device under /dev (for example sda, sda1 or pmem0).
+        std::string Name;
+
+        // Sysfs path of the device, relative to /sys (for example /devices/.../0:0:0:1/block/sdb).
+        std::string DevPath;
+
+        // Device number.
+        dev_t Number = 0;
+
+        // Name of the disk of a partition, empty for a disk.
+        std::string Disk;
+
+        // SCSI address (host:channel:target:lun) of a SCSI disk, empty for other devices.
+        std::string ScsiAddress;
+    };
+
+    DeviceMonitor();
+    ~DeviceMonitor();
+
+    DeviceMonitor(const DeviceMonitor&) = delete;
+    DeviceMonitor(DeviceMonitor&&) = delete;
+    DeviceMonitor& operator=(const DeviceMonitor&) = delete;
+    DeviceMonitor& operator=(DeviceMonitor&&) = delete;
+
+    // Wait for a block device to be present.
+    //
+    // Arguments:
+    //    name - name of the device under /dev.
+    //    timeout - how long to wait for the device.
+    //
+    // Return Value:
+    //    true if the device is present, false if it didn't appear before the timeout.
+    bool WaitForBlockDevice(const std::string& name, std::chrono::milliseconds timeout);
+
+    // Wait for the disk of a SCSI device to be present.
+    //
+    // Arguments:
+    //    address - SCSI address of the device (host:channel:target:lun).
+    //    timeout - how long to wait for the disk.
+    //
+    // Return Value:
+    //    The name of the disk under /dev, or nothing if it didn't appear before the timeout.
+    std::optional<std::string> WaitForScsiDisk(const std::string& address, std::chrono::milliseconds timeout);
+
+    // Return a disk and its partitions. Throws if the disk isn't present.
+    std::vector<BlockDevice> GetDiskAndPartitions(const std::string& disk);
+
+    // Apply a uevent to the table, as if it was received from the kernel.
+    void Apply(const std::string& event);
+
+    // Return the SCSI address (host:channel:target:lun) of a disk, or an empty string if it isn't a SCSI disk.
+    static std::string GetScsiAddress(const std::string& devPath);
+
+    // Return the name of the disk of a partition, given its sysfs path.
+    static std::string GetPartitionDisk(const std::string& devPath);
+
+private:
+    using Predicate = std::function<std::optional<std::string>()>;
+
+    // Wait until a predicate returns a value. The predicate is called with m_lock held.
+    std::optional<std::string> WaitFor(const Predicate& predicate, std::chrono::milliseconds timeout);
+
+    // Receive the uevents until the monitor is destroyed.
+    void Run() noexcept;
+
+    // Apply the pending uevents, waking up the waiting threads if the table changed. Requires m_lock.
+    void Update();
+
+    // Rebuild the table from sysfs. Requires m_lock.
+    void Enumerate();
+
+    // Receive the pending uevents. Returns false if uevents were lost. Requires m_lock.
+    bool Receive(std::vector<std::string>& events);
+
+    // Apply a uevent to the table. Requires m_lock.
+    void ApplyLocked(const std::string& event);
+
+    // Add or replace a device and update the indexes. Requires m_lock.
+    void Insert(BlockDevice&& device);
+
+    // Remove a device and update the indexes. Requires m_lock.
+    void Erase(const std::string& name);
+
+    std::mutex m_lock;
+
+    // Notified when the table changes.
+    std::condition_variable m_changed;
+
+    // Block devices, indexed by name.
+    // _Guarded_by_(m_lock)
+    std::map<std::string, BlockDevice> m_devices;
+
+    // Names of the SCSI disks, indexed by SCSI address.
+    // _Guarded_by_(m_lock)
+    std::map<std::string, std::string> m_scsiDisks;
+
+    // Names of the partitions, indexed by disk name.
+    // _Guarded_by_(m_lock)
+    std::map<std::string, std::set<std::string>> m_partitions;
+
+    // _Guarded_by_(m_lock)
+    wil::unique_fd m_socket;
+
+    // Pipe used to stop m_thread.
+    wil::unique_pipe m_shutdownPipe;
+
+    std::thread m_thread;
+};
@@ -0,0 +1,515 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "DnsCache.h"
+#include "util.h"
+
+// Size of the DNS header
+constexpr size_t c_dnsHeaderSize = 12;
+// Maximum size of a DNS over UDP response when the client doesn't use EDNS
+constexpr uint16_t c_defaultMaxUdpPayloadSize = 512;
+// Size of the fixed part of a resource record following its name (type, class, TTL, data length)
+constexpr size_t c_resourceRecordFixedSize = 10;
+// Maximum number of cached responses
+constexpr size_t c_maxCacheEntries = 4096;
+// Maximum total size of the cached responses
+constexpr size_t c_maxCacheBytes = 4 * 1024 * 1024;
+// Responses larger than this are not cached
+constexpr size_t c_maxCachedResponseSize = 16 * 1024;
+// Upper bound of the time a positive answer is cached, regardless of its TTL
+constexpr uint32_t c_maxPositiveTtlSeconds = 24 * 60 * 60;
+// Upper bound of the time a negative answer is cached, regardless of its SOA record (RFC 2308 recommends 1 to 3 hours)
+constexpr uint32_t c_maxNegativeTtlSeconds = 15 * 60;
+// Maximum number of requests being tracked for coalescing
+constexpr size_t c_maxInFlightRequests = 1024;
+// Maximum number of clients waiting on the same in-flight request
+constexpr size_t c_maxWaitersPerRequest = 64;
+// Time after which an in-flight request is considered lost and is not used for coalescing anymore
+constexpr auto c_inFlightRequestTimeout = std::chrono::seconds(5);
+
+// DNS header flags
+constexpr uint16_t c_dnsFlagResponse = 0x8000;
+constexpr uint16_t c_dnsOpcodeMask = 0x7800;
+constexpr uint16_t c_dnsFlagTruncated = 0x0200;
+constexpr uint16_t c_dnsFlagRecursionDesired = 0x0100;
+constexpr uint16_t c_dnsFlagCheckingDisabled = 0x0010;
+constexpr uint16_t c_dnsRcodeMask = 0x000F;
+// DNSSEC OK flag, stored in the TTL field of the OPT pseudo-record
+constexpr uint32_t c_ednsFlagDnssecOk = 0x8000;
+
+constexpr uint16_t c_dnsRcodeNoError = 0;
+constexpr uint16_t c_dnsRcodeNameError = 3;
+
+constexpr uint16_t c_dnsTypeSoa = 6;
+constexpr uint16_t c_dnsTypeOpt = 41;
+constexpr uint16_t c_dnsTypeIxfr = 251;
+constexpr uint16_t c_dnsTypeAxfr = 252;
+
+// Flags of the cache key
+constexpr char c_keyFlagRecursionDesired = 0x1;
+constexpr char c_keyFlagCheckingDisabled = 0x2;
+constexpr char c_keyFlagDnssecOk = 0x4;
+constexpr char c_keyFlagEdns = 0x8;
+
+static uint16_t ReadUint16(const gsl::span<const gsl::byte> buffer, size_t offset)
+{
+    uint16_t value{};
+    memcpy(&value, buffer.data() + offset, sizeof(value));
+    return ntohs(value);
+}
+
+static uint32_t ReadUint32(const gsl::span<const gsl::byte> buffer, size_t offset)
+{
+    uint32_t value{};
+    memcpy(&value, buffer.data() + offset, sizeof(value));
+    return ntohl(value);
+}
+
+static void WriteUint16(gsl::span<gsl::byte> buffer, size_t offset, uint16_t value)
+{
+    value = htons(value);
+    memcpy(buffer.data() + offset, &value, sizeof(value));
+}
+
+static void WriteUint32(gsl::span<gsl::byte> buffer, size_t offset, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(buffer.data() + offset, &value, sizeof(value));
+}
+
+// Skip a (possibly compressed) domain name starting at offset. If name is not null, the name is appended to it in
+// lowercase wire format; compressed names are rejected in that case.
+//
+// Returns the offset following the name, or std::nullopt if the name is malformed.
+static std::optional<size_t> ReadName(const gsl::span<const gsl::byte> buffer, size_t offset, std::string* name)
+{
+    for (;;)
+    {
+        if (offset >= buffer.size())
+        {
+            return {};
+        }
+
+        const auto labelLength = static_cast<uint8_t>(buffer[offset]);
+
+        // Compression pointer, which terminates the name
+        if ((labelLength & 0xC0) == 0xC0)
+        {
+            if (name != nullptr || offset + 2 > buffer.size())
+            {
+                return {};
+            }
+
+            return offset + 2;
+        }
+        else if ((labelLength & 0xC0) != 0)
+        {
+            return {};
+        }
+
+        if (offset + 1 + labelLength > buffer.size())
+        {
+            return {};
+        }
+
+        if (name != nullptr)
+        {
+            name->push_back(static_cast<char>(labelLength));
+            for (size_t index = 0; index < labelLength; index++)
+            {
+                name->push_back(static_cast<char>(tolower(static_cast<unsigned char>(buffer[offset + 1 + index]))));
+            }
+        }
+
+        offset += 1 + labelLength;
+        if (labelLength == 0)
+        {
+            return offset;
+        }
+    }
+}
+
+// Parse the question section of a DNS message, which is expected to contain exactly one question.
+// The name, type and class of the question are appended to key.
+//
+// Returns the offset following the question section, or std::nullopt if the message can't be cached.
+static std::optional<size_t> ReadQuestion(const gsl::span<const gsl::byte> buffer, std::string& key)
+{
+    if (buffer.size() < c_dnsHeaderSize || ReadUint16(buffer, 4) != 1)
+    {
+        return {};
+    }
+
+    auto offset = ReadName(buffer, c_dnsHeaderSize, &key);
+    if (!offset.has_value() || offset.value() + 4 > buffer.size())
+    {
+        return {};
+    }
+
+    const auto type = ReadUint16(buffer, offset.value());
+    if (type == c_dnsTypeAxfr || type == c_dnsTypeIxfr)
+    {
+        return {};
+    }
+
+    key.append(reinterpret_cast<const char*>(buffer.data() + offset.value()), 4);
+    return offset.value() + 4;
+}
+
+// Compute the key flags from the DNS header flags and the OPT pseudo-record.
+//
+// N.B. A response only has an OPT pseudo-record if its request had one, and a response with an OPT pseudo-record must not
+//      be sent to a client that didn't use EDNS (RFC 6891), so the presence of the record is part of the key.
+static char KeyFlags(uint16_t headerFlags, bool edns, bool dnssecOk)
+{
+    char flags = 0;
+    WI_SetFlagIf(flags, c_keyFlagRecursionDesired, WI_IsFlagSet(headerFlags, c_dnsFlagRecursionDesired));
+    WI_SetFlagIf(flags, c_keyFlagCheckingDisabled, WI_IsFlagSet(headerFlags, c_dnsFlagCheckingDisabled));
+    WI_SetFlagIf(flags, c_keyFlagEdns, edns);
+    WI_SetFlagIf(flags, c_keyFlagDnssecOk, dnssecOk);
+    return flags;
+}
+
+std::optional<DnsCache::Question> DnsCache::ParseRequest(const gsl::span<const gsl::byte> dnsRequest) noexcept
+try
+{
+    Question question{};
+    auto offset = ReadQuestion(dnsRequest, question.Key);
+    if (!offset.has_value())
+    {
+        return {};
+    }
+
+    const auto flags = ReadUint16(dnsRequest, 2);
+    if (WI_IsFlagSet(flags, c_dnsFlagResponse) || (flags & c_dnsOpcodeMask) != 0)
+    {
+        return {};
+    }
+
+    // Look for an OPT pseudo-record in the additional section, which carries the UDP payload size and the DNSSEC OK flag.
+    const size_t recordCount = ReadUint16(dnsRequest, 6) + ReadUint16(dnsRequest, 8) + ReadUint16(dnsRequest, 10);
+    bool edns = false;
+    bool dnssecOk = false;
+    question.MaxUdpPayloadSize = c_defaultMaxUdpPayloadSize;
+    for (size_t index = 0; index < recordCount; index++)
+    {
+        offset = ReadName(dnsRequest, offset.value(), nullptr);
+        if (!offset.has_value() || offset.value() + c_resourceRecordFixedSize > dnsRequest.size())
+        {
+            return {};
+        }
+
+        if (ReadUint16(dnsRequest, offset.value()) == c_dnsTypeOpt)
+        {
+            question.MaxUdpPayloadSize = std::max(ReadUint16(dnsRequest, offset.value() + 2), c_defaultMaxUdpPayloadSize);
+            edns = true;
+            dnssecOk = WI_IsFlagSet(ReadUint32(dnsRequest, offset.value() + 4), c_ednsFlagDnssecOk);
+        }
+
+        offset = offset.value() + c_resourceRecordFixedSize + ReadUint16(dnsRequest, offset.value() + 8);
+    }
+
+    question.Key.push_back(KeyFlags(flags, edns, dnssecOk));
+    question.TransactionId = ReadUint16(dnsRequest, 0);
+
+    // The key holds the name in wire format, followed by the type, the class and the flags.
+    const auto nameLength = question.Key.size() - 4 - 1;
+    question.Name.assign(reinterpret_cast<const char*>(dnsRequest.data() + c_dnsHeaderSize), nameLength);
+    return question;
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    return {};
+}
+
+std::optional<DnsCache::Entry> DnsCache::ParseResponse(const gsl::span<const gsl::byte> dnsResponse, Clock::time_point now)
+{
+    if (dnsResponse.size() > c_maxCachedResponseSize)
+    {
+        return {};
+    }
+
+    Entry entry{};
+    auto offset = ReadQuestion(dnsResponse, entry.Key);
+    if (!offset.has_value())
+    {
+        return {};
+    }
+
+    // Only cache complete answers to standard queries that either succeeded or reported that the name doesn't exist.
+    const auto flags = ReadUint16(dnsResponse, 2);
+    const auto rcode = flags & c_dnsRcodeMask;
+    if (WI_IsFlagClear(flags, c_dnsFlagResponse) || (flags & c_dnsOpcodeMask) != 0 || WI_IsFlagSet(flags, c_dnsFlagTruncated) ||
+        (rcode != c_dnsRcodeNoError && rcode != c_dnsRcodeNameError))
+    {
+        return {};
+    }
+
+    const size_t answerCount = ReadUint16(dnsResponse, 6);
+    const size_t authorityCount = ReadUint16(dnsResponse, 8);
+    const size_t recordCount = answerCount + authorityCount + ReadUint16(dnsResponse, 10);
+    const bool negative = rcode == c_dnsRcodeNameError || answerCount == 0;
+
+    std::optional<uint32_t> ttl;
+    bool edns = false;
+    bool dnssecOk = false;
+    for (size_t index = 0; index < recordCount; index++)
+    {
+        offset = ReadName(dnsResponse, offset.value(), nullptr);
+        if (!offset.has_value() || offset.value() + c_resourceRecordFixedSize > dnsResponse.size())
+        {
+            return {};
+        }
+
+        const auto type = ReadUint16(dnsResponse, offset.value());
+        const auto ttlOffset = offset.value() + 4;
+        const auto dataLength = ReadUint16(dnsResponse, offset.value() + 8);
+        const auto dataOffset = offset.value() + c_resourceRecordFixedSize;
+        if (dataOffset + dataLength > dnsResponse.size())
+        {
+            return {};
+        }
+
+        offset = dataOffset + dataLength;
+
+        // The TTL field of the OPT pseudo-record contains flags
+        if (type == c_dnsTypeOpt)
+        {
+            edns = true;
+            dnssecOk = WI_IsFlagSet(ReadUint32(dnsResponse, ttlOffset), c_ednsFlagDnssecOk);
+            continue;
+        }
+
+        const auto recordTtl = ReadUint32(dnsResponse, ttlOffset);
+        entry.TtlOffsets.push_back(gsl::narrow_cast<uint16_t>(ttlOffset));
+
+        if (!negative)
+        {
+            ttl = std::min(ttl.value_or(recordTtl), recordTtl);
+        }
+        else if (type == c_dnsTypeSoa && index >= answerCount && index < answerCount + authorityCount && dataLength >= 4)
+        {
+            // The TTL of a negative answer is the minimum of the SOA record TTL and its MINIMUM field (RFC 2308).
+            const auto soaMinimum = ReadUint32(dnsResponse, dataOffset + dataLength - 4);
+            ttl = std::min({ttl.value_or(recordTtl), recordTtl, soaMinimum});
+        }
+    }
+
+    if (!ttl.has_value() || ttl.value() == 0)
+    {
+        return {};
+    }
+
+    ttl = std::min(ttl.value(), negative ? c_maxNegativeTtlSeconds : c_maxPositiveTtlSeconds);
+
+    entry.Key.push_back(KeyFlags(flags, edns, dnssecOk));
+    entry.Response.assign(dnsResponse.begin(), dnsResponse.end());
+    entry.Inserted = now;
+    entry.Expiry = now + std::chrono::seconds(ttl.value());
+    return entry;
+}
+
+std::string DnsCache::InFlightKey(const Question& question, int protocol)
+{
+    std::string key = question.Key;
+    key.push_back(static_cast<char>(protocol));
+    if (protocol == IPPROTO_UDP)
+    {
+        key.append(reinterpret_cast<const char*>(&question.MaxUdpPayloadSize), sizeof(question.MaxUdpPayloadSize));
+    }
+
+    return key;
+}
+
+uint64_t DnsCache::ClientKey(const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept
+{
+    return (static_cast<uint64_t>(dnsClientIdentifier.Protocol) << 32) | dnsClientIdentifier.DnsClientId;
+}
+
+std::vector<gsl::byte> DnsCache::Lookup(const Question& question, int protocol)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+
+    const auto it = m_index.find(question.Key);
+    if (it == m_index.end())
+    {
+        return {};
+    }
+
+    const auto entry = it->second;
+    const auto now = Clock::now();
+    if (now >= entry->Expiry)
+    {
+        Erase(entry);
+        return {};
+    }
+
+    // A cached response that doesn't fit in the client's UDP payload size is not used. The request is tunneled instead
+    // so the client receives a truncated response and retries over TCP.
+    if (protocol == IPPROTO_UDP && entry->Response.size() > question.MaxUdpPayloadSize)
+    {
+        return {};
+    }
+
+    // Mark the entry as most recently used
+    m_entries.splice(m_entries.begin(), m_entries, entry);
+
+    std::vector<gsl::byte> response = entry->Response;
+    WriteUint16(gsl::make_span(response), 0, question.TransactionId);
+    CopyQuestionName(gsl::make_span(response), question.Name);
+
+    const auto age = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now - entry->Inserted).count());
+    for (const auto ttlOffset : entry->TtlOffsets)
+    {
+        const auto ttl = ReadUint32(gsl::make_span(response), ttlOffset);
+        WriteUint32(gsl::make_span(response), ttlOffset, ttl > age ? ttl - age : 0);
+    }
+
+    return response;
+}
+
+void DnsCache::CopyQuestionName(gsl::span<gsl::byte> dnsResponse, const std::string& name) noexcept
+{
+    if (dnsResponse.size() < c_dnsHeaderSize + name.size())
+    {
+        return;
+    }
+
+    const auto responseName = dnsResponse.subspan(c_dnsHeaderSize, name.size());
+    const auto sameName = std::equal(responseName.begin(), responseName.end(), name.begin(), [](gsl::byte left, char right) {
+        return tolower(static_cast<unsigned char>(left)) == tolower(static_cast<unsigned char>(right));
+    });
+
+    if (sameName)
+    {
+        memcpy(responseName.data(), name.data(), name.size());
+    }
+}
+
+bool DnsCache::BeginRequest(const Question& question, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+
+    const auto now = Clock::now();
+    auto key = InFlightKey(question, dnsClientIdentifier.Protocol);
+    const auto indexIt = m_inFlightIndex.find(key);
+    if (indexIt != m_inFlightIndex.end())
+    {
+        auto& request = m_inFlightRequests.at(indexIt->second);
+        if (now - request.Started < c_inFlightRequestTimeout)
+        {
+            if (request.Waiters.size() >= c_maxWaitersPerRequest)
+            {
+                return true;
+            }
+
+            request.Waiters.emplace_back(Waiter{dnsClientIdentifier, question.TransactionId, question.Name});
+            return false;
+        }
+
+        // The in-flight request is considered lost and this request replaces it.
+        // Its waiters are dropped, their clients will retry.
+        GNS_LOG_ERROR("In-flight DNS request timed out, dropping {} coalesced requests", request.Waiters.size());
+        m_inFlightRequests.erase(indexIt->second);
+        m_inFlightIndex.erase(indexIt);
+    }
+
+    // Multiple requests can be in flight for the same TCP connection id. Only the first one is tracked.
+    const auto clientKey = ClientKey(dnsClientIdentifier);
+    if (m_inFlightRequests.contains(clientKey))
+    {
+        return true;
+    }
+
+    if (m_inFlightRequests.size() >= c_maxInFlightRequests)
+    {
+        std::erase_if(m_inFlightRequests, [&](const auto& e) {
+            if (now - e.second.Started < c_inFlightRequestTimeout)
+            {
+                return false;
+            }
+
+            m_inFlightIndex.erase(e.second.Key);
+            return true;
+        });
+
+        if (m_inFlightRequests.size() >= c_maxInFlightRequests)
+        {
+            return true;
+        }
+    }
+
+    m_inFlightRequests.emplace(clientKey, InFlightRequest{key, question.Key, now, {}});
+    m_inFlightIndex.emplace(std::move(key), clientKey);
+    return true;
+}
+
+void DnsCache::AbortRequest(const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+
+    const auto it = m_inFlightRequests.find(ClientKey(dnsClientIdentifier));
+    if (it != m_inFlightRequests.end())
+    {
+        m_inFlightIndex.erase(it->second.Key);
+        m_inFlightRequests.erase(it);
+    }
+}
+
+std::vector<DnsCache::Waiter> DnsCache::CompleteRequest(
+    const gsl::span<const gsl::byte> dnsResponse, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier)
+{
+    auto entry = ParseResponse(dnsResponse, Clock::now());
+
+    std::scoped_lock<std::mutex> lock{m_lock};
+
+    std::vector<Waiter> waiters;
+    const auto it = m_inFlightRequests.find(ClientKey(dnsClientIdentifier));
+    if (it != m_inFlightRequests.end())
+    {
+        // Compare the question of the response with the question of the in-flight request, since multiple requests
+        // can share the same client id on a TCP connection.
+        std::string questionKey;
+        if (ReadQuestion(dnsResponse, questionKey).has_value() && it->second.QuestionKey.starts_with(questionKey))
+        {
+            waiters = std::move(it->second.Waiters);
+            m_inFlightIndex.erase(it->second.Key);
+            m_inFlightRequests.erase(it);
+        }
+    }
+
+    if (entry.has_value())
+    {
+        Insert(std::move(entry.value()));
+    }
+
+    return waiters;
+}
+
+void DnsCache::Insert(Entry&& entry)
+{
+    const auto it = m_index.find(entry.Key);
+    if (it != m_index.end())
+    {
+        Erase(it->second);
+    }
+
+    m_cachedBytes += entry.Response.size();
+    m_entries.emplace_front(std::move(entry));
+    m_index.emplace(m_entries.front().Key, m_entries.begin());
+
+    // Evict the least recently used entries until the cache is within its bounds.
+    while (m_entries.size() > c_maxCacheEntries || m_cachedBytes > c_maxCacheBytes)
+    {
+        Erase(std::prev(m_entries.end()));
+    }
+}
+
+void DnsCache::Erase(std::list<Entry>::iterator entry)
+{
+    m_cachedBytes -= entry->Response.size();
+    m_index.erase(entry->Key);
+    m_entries.erase(entry);
+}
@@ -0,0 +1,175 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "common.h"
+#include "lxinitshared.h"
+
+// Cache of DNS answers received through the DNS tunneling channel, placed in front of the tunnel so that repeated
+// questions from Linux DNS clients can be answered without a round trip to Windows.
+//
+// The cache stores raw DNS responses (without the TCP length prefix) and honors the TTL of the records they contain:
+// an entry expires when its record with the lowest TTL expires, and TTLs are decremented by the entry age when a cached
+// response is served. Negative answers (NXDOMAIN / NODATA) are cached using the SOA record of the authority section (RFC 2308).
+//
+// The cache also coalesces identical questions that are in flight: only the first request is tunneled to Windows and
+// the other clients are answered when its response arrives.
+class DnsCache
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Information extracted from a DNS request.
+    struct Question
+    {
+        // Normalized question (lowercase name, type, class and the flags that influence the answer, including whether the
+        // request used EDNS), used as cache key.
+        std::string Key;
+
+        // Name of the question as sent by the client, in wire format. Clients that randomize the case of the names they
+        // query (DNS 0x20) expect the response to echo it unchanged.
+        std::string Name;
+
+        // DNS transaction id of the request.
+        uint16_t TransactionId{};
+
+        // Maximum size of a UDP response the client accepts (512 bytes, or the EDNS payload size advertised by the client).
+        uint16_t MaxUdpPayloadSize{};
+    };
+
+    // Client waiting for the response of a coalesced request.
+    struct Waiter
+    {
+        LX_GNS_DNS_CLIENT_IDENTIFIER DnsClientIdentifier{};
+        uint16_t TransactionId{};
+        std::string QuestionName;
+    };
+
+    DnsCache() = default;
+    ~DnsCache() noexcept = default;
+
+    DnsCache(const DnsCache&) = delete;
+    DnsCache(DnsCache&&) = delete;
+    DnsCache& operator=(const DnsCache&) = delete;
+    DnsCache& operator=(DnsCache&&) = delete;
+
+    // Parse a DNS request.
+    //
+    // Arguments:
+    //    dnsRequest - buffer containing the DNS request (without TCP length prefix).
+    //
+    // Return Value:
+    //    The parsed question, or std::nullopt if the request can't be served from the cache (not a standard query
+    //    with exactly one question, or malformed).
+    static std::optional<Question> ParseRequest(const gsl::span<const gsl::byte> dnsRequest) noexcept;
+
+    // Look up a cached response for a request.
+    //
+    // Arguments:
+    //    question - question parsed from the request.
+    //    protocol - protocol (TCP/UDP) the request was received on.
+    //
+    // Return Value:
+    //    A copy of the cached response with the transaction id and question name of the request and decremented TTLs,
+    //    or an empty vector if there is no usable cached response.
+    std::vector<gsl::byte> Lookup(const Question& question, int protocol);
+
+    // Replace the question name of a response with the name of a request, which differs from it at most by case.
+    //
+    // Arguments:
+    //    dnsResponse - buffer containing the DNS response (without TCP length prefix).
+    //    name - question name of the request, see Question::Name.
+    static void CopyQuestionName(gsl::span<gsl::byte> dnsResponse, const std::string& name) noexcept;
+
+    // Track a request that is about to be tunneled to Windows, coalescing it with an identical in-flight request if any.
+    //
+    // Arguments:
+    //    question - question parsed from the request.
+    //    dnsClientIdentifier - struct containing protocol (TCP/UDP) and unique id of the Linux DNS client making the request.
+    //
+    // Return Value:
+    //    true if the request needs to be tunneled, false if it was attached to an identical in-flight request.
+    bool BeginRequest(const Question& question, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier);
+
+    // Stop tracking a request that could not be tunneled. Clients waiting on it are dropped.
+    void AbortRequest(const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier);
+
+    // Process a DNS response received from Windows: cache it if possible and return the clients waiting for it.
+    //
+    // Arguments:
+    //    dnsResponse - buffer containing the DNS response (without TCP length prefix).
+    //    dnsClientIdentifier - identifier of the Linux DNS client the response was received for.
+    //
+    // Return Value:
+    //    Clients whose identical requests were coalesced with this one.
+    std::vector<Waiter> CompleteRequest(
+        const gsl::span<const gsl::byte> dnsResponse, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier);
+
+private:
+    struct Entry
+    {
+        std::string Key;
+
+        // Cached response, without TCP length prefix.
+        std::vector<gsl::byte> Response;
+
+        // Offsets in Response of the 32 bit TTL fields that need to be decremented when the response is served.
+        std::vector<uint16_t> TtlOffsets;
+
+        Clock::time_point Inserted;
+        Clock::time_point Expiry;
+    };
+
+    struct InFlightRequest
+    {
+        // Key used to coalesce requests, see InFlightKey().
+        std::string Key;
+
+        // Cache key of the question, used to validate that a response matches the request.
+        std::string QuestionKey;
+
+        Clock::time_point Started;
+        std::vector<Waiter> Waiters;
+    };
+
+    // Parse a DNS response and, if it can be cached, build the matching cache entry.
+    static std::optional<Entry> ParseResponse(const gsl::span<const gsl::byte> dnsResponse, Clock::time_point now);
+
+    // Key used to coalesce in-flight requests. Requests are only coalesced with requests received on the same protocol
+    // and advertising the same UDP payload size, so that the response is valid for all of them.
+    static std::string InFlightKey(const Question& question, int protocol);
+
+    static uint64_t ClientKey(const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept;
+
+    void Insert(Entry&& entry);
+
+    void Erase(std::list<Entry>::iterator entry);
+
+    std::mutex m_lock;
+
+    // Cache entries, ordered from most to least recently used.
+    // _Guarded_by_(m_lock)
+    std::list<Entry> m_entries;
+
+    // _Guarded_by_(m_lock)
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index;
+
+    // Total size of the cached responses.
+    // _Guarded_by_(m_lock)
+    size_t m_cachedBytes = 0;
+
+    // Mapping the identifier of a tunneled request to the in-flight request it represents.
+    // _Guarded_by_(m_lock)
+    std::map<uint64_t, InFlightRequest> m_inFlightRequests;
+
+    // Mapping in-flight key to the identifier of the tunneled request.
+    // _Guarded_by_(m_lock)
+    std::unordered_map<std::string, uint64_t> m_inFlightIndex;
+};
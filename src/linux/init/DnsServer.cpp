@@ -17,9 +17,32 @@ constexpr int c_epollWaitMaxEvents = 100;
 constexpr int c_maxUdpDnsBufferSize = 4096;
 // Max number of pending connections in the TCP listen queue
 constexpr int c_maxListenBacklog = 1000;
+// Max number of DNS over UDP requests read, or responses sent, with a single system call
+constexpr unsigned int c_udpBatchSize = 32;
+// Time after which a tracked UDP request that didn't get a response is evicted. DNS clients retry well before that.
+constexpr auto c_udpRequestTimeout = std::chrono::seconds(30);
 
-DnsServer::DnsServer(DnsTunnelingCallback&& tunnelDnsRequest) : m_tunnelDnsRequest(std::move(tunnelDnsRequest))
+namespace {
+
+// Build the address the DNS server listens on.
+sockaddr_in BuildServerAddress(const std::string& ipAddress)
 {
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    Syscall(inet_pton, AF_INET, ipAddress.c_str(), &serverAddr.sin_addr);
+    serverAddr.sin_port = htons(c_dnsServerPort);
+    return serverAddr;
+}
+
+} // namespace
+
+DnsServer::DnsServer(DnsTunnelingCallback&& tunnelDnsRequest, bool enableCache) :
+    m_udpRequests(c_maxTrackedUdpRequests), m_tunnelDnsRequest(std::move(tunnelDnsRequest))
+{
+    if (enableCache)
+    {
+        m_dnsCache.emplace();
+    }
 }
 
 DnsServer::~DnsServer() noexcept
@@ -52,17 +75,13 @@ CATCH_LOG()
 void DnsServer::StartUdpDnsServer(const std::string& ipAddress) noexcept
 try
 {
-    sockaddr_in serverAddr{};
-
-    serverAddr.sin_family = AF_INET;
-    Syscall(inet_pton, AF_INET, ipAddress.c_str(), &serverAddr.sin_addr);
-    serverAddr.sin_port = htons(c_dnsServerPort);
+    const auto serverAddr = BuildServerAddress(ipAddress);
 
-    // Create IPv4 UDP socket
+    // Create UDP socket
     m_udpSocket = Syscall(socket, AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
 
     // Bind socket
-    Syscall(bind, m_udpSocket.get(), reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr));
+    Syscall(bind, m_udpSocket.get(), reinterpret_cast<const sockaddr*>(&serverAddr), sizeof(serverAddr));
 
     // Configure epoll to track the UDP socket. EPOLLIN is used to get epoll notifications
     // whenever there is data available to be read from the socket
@@ -78,17 +97,13 @@ CATCH_LOG()
 void DnsServer::StartTcpDnsServer(const std::string& ipAddress) noexcept
 try
 {
-    sockaddr_in serverAddr{};
+    const auto serverAddr = BuildServerAddress(ipAddress);
 
-    serverAddr.sin_family = AF_INET;
-    Syscall(inet_pton, AF_INET, ipAddress.c_str(), &serverAddr.sin_addr);
-    serverAddr.sin_port = htons(c_dnsServerPort);
-
-    // Create IPv4 TCP socket
+    // Create TCP socket
     m_tcpListenSocket = Syscall(socket, AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
 
     // Bind socket
-    Syscall(bind, m_tcpListenSocket.get(), reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr));
+    Syscall(bind, m_tcpListenSocket.get(), reinterpret_cast<const sockaddr*>(&serverAddr), sizeof(serverAddr));
 
     // Listen for incoming connections
     Syscall(listen, m_tcpListenSocket.get(), c_maxListenBacklog);
@@ -104,34 +119,75 @@ try
 }
 CATCH_LOG();
 
-void DnsServer::HandleUdpDnsResponse(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept
+void DnsServer::SendUdpDnsResponses(const gsl::span<const UdpDnsResponse> responses) noexcept
 try
 {
-    GNS_LOG_INFO("New UDP DNS response DNS buffer size: {}, UDP request id: {}", dnsBuffer.size(), dnsClientIdentifier.DnsClientId);
+    std::array<mmsghdr, c_udpBatchSize> messages{};
+    std::array<iovec, c_udpBatchSize> buffers{};
+    std::array<uint32_t, c_udpBatchSize> requestIds{};
 
     std::scoped_lock<std::mutex> lock{m_udpLock};
 
-    auto it = m_udpRequests.find(dnsClientIdentifier.DnsClientId);
-    if (it == m_udpRequests.end())
+    const auto now = std::chrono::steady_clock::now();
+    size_t next = 0;
+
+    while (next < responses.size())
     {
-        GNS_LOG_ERROR("Received a response for a UDP request that is not tracked, UDP request id: {}", dnsClientIdentifier.DnsClientId);
-        return;
-    }
+        // Build the next batch of messages, skipping responses for requests that are no longer tracked
+        unsigned int messageCount = 0;
+        for (; next < responses.size() && messageCount < c_udpBatchSize; next++)
+        {
+            const auto& response = responses[next];
+            GNS_LOG_INFO(
+                "New UDP DNS response DNS buffer size: {}, UDP request id: {}", response.m_dnsBuffer.size(), response.m_requestId);
 
-    // Stop tracking the request, irrespective of the DNS response being successfully sent
-    const auto removeDnsRequest = wil::scope_exit([&] { m_udpRequests.erase(dnsClientIdentifier.DnsClientId); });
+            auto* request = FindUdpRequest(response.m_requestId, now);
+            if (request == nullptr)
+            {
+                GNS_LOG_ERROR(
+                    "Received a response for a UDP request that is not tracked, UDP request id: {}", response.m_requestId);
+                continue;
+            }
 
-    sockaddr_in& remoteAddr = it->second;
+            buffers[messageCount].iov_base = response.m_dnsBuffer.data();
+            buffers[messageCount].iov_len = response.m_dnsBuffer.size();
 
-    // Send DNS response buffer back to the Linux DNS client
-    int bufferSize = dnsBuffer.size();
-    int totalBytesSent = 0;
+            messages[messageCount] = {};
+            messages[messageCount].msg_hdr.msg_name = &request->m_remoteAddr;
+            messages[messageCount].msg_hdr.msg_namelen = sizeof(request->m_remoteAddr);
+            messages[messageCount].msg_hdr.msg_iov = &buffers[messageCount];
+            messages[messageCount].msg_hdr.msg_iovlen = 1;
 
-    while (totalBytesSent < bufferSize)
-    {
-        int bytesSent = Syscall(
-            sendto, m_udpSocket.get(), dnsBuffer.data() + totalBytesSent, bufferSize - totalBytesSent, 0, reinterpret_cast<sockaddr*>(&remoteAddr), sizeof(remoteAddr));
-        totalBytesSent += bytesSent;
+            requestIds[messageCount] = response.m_requestId;
+            messageCount++;
+        }
+
+        // Send DNS response buffers back to the Linux DNS clients. sendmmsg() stops at the first message that fails to be sent,
+        // in which case that message is dropped and the remaining ones are sent with the next call.
+        unsigned int messagesSent = 0;
+        while (messagesSent < messageCount)
+        {
+            try
+            {
+                const int result = SyscallInterruptable(
+                    sendmmsg, m_udpSocket.get(), messages.data() + messagesSent, messageCount - messagesSent, 0);
+                if (result > 0)
+                {
+                    messagesSent += result;
+                }
+            }
+            catch (const std::exception& e)
+            {
+                GNS_LOG_ERROR("Failed to send DNS response, UDP request id: {}, {}", requestIds[messagesSent], e.what());
+                messagesSent++;
+            }
+        }
+
+        // Stop tracking the requests, irrespective of the DNS responses being successfully sent
+        for (unsigned int index = 0; index < messageCount; index++)
+        {
+            UntrackUdpRequest(requestIds[index]);
+        }
     }
 }
 CATCH_LOG()
@@ -269,19 +325,112 @@ try
 
         GNS_LOG_INFO("New TCP DNS request DNS buffer size: {}, TCP connection id: {}", dnsRequest.size(), dnsClientIdentifier.DnsClientId);
 
+        if (HandleDnsRequestFromCache(gsl::make_span(dnsRequest).subspan(c_byteCountTcpRequestLength), dnsClientIdentifier))
+        {
+            return;
+        }
+
+        auto abortRequestOnError = wil::scope_exit([&] {
+            if (m_dnsCache)
+            {
+                m_dnsCache->AbortRequest(dnsClientIdentifier);
+            }
+        });
+
         m_tunnelDnsRequest(gsl::make_span(dnsRequest), dnsClientIdentifier);
+
+        abortRequestOnError.release();
     }
 }
 CATCH_LOG();
 
 void DnsServer::HandleDnsResponse(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept
 try
+{
+    if (!m_dnsCache)
+    {
+        SendDnsResponse(dnsBuffer, dnsClientIdentifier);
+        return;
+    }
+
+    // DNS over TCP responses are prefixed by their length, which is not part of the DNS message.
+    const size_t prefixLength = dnsClientIdentifier.Protocol == IPPROTO_TCP ? c_byteCountTcpRequestLength : 0;
+    if (dnsBuffer.size() < prefixLength)
+    {
+        GNS_LOG_ERROR("Unexpected DNS response size {}", dnsBuffer.size());
+        return;
+    }
+
+    const auto dnsResponse = dnsBuffer.subspan(prefixLength);
+    const auto waiters = m_dnsCache->CompleteRequest(dnsResponse, dnsClientIdentifier);
+
+    // Responses sent over UDP are batched, so that all the clients waiting for this response are answered with as few
+    // system calls as possible.
+    std::vector<UdpDnsResponse> udpResponses;
+    std::vector<std::vector<gsl::byte>> waiterResponses;
+    waiterResponses.reserve(waiters.size());
+
+    if (dnsClientIdentifier.Protocol == IPPROTO_UDP)
+    {
+        udpResponses.push_back({dnsBuffer, dnsClientIdentifier.DnsClientId});
+    }
+    else
+    {
+        SendDnsResponse(dnsBuffer, dnsClientIdentifier);
+    }
+
+    // Answer the requests that were coalesced with this one, using their own transaction id and question name.
+    for (const auto& waiter : waiters)
+    {
+        const size_t waiterPrefixLength = waiter.DnsClientIdentifier.Protocol == IPPROTO_TCP ? c_byteCountTcpRequestLength : 0;
+        auto& response = waiterResponses.emplace_back(waiterPrefixLength + dnsResponse.size());
+        gsl::copy(dnsResponse, gsl::make_span(response).subspan(waiterPrefixLength));
+
+        if (waiterPrefixLength != 0)
+        {
+            const uint16_t responseLength = htons(gsl::narrow_cast<uint16_t>(dnsResponse.size()));
+            memcpy(response.data(), &responseLength, sizeof(responseLength));
+        }
+
+        if (dnsResponse.size() >= sizeof(waiter.TransactionId))
+        {
+            const uint16_t transactionId = htons(waiter.TransactionId);
+            memcpy(response.data() + waiterPrefixLength, &transactionId, sizeof(transactionId));
+        }
+
+        DnsCache::CopyQuestionName(gsl::make_span(response).subspan(waiterPrefixLength), waiter.QuestionName);
+
+        GNS_LOG_INFO(
+            "Answering coalesced DNS request, Protocol {}, DNS client id: {}",
+            waiter.DnsClientIdentifier.Protocol,
+            waiter.DnsClientIdentifier.DnsClientId);
+
+        if (waiter.DnsClientIdentifier.Protocol == IPPROTO_UDP)
+        {
+            udpResponses.push_back({gsl::make_span(response), waiter.DnsClientIdentifier.DnsClientId});
+        }
+        else
+        {
+            SendDnsResponse(gsl::make_span(response), waiter.DnsClientIdentifier);
+        }
+    }
+
+    if (!udpResponses.empty())
+    {
+        SendUdpDnsResponses(gsl::make_span(udpResponses));
+    }
+}
+CATCH_LOG()
+
+void DnsServer::SendDnsResponse(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept
+try
 {
     switch (dnsClientIdentifier.Protocol)
     {
     case IPPROTO_UDP:
     {
-        HandleUdpDnsResponse(dnsBuffer, dnsClientIdentifier);
+        const UdpDnsResponse response{dnsBuffer, dnsClientIdentifier.DnsClientId};
+        SendUdpDnsResponses(gsl::make_span(&response, 1));
         break;
     }
     case IPPROTO_TCP:
@@ -335,7 +484,7 @@ void DnsServer::ServerLoop() noexcept
                 // Notification for the UDP socket == There is data to be read from the UDP socket, indicating a new DNS request was received
                 else if (events[index].data.fd == m_udpSocket.get())
                 {
-                    HandleUdpDnsRequest();
+                    HandleUdpDnsRequests();
                 }
                 // Other notifications == new data was received on one of the active TCP connections
                 else
@@ -348,69 +497,192 @@ void DnsServer::ServerLoop() noexcept
     }
 }
 
-void DnsServer::HandleUdpDnsRequest() noexcept
+void DnsServer::HandleUdpDnsRequests() noexcept
 try
 {
-    static std::array<gsl::byte, c_maxUdpDnsBufferSize> s_dnsBuffer;
+    static std::array<std::array<gsl::byte, c_maxUdpDnsBufferSize>, c_udpBatchSize> s_dnsBuffers;
 
-    gsl::span<gsl::byte> dnsRequest;
-    uint32_t udpRequestId{};
+    std::array<mmsghdr, c_udpBatchSize> messages{};
+    std::array<iovec, c_udpBatchSize> buffers{};
+    std::array<sockaddr_in, c_udpBatchSize> remoteAddrs{};
+    std::array<uint32_t, c_udpBatchSize> udpRequestIds{};
+
+    for (unsigned int index = 0; index < c_udpBatchSize; index++)
+    {
+        buffers[index].iov_base = s_dnsBuffers[index].data();
+        buffers[index].iov_len = s_dnsBuffers[index].size();
+
+        messages[index].msg_hdr.msg_name = &remoteAddrs[index];
+        messages[index].msg_hdr.msg_namelen = sizeof(remoteAddrs[index]);
+        messages[index].msg_hdr.msg_iov = &buffers[index];
+        messages[index].msg_hdr.msg_iovlen = 1;
+    }
+
+    int messageCount = 0;
 
     // Scoped m_udpLock
     {
         std::scoped_lock<std::mutex> lock{m_udpLock};
 
-        // Since we only configure an IPv4 DNS server in Linux, we expect all Linux DNS clients to use IPv4 addresses
-        sockaddr_in remoteAddr{};
-        socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-        // Read the DNS request
-        int bytesReceived = Syscall(
-            recvfrom, m_udpSocket.get(), s_dnsBuffer.data(), c_maxUdpDnsBufferSize, 0, reinterpret_cast<sockaddr*>(&remoteAddr), &remoteAddrLen);
+        // Read the available DNS requests, up to c_udpBatchSize. The socket is non-blocking, so this returns as soon as no more
+        // requests are queued. Requests left in the socket are read on the next epoll notification.
+        messageCount = Syscall(recvmmsg, m_udpSocket.get(), messages.data(), c_udpBatchSize, 0, nullptr);
 
-        if (bytesReceived == 0)
+        const auto now = std::chrono::steady_clock::now();
+        for (int index = 0; index < messageCount; index++)
         {
-            GNS_LOG_ERROR("recvfrom returned 0 bytes");
-            return;
+            // Track the request
+            udpRequestIds[index] = TrackUdpRequest(remoteAddrs[index], now);
+
+            GNS_LOG_INFO(
+                "New UDP DNS request DNS client IP: {}, DNS client port {}, DNS buffer size: {}, UDP request id: {}",
+                Address::FromBinary(AF_INET, 0, &remoteAddrs[index].sin_addr).Addr().c_str(),
+                ntohs(remoteAddrs[index].sin_port),
+                messages[index].msg_len,
+                udpRequestIds[index]);
         }
-
-        // Get next request id. If value reaches UINT_MAX + 1 it will be automatically reset to 0
-        const auto requestId = m_currentUdpRequestId++;
-
-        GNS_LOG_INFO(
-            "New UDP DNS request DNS client IP: {}, DNS client port {}, DNS buffer size: {}, UDP request id: {}",
-            Address::FromBinary(AF_INET, 0, &remoteAddr.sin_addr).Addr().c_str(),
-            ntohs(remoteAddr.sin_port),
-            bytesReceived,
-            requestId);
-
-        // Move request to a local variable
-        dnsRequest = std::move(gsl::make_span(s_dnsBuffer).subspan(0, bytesReceived));
-        udpRequestId = requestId;
-
-        // Track the request
-        m_udpRequests.emplace(requestId, remoteAddr);
     }
 
-    if (!dnsRequest.empty())
+    for (int index = 0; index < messageCount; index++)
     {
-        auto removeRequestOnError = wil::scope_exit([&] {
+        if (messages[index].msg_len == 0)
+        {
+            GNS_LOG_ERROR("recvmmsg returned 0 bytes, UDP request id: {}", udpRequestIds[index]);
+
             std::scoped_lock<std::mutex> lock{m_udpLock};
-            m_udpRequests.erase(udpRequestId);
-        });
+            UntrackUdpRequest(udpRequestIds[index]);
+            continue;
+        }
 
-        // Tunnel request to Windows
-        LX_GNS_DNS_CLIENT_IDENTIFIER dnsClientIdentifier{};
-        dnsClientIdentifier.Protocol = IPPROTO_UDP;
-        dnsClientIdentifier.DnsClientId = udpRequestId;
+        HandleUdpDnsRequest(gsl::make_span(s_dnsBuffers[index]).subspan(0, messages[index].msg_len), udpRequestIds[index]);
+    }
+}
+CATCH_LOG()
 
-        m_tunnelDnsRequest(dnsRequest, dnsClientIdentifier);
+void DnsServer::HandleUdpDnsRequest(const gsl::span<gsl::byte> dnsRequest, uint32_t udpRequestId) noexcept
+try
+{
+    auto removeRequestOnError = wil::scope_exit([&] {
+        std::scoped_lock<std::mutex> lock{m_udpLock};
+        UntrackUdpRequest(udpRequestId);
+    });
+
+    LX_GNS_DNS_CLIENT_IDENTIFIER dnsClientIdentifier{};
+    dnsClientIdentifier.Protocol = IPPROTO_UDP;
+    dnsClientIdentifier.DnsClientId = udpRequestId;
 
+    // The request stays tracked if it was answered from the cache (the response removes it) or coalesced.
+    if (HandleDnsRequestFromCache(dnsRequest, dnsClientIdentifier))
+    {
         removeRequestOnError.release();
+        return;
     }
+
+    auto abortRequestOnError = wil::scope_exit([&] {
+        if (m_dnsCache)
+        {
+            m_dnsCache->AbortRequest(dnsClientIdentifier);
+        }
+    });
+
+    // Tunnel request to Windows
+    m_tunnelDnsRequest(dnsRequest, dnsClientIdentifier);
+
+    abortRequestOnError.release();
+    removeRequestOnError.release();
 }
 CATCH_LOG()
 
+uint32_t DnsServer::TrackUdpRequest(const sockaddr_in& remoteAddr, std::chrono::steady_clock::time_point now)
+{
+    // Get next request id. If value reaches UINT_MAX + 1 it will be automatically reset to 0
+    const auto requestId = m_currentUdpRequestId++;
+
+    auto& request = m_udpRequests[requestId % c_maxTrackedUdpRequests];
+    if (request.m_inUse)
+    {
+        // The slot is still used by a request that was received c_maxTrackedUdpRequests requests ago and never got a response.
+        // Evict it - if its response arrives later, it's dropped.
+        GNS_LOG_ERROR("Evicting UDP request id: {} to track UDP request id: {}", request.m_requestId, requestId);
+    }
+
+    request.m_requestId = requestId;
+    request.m_inUse = true;
+    request.m_remoteAddr = remoteAddr;
+    request.m_receivedTime = now;
+
+    return requestId;
+}
+
+DnsServer::UdpRequestContext* DnsServer::FindUdpRequest(uint32_t requestId, std::chrono::steady_clock::time_point now) noexcept
+{
+    auto& request = m_udpRequests[requestId % c_maxTrackedUdpRequests];
+    if (!request.m_inUse || request.m_requestId != requestId)
+    {
+        return nullptr;
+    }
+
+    if (now - request.m_receivedTime > c_udpRequestTimeout)
+    {
+        GNS_LOG_ERROR("UDP request id: {} timed out", requestId);
+        request.m_inUse = false;
+        return nullptr;
+    }
+
+    return &request;
+}
+
+void DnsServer::UntrackUdpRequest(uint32_t requestId) noexcept
+{
+    auto& request = m_udpRequests[requestId % c_maxTrackedUdpRequests];
+    if (request.m_inUse && request.m_requestId == requestId)
+    {
+        request.m_inUse = false;
+    }
+}
+
+bool DnsServer::HandleDnsRequestFromCache(const gsl::span<gsl::byte> dnsRequest, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept
+try
+{
+    if (!m_dnsCache)
+    {
+        return false;
+    }
+
+    const auto question = DnsCache::ParseRequest(dnsRequest);
+    if (!question.has_value())
+    {
+        return false;
+    }
+
+    auto response = m_dnsCache->Lookup(question.value(), dnsClientIdentifier.Protocol);
+    if (!response.empty())
+    {
+        GNS_LOG_INFO(
+            "Answering DNS request from cache, Protocol {}, DNS client id: {}, DNS buffer size: {}",
+            dnsClientIdentifier.Protocol,
+            dnsClientIdentifier.DnsClientId,
+            response.size());
+
+        if (dnsClientIdentifier.Protocol == IPPROTO_TCP)
+        {
+            const uint16_t responseLength = htons(gsl::narrow_cast<uint16_t>(response.size()));
+            const auto* lengthBytes = reinterpret_cast<const gsl::byte*>(&responseLength);
+            response.insert(response.begin(), lengthBytes, lengthBytes + c_byteCountTcpRequestLength);
+        }
+
+        SendDnsResponse(gsl::make_span(response), dnsClientIdentifier);
+        return true;
+    }
+
+    return !m_dnsCache->BeginRequest(question.value(), dnsClientIdentifier);
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    return false;
+}
+
 void DnsServer::Stop() noexcept
 try
 {
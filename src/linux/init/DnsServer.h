@@ -2,8 +2,12 @@
 
 #pragma once
 
+#include <chrono>
 #include <map>
+#include <optional>
+#include <vector>
 #include "common.h"
+#include "DnsCache.h"
 #include "lxinitshared.h"
 
 using DnsTunnelingCallback = std::function<void(const gsl::span<gsl::byte>, const LX_GNS_DNS_CLIENT_IDENTIFIER&)>;
@@ -11,10 +15,18 @@ using DnsTunnelingCallback = std::function<void(const gsl::span<gsl::byte>, cons
 // Number of bytes used to store the length of DNS over TCP requests
 constexpr int c_byteCountTcpRequestLength = 2;
 
+// Number of DNS over UDP requests that can be tracked at the same time. Must be a power of 2, so that request ids keep
+// mapping to consecutive slots when the id counter wraps around.
+constexpr size_t c_maxTrackedUdpRequests = 1024;
+static_assert((c_maxTrackedUdpRequests & (c_maxTrackedUdpRequests - 1)) == 0);
+
 class DnsServer
 {
 public:
-    DnsServer(DnsTunnelingCallback&& tunnelDnsRequest);
+    // Arguments:
+    //    tunnelDnsRequest - callback used for tunneling a DNS request to Windows.
+    //    enableCache - whether DNS responses should be cached and identical in-flight requests coalesced.
+    DnsServer(DnsTunnelingCallback&& tunnelDnsRequest, bool enableCache = false);
     ~DnsServer() noexcept;
 
     DnsServer(const DnsServer&) = delete;
@@ -68,6 +80,29 @@ private:
         TcpConnectionContext& operator=(TcpConnectionContext&&) = delete;
     };
 
+    // DNS over UDP request tracked until its response is received from Windows.
+    struct UdpRequestContext
+    {
+        // Id of the request occupying the slot.
+        uint32_t m_requestId{};
+
+        bool m_inUse = false;
+
+        // IP and port used by the Linux DNS client that made the DNS request. Note: Since we only configure an IPv4 DNS server in
+        // Linux, we expect all Linux DNS clients to use IPv4 addresses.
+        sockaddr_in m_remoteAddr{};
+
+        // Time the request was received, used to evict requests that never got a response.
+        std::chrono::steady_clock::time_point m_receivedTime;
+    };
+
+    // UDP DNS response ready to be sent to a Linux DNS client.
+    struct UdpDnsResponse
+    {
+        gsl::span<gsl::byte> m_dnsBuffer;
+        uint32_t m_requestId{};
+    };
+
     void StartUdpDnsServer(const std::string& ipAddress) noexcept;
 
     void StartTcpDnsServer(const std::string& ipAddress) noexcept;
@@ -81,13 +116,42 @@ private:
     // Handle new data received on an existing TCP connection.
     void HandleNewTcpData(TcpConnectionContext* context) noexcept;
 
-    // Read the next DNS request from the UDP socket.
-    void HandleUdpDnsRequest() noexcept;
+    // Read the available DNS requests from the UDP socket, in batches.
+    void HandleUdpDnsRequests() noexcept;
+
+    // Answer a DNS request received over UDP from the cache, or tunnel it to Windows.
+    void HandleUdpDnsRequest(const gsl::span<gsl::byte> dnsRequest, uint32_t udpRequestId) noexcept;
 
-    void HandleUdpDnsResponse(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept;
+    // Send DNS responses to Linux DNS clients over UDP, using as few system calls as possible.
+    void SendUdpDnsResponses(const gsl::span<const UdpDnsResponse> responses) noexcept;
+
+    // Start tracking a new UDP request, evicting the request previously occupying its slot if any. Requires m_udpLock.
+    uint32_t TrackUdpRequest(const sockaddr_in& remoteAddr, std::chrono::steady_clock::time_point now);
+
+    // Find a tracked UDP request. Requests older than the UDP request timeout are evicted. Requires m_udpLock.
+    //
+    // Return Value:
+    //    The request context, or nullptr if the request is not tracked.
+    UdpRequestContext* FindUdpRequest(uint32_t requestId, std::chrono::steady_clock::time_point now) noexcept;
+
+    // Stop tracking a UDP request. Requires m_udpLock.
+    void UntrackUdpRequest(uint32_t requestId) noexcept;
 
     void HandleTcpDnsResponse(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept;
 
+    // Send a DNS response to the Linux DNS client, based on the protocol of the client.
+    void SendDnsResponse(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept;
+
+    // Try to answer a DNS request from the cache, or coalesce it with an identical in-flight request.
+    //
+    // Arguments:
+    //    dnsRequest - buffer containing the DNS request (without TCP length prefix).
+    //    dnsClientIdentifier - struct containing protocol (TCP/UDP) and unique id of the Linux DNS client making the request.
+    //
+    // Return Value:
+    //    true if the request was handled and doesn't need to be tunneled to Windows.
+    bool HandleDnsRequestFromCache(const gsl::span<gsl::byte> dnsRequest, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept;
+
     // File descriptor used to interact with epoll. Declared before the UDP and TCP sockets and the shutdown pipe so it will be closed after them.
     // Note: Closing a socket fd automatically leads to unregistering it from epoll - EPOLL_CTL_DEL is not necessary for that fd.
     wil::unique_fd m_epollFd;
@@ -102,10 +166,10 @@ private:
     // _Guarded_by_(m_udpLock)
     uint32_t m_currentUdpRequestId = 0;
 
-    // Mapping id of an UDP DNS request to the sockaddr_in struct storing the IP and port used by the Linux DNS client that made
-    // the DNS request. Note: Since we only configure an IPv4 DNS server in Linux, we expect all Linux DNS clients to use IPv4
-    // addresses. _Guarded_by_(m_udpLock)
-    std::map<uint32_t, sockaddr_in> m_udpRequests;
+    // Table of tracked UDP DNS requests, indexed by request id modulo c_maxTrackedUdpRequests. The table is allocated once, so
+    // tracking a request doesn't allocate memory.
+    // _Guarded_by_(m_udpLock)
+    std::vector<UdpRequestContext> m_udpRequests;
 
     wil::unique_fd m_tcpListenSocket;
 
@@ -128,4 +192,7 @@ private:
 
     // Callback used for tunneling a DNS request to Windows to be resolved.
     DnsTunnelingCallback m_tunnelDnsRequest;
+
+    // Cache of DNS responses, only present if caching is enabled.
+    std::optional<DnsCache> m_dnsCache;
 };
@@ -26,11 +26,13 @@ DnsTunnelingChannel::~DnsTunnelingChannel()
 void DnsTunnelingChannel::SendDnsMessage(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) noexcept
 try
 {
-    wsl::shared::MessageWriter<LX_GNS_DNS_TUNNELING_MESSAGE> message(LxGnsMessageDnsTunneling);
-    message->DnsClientIdentifier = dnsClientIdentifier;
-    message.WriteSpan(dnsBuffer);
-
-    m_channel.SendMessage<LX_GNS_DNS_TUNNELING_MESSAGE>(message.Span());
+    if (!m_sendQueue.Push(dnsBuffer, dnsClientIdentifier))
+    {
+        GNS_LOG_ERROR(
+            "DNS tunneling send queue is full, dropping DNS message, Protocol {}, DNS client id: {}",
+            dnsClientIdentifier.Protocol == IPPROTO_UDP ? "UDP" : "TCP",
+            dnsClientIdentifier.DnsClientId);
+    }
 }
 CATCH_LOG()
 
@@ -131,6 +133,29 @@ void DnsTunnelingChannel::ReceiveLoop() noexcept
                 break;
             }
 
+            case LxGnsMessageDnsTunnelingBatch:
+            {
+                const auto parsed = wsl::shared::DnsTunnelingQueue::ParseBatch(
+                    span, [this](const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) {
+                        GNS_LOG_INFO(
+                            "received batched DNS message DNS buffer size: {}, Protocol {}, DNS client id: {}",
+                            dnsBuffer.size(),
+                            dnsClientIdentifier.Protocol == IPPROTO_UDP ? "UDP" : "TCP",
+                            dnsClientIdentifier.DnsClientId);
+
+                        // Invoke callback to notify about the new DNS response
+                        m_reportDnsResponse(dnsBuffer, dnsClientIdentifier);
+                    });
+
+                if (!parsed)
+                {
+                    GNS_LOG_ERROR("failed to parse LX_GNS_DNS_TUNNELING_BATCH_MESSAGE");
+                    return;
+                }
+
+                break;
+            }
+
             default:
             {
                 throw RuntimeErrorWithSourceLocation(std::format("Unexpected LX_MESSAGE_TYPE : {}", static_cast<int>(message->MessageType)));
@@ -146,6 +171,16 @@ try
 {
     GNS_LOG_INFO("stopping DNS server");
 
+    // The send thread can be blocked writing to the channel if Windows stops reading it. Shutting down the socket makes
+    // the write fail, so the thread can be joined.
+    if (m_channel.Socket() >= 0 && shutdown(m_channel.Socket(), SHUT_RDWR) < 0 && errno != ENOTCONN)
+    {
+        GNS_LOG_ERROR("shutdown failed {}", errno);
+    }
+
+    // Stop sending queued DNS requests
+    m_sendQueue.Stop();
+
     // Stop receive loop by closing the write fd of the pipe
     m_shutdownReceiveWorkerPipe.write().reset();
 
@@ -5,6 +5,7 @@
 #include "common.h"
 #include "lxinitshared.h"
 #include "SocketChannel.h"
+#include "DnsTunnelingQueue.h"
 
 using DnsTunnelingCallback = std::function<void(const gsl::span<gsl::byte>, const LX_GNS_DNS_CLIENT_IDENTIFIER&)>;
 
@@ -19,8 +20,8 @@ public:
     DnsTunnelingChannel& operator=(const DnsTunnelingChannel&) = delete;
     DnsTunnelingChannel& operator=(DnsTunnelingChannel&&) = delete;
 
-    // Construct and send a LX_GNS_DNS_TUNNELING_MESSAGE message on the channel.
-    // Note: Callers are responsible for sequencing calls to this method.
+    // Queue a DNS request to be sent on the channel. Requests queued together are sent in a single
+    // LX_GNS_DNS_TUNNELING_BATCH_MESSAGE, so a slow channel doesn't block the caller.
     //
     // Arguments:
     // dnsBuffer - buffer containing DNS request.
@@ -36,6 +37,9 @@ private:
 
     wsl::shared::SocketChannel m_channel;
 
+    // Queue of DNS requests waiting to be sent on m_channel. Declared after m_channel so it's destroyed first.
+    wsl::shared::DnsTunnelingQueue m_sendQueue{m_channel};
+
     // Thread running the receive loop.
     std::thread m_receiveWorkerThread;
 
@@ -7,22 +7,24 @@
 #include "common.h"
 #include "DnsTunnelingManager.h"
 
-DnsTunnelingManager::DnsTunnelingManager(int hvsocketFd, const std::string& dnsTunnelingIpAddress) :
+DnsTunnelingManager::DnsTunnelingManager(int hvsocketFd, const std::string& dnsTunnelingIpAddress, bool enableDnsCache) :
     m_dnsChannel(
         hvsocketFd,
         [this](const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) {
             m_dnsServer.HandleDnsResponse(dnsBuffer, dnsClientIdentifier);
         }),
-    m_dnsServer([this](const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) {
-        if (m_stopped)
-        {
-            return;
-        }
+    m_dnsServer(
+        [this](const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) {
+            if (m_stopped)
+            {
+                return;
+            }
 
-        m_dnsChannel.SendDnsMessage(dnsBuffer, dnsClientIdentifier);
-    })
+            m_dnsChannel.SendDnsMessage(dnsBuffer, dnsClientIdentifier);
+        },
+        enableDnsCache)
 {
-    GNS_LOG_INFO("Using DNS server IP {}", dnsTunnelingIpAddress.c_str());
+    GNS_LOG_INFO("Using DNS server IP {}, DNS cache enabled: {}", dnsTunnelingIpAddress.c_str(), enableDnsCache);
 
     // Start DNS server used for tunneling. Server has both TCP and UDP support.
     //
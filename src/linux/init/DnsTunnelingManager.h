@@ -8,7 +8,7 @@
 class DnsTunnelingManager
 {
 public:
-    DnsTunnelingManager(int hvsocketFd, const std::string& dnsTunnelingIpAddress);
+    DnsTunnelingManager(int hvsocketFd, const std::string& dnsTunnelingIpAddress, bool enableDnsCache);
     ~DnsTunnelingManager();
 
     DnsTunnelingManager(const DnsTunnelingManager&) = delete;
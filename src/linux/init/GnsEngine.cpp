@@ -19,7 +19,6 @@ using wsl::shared::hns::ModifyGuestEndpointSettingRequest;
 using wsl::shared::hns::ModifyRequestType;
 
 constexpr auto c_interfaceLookupTimeout = std::chrono::seconds(30);
-constexpr auto c_interfaceLookupRetryPeriod = std::chrono::milliseconds(100);
 constexpr auto c_ipStrings = {"ip", "ip6"};
 
 const char* c_loopbackInterfaceName = "lo";
@@ -29,62 +28,39 @@ GnsEngine::GnsEngine(
     const StatusRoutine& statusRoutine,
     NetworkManager& manager,
     std::optional<int> dnsTunnelingFd,
-    const std::string& dnsTunnelingIpAddress) :
-    notificationRoutine(notificationRoutine), statusRoutine(statusRoutine), manager(manager)
+    const std::string& dnsTunnelingIpAddress,
+    bool enableDnsTunnelingCache) :
+    notificationRoutine(notificationRoutine), statusRoutine(statusRoutine), manager(manager), linkTracker(manager.NetlinkState())
 {
     if (dnsTunnelingFd.has_value())
     {
         // Add the IP address to the loopback interface, to be used by the DNS tunneling listener.
         // Note: Linux allows IPv4 addresses that are not in the range 127.0.0.0/8 to be added to the loopback interface.
-        auto loInterface = Interface::Open(c_loopbackInterfaceName);
+        auto loInterface = manager.OpenInterface(c_loopbackInterfaceName);
         Address address{AF_INET, 32, dnsTunnelingIpAddress};
         manager.ModifyAddress(loInterface, address, Operation::Create);
 
-        dnsTunnelingManager.emplace(dnsTunnelingFd.value(), dnsTunnelingIpAddress);
+        dnsTunnelingManager.emplace(dnsTunnelingFd.value(), dnsTunnelingIpAddress, enableDnsTunnelingCache);
     }
 }
 
-Interface GnsEngine::OpenAdapterImpl(const GUID& id)
+Interface GnsEngine::OpenAdapter(const GUID& id)
 {
-    std::string interfaceName;
-    for (const auto& e : std::filesystem::directory_iterator("/sys/class/net/"))
-    {
-        auto adapterId = GetAdapterId(e.path());
-        if (adapterId.has_value() && adapterId.value() == id)
-        {
-            interfaceName = e.path().filename().string();
-            // Special case _wlanxx interfaces: look for the wlanxx version instead.
-            if (interfaceName.compare(0, 5, "_wlan") == 0)
-            {
-                continue;
-            }
-
-            break;
-        }
-    }
+    const auto interfaceName = linkTracker.WaitForAdapter(id, c_interfaceLookupTimeout);
 
-    if (!interfaceName.empty())
-    {
-        GNS_LOG_INFO(
-            "Found an interface matching the GUID {}, with name {}",
-            wsl::shared::string::GuidToString<char>(id).c_str(),
-            interfaceName.c_str());
-        return Interface::Open(interfaceName);
-    }
-
-    throw RuntimeErrorWithSourceLocation(std::format("Couldn't find an adapter for id: {}", wsl::shared::string::GuidToString<char>(id)));
-}
+    GNS_LOG_INFO(
+        "Found an interface matching the GUID {}, with name {}",
+        wsl::shared::string::GuidToString<char>(id).c_str(),
+        interfaceName.c_str());
 
-Interface GnsEngine::OpenAdapter(const GUID& id)
-{
-    return wsl::shared::retry::RetryWithTimeout<Interface>([&]() { return OpenAdapterImpl(id); }, c_interfaceLookupRetryPeriod, c_interfaceLookupTimeout);
+    return manager.OpenInterface(interfaceName);
 }
 
 Interface GnsEngine::OpenInterfaceImpl(const std::string& deviceName)
 {
     try
     {
-        return Interface::Open(deviceName);
+        return manager.OpenInterface(deviceName);
     }
     catch (const std::exception& e)
     {
@@ -94,36 +70,10 @@ Interface GnsEngine::OpenInterfaceImpl(const std::string& deviceName)
 
 Interface GnsEngine::OpenInterface(const std::string& deviceName)
 {
-    return wsl::shared::retry::RetryWithTimeout<Interface>(
-        [&]() { return OpenInterfaceImpl(deviceName); }, c_interfaceLookupRetryPeriod, c_interfaceLookupTimeout);
-}
-
-std::optional<GUID> GnsEngine::GetAdapterId(const std::string& path)
-{
-    // Sample symlink:
-    // /sys/class/net/eth0/device -> ../../devices/LNXSYSTM:00/LNXSYBUS:00/ACPI0004:00/VMBUS:00/ebfda100-7464-4629-9da5-12de5470cb4f
-
-    try
-    {
-        auto symlink = std::filesystem::read_symlink(path);
-        const std::string adapterName = symlink.filename();
-        if (adapterName.size() > 3 && adapterName.compare(0, 4, "wlan") == 0)
-        {
-            symlink = symlink.parent_path().parent_path();
-        }
-        auto device = symlink.parent_path().parent_path();
-        std::string deviceGuid = device.filename();
-        if (deviceGuid.size() > 6 && deviceGuid.compare(0, 6, "virtio") == 0)
-        {
-            deviceGuid = device.parent_path().parent_path().parent_path().filename();
-        }
+    // If the interface doesn't show up before the timeout, let OpenInterfaceImpl() report the failure.
+    linkTracker.WaitForInterface(deviceName, c_interfaceLookupTimeout);
 
-        return wsl::shared::string::ToGuid(deviceGuid);
-    }
-    catch (...)
-    {
-        return {};
-    }
+    return OpenInterfaceImpl(deviceName);
 }
 
 Interface GnsEngine::OpenInterfaceOrAdapter(const std::wstring& nameOrId)
@@ -144,16 +94,16 @@ Interface GnsEngine::OpenInterfaceOrAdapter(const std::wstring& nameOrId)
     }
 }
 
-void GnsEngine::ProcessNotification(const nlohmann::json& payload, Interface& interface)
+void GnsEngine::ProcessNotification(const std::string& payload, const NotificationHeader& header, Interface& interface)
 {
     using namespace std::placeholders;
 
-    if (!payload.contains("ResourceType"))
+    if (!header.ResourceType.has_value())
     {
         throw RuntimeErrorWithSourceLocation("Json is missing ResourceType");
     }
 
-    switch (payload["ResourceType"].get<GuestEndpointResourceType>())
+    switch (header.ResourceType.value())
     {
     case GuestEndpointResourceType::Route:
         GNS_LOG_INFO("GuestEndpointResourceType::Route for interfaceName {}", interface.Name().c_str());
@@ -182,18 +132,20 @@ void GnsEngine::ProcessNotification(const nlohmann::json& payload, Interface& in
 
     default:
         throw RuntimeErrorWithSourceLocation(std::format(
-            "Unexpected LxGnsMessageNotification for interfaceName {}: {}", interface.Name(), payload["ResourceType"].get<std::string>()));
+            "Unexpected LxGnsMessageNotification for interfaceName {}: {}",
+            interface.Name(),
+            static_cast<int>(header.ResourceType.value())));
         break;
     }
 }
 
 template <typename T>
 void GnsEngine::ProcessNotificationImpl(
-    Interface& interface, const nlohmann::json& payload, void (GnsEngine::*routine)(Interface&, const T&, wsl::shared::hns::ModifyRequestType))
+    Interface& interface, const std::string& payload, void (GnsEngine::*routine)(Interface&, const T&, wsl::shared::hns::ModifyRequestType))
 {
-    T settings{};
-    nlohmann::from_json(payload.at("Settings"), settings);
-    (this->*routine)(interface, settings, payload["RequestType"].get<wsl::shared::hns::ModifyRequestType>());
+    // Now that the type of the settings is known, read the whole request.
+    const auto request = wsl::shared::FromJsonStreaming<ModifyGuestEndpointSettingRequest<T>>(payload);
+    (this->*routine)(interface, request.Settings, request.RequestType);
 }
 
 void GnsEngine::ProcessIpAddressChange(Interface& interface, const wsl::shared::hns::IPAddress& payload, wsl::shared::hns::ModifyRequestType action)
@@ -222,21 +174,30 @@ void GnsEngine::ProcessIpAddressChange(Interface& interface, const wsl::shared::
     {
         GNS_LOG_INFO("Remove address {} on interfaceName {}", addressString.c_str(), interface.Name().c_str());
         manager.ModifyAddress(interface, address, Operation::Remove);
+        return;
     }
-    else if (action == ModifyRequestType::Add)
+
+    if (action != ModifyRequestType::Add && action != ModifyRequestType::Update)
+    {
+        throw RuntimeErrorWithSourceLocation(std::format("Unexpected ip address action: {}", static_cast<int>(action)));
+    }
+
+    if (IsAddressSet(interface, address))
+    {
+        GNS_LOG_INFO("Address {} is already set on interfaceName {}, skipping", addressString.c_str(), interface.Name().c_str());
+        return;
+    }
+
+    if (action == ModifyRequestType::Add)
     {
         GNS_LOG_INFO("Add address {} on interfaceName {}", addressString.c_str(), interface.Name().c_str());
         manager.ModifyAddress(interface, address, Operation::Create);
     }
-    else if (action == ModifyRequestType::Update)
+    else
     {
         GNS_LOG_INFO("Update address {} on interfaceName {}", addressString.c_str(), interface.Name().c_str());
         manager.ModifyAddress(interface, address, Operation::Update);
     }
-    else
-    {
-        throw RuntimeErrorWithSourceLocation(std::format("Unexpected ip address action: {}", static_cast<int>(action)));
-    }
 }
 
 void GnsEngine::ProcessRouteChange(Interface& interface, const wsl::shared::hns::Route& route, wsl::shared::hns::ModifyRequestType action)
@@ -272,6 +233,12 @@ void GnsEngine::ProcessRouteChange(Interface& interface, const wsl::shared::hns:
 
     if (action == ModifyRequestType::Add)
     {
+        if (IsRouteSet(interfaceRoute))
+        {
+            GNS_LOG_INFO("Route {} is already set on interfaceName {}, skipping", routeString.c_str(), interface.Name().c_str());
+            return;
+        }
+
         GNS_LOG_INFO("Add route {} on interfaceName {}", routeString.c_str(), interface.Name().c_str());
         manager.ModifyRoute(interfaceRoute, Operation::Create);
     }
@@ -324,6 +291,18 @@ void GnsEngine::ProcessDNSChange(Interface& interface, const wsl::shared::hns::D
         content << L"search " << wsl::shared::string::Join(wsl::shared::string::Split(payload.Search, L','), L' ') << L"\n";
     }
 
+    // The file is compared with its content on disk, since something else may have written it since.
+    {
+        std::wifstream currentResolvConf("/etc/resolv.conf");
+        std::wstringstream currentContent;
+        currentContent << currentResolvConf.rdbuf();
+        if (currentResolvConf && currentContent.str() == content.str())
+        {
+            GNS_LOG_INFO("DNS settings are unchanged on interfaceName {}, skipping", interface.Name().c_str());
+            return;
+        }
+    }
+
     GNS_LOG_INFO(
         "Setting DNS search to {}: {} on interfaceName {} ", payload.Search.c_str(), content.str().c_str(), interface.Name().c_str());
 
@@ -340,29 +319,90 @@ void GnsEngine::ProcessMacAddressChange(Interface& interface, const wsl::shared:
         address.PhysicalAddress.c_str(),
         interface.Name().c_str());
     manager.SetAdapterMacAddress(interface, wsl::shared::string::ParseMacAddress(address.PhysicalAddress, '-'));
+
+    // Toggling the interface state can drop addresses and routes.
+    ResetInterfaceState(interface);
 }
 
 void GnsEngine::ProcessLinkChange(Interface& interface, const wsl::shared::hns::NetworkInterface& link, wsl::shared::hns::ModifyRequestType type)
 {
-    GNS_LOG_INFO(
-        "Setting link state to {} on interfaceName {}",
-        link.Connected ? "InterfaceState::Up" : "InterfaceState::Down",
-        interface.Name().c_str());
-    manager.SetInterfaceState(interface, link.Connected ? NetworkManager::InterfaceState::Up : NetworkManager::InterfaceState::Down);
+    if (GetInterfaceState(interface).Connected != link.Connected)
+    {
+        GNS_LOG_INFO(
+            "Setting link state to {} on interfaceName {}",
+            link.Connected ? "InterfaceState::Up" : "InterfaceState::Down",
+            interface.Name().c_str());
+        manager.SetInterfaceState(
+            interface, link.Connected ? NetworkManager::InterfaceState::Up : NetworkManager::InterfaceState::Down);
+
+        if (!link.Connected)
+        {
+            // The kernel drops the routes (and possibly the addresses) of an interface that goes down.
+            ResetInterfaceState(interface);
+        }
 
-    if (link.Connected && link.NlMtu != 0)
+        GetInterfaceState(interface).Connected = link.Connected;
+    }
+
+    auto& state = GetInterfaceState(interface);
+    if (link.Connected && link.NlMtu != 0 && state.Mtu != link.NlMtu)
     {
         GNS_LOG_INFO("Setting MTU to {} on interfaceName {} ", link.NlMtu, interface.Name().c_str());
         interface.SetMtu(link.NlMtu);
+        state.Mtu = link.NlMtu;
     }
 
-    if (link.Connected && link.Metric != 0)
+    if (link.Connected && link.Metric != 0 && state.Metric != link.Metric)
     {
         GNS_LOG_INFO("Setting Metric to {} on interfaceName {} ", link.Metric, interface.Name().c_str());
         interface.SetMetric(link.Metric);
+        state.Metric = link.Metric;
     }
 }
 
+GnsEngine::InterfaceState& GnsEngine::GetInterfaceState(const Interface& interface)
+{
+    return interfaceStates[interface.Index()];
+}
+
+void GnsEngine::ResetInterfaceState(const Interface& interface)
+{
+    interfaceStates.erase(interface.Index());
+}
+
+bool GnsEngine::IsAddressSet(const Interface& interface, const Address& address)
+{
+    // An address with a finite preferred lifetime is always applied: the lifetime is relative, so applying the address
+    // again is what refreshes it.
+    if (static_cast<uint32_t>(address.PreferredLifetime()) != NetlinkStateCache::InfiniteLifetime)
+    {
+        return false;
+    }
+
+    // The addresses are listed from the rtnetlink mirror, which reflects the addresses removed by the kernel or other tools.
+    const auto matches = [&](const NetlinkStateCache::AddressEntry& e) {
+        return e.Value == address && e.PreferredLifetime == NetlinkStateCache::InfiniteLifetime;
+    };
+
+    return std::ranges::any_of(manager.ListAddresses(interface, address.Family()), matches);
+}
+
+bool GnsEngine::IsRouteSet(const Route& route)
+{
+    // The routes are listed from the rtnetlink mirror, which reflects the routes the kernel flushed on its own.
+    // On-link routes are created without a gateway. The prefix length of a gateway address isn't meaningful.
+    const auto matches = [&](const Route& e) {
+        if (e.dev != route.dev || e.metric != route.metric || e.to != route.to)
+        {
+            return false;
+        }
+
+        return route.IsOnlink() ? !e.via.has_value() : (e.via.has_value() && e.via->Addr() == route.via->Addr());
+    };
+
+    return std::ranges::any_of(manager.ListRoutes(route.family), matches);
+}
+
 std::tuple<bool, int> GnsEngine::ProcessNextMessage()
 {
     int return_value = 0;
@@ -384,15 +424,18 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
     {
         auto interface = OpenAdapter(payload->AdapterId.value());
 
-        ProcessNotification(nlohmann::json::parse(payload->Json), interface);
+        ProcessNotification(payload->Json, wsl::shared::FromJsonStreaming<NotificationHeader>(payload->Json), interface);
         break;
     }
     case LxGnsMessageInterfaceConfiguration:
     {
-        const auto endpoint = wsl::shared::FromJson<wsl::shared::hns::HNSEndpoint>(payload->Json.c_str());
+        const auto endpoint = wsl::shared::FromJsonStreaming<wsl::shared::hns::HNSEndpoint>(payload->Json);
         const auto endpointString = wsl::shared::string::GuidToString<char>(endpoint.ID);
         auto interface = OpenAdapter(endpoint.ID);
 
+        // The whole configuration of the interface is about to be replaced.
+        ResetInterfaceState(interface);
+
         // Give the interface a new name if requested.
         if (endpoint.PortFriendlyName.size() > 0)
         {
@@ -415,7 +458,7 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
                         assignedName.c_str());
                     interface = manager.CreateVirtualWifiAdapter(interface, assignedName);
 
-                    auto backingInterface = Interface::Open(backingName);
+                    auto backingInterface = manager.OpenInterface(backingName);
                     GNS_LOG_INFO(
                         "LxGnsMessageInterfaceConfiguration: endpointID ({}) setting interface ({}) state up on the newly "
                         "created interfaceName {}",
@@ -432,7 +475,7 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
                         interface.Name().c_str(),
                         assignedName.c_str());
                     manager.SetAdapterName(interface, assignedName);
-                    interface = Interface::Open(assignedName);
+                    interface = manager.OpenInterface(assignedName);
                 }
             }
             else
@@ -458,11 +501,12 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
         }
 
         manager.SetInterfaceState(interface, NetworkManager::InterfaceState::Up);
+        ResetInterfaceState(interface);
         break;
     }
     case LxGnsMessageVmNicCreatedNotification:
     {
-        auto vmNic = wsl::shared::FromJson<wsl::shared::hns::VmNicCreatedNotification>(payload->Json.c_str());
+        auto vmNic = wsl::shared::FromJsonStreaming<wsl::shared::hns::VmNicCreatedNotification>(payload->Json);
         auto interface = OpenAdapter(vmNic.adapterId);
 
         GNS_LOG_INFO(
@@ -474,7 +518,7 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
     }
     case LxGnsMessageCreateDeviceRequest:
     {
-        auto createDeviceRequest = wsl::shared::FromJson<wsl::shared::hns::CreateDeviceRequest>(payload->Json.c_str());
+        auto createDeviceRequest = wsl::shared::FromJsonStreaming<wsl::shared::hns::CreateDeviceRequest>(payload->Json);
         switch (createDeviceRequest.type)
         {
         case wsl::shared::hns::DeviceType::Loopback:
@@ -498,8 +542,8 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
     }
     case LxGnsMessageModifyGuestDeviceSettingRequest:
     {
-        auto modifyRequest = wsl::shared::FromJson<wsl::shared::hns::ModifyGuestEndpointSettingRequest<wsl::shared::hns::NetworkInterface>>(
-            payload->Json.c_str());
+        auto modifyRequest =
+            wsl::shared::FromJsonStreaming<ModifyGuestEndpointSettingRequest<wsl::shared::hns::NetworkInterface>>(payload->Json);
         if (modifyRequest.ResourceType != GuestEndpointResourceType::Interface)
         {
             GNS_LOG_INFO(
@@ -527,7 +571,7 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
     }
     case LxGnsMessageLoopbackRoutesRequest:
     {
-        auto request = wsl::shared::FromJson<wsl::shared::hns::LoopbackRoutesRequest>(payload->Json.c_str());
+        auto request = wsl::shared::FromJsonStreaming<wsl::shared::hns::LoopbackRoutesRequest>(payload->Json);
         if (request.operation != wsl::shared::hns::OperationType::Create && request.operation != wsl::shared::hns::OperationType::Remove)
         {
             GNS_LOG_INFO(
@@ -555,14 +599,19 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
     }
     case LxGnsMessageDeviceSettingRequest:
     {
-        auto json = nlohmann::json::parse(payload->Json);
-        auto interface = OpenInterfaceOrAdapter(json.at("targetDeviceName").get<std::wstring>());
-        ProcessNotification(json, interface);
+        const auto header = wsl::shared::FromJsonStreaming<NotificationHeader>(payload->Json);
+        if (!header.targetDeviceName.has_value())
+        {
+            throw RuntimeErrorWithSourceLocation("Json is missing targetDeviceName");
+        }
+
+        auto interface = OpenInterfaceOrAdapter(header.targetDeviceName.value());
+        ProcessNotification(payload->Json, header, interface);
         break;
     }
     case LxGnsMessageInitialIpConfigurationNotification:
     {
-        auto notification = wsl::shared::FromJson<wsl::shared::hns::InitialIpConfigurationNotification>(payload->Json.c_str());
+        auto notification = wsl::shared::FromJsonStreaming<wsl::shared::hns::InitialIpConfigurationNotification>(payload->Json);
         auto interface = OpenInterfaceOrAdapter(notification.targetDeviceName);
 
         if (WI_IsFlagClear(notification.flags, wsl::shared::hns::InitialIpConfigurationNotificationFlags::SkipPrimaryRoutingTableUpdate))
@@ -583,6 +632,7 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
 
         GNS_LOG_INFO("LxGnsMessageInitialIpConfigurationNotification: Resetting IPv6 state for interface {}", interface.Name().c_str());
         interface.ResetIpv6State();
+        ResetInterfaceState(interface);
 
         if (WI_IsFlagClear(notification.flags, wsl::shared::hns::InitialIpConfigurationNotificationFlags::SkipLoopbackRouteReset))
         {
@@ -636,7 +686,8 @@ std::tuple<bool, int> GnsEngine::ProcessNextMessage()
     }
     case LxGnsMessageInterfaceNetFilter:
     {
-        auto interfaceNetFilterRequest = wsl::shared::FromJson<wsl::shared::hns::InterfaceNetFilterRequest>(payload->Json.c_str());
+        auto interfaceNetFilterRequest =
+            wsl::shared::FromJsonStreaming<wsl::shared::hns::InterfaceNetFilterRequest>(payload->Json);
         auto interface = OpenInterfaceOrAdapter(interfaceNetFilterRequest.targetDeviceName);
 
         GNS_LOG_INFO(
@@ -739,6 +790,9 @@ void GnsEngine::run()
         {
             GNS_LOG_ERROR("Error while processing message: {}", e.what());
             statusRoutine(-1, e.what());
+
+            // The change may have been partially applied, forget the applied state so that no change is skipped.
+            interfaceStates.clear();
         }
     }
 
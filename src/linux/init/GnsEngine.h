@@ -3,12 +3,15 @@
 #pragma once
 
 #include <functional>
+#include <map>
 #include <optional>
+#include <string>
 #include <tuple>
 #include "util.h"
 #include "lxinitshared.h"
 #include "NetworkManager.h"
 #include "DnsTunnelingManager.h"
+#include "LinkTracker.h"
 #include "hns_schema.h"
 
 class GnsEngine
@@ -29,16 +32,53 @@ public:
         const StatusRoutine& statusRoutine,
         NetworkManager& manager,
         std::optional<int> dnsTunnelingFd,
-        const std::string& dnsTunnelingIpAddress);
+        const std::string& dnsTunnelingIpAddress,
+        bool enableDnsTunnelingCache = false);
 
     void setup();
 
     void run();
 
 private:
+    // Configuration applied to an interface by the engine.
+    //
+    // Windows sends a notification for every change on the host, and a network flap typically sends the same addresses,
+    // routes and link settings again. Changes that are already applied are skipped instead of being sent to the kernel.
+    // Addresses and routes aren't tracked here: the kernel and other tools change them on their own, so they are compared
+    // with the rtnetlink mirror of the network manager instead (see IsAddressSet() and IsRouteSet()).
+    // The state of an interface is dropped whenever the kernel may have changed it on its own (link down, MAC address
+    // change, reset, failure), so that the next notification is applied unconditionally.
+    struct InterfaceState
+    {
+        std::optional<bool> Connected;
+        std::optional<uint32_t> Mtu;
+        std::optional<uint32_t> Metric;
+    };
+
+    InterfaceState& GetInterfaceState(const Interface& interface);
+
+    void ResetInterfaceState(const Interface& interface);
+
+    // Returns true if the kernel already has the address on the interface, with the same prefix length and an infinite
+    // lifetime.
+    bool IsAddressSet(const Interface& interface, const Address& address);
+
+    // Returns true if the kernel already has a route to the same destination, through the same gateway and device, with the
+    // same metric.
+    bool IsRouteSet(const Route& route);
+
     std::tuple<bool, int> ProcessNextMessage();
 
-    void ProcessNotification(const nlohmann::json& payload, Interface& interface);
+    // Fields of a ModifyGuestEndpointSettingRequest needed to know the type of its settings.
+    struct NotificationHeader
+    {
+        std::optional<wsl::shared::hns::GuestEndpointResourceType> ResourceType;
+        std::optional<std::wstring> targetDeviceName;
+
+        WSL_DEFINE_JSON_READER_INTRUSIVE(NotificationHeader, ResourceType, targetDeviceName);
+    };
+
+    void ProcessNotification(const std::string& payload, const NotificationHeader& header, Interface& interface);
 
     void ProcessRouteChange(Interface& interface, const wsl::shared::hns::Route& route, wsl::shared::hns::ModifyRequestType type);
 
@@ -50,28 +90,29 @@ private:
 
     void ProcessLinkChange(Interface& interface, const wsl::shared::hns::NetworkInterface& link, wsl::shared::hns::ModifyRequestType type);
 
-    static Interface OpenAdapter(const GUID& id);
-
-    static Interface OpenAdapterImpl(const GUID& id);
+    Interface OpenAdapter(const GUID& id);
 
-    static Interface OpenInterface(const std::string& deviceName);
+    Interface OpenInterface(const std::string& deviceName);
 
-    static Interface OpenInterfaceImpl(const std::string& deviceName);
+    Interface OpenInterfaceImpl(const std::string& deviceName);
 
-    static Interface OpenInterfaceOrAdapter(const std::wstring& nameOrId);
-
-    static std::optional<GUID> GetAdapterId(const std::string& name);
+    Interface OpenInterfaceOrAdapter(const std::wstring& nameOrId);
 
     template <typename T>
     static T Deserialize(const std::string& json);
 
     template <typename T>
     void ProcessNotificationImpl(
-        Interface& interface, const nlohmann::json& payload, void (GnsEngine::*routine)(Interface&, const T&, wsl::shared::hns::ModifyRequestType));
+        Interface& interface, const std::string& payload, void (GnsEngine::*routine)(Interface&, const T&, wsl::shared::hns::ModifyRequestType));
 
     const NotificationRoutine& notificationRoutine;
     const StatusRoutine& statusRoutine;
     NetworkManager& manager;
 
     std::optional<DnsTunnelingManager> dnsTunnelingManager;
+
+    LinkTracker linkTracker;
+
+    // Mapping interface index to the configuration applied to it.
+    std::map<int, InterfaceState> interfaceStates;
 };
@@ -0,0 +1,175 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <filesystem>
+#include <format>
+#include "LinkTracker.h"
+#include "RuntimeErrorWithSourceLocation.h"
+#include "stringshared.h"
+
+constexpr auto c_sysClassNet = "/sys/class/net/";
+
+LinkTracker::LinkTracker(NetlinkStateCache& netlinkState) : m_netlinkState(netlinkState)
+{
+    // The callback is called once with the current links, which builds the index.
+    m_netlinkState.SetLinkCallback([this](const std::map<int, NetlinkStateCache::Link>& links) {
+        std::scoped_lock<std::mutex> lock{m_lock};
+        Synchronize(links);
+    });
+}
+
+LinkTracker::~LinkTracker() noexcept
+{
+    try
+    {
+        m_netlinkState.SetLinkCallback({});
+    }
+    CATCH_LOG()
+}
+
+std::string LinkTracker::WaitForAdapter(const GUID& id, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock{m_lock};
+
+    std::optional<std::string> name;
+    if (!m_linksChanged.wait_for(lock, timeout, [&]() {
+            name = FindAdapter(id);
+            return name.has_value();
+        }))
+    {
+        throw RuntimeErrorWithSourceLocation(
+            std::format("Couldn't find an adapter for id: {}", wsl::shared::string::GuidToString<char>(id)));
+    }
+
+    return name.value();
+}
+
+bool LinkTracker::WaitForInterface(const std::string& name, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock{m_lock};
+
+    return m_linksChanged.wait_for(lock, timeout, [&]() { return m_names.contains(name); });
+}
+
+std::optional<GUID> LinkTracker::GetAdapterId(const std::string& path)
+{
+    // Sample symlink:
+    // /sys/class/net/eth0/device -> ../../devices/LNXSYSTM:00/LNXSYBUS:00/ACPI0004:00/VMBUS:00/ebfda100-7464-4629-9da5-12de5470cb4f
+
+    try
+    {
+        auto symlink = std::filesystem::read_symlink(path);
+        const std::string adapterName = symlink.filename();
+        if (adapterName.size() > 3 && adapterName.compare(0, 4, "wlan") == 0)
+        {
+            symlink = symlink.parent_path().parent_path();
+        }
+        auto device = symlink.parent_path().parent_path();
+        std::string deviceGuid = device.filename();
+        if (deviceGuid.size() > 6 && deviceGuid.compare(0, 6, "virtio") == 0)
+        {
+            deviceGuid = device.parent_path().parent_path().parent_path().filename();
+        }
+
+        return wsl::shared::string::ToGuid(deviceGuid);
+    }
+    catch (...)
+    {
+        return {};
+    }
+}
+
+void LinkTracker::Synchronize(const std::map<int, NetlinkStateCache::Link>& links)
+{
+    for (auto it = m_links.begin(); it != m_links.end();)
+    {
+        const auto index = (it++)->first;
+        if (!links.contains(index))
+        {
+            RemoveLink(index);
+        }
+    }
+
+    for (const auto& [index, link] : links)
+    {
+        UpdateLink(index, link.Name);
+    }
+
+    m_linksChanged.notify_all();
+}
+
+void LinkTracker::UpdateLink(int index, const std::string& name)
+{
+    // Only a new link or a rename needs the index to be updated.
+    const auto it = m_links.find(index);
+    if (it != m_links.end())
+    {
+        if (it->second.Name == name)
+        {
+            return;
+        }
+
+        RemoveLink(index);
+    }
+
+    auto& link = m_links[index];
+    link.Name = name;
+    link.AdapterId = GetAdapterId(c_sysClassNet + name);
+
+    m_names[name] = index;
+    if (link.AdapterId.has_value())
+    {
+        m_adapters[wsl::shared::string::GuidToString<char>(link.AdapterId.value())].push_back(index);
+    }
+}
+
+void LinkTracker::RemoveLink(int index)
+{
+    const auto it = m_links.find(index);
+    if (it == m_links.end())
+    {
+        return;
+    }
+
+    const auto name = m_names.find(it->second.Name);
+    if (name != m_names.end() && name->second == index)
+    {
+        m_names.erase(name);
+    }
+
+    if (it->second.AdapterId.has_value())
+    {
+        const auto adapter = m_adapters.find(wsl::shared::string::GuidToString<char>(it->second.AdapterId.value()));
+        if (adapter != m_adapters.end())
+        {
+            std::erase(adapter->second, index);
+            if (adapter->second.empty())
+            {
+                m_adapters.erase(adapter);
+            }
+        }
+    }
+
+    m_links.erase(it);
+}
+
+std::optional<std::string> LinkTracker::FindAdapter(const GUID& id) const
+{
+    const auto adapter = m_adapters.find(wsl::shared::string::GuidToString<char>(id));
+    if (adapter == m_adapters.end() || adapter->second.empty())
+    {
+        return {};
+    }
+
+    // Special case _wlanxx interfaces: look for the wlanxx version instead.
+    std::optional<std::string> name;
+    for (const auto index : adapter->second)
+    {
+        name = m_links.at(index).Name;
+        if (name->compare(0, 5, "_wlan") != 0)
+        {
+            break;
+        }
+    }
+
+    return name;
+}
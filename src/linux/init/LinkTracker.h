@@ -0,0 +1,95 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "lxinitshared.h"
+#include "NetlinkStateCache.h"
+
+// Index of the network interfaces, mapping the id of the adapter backing each interface to its interface index and name.
+//
+// The index follows the links of a NetlinkStateCache, so looking up an adapter doesn't walk sysfs and waiters are woken as
+// soon as the interface appears. Sysfs is only read to find the adapter of new or renamed interfaces.
+class LinkTracker
+{
+public:
+    LinkTracker(NetlinkStateCache& netlinkState);
+    ~LinkTracker() noexcept;
+
+    LinkTracker(const LinkTracker&) = delete;
+    LinkTracker(LinkTracker&&) = delete;
+    LinkTracker& operator=(const LinkTracker&) = delete;
+    LinkTracker& operator=(LinkTracker&&) = delete;
+
+    // Wait for an interface backed by an adapter to be present.
+    //
+    // Arguments:
+    //    id - id of the adapter.
+    //    timeout - how long to wait for the interface.
+    //
+    // Return Value:
+    //    The name of the interface. Throws if no interface appears before the timeout.
+    std::string WaitForAdapter(const GUID& id, std::chrono::milliseconds timeout);
+
+    // Wait for an interface to be present.
+    //
+    // Arguments:
+    //    name - name of the interface.
+    //    timeout - how long to wait for the interface.
+    //
+    // Return Value:
+    //    true if the interface is present, false if it didn't appear before the timeout.
+    bool WaitForInterface(const std::string& name, std::chrono::milliseconds timeout);
+
+    // Read the id of the adapter backing an interface from sysfs.
+    //
+    // Arguments:
+    //    path - sysfs path of the interface (/sys/class/net/<name>).
+    static std::optional<GUID> GetAdapterId(const std::string& path);
+
+private:
+    struct Link
+    {
+        std::string Name;
+        std::optional<GUID> AdapterId;
+    };
+
+    // Update the index to match the links of the cache. Requires m_lock.
+    void Synchronize(const std::map<int, NetlinkStateCache::Link>& links);
+
+    // Add or rename an interface. Requires m_lock.
+    void UpdateLink(int index, const std::string& name);
+
+    // Remove an interface. Requires m_lock.
+    void RemoveLink(int index);
+
+    // Find the name of the interface backed by an adapter. Requires m_lock.
+    std::optional<std::string> FindAdapter(const GUID& id) const;
+
+    NetlinkStateCache& m_netlinkState;
+
+    std::mutex m_lock;
+
+    // Notified when the index changes.
+    std::condition_variable m_linksChanged;
+
+    // Mapping interface index to the interface.
+    // _Guarded_by_(m_lock)
+    std::map<int, Link> m_links;
+
+    // Mapping adapter id to the indexes of the interfaces it backs.
+    // _Guarded_by_(m_lock)
+    std::unordered_map<std::string, std::vector<int>> m_adapters;
+
+    // Mapping interface name to interface index.
+    // _Guarded_by_(m_lock)
+    std::unordered_map<std::string, int> m_names;
+};
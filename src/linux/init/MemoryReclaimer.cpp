@@ -0,0 +1,477 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <algorithm>
+#include <fstream>
+#include <pthread.h>
+#include <span>
+#include <sstream>
+#include <sys/sysinfo.h>
+#include "MemoryReclaimer.h"
+#include "util.h"
+
+constexpr auto c_buddyInfoPath = "/proc/buddyinfo";
+constexpr auto c_cpuPressurePath = "/proc/pressure/cpu";
+constexpr auto c_memoryPressurePath = "/proc/pressure/memory";
+constexpr auto c_statPath = "/proc/stat";
+constexpr auto c_meminfoPath = "/proc/meminfo";
+constexpr auto c_compactPath = "/proc/sys/vm/compact_memory";
+constexpr auto c_dropCachesPath = "/proc/sys/vm/drop_caches";
+constexpr auto c_memoryStatPath = "/sys/fs/cgroup/memory.stat";
+constexpr auto c_reclaimPath = "/sys/fs/cgroup/memory.reclaim";
+constexpr auto c_nodeCompactPath = "/sys/devices/system/node/node{}/compact";
+
+constexpr auto c_interval = std::chrono::seconds(10);
+constexpr auto c_gradualIdleDelay = std::chrono::minutes(3);
+constexpr auto c_dropCacheIdleDelay = std::chrono::minutes(10);
+constexpr auto c_minimumBackoff = std::chrono::seconds(30);
+constexpr auto c_maximumBackoff = std::chrono::minutes(5);
+constexpr auto c_logInterval = std::chrono::minutes(10);
+constexpr auto c_compactionInterval = std::chrono::minutes(5);
+constexpr auto c_pressureWindow = std::chrono::microseconds(std::chrono::seconds(1));
+
+constexpr uint64_t c_minimumFloor = 256 * 1024 * 1024;
+constexpr uint64_t c_maximumFloor = 1024 * 1024 * 1024;
+constexpr uint64_t c_minimumReclaim = 4 * 1024 * 1024;
+constexpr uint64_t c_minimumFragmentation = 64 * 1024 * 1024;
+constexpr uint64_t c_minimumFragmentationShare = 20;
+constexpr double c_maxIdleCpuPressure = 1.0;
+constexpr double c_maxCompactionCpuPressure = 10.0;
+
+MemoryReclaimer::MemoryReclaimer(const Settings& settings) : m_settings(settings)
+{
+    m_settings.MaxPressure = std::clamp(m_settings.MaxPressure, 1u, 100u);
+
+    // By default, an eighth of the memory (between 256MB and 1GB) is left to the page cache.
+    m_floor = m_settings.Floor;
+    if (m_floor == 0)
+    {
+        struct sysinfo info{};
+        THROW_LAST_ERROR_IF(sysinfo(&info) < 0);
+        m_floor = std::clamp<uint64_t>(static_cast<uint64_t>(info.totalram) * info.mem_unit / 8, c_minimumFloor, c_maximumFloor);
+    }
+}
+
+void MemoryReclaimer::Run()
+{
+    sched_param parameter{};
+    const int result = pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameter);
+    THROW_ERRNO_IF(result, result != 0);
+
+    // Fall back to drop cache if the required cgroup file is not present.
+    if (m_settings.Mode == LxMiniInitMemoryReclaimModeGradual && access(c_reclaimPath, W_OK) < 0)
+    {
+        LOG_WARNING("access({}, W_OK) failed {}, falling back to autoMemoryReclaim = dropcache", c_reclaimPath, errno);
+        m_settings.Mode = LxMiniInitMemoryReclaimModeDropCache;
+    }
+
+    m_pressureTrigger = OpenPressureTrigger();
+
+    // The VM is idle if less than 0.5% of the CPU time was spent in user mode during the last interval.
+    const auto idleDelay = m_settings.Mode == LxMiniInitMemoryReclaimModeGradual ? c_gradualIdleDelay : c_dropCacheIdleDelay;
+    const long long idleThreshold = (get_nprocs() * sysconf(_SC_CLK_TCK) * std::chrono::seconds(c_interval).count()) / 200;
+    auto cpuTime = GetUserCpuTime();
+    m_idleStart = std::chrono::steady_clock::now();
+    m_lastLog = m_idleStart;
+    for (;;)
+    {
+        // A failed iteration is logged, and the next one runs as usual.
+        try
+        {
+            const bool pressure = WaitForPressure(std::chrono::steady_clock::now() + c_interval);
+            const auto now = std::chrono::steady_clock::now();
+            const auto previousCpuTime = cpuTime;
+            cpuTime = GetUserCpuTime();
+            if (pressure)
+            {
+                // Pressure that comes back once reclaiming resumed doubles the backoff. Pressure during the backoff extends it.
+                m_statistics.PressureEvents += 1;
+                if (now >= m_backoffEnd)
+                {
+                    m_backoff = std::clamp(
+                        m_backoff * 2, c_minimumBackoff, std::chrono::seconds(c_maximumBackoff));
+                }
+
+                m_backoffEnd = now + m_backoff;
+            }
+            else if (m_backoff.count() != 0 && now >= m_backoffEnd + m_backoff)
+            {
+                m_backoff = {};
+            }
+
+            const bool idle = !pressure && (cpuTime - previousCpuTime) < idleThreshold && IsCpuAvailable(c_maxIdleCpuPressure);
+            if (!idle)
+            {
+                m_idleStart = now;
+                m_cacheDropped = false;
+            }
+            else if (now >= m_backoffEnd && now - m_idleStart >= idleDelay)
+            {
+                if (m_settings.Mode == LxMiniInitMemoryReclaimModeGradual)
+                {
+                    Reclaim();
+                }
+                else if (m_settings.Mode == LxMiniInitMemoryReclaimModeDropCache)
+                {
+                    DropCache();
+                }
+            }
+
+            // Fragmented free memory isn't returned to the host, so compaction only waits for the CPU not to be saturated.
+            // Each node is compacted at most once per compaction interval, since compaction competes with the workload.
+            if (!pressure && now >= m_backoffEnd && IsCpuAvailable(c_maxCompactionCpuPressure))
+            {
+                Compact(now);
+            }
+
+            LogStatistics();
+        }
+        CATCH_LOG()
+    }
+}
+
+bool MemoryReclaimer::WaitForPressure(std::chrono::steady_clock::time_point deadline)
+{
+    for (;;)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+        {
+            break;
+        }
+
+        const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+        if (!m_pressureTrigger)
+        {
+            std::this_thread::sleep_for(remaining);
+            continue;
+        }
+
+        pollfd pollDescriptor{.fd = m_pressureTrigger.get(), .events = POLLPRI, .revents = 0};
+        if (poll(&pollDescriptor, 1, static_cast<int>(remaining.count())) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            // Failing here would skip the wait, so the trigger is dropped instead.
+            LOG_ERROR("poll({}) failed {}, falling back to polling", c_memoryPressurePath, errno);
+            m_pressureTrigger.reset();
+            continue;
+        }
+
+        if (pollDescriptor.revents & POLLERR)
+        {
+            LOG_ERROR("{} trigger failed, falling back to polling", c_memoryPressurePath);
+            m_pressureTrigger.reset();
+        }
+        else if (pollDescriptor.revents & POLLPRI)
+        {
+            return true;
+        }
+    }
+
+    if (m_pressureTrigger)
+    {
+        return false;
+    }
+
+    // Without a trigger, the average of the last 10 seconds is checked once per interval.
+    const auto pressure = GetPressure(c_memoryPressurePath);
+    return pressure.has_value() && pressure.value() > m_settings.MaxPressure;
+}
+
+bool MemoryReclaimer::IsCpuAvailable(double maxPressure)
+{
+    // N.B. Kernels without PSI only use the user CPU time.
+    const auto pressure = GetPressure(c_cpuPressurePath);
+    return !pressure.has_value() || pressure.value() < maxPressure;
+}
+
+void MemoryReclaimer::Reclaim()
+{
+    const auto inUse = GetMemoryInUse();
+    if (inUse <= m_floor)
+    {
+        return;
+    }
+
+    // The colder the file cache (the larger its inactive list compared to its active list), the larger the share of the
+    // inactive list that is reclaimed, up to half of it per pass.
+    const auto stat = GetMemoryStat();
+    const auto fileCache = stat.ActiveFile + stat.InactiveFile;
+    if (fileCache == 0)
+    {
+        return;
+    }
+
+    const auto cold = static_cast<double>(stat.InactiveFile) / fileCache;
+    const auto target = std::min(static_cast<uint64_t>(stat.InactiveFile * cold / 2), inUse - m_floor);
+    if (target < c_minimumReclaim)
+    {
+        return;
+    }
+
+    // The swappiness argument restricts reclaim to the file cache. Kernels that don't support it reject it with EINVAL.
+    int result = -1;
+    if (m_reclaimSwappiness)
+    {
+        result = WriteToFile(c_reclaimPath, std::format("{} swappiness=0", target).c_str());
+        if (result < 0 && errno == EINVAL)
+        {
+            m_reclaimSwappiness = false;
+        }
+    }
+
+    if (!m_reclaimSwappiness)
+    {
+        result = WriteToFile(c_reclaimPath, std::to_string(target).c_str());
+    }
+
+    // EAGAIN means that it attempted, but was unable to evict sufficient pages.
+    THROW_LAST_ERROR_IF(result < 0 && errno != EAGAIN);
+
+    const auto freed = inUse - std::min(inUse, GetMemoryInUse());
+    m_statistics.ReclaimRuns += 1;
+    m_statistics.BytesReclaimed += freed;
+}
+
+void MemoryReclaimer::DropCache()
+{
+    if (m_cacheDropped)
+    {
+        return;
+    }
+
+    const auto inUse = GetMemoryInUse();
+    if (inUse <= m_floor)
+    {
+        return;
+    }
+
+    THROW_LAST_ERROR_IF(WriteToFile(c_dropCachesPath, "1\n") < 0);
+
+    const auto freed = inUse - std::min(inUse, GetMemoryInUse());
+    m_cacheDropped = true;
+    m_statistics.CacheDrops += 1;
+    m_statistics.BytesReclaimed += freed;
+}
+
+void MemoryReclaimer::Compact(std::chrono::steady_clock::time_point now)
+{
+    // N.B. Memory compaction is not needed if the page reporting order is set to single page (0).
+    if (m_settings.PageReportingOrder == 0)
+    {
+        return;
+    }
+
+    const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+    for (const auto& [node, pages] : GetFreePages())
+    {
+        // A node is compacted if enough of its free memory is in blocks too small to be reported, and its fragmentation
+        // grew since it was last compacted.
+        const auto fragmentation = (pages.Total - pages.Reportable) * pageSize;
+        auto& compacted = m_compactedNodes[node];
+        compacted.Fragmentation = std::min(compacted.Fragmentation, fragmentation);
+        if (fragmentation < compacted.Fragmentation + c_minimumFragmentation ||
+            fragmentation * 100 < pages.Total * pageSize * c_minimumFragmentationShare ||
+            (compacted.Time.has_value() && now - compacted.Time.value() < c_compactionInterval))
+        {
+            continue;
+        }
+
+        // N.B. Kernels without NUMA support don't have per-node compaction, and only have a single node.
+        // N.B. A node that fails to compact is retried after the compaction interval, and doesn't keep the other
+        //      nodes from being compacted.
+        compacted.Time = now;
+        auto path = std::format(c_nodeCompactPath, node);
+        if (access(path.c_str(), W_OK) < 0)
+        {
+            path = c_compactPath;
+        }
+
+        if (WriteToFile(path.c_str(), "1\n") < 0)
+        {
+            LOG_ERROR("Failed to compact node {}, write({}) failed {}", node, path, errno);
+            continue;
+        }
+
+        const auto after = GetFreePages()[node];
+        const auto gathered = after.Reportable - std::min(after.Reportable, pages.Reportable);
+        m_statistics.CompactionRuns += 1;
+        m_statistics.CompactedBlocks += gathered >> m_settings.PageReportingOrder;
+        compacted.Fragmentation = (after.Total - after.Reportable) * pageSize;
+    }
+}
+
+void MemoryReclaimer::LogStatistics()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (m_statistics == m_loggedStatistics || now - m_lastLog < c_logInterval)
+    {
+        return;
+    }
+
+    LOG_INFO(
+        "Memory reclaim: {} bytes reclaimed, {} reclaim runs, {} cache drops, {} compaction runs, {} order {} blocks "
+        "compacted, {} pressure events",
+        m_statistics.BytesReclaimed,
+        m_statistics.ReclaimRuns,
+        m_statistics.CacheDrops,
+        m_statistics.CompactionRuns,
+        m_statistics.CompactedBlocks,
+        m_settings.PageReportingOrder,
+        m_statistics.PressureEvents);
+
+    m_loggedStatistics = m_statistics;
+    m_lastLog = now;
+}
+
+wil::unique_fd MemoryReclaimer::OpenPressureTrigger() const
+{
+    wil::unique_fd fd{open(c_memoryPressurePath, (O_RDWR | O_NONBLOCK | O_CLOEXEC))};
+    if (!fd)
+    {
+        LOG_WARNING("open({}) failed {}, memory pressure is not monitored", c_memoryPressurePath, errno);
+        return {};
+    }
+
+    // A trigger is "some <stall> <window>", in microseconds, and includes the null terminator.
+    const auto stall = c_pressureWindow.count() * m_settings.MaxPressure / 100;
+    const auto trigger = std::format("some {} {}", stall, c_pressureWindow.count());
+    if (write(fd.get(), trigger.c_str(), trigger.size() + 1) < 0)
+    {
+        LOG_WARNING("write({}, {}) failed {}, falling back to polling", c_memoryPressurePath, trigger, errno);
+        return {};
+    }
+
+    return fd;
+}
+
+std::optional<double> MemoryReclaimer::GetPressure(const char* path)
+{
+    std::ifstream file{path};
+    return ReadPressure(file);
+}
+
+std::optional<double> MemoryReclaimer::ReadPressure(std::istream& file)
+{
+    // The first line is "some avg10=<percent> avg60=<percent> avg300=<percent> total=<microseconds>".
+    std::string type;
+    std::string average;
+    if (!(file >> type >> average) || type != "some" || !average.starts_with("avg10="))
+    {
+        return {};
+    }
+
+    return std::strtod(average.c_str() + strlen("avg10="), nullptr);
+}
+
+long long MemoryReclaimer::GetUserCpuTime()
+{
+    // The first line of /proc/stat is "cpu <user> <nice> <system> ...", summed over all cores.
+    std::ifstream file{c_statPath};
+    std::string name;
+    long long user{};
+    THROW_ERRNO_IF(EINVAL, !(file >> name >> user) || name != "cpu");
+
+    return user;
+}
+
+uint64_t MemoryReclaimer::GetMemoryInUse()
+{
+    // Total memory - free memory, which includes the memory used by the page cache.
+    struct sysinfo info{};
+    THROW_LAST_ERROR_IF(sysinfo(&info) < 0);
+
+    return static_cast<uint64_t>(info.totalram - info.freeram) * info.mem_unit;
+}
+
+std::map<int, MemoryReclaimer::FreePages> MemoryReclaimer::GetFreePages() const
+{
+    std::ifstream file{c_buddyInfoPath};
+    THROW_LAST_ERROR_IF(!file);
+
+    return ReadBuddyInfo(file, m_settings.PageReportingOrder);
+}
+
+std::map<int, MemoryReclaimer::FreePages> MemoryReclaimer::ReadBuddyInfo(std::istream& file, int pageReportingOrder)
+{
+    // Each line is "Node <node>, zone <zone> <free blocks of order 0> <free blocks of order 1> ...".
+    std::map<int, FreePages> nodes;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream{line};
+        std::string label;
+        int node{};
+        char separator{};
+        std::string zoneLabel;
+        std::string zone;
+        if (!(stream >> label >> node >> separator >> zoneLabel >> zone) || label != "Node" || zoneLabel != "zone")
+        {
+            continue;
+        }
+
+        auto& pages = nodes[node];
+        uint64_t blocks{};
+        for (int order = 0; stream >> blocks; order += 1)
+        {
+            pages.Total += blocks << order;
+            if (order >= pageReportingOrder)
+            {
+                pages.Reportable += blocks << order;
+            }
+        }
+    }
+
+    return nodes;
+}
+
+MemoryReclaimer::MemoryStat MemoryReclaimer::GetMemoryStat()
+{
+    // The root cgroup reports the sizes in bytes. Without it, they are read from /proc/meminfo, in kB.
+    std::ifstream file{c_memoryStatPath};
+    if (file)
+    {
+        return ReadMemoryStat(file, false);
+    }
+
+    file.open(c_meminfoPath);
+    THROW_ERRNO_IF(ENOENT, !file);
+
+    return ReadMemoryStat(file, true);
+}
+
+MemoryReclaimer::MemoryStat MemoryReclaimer::ReadMemoryStat(std::istream& file, bool meminfo)
+{
+    MemoryStat stat{};
+    const std::pair<std::string_view, uint64_t*> cgroupKeys[] = {
+        {"active_file", &stat.ActiveFile}, {"inactive_file", &stat.InactiveFile}};
+    const std::pair<std::string_view, uint64_t*> meminfoKeys[] = {
+        {"Active(file):", &stat.ActiveFile}, {"Inactive(file):", &stat.InactiveFile}};
+
+    const std::span<const std::pair<std::string_view, uint64_t*>> keys = meminfo ? meminfoKeys : cgroupKeys;
+    const uint64_t unit = meminfo ? 1024 : 1;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream{line};
+        std::string key;
+        uint64_t value{};
+        if (!(stream >> key >> value))
+        {
+            continue;
+        }
+
+        for (const auto& [name, field] : keys)
+        {
+            if (key == name)
+            {
+                *field = value * unit;
+            }
+        }
+    }
+
+    return stat;
+}
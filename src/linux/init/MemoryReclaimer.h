@@ -0,0 +1,168 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <optional>
+#include "common.h"
+
+// Returns the memory that the VM no longer needs to the host.
+//
+// Memory is only reclaimed while the VM is idle: user CPU time barely advances and no task is stalled waiting for a
+// CPU (/proc/pressure/cpu). Any memory pressure (a PSI trigger on /proc/pressure/memory) stops reclaiming, and each
+// consecutive pressure event doubles the time before reclaiming resumes, so a working set that is still needed isn't
+// evicted over and over.
+//
+// In gradual mode, each pass reclaims a share of the inactive file cache read from memory.stat, larger as the cache gets
+// colder, so the cache that was used recently and anonymous memory are left alone, and memory in use is never reclaimed
+// below a floor. In drop cache mode, the page cache is dropped once per idle period.
+//
+// Free page reporting only returns free blocks of at least 2^PageReportingOrder pages to the host. When a NUMA node has
+// enough free memory in smaller blocks (read from /proc/buddyinfo), that node is compacted, as long as the CPU isn't
+// saturated. A node isn't compacted again until its fragmentation grows, so memory that can't be compacted (pinned or
+// unmovable pages) doesn't cause repeated compactions, and at most once every 5 minutes, since compaction doesn't wait for
+// the VM to be idle.
+//
+// The statistics (bytes reclaimed, cache drops, compactions, blocks made reportable by compaction and pressure events)
+// are written to the kernel log.
+class MemoryReclaimer
+{
+public:
+    struct Settings
+    {
+        LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode = LxMiniInitMemoryReclaimModeDisabled;
+
+        int PageReportingOrder = 0;
+
+        // Memory in use, in bytes, below which nothing is reclaimed. 0 derives it from the memory size of the VM.
+        uint64_t Floor = 0;
+
+        // Share of time, in percent, during which tasks may stall on memory before it counts as pressure.
+        unsigned int MaxPressure = 5;
+    };
+
+    struct Statistics
+    {
+        uint64_t BytesReclaimed = 0;
+        uint64_t ReclaimRuns = 0;
+        uint64_t CacheDrops = 0;
+        uint64_t CompactionRuns = 0;
+
+        // Free blocks of 2^PageReportingOrder pages gathered by compaction, which free page reporting returns to the host.
+        uint64_t CompactedBlocks = 0;
+
+        uint64_t PressureEvents = 0;
+
+        bool operator==(const Statistics&) const = default;
+    };
+
+    explicit MemoryReclaimer(const Settings& settings);
+
+    MemoryReclaimer(const MemoryReclaimer&) = delete;
+    MemoryReclaimer(MemoryReclaimer&&) = delete;
+    MemoryReclaimer& operator=(const MemoryReclaimer&) = delete;
+    MemoryReclaimer& operator=(MemoryReclaimer&&) = delete;
+
+    // Reclaim memory. A failed pass is logged, and reclaiming goes on. Only throws if the thread can't be set up. Must
+    // run on its own thread.
+    [[noreturn]] void Run();
+
+    // Sizes of the file cache LRU lists, in bytes.
+    struct MemoryStat
+    {
+        uint64_t ActiveFile = 0;
+        uint64_t InactiveFile = 0;
+    };
+
+    // Free pages of a NUMA node.
+    struct FreePages
+    {
+        uint64_t Total = 0;
+
+        // Free pages in blocks of at least 2^PageReportingOrder pages.
+        uint64_t Reportable = 0;
+    };
+
+    // Returns the "avg10" value of the "some" line of a /proc/pressure file, or nothing if it can't be parsed.
+    static std::optional<double> ReadPressure(std::istream& file);
+
+    // Returns the file cache sizes from the root cgroup's memory.stat, in bytes, or from /proc/meminfo, in kB.
+    static MemoryStat ReadMemoryStat(std::istream& file, bool meminfo);
+
+    // Returns the free pages of each NUMA node, from /proc/buddyinfo.
+    static std::map<int, FreePages> ReadBuddyInfo(std::istream& file, int pageReportingOrder);
+
+private:
+    // Wait until the next pass. Returns true if memory pressure was reported while waiting.
+    bool WaitForPressure(std::chrono::steady_clock::time_point deadline);
+
+    // Returns true if tasks were kept from running for less than a share (in percent) of the last 10 seconds.
+    static bool IsCpuAvailable(double maxPressure);
+
+    void Reclaim();
+
+    void DropCache();
+
+    // Compact the NUMA nodes whose free memory is fragmented at the page reporting order.
+    void Compact(std::chrono::steady_clock::time_point now);
+
+    // Log the statistics if they changed since they were last logged, at most once per interval.
+    void LogStatistics();
+
+    // Open a trigger that reports when tasks stall on memory for more than the maximum pressure, or an empty file
+    // descriptor if the kernel doesn't support PSI triggers.
+    wil::unique_fd OpenPressureTrigger() const;
+
+    // Returns the "avg10" value of the "some" line of a /proc/pressure file, or nothing if it can't be read.
+    static std::optional<double> GetPressure(const char* path);
+
+    // Returns the user CPU time of all cores, in clock ticks.
+    static long long GetUserCpuTime();
+
+    // Returns the memory in use (including the page cache), in bytes.
+    static uint64_t GetMemoryInUse();
+
+    // Returns the file cache sizes of the VM.
+    static MemoryStat GetMemoryStat();
+
+    // Returns the free pages of each NUMA node.
+    std::map<int, FreePages> GetFreePages() const;
+
+    Settings m_settings;
+
+    uint64_t m_floor = 0;
+
+    Statistics m_statistics;
+    Statistics m_loggedStatistics;
+    std::chrono::steady_clock::time_point m_lastLog;
+
+    wil::unique_fd m_pressureTrigger;
+
+    // Time before reclaiming resumes after memory pressure, doubled by each consecutive pressure event.
+    std::chrono::seconds m_backoff{0};
+    std::chrono::steady_clock::time_point m_backoffEnd;
+
+    // Start of the current idle period.
+    std::chrono::steady_clock::time_point m_idleStart;
+
+    // True once the page cache was dropped in the current idle period.
+    bool m_cacheDropped = false;
+
+    // False if memory.reclaim doesn't support the swappiness argument.
+    bool m_reclaimSwappiness = true;
+
+    struct CompactedNode
+    {
+        // Free memory, in bytes, in blocks too small to be reported, after the last compaction of the node. Lowered when
+        // the node's fragmentation goes down.
+        uint64_t Fragmentation = 0;
+
+        // Time of the last compaction of the node.
+        std::optional<std::chrono::steady_clock::time_point> Time;
+    };
+
+    std::map<int, CompactedNode> m_compactedNodes;
+};
@@ -1,5 +1,6 @@
 // Copyright (C) Microsoft Corporation. All rights reserved.
 
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
 #include <lxwil.h>
@@ -54,11 +55,30 @@ constexpr const char* c_routeLocalnetSetting = "route_localnet";
 constexpr char c_disableSetting[] = "0\n";
 constexpr char c_enableSetting[] = "1\n";
 
-NetworkManager::NetworkManager(RoutingTable& routingTable) :
-    routingTable(routingTable), loopbackRoutingTable(c_loopbackRoutingTableId), localRoutingTable(c_localRoutingTableId)
+NetworkManager::NetworkManager(RoutingTable& routingTable, NetlinkStateCache& netlinkState) :
+    routingTable(routingTable),
+    netlinkState(netlinkState),
+    loopbackRoutingTable(c_loopbackRoutingTableId, &netlinkState),
+    localRoutingTable(c_localRoutingTableId, &netlinkState)
 {
 }
 
+NetlinkStateCache& NetworkManager::NetlinkState()
+{
+    return netlinkState;
+}
+
+Interface NetworkManager::OpenInterface(const std::string& name)
+{
+    const auto index = netlinkState.GetInterfaceIndex(name);
+    if (!index.has_value())
+    {
+        throw RuntimeErrorWithSourceLocation(std::format("Interface {} not found", name));
+    }
+
+    return {index.value(), name};
+}
+
 std::optional<int> NetworkManager::FindRoutingTableIdForInterface(const Interface& interface) const
 {
     return c_routeTableOffsetFromIndex + interface.Index();
@@ -74,11 +94,16 @@ std::vector<Route> NetworkManager::ListRoutes(int family) const
     return routingTable.ListRoutes(family);
 }
 
+std::vector<NetlinkStateCache::AddressEntry> NetworkManager::ListAddresses(const Interface& interface, int family) const
+{
+    return netlinkState.ListAddresses(interface.Index(), family);
+}
+
 Interface NetworkManager::CreateVirtualWifiAdapter(Interface& baseAdapter, const std::string& wifiName)
 {
     GNS_LOG_INFO("Creating virtual wifi adapter with name {}", wifiName.c_str());
     baseAdapter.CreateVirtualWifiAdapter(wifiName);
-    auto virtualWifi = Interface::Open(wifiName);
+    auto virtualWifi = OpenInterface(wifiName);
 
     GNS_LOG_INFO("Enabling Ipv4 loopback routing on virtual wifi adapter with name {}", wifiName.c_str());
     EnableLoopbackRouting(virtualWifi);
@@ -88,7 +113,7 @@ Interface NetworkManager::CreateVirtualWifiAdapter(Interface& baseAdapter, const
 Interface NetworkManager::CreateProxyWifiAdapter(Interface& baseAdapter, const std::string& wifiName)
 {
     baseAdapter.CreateProxyWifiAdapter(wifiName);
-    auto proxyWifi = Interface::Open(wifiName);
+    auto proxyWifi = OpenInterface(wifiName);
 
     GNS_LOG_INFO("Enabling Ipv4 loopback routing on proxy wifi adapter with name {}", wifiName.c_str());
     EnableLoopbackRouting(proxyWifi);
@@ -117,6 +142,14 @@ void NetworkManager::SetAdapterConfiguration(Interface& interface, const wsl::sh
 
 void NetworkManager::SetInterfaceState(Interface& adapter, InterfaceState state)
 {
+    const auto flags = netlinkState.GetInterfaceFlags(adapter.Index());
+    if (flags.has_value() && WI_IsFlagSet(flags.value(), IFF_UP) == (state == InterfaceState::Up))
+    {
+        GNS_LOG_INFO(
+            "Interface state is already {} on interfaceName {}", state == InterfaceState::Up ? "Up" : "Down", adapter.Name());
+        return;
+    }
+
     GNS_LOG_INFO("Setting interface state to {} on interfaceName {}", state == InterfaceState::Up ? "Up" : "Down", adapter.Name().c_str());
     if (state == InterfaceState::Up)
     {
@@ -160,15 +193,27 @@ void NetworkManager::ResetRoutingTable(int addressFamily, const Interface& inter
 
     for (const auto& e : routes)
     {
-        const auto routeString = utils::Stringify(e);
-        try
-        {
-            GNS_LOG_INFO("Removing route {} from interfaceName {}", routeString, interface.Name());
-            routingTable.ModifyRoute(e, Operation::Remove);
-        }
-        catch (const std::exception& ex)
+        GNS_LOG_INFO("Removing route {} from interfaceName {}", utils::Stringify(e), interface.Name());
+    }
+
+    // Remove all the routes with a single netlink round trip
+    std::vector<int> errors;
+    try
+    {
+        errors = routingTable.ModifyRoutes(routes, Operation::Remove);
+    }
+    catch (const std::exception& ex)
+    {
+        throw RuntimeErrorWithSourceLocation(
+            std::format("Failed to remove routes from interfaceName {}, {}", interface.Name(), ex.what()));
+    }
+
+    for (size_t index = 0; index < routes.size(); index++)
+    {
+        if (errors[index] != 0)
         {
-            throw RuntimeErrorWithSourceLocation(std::format("Failed to remove route '{}', {}", routeString, ex.what()));
+            throw RuntimeErrorWithSourceLocation(std::format(
+                "Failed to remove route '{}', Netlink returned error: {}", utils::Stringify(routes[index]), errors[index]));
         }
     }
 }
@@ -187,32 +232,46 @@ void NetworkManager::ModifyAddress(Interface& adapter, const Address& address, O
 
     adapter.ModifyIpAddress(address, operation);
 
-    // Restore the routes for this interface.
+    std::erase_if(
+        routes, [&](const Route& savedRoute) { return savedRoute.dev != adapter.Index() || !savedRoute.via.has_value(); });
+    if (routes.empty())
+    {
+        return;
+    }
+
+    for (const auto& savedRoute : routes)
+    {
+        GNS_LOG_INFO(
+            "Restoring route {} after address change, on interfaceName {}",
+            utils::Stringify(savedRoute).c_str(),
+            adapter.Name().c_str());
+    }
+
+    // Restore the routes for this interface, with a single netlink round trip.
     // Note: If a route fails to be restored, it's probably because the new address's subnet is different,
     // and so the route would have been unusable with the new address anyway
-    for (const auto& savedRoute : routes)
+    try
     {
-        if (savedRoute.dev == adapter.Index() && savedRoute.via.has_value())
+        const auto errors = routingTable.ModifyRoutes(routes, Operation::Create);
+        for (size_t index = 0; index < routes.size(); index++)
         {
-            const auto savedRouteString = utils::Stringify(savedRoute);
-
-            try
-            {
-                GNS_LOG_INFO(
-                    "Restoring route {} after address change, on interfaceName {}", savedRouteString.c_str(), adapter.Name().c_str());
-                routingTable.ModifyRoute(savedRoute, Operation::Create);
-            }
-            catch (const std::exception& ex)
+            if (errors[index] != 0)
             {
                 GNS_LOG_ERROR(
-                    "Failed to restore route {} after address change, on interfaceName {}, caught exception "
-                    "{}",
-                    savedRouteString.c_str(),
+                    "Failed to restore route {} after address change, on interfaceName {}, netlink error {}",
+                    utils::Stringify(routes[index]).c_str(),
                     adapter.Name().c_str(),
-                    ex.what());
+                    errors[index]);
             }
         }
     }
+    catch (const std::exception& ex)
+    {
+        GNS_LOG_ERROR(
+            "Failed to restore routes after address change, on interfaceName {}, caught exception {}",
+            adapter.Name().c_str(),
+            ex.what());
+    }
 }
 
 void NetworkManager::SetAdapterMacAddress(Interface& interface, const MacAddress& address)
@@ -224,7 +283,7 @@ void NetworkManager::SetAdapterMacAddress(Interface& interface, const MacAddress
 
 void NetworkManager::DisassociateAdapterFromBond(const std::string& bondInterfaceName, Interface& interface)
 {
-    auto bondInterface = Interface::Open(bondInterfaceName);
+    auto bondInterface = OpenInterface(bondInterfaceName);
     GNS_LOG_INFO(
         "Trying to disassociate from bond - bondDeviceName {}, interfaceName {}", bondInterfaceName.c_str(), interface.Name().c_str());
     bondInterface.RemoveFromBond(interface);
@@ -234,7 +293,7 @@ void NetworkManager::DisassociateAdapterFromBond(const std::string& bondInterfac
 
 void NetworkManager::AssociateAdapterWithBond(const std::string& bondInterfaceName, Interface& interface)
 {
-    auto bondInterface = Interface::Open(bondInterfaceName);
+    auto bondInterface = OpenInterface(bondInterfaceName);
     // must set the interface down before associating it to bond
     SetInterfaceState(interface, InterfaceState::Down);
     bondInterface.AddToBond(interface);
@@ -245,14 +304,14 @@ void NetworkManager::AssociateAdapterWithBond(const std::string& bondInterfaceNa
 
 void NetworkManager::ActivateAdapterWithBond(const std::string& bondInterfaceName, const Interface& interface)
 {
-    auto bondInterface = Interface::Open(bondInterfaceName);
+    auto bondInterface = OpenInterface(bondInterfaceName);
     bondInterface.SetActiveChild(interface);
 }
 
 Interface NetworkManager::CreateBondAdapter(const std::string& name)
 {
     Interface::CreateBondAdapter(name);
-    auto bondInterface = Interface::Open(name);
+    auto bondInterface = OpenInterface(name);
 
     // Enable routing of IPv4 loopback on the bond interface.
     GNS_LOG_INFO("Enabling IPv4 loopback routing on bond adapter with name {}", name.c_str());
@@ -460,6 +519,19 @@ void NetworkManager::UpdateLoopbackRoute(Interface& interface, const Address& ad
     route.isLoopbackRoute = true;
 
     const auto routeString = utils::Stringify(route);
+
+    // The routes of the local table are mirrored, so checking whether the route is already present is cheap.
+    if (operation == Operation::Create)
+    {
+        const auto routes = localRoutingTable.ListRoutes(address.Family());
+        const auto matches = [&](const Route& e) { return e.dev == route.dev && e.to == route.to && e.via == route.via; };
+        if (std::ranges::any_of(routes, matches))
+        {
+            GNS_LOG_INFO("Loopback route {} is already present on interfaceName {}", routeString, interface.Name());
+            return;
+        }
+    }
+
     GNS_LOG_INFO(
         "{} loopback route {} on interfaceName {}",
         operation == Operation::Create ? "Add" : "Remove",
@@ -3,6 +3,7 @@
 #pragma once
 #include <Interface.h>
 #include <RoutingTable.h>
+#include <NetlinkStateCache.h>
 #include <IpRuleManager.h>
 #include <IpNeighborManager.h>
 #include <conncheckshared.h>
@@ -11,7 +12,11 @@
 class NetworkManager
 {
 public:
-    NetworkManager(RoutingTable& routingTable);
+    NetworkManager(RoutingTable& routingTable, NetlinkStateCache& netlinkState);
+
+    NetlinkStateCache& NetlinkState();
+
+    Interface OpenInterface(const std::string& name);
 
     Interface CreateVirtualWifiAdapter(Interface& baseAdapter, const std::string& wifiName);
 
@@ -39,6 +44,8 @@ public:
 
     std::vector<Route> ListRoutes(int family) const;
 
+    std::vector<NetlinkStateCache::AddressEntry> ListAddresses(const Interface& interface, int family) const;
+
     void ModifyRoute(const Route& route, Operation operation);
 
     void ModifyAddress(Interface& adapter, const Address& address, Operation operation);
@@ -83,6 +90,7 @@ private:
     void InitializeLoopbackConfigurationImpl(Interface& gelnic, int addressFamily);
 
     RoutingTable& routingTable;
+    NetlinkStateCache& netlinkState;
     // Custom routing tables used for loopback mirroring. Not to be confused with the Linux "local" table
     RoutingTable loopbackRoutingTable;
     RoutingTable localRoutingTable;
@@ -0,0 +1,150 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <grp.h>
+#include "SessionLauncher.h"
+#include "config.h"
+#include "util.h"
+
+constexpr const char* c_sourceFiles[] = {"/etc/passwd", "/etc/group", "/etc/nsswitch.conf", "/etc/default/locale"};
+
+void SessionLauncher::Refresh()
+{
+    auto stamps = GetFileStamps();
+    if (stamps != m_stamps)
+    {
+        m_uids.clear();
+        m_users.clear();
+        m_environment.reset();
+        m_stamps = std::move(stamps);
+    }
+}
+
+const passwd* SessionLauncher::GetUser(const char* name)
+{
+    if (const auto it = m_users.find(name); it != m_users.end())
+    {
+        return &it->second.Entry;
+    }
+
+    const auto* entry = getpwnam(name);
+    if (entry == nullptr)
+    {
+        return nullptr;
+    }
+
+    return &Insert(*entry)->Entry;
+}
+
+const passwd* SessionLauncher::GetUser(uid_t uid)
+{
+    if (const auto it = m_uids.find(uid); it != m_uids.end())
+    {
+        return &it->second->Entry;
+    }
+
+    const auto* entry = getpwuid(uid);
+    if (entry == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto* user = Insert(*entry);
+    m_uids.emplace(uid, user);
+    return &user->Entry;
+}
+
+std::vector<gid_t> SessionLauncher::GetGroups(const passwd& user)
+{
+    const auto it = m_users.find(user.pw_name);
+    if (it == m_users.end() || &it->second.Entry != &user)
+    {
+        return ReadGroups(user);
+    }
+
+    auto& entry = it->second;
+    if (!entry.Groups.has_value())
+    {
+        entry.Groups = ReadGroups(user);
+    }
+
+    return entry.Groups.value();
+}
+
+const std::vector<std::pair<std::string, std::string>>& SessionLauncher::GetEnvironment()
+{
+    if (!m_environment.has_value())
+    {
+        std::vector<std::pair<std::string, std::string>> environment;
+        for (const auto* name : {NAME_ENV, WSL_DISTRO_NAME_ENV})
+        {
+            auto value = UtilGetEnvironmentVariable(name);
+            if (!value.empty())
+            {
+                environment.emplace_back(name, std::move(value));
+            }
+        }
+
+        // N.B. Failure to read the language is non-fatal.
+        EnvironmentBlock language;
+        ConfigUpdateLanguage(language);
+        if (const auto value = language.GetVariable("LANG"); !value.empty())
+        {
+            environment.emplace_back("LANG", value);
+        }
+
+        m_environment = std::move(environment);
+    }
+
+    return m_environment.value();
+}
+
+SessionLauncher::User* SessionLauncher::Insert(const passwd& entry)
+{
+    // A name returned by getpwuid may already be known.
+    auto [it, inserted] = m_users.try_emplace(entry.pw_name);
+    auto& user = it->second;
+    if (inserted)
+    {
+        user.Name = entry.pw_name;
+        user.Directory = entry.pw_dir != nullptr ? entry.pw_dir : "";
+        user.Shell = entry.pw_shell != nullptr ? entry.pw_shell : "";
+        user.Entry.pw_name = user.Name.data();
+        user.Entry.pw_uid = entry.pw_uid;
+        user.Entry.pw_gid = entry.pw_gid;
+        user.Entry.pw_dir = user.Directory.data();
+        user.Entry.pw_shell = user.Shell.data();
+    }
+
+    return &user;
+}
+
+std::vector<gid_t> SessionLauncher::ReadGroups(const passwd& user)
+{
+    // N.B. getgrouplist is used instead of initgroups because the musl version of initgroups has a hard-coded 32 group max.
+    int count{};
+    getgrouplist(user.pw_name, user.pw_gid, nullptr, &count);
+    std::vector<gid_t> groups(count);
+    THROW_LAST_ERROR_IF(getgrouplist(user.pw_name, user.pw_gid, groups.data(), &count) < 0);
+
+    groups.resize(count);
+    return groups;
+}
+
+std::vector<SessionLauncher::FileStamp> SessionLauncher::GetFileStamps()
+{
+    std::vector<FileStamp> stamps;
+    for (const auto* path : c_sourceFiles)
+    {
+        struct stat status{};
+        if (stat(path, &status) < 0)
+        {
+            stamps.emplace_back();
+        }
+        else
+        {
+            stamps.emplace_back(std::make_tuple(status.st_ino, status.st_size, status.st_mtim.tv_sec, status.st_mtim.tv_nsec));
+        }
+    }
+
+    return stamps;
+}
@@ -0,0 +1,81 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <pwd.h>
+#include <sys/stat.h>
+#include "common.h"
+
+// The setup that the processes created by a session leader share.
+//
+// Every process created from wsl.exe needs the password entry of its user, the user's supplementary groups and the
+// base environment (NAME, WSL_DISTRO_NAME and LANG). Resolving them parses /etc/passwd, /etc/group and
+// /etc/default/locale (or queries the NSS modules) and queries the interop server. The session leader resolves them
+// before it forks, so its children inherit the result and only apply what differs between requests (command line,
+// current working directory, environment and standard handles).
+//
+// The entries are dropped when one of the files they are read from changes.
+class SessionLauncher
+{
+public:
+    SessionLauncher() = default;
+
+    SessionLauncher(const SessionLauncher&) = delete;
+    SessionLauncher(SessionLauncher&&) = delete;
+    SessionLauncher& operator=(const SessionLauncher&) = delete;
+    SessionLauncher& operator=(SessionLauncher&&) = delete;
+
+    // Drop the entries if one of the files they were read from changed since they were resolved.
+    void Refresh();
+
+    // Return the password entry of a user, or nullptr if the user doesn't exist. The entry stays valid until Refresh().
+    const passwd* GetUser(const char* name);
+
+    // Return the password entry of a uid, or nullptr if the uid doesn't exist. The entry stays valid until Refresh().
+    const passwd* GetUser(uid_t uid);
+
+    // Return the supplementary groups of a user. The groups of the users returned by GetUser() are cached.
+    std::vector<gid_t> GetGroups(const passwd& user);
+
+    // Return the environment variables that all processes start with.
+    const std::vector<std::pair<std::string, std::string>>& GetEnvironment();
+
+private:
+    struct User
+    {
+        std::string Name;
+        std::string Directory;
+        std::string Shell;
+
+        // Points to the strings above.
+        passwd Entry{};
+
+        std::optional<std::vector<gid_t>> Groups;
+    };
+
+    // Identity of a file, empty if the file doesn't exist.
+    using FileStamp = std::optional<std::tuple<ino_t, off_t, time_t, long>>;
+
+    // Add the entry returned by getpwnam or getpwuid.
+    User* Insert(const passwd& entry);
+
+    static std::vector<gid_t> ReadGroups(const passwd& user);
+
+    static std::vector<FileStamp> GetFileStamps();
+
+    // Users, indexed by name.
+    std::map<std::string, User> m_users;
+
+    // Users returned by getpwuid, indexed by uid. A uid may be shared by several names.
+    std::map<uid_t, User*> m_uids;
+
+    std::optional<std::vector<std::pair<std::string, std::string>>> m_environment;
+
+    std::vector<FileStamp> m_stamps;
+};
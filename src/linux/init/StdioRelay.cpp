@@ -0,0 +1,345 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include "StdioRelay.h"
+
+constexpr size_t c_spliceSize = 1024 * 1024;
+constexpr size_t c_bufferSize = 64 * 1024;
+constexpr int c_pipeSize = 1024 * 1024;
+constexpr int c_maxEvents = 16;
+
+namespace {
+
+bool IsPipe(int fd)
+{
+    struct stat status{};
+    return fstat(fd, &status) == 0 && S_ISFIFO(status.st_mode);
+}
+
+bool IsReadable(int fd)
+{
+    pollfd pollDescriptor{.fd = fd, .events = POLLIN, .revents = 0};
+    return poll(&pollDescriptor, 1, 0) > 0 && (pollDescriptor.revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+}
+
+void SetNonBlocking(int fd)
+{
+    const int flags = fcntl(fd, F_GETFL);
+    THROW_LAST_ERROR_IF(flags < 0);
+    THROW_LAST_ERROR_IF(fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0);
+}
+
+} // namespace
+
+StdioRelay::StdioRelay() : m_epoll(epoll_create1(EPOLL_CLOEXEC))
+{
+    THROW_LAST_ERROR_IF(!m_epoll);
+}
+
+StdioRelay::StreamId StdioRelay::AddStream(int source, int destination, EndRoutine onEnd)
+{
+    SetNonBlocking(source);
+    SetNonBlocking(destination);
+
+    // splice needs one of the file descriptors to be a pipe. A larger pipe moves more data per wakeup.
+    bool splice = false;
+    for (const int fd : {source, destination})
+    {
+        if (IsPipe(fd))
+        {
+            splice = true;
+            if (fcntl(fd, F_SETPIPE_SZ, c_pipeSize) < 0)
+            {
+                LOG_ERROR("fcntl(F_SETPIPE_SZ) failed {}", errno);
+            }
+        }
+    }
+
+    m_streams.emplace_back(Stream{.Source = source, .Destination = destination, .Splice = splice, .OnEnd = std::move(onEnd)});
+    Sync();
+    return m_streams.size() - 1;
+}
+
+void StdioRelay::RemoveStream(StreamId id)
+{
+    m_streams[id].Open = false;
+    m_streams[id].OnEnd = {};
+    Sync();
+}
+
+void StdioRelay::AddHandler(int fd, HandlerRoutine routine)
+{
+    m_handlers[fd] = std::move(routine);
+    Sync();
+}
+
+void StdioRelay::RemoveHandler(int fd)
+{
+    m_handlers.erase(fd);
+    Sync();
+}
+
+void StdioRelay::Flush(StreamId id)
+{
+    for (;;)
+    {
+        if (!m_streams[id].Open)
+        {
+            return;
+        }
+
+        if (m_streams[id].Blocked)
+        {
+            pollfd pollDescriptor{.fd = m_streams[id].Destination, .events = POLLOUT, .revents = 0};
+            if (poll(&pollDescriptor, 1, -1) < 0 && errno != EINTR)
+            {
+                THROW_LAST_ERROR();
+            }
+        }
+
+        if (!Pump(id) && m_streams[id].Open && !m_streams[id].Blocked)
+        {
+            Sync();
+            return;
+        }
+    }
+}
+
+void StdioRelay::Run()
+{
+    m_stop = false;
+
+    epoll_event events[c_maxEvents];
+    while (!m_stop)
+    {
+        Sync();
+        if (m_registered.empty())
+        {
+            return;
+        }
+
+        const int count = epoll_wait(m_epoll.get(), events, c_maxEvents, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            THROW_LAST_ERROR();
+        }
+
+        bool moved = false;
+        for (int index = 0; index < count && !m_stop; index += 1)
+        {
+            const int fd = events[index].data.fd;
+            for (StreamId id = 0; id < m_streams.size() && !m_stop; id += 1)
+            {
+                const auto& stream = m_streams[id];
+                if (stream.Open && ((!stream.Blocked && stream.Source == fd) || (stream.Blocked && stream.Destination == fd)))
+                {
+                    moved |= Pump(id);
+                }
+            }
+        }
+
+        // Handlers only run once the streams are idle. Their file descriptors are level-triggered, so they are reported
+        // again by the next epoll_wait.
+        if (moved)
+        {
+            continue;
+        }
+
+        for (int index = 0; index < count && !m_stop; index += 1)
+        {
+            const auto it = m_handlers.find(events[index].data.fd);
+            if (it == m_handlers.end())
+            {
+                continue;
+            }
+
+            // The handler may remove itself.
+            const auto routine = it->second;
+            if (!routine())
+            {
+                m_stop = true;
+            }
+        }
+    }
+}
+
+void StdioRelay::Stop()
+{
+    m_stop = true;
+}
+
+bool StdioRelay::Pump(StreamId id)
+{
+    if (!m_streams[id].Open)
+    {
+        return false;
+    }
+
+    return m_streams[id].Splice ? PumpSplice(id) : PumpBuffered(id);
+}
+
+bool StdioRelay::PumpBuffered(StreamId id)
+{
+    auto& stream = m_streams[id];
+    bool moved = false;
+    if (stream.Pending == 0)
+    {
+        stream.Buffer.resize(c_bufferSize);
+        const auto bytes = read(stream.Source, stream.Buffer.data(), stream.Buffer.size());
+        if (bytes == 0)
+        {
+            End(id, 0);
+            return false;
+        }
+        else if (bytes < 0)
+        {
+            if (errno != EAGAIN && errno != EINTR)
+            {
+                End(id, errno);
+            }
+
+            return false;
+        }
+
+        stream.Offset = 0;
+        stream.Pending = bytes;
+        moved = true;
+    }
+
+    const auto bytes = write(stream.Destination, stream.Buffer.data() + stream.Offset, stream.Pending);
+    if (bytes < 0)
+    {
+        if (errno == EAGAIN || errno == EINTR)
+        {
+            stream.Blocked = true;
+        }
+        else
+        {
+            End(id, errno);
+        }
+
+        return moved;
+    }
+
+    stream.Offset += bytes;
+    stream.Pending -= bytes;
+    stream.Blocked = stream.Pending > 0;
+    return true;
+}
+
+bool StdioRelay::PumpSplice(StreamId id)
+{
+    auto& stream = m_streams[id];
+    const auto bytes =
+        splice(stream.Source, nullptr, stream.Destination, nullptr, c_spliceSize, (SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+    if (bytes > 0)
+    {
+        stream.Blocked = false;
+        return true;
+    }
+    else if (bytes == 0)
+    {
+        End(id, 0);
+        return false;
+    }
+
+    switch (errno)
+    {
+    case EAGAIN:
+        // Either the source is empty or the destination is full.
+        stream.Blocked = IsReadable(stream.Source);
+        return false;
+
+    case EINTR:
+        return false;
+
+    case EINVAL:
+        // Not all file types support splice.
+        stream.Splice = false;
+        return PumpBuffered(id);
+
+    default:
+        End(id, errno);
+        return false;
+    }
+}
+
+void StdioRelay::End(StreamId id, int error)
+{
+    auto& stream = m_streams[id];
+    stream.Open = false;
+    stream.Buffer = {};
+    Sync();
+
+    // The end routine may add streams.
+    const auto onEnd = std::move(stream.OnEnd);
+    if (onEnd)
+    {
+        onEnd(error);
+    }
+}
+
+void StdioRelay::Sync()
+{
+    std::map<int, uint32_t> events;
+    for (const auto& stream : m_streams)
+    {
+        if (stream.Open)
+        {
+            if (stream.Blocked)
+            {
+                events[stream.Destination] |= EPOLLOUT;
+            }
+            else
+            {
+                events[stream.Source] |= EPOLLIN;
+            }
+        }
+    }
+
+    for (const auto& handler : m_handlers)
+    {
+        events[handler.first] |= EPOLLIN;
+    }
+
+    for (auto it = m_registered.begin(); it != m_registered.end();)
+    {
+        if (events.find(it->first) == events.end())
+        {
+            // The file descriptor may already be closed.
+            epoll_ctl(m_epoll.get(), EPOLL_CTL_DEL, it->first, nullptr);
+            it = m_registered.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (const auto& [fd, mask] : events)
+    {
+        epoll_event event{};
+        event.events = mask;
+        event.data.fd = fd;
+
+        const auto it = m_registered.find(fd);
+        if (it == m_registered.end())
+        {
+            THROW_LAST_ERROR_IF(epoll_ctl(m_epoll.get(), EPOLL_CTL_ADD, fd, &event) < 0);
+            m_registered.emplace(fd, mask);
+        }
+        else if (it->second != mask)
+        {
+            THROW_LAST_ERROR_IF(epoll_ctl(m_epoll.get(), EPOLL_CTL_MOD, fd, &event) < 0);
+            it->second = mask;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <vector>
+#include "common.h"
+
+// Relays data between file descriptors, and dispatches the other file descriptors a relay waits on, from a single epoll.
+//
+// A stream relays data from a source to a destination. When one of them is a pipe, the data is moved with splice and
+// never copied to user space. Otherwise (for example for a pseudoterminal), the data goes through a buffer. A stream
+// whose destination is full stops reading its source until the destination is writable again, so a slow reader only
+// stalls its own stream.
+//
+// Streams are serviced before handlers: handlers only run once no stream has data to move, so the output of a process is
+// relayed before its exit is processed.
+//
+// N.B. The relay sets O_NONBLOCK on the source and destination of the streams.
+class StdioRelay
+{
+public:
+    using StreamId = size_t;
+
+    // Called once when a stream ends. The error is 0 if the source reached end of file, otherwise the errno of the
+    // failure. The routine may close the source and destination of the stream.
+    using EndRoutine = std::function<void(int error)>;
+
+    // Called when a file descriptor is readable. Returns false to stop the relay.
+    using HandlerRoutine = std::function<bool()>;
+
+    StdioRelay();
+
+    StdioRelay(const StdioRelay&) = delete;
+    StdioRelay(StdioRelay&&) = delete;
+    StdioRelay& operator=(const StdioRelay&) = delete;
+    StdioRelay& operator=(StdioRelay&&) = delete;
+
+    // Add a stream.
+    //
+    // Arguments:
+    //    source - file descriptor to read from.
+    //    destination - file descriptor to write to.
+    //    onEnd - called when the stream ends.
+    //
+    // Return Value:
+    //    The id of the stream.
+    StreamId AddStream(int source, int destination, EndRoutine onEnd);
+
+    // Stop relaying a stream, without calling its end routine. Must be called before closing its file descriptors.
+    void RemoveStream(StreamId id);
+
+    // Call a routine when a file descriptor is readable.
+    void AddHandler(int fd, HandlerRoutine routine);
+
+    // Stop dispatching a file descriptor. Must be called before closing it.
+    void RemoveHandler(int fd);
+
+    // Relay the data that a stream's source has available, waiting for the destination to be writable if needed.
+    void Flush(StreamId id);
+
+    // Relay data and dispatch handlers until a handler returns false, Stop() is called or there is nothing left to wait on.
+    void Run();
+
+    // Make Run() return once the current handler or end routine returns.
+    void Stop();
+
+private:
+    struct Stream
+    {
+        int Source = -1;
+        int Destination = -1;
+
+        // True if the data is moved with splice, false if it goes through Buffer.
+        bool Splice = false;
+
+        bool Open = true;
+
+        // True while the destination is full. The stream then waits for the destination instead of the source.
+        bool Blocked = false;
+
+        std::vector<char> Buffer;
+        size_t Offset = 0;
+        size_t Pending = 0;
+
+        EndRoutine OnEnd;
+    };
+
+    // Move data from the source of a stream to its destination. Returns true if data was moved.
+    bool Pump(StreamId id);
+
+    bool PumpBuffered(StreamId id);
+
+    bool PumpSplice(StreamId id);
+
+    // Close a stream and call its end routine.
+    void End(StreamId id, int error);
+
+    // Update the epoll registrations to match what the streams and handlers wait on.
+    void Sync();
+
+    wil::unique_fd m_epoll;
+
+    std::vector<Stream> m_streams;
+
+    std::map<int, HandlerRoutine> m_handlers;
+
+    // Events registered in m_epoll, by file descriptor.
+    std::map<int, uint32_t> m_registered;
+
+    bool m_stop = false;
+};
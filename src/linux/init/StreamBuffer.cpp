@@ -0,0 +1,232 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <signal.h>
+#include <sys/eventfd.h>
+#include "StreamBuffer.h"
+
+constexpr size_t c_chunkSize = 1024 * 1024;
+
+StreamBuffer::StreamBuffer(int source, wil::unique_fd&& destination, size_t capacity) :
+    m_source(source), m_destination(std::move(destination)), m_capacity(capacity), m_wake(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    THROW_LAST_ERROR_IF(!m_wake);
+
+    const int flags = fcntl(m_destination.get(), F_GETFL);
+    THROW_LAST_ERROR_IF(flags < 0);
+    THROW_LAST_ERROR_IF(fcntl(m_destination.get(), F_SETFL, flags | O_NONBLOCK) < 0);
+
+    m_reader = std::thread(&StreamBuffer::Read, this);
+    try
+    {
+        m_writer = std::thread(&StreamBuffer::Write, this);
+    }
+    catch (...)
+    {
+        Stop();
+        throw;
+    }
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    Stop();
+}
+
+void StreamBuffer::Wait()
+{
+    std::unique_lock<std::mutex> lock{m_lock};
+    m_changed.wait(lock, [&]() { return m_done || m_stop; });
+}
+
+void StreamBuffer::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_lock};
+        m_stop = true;
+    }
+
+    eventfd_write(m_wake.get(), 1);
+    m_changed.notify_all();
+    for (auto* e : {&m_reader, &m_writer})
+    {
+        if (e->joinable())
+        {
+            e->join();
+        }
+    }
+}
+
+uint64_t StreamBuffer::BytesRead() const
+{
+    return m_bytesRead.load();
+}
+
+int StreamBuffer::Error()
+{
+    std::lock_guard<std::mutex> lock{m_lock};
+    return m_error;
+}
+
+void StreamBuffer::Read() noexcept
+try
+{
+    std::vector<char> buffer(c_chunkSize);
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock{m_lock};
+            m_changed.wait(lock, [&]() { return m_stop || m_buffered < m_capacity; });
+            if (m_stop)
+            {
+                return;
+            }
+        }
+
+        pollfd pollDescriptors[] = {
+            {.fd = m_source, .events = POLLIN, .revents = 0}, {.fd = m_wake.get(), .events = POLLIN, .revents = 0}};
+        if (poll(pollDescriptors, std::size(pollDescriptors), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            THROW_LAST_ERROR();
+        }
+
+        if (pollDescriptors[1].revents != 0)
+        {
+            return;
+        }
+
+        const auto bytes = read(m_source, buffer.data(), buffer.size());
+        if (bytes < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+
+            THROW_LAST_ERROR();
+        }
+
+        std::lock_guard<std::mutex> lock{m_lock};
+        if (bytes == 0)
+        {
+            m_endOfFile = true;
+            m_changed.notify_all();
+            return;
+        }
+
+        // Small reads are appended to the last chunk, so the memory used stays close to the bytes buffered.
+        // N.B. The writer removes a chunk from the queue before writing it.
+        if (m_chunks.empty() || m_chunks.back().size() + bytes > c_chunkSize)
+        {
+            m_chunks.emplace_back().reserve(c_chunkSize);
+        }
+
+        m_chunks.back().insert(m_chunks.back().end(), buffer.data(), buffer.data() + bytes);
+        m_buffered += bytes;
+        m_bytesRead += bytes;
+        m_changed.notify_all();
+    }
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+
+    std::lock_guard<std::mutex> lock{m_lock};
+    Fail(wil::ResultFromCaughtException());
+}
+
+void StreamBuffer::Write() noexcept
+try
+{
+    // If the process reading the destination exited, write fails with EPIPE instead of raising SIGPIPE.
+    sigset_t signals{};
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    THROW_ERRNO_IF(EINVAL, pthread_sigmask(SIG_BLOCK, &signals, nullptr) != 0);
+
+    for (;;)
+    {
+        std::vector<char> chunk;
+        {
+            std::unique_lock<std::mutex> lock{m_lock};
+            m_changed.wait(lock, [&]() { return m_stop || m_endOfFile || !m_chunks.empty(); });
+            if (m_stop)
+            {
+                return;
+            }
+            else if (m_chunks.empty())
+            {
+                m_destination.reset();
+                m_done = true;
+                m_changed.notify_all();
+                return;
+            }
+
+            chunk = std::move(m_chunks.front());
+            m_chunks.pop_front();
+        }
+
+        size_t offset = 0;
+        while (offset < chunk.size())
+        {
+            const auto bytes = write(m_destination.get(), chunk.data() + offset, chunk.size() - offset);
+            if (bytes >= 0)
+            {
+                offset += bytes;
+                continue;
+            }
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+            else if (errno == EPIPE)
+            {
+                // The process reading the destination exited. Its exit status reports why.
+                std::lock_guard<std::mutex> lock{m_lock};
+                Fail(EPIPE);
+                return;
+            }
+            else if (errno != EAGAIN)
+            {
+                THROW_LAST_ERROR();
+            }
+
+            pollfd pollDescriptors[] = {
+                {.fd = m_destination.get(), .events = POLLOUT, .revents = 0},
+                {.fd = m_wake.get(), .events = POLLIN, .revents = 0}};
+            if (poll(pollDescriptors, std::size(pollDescriptors), -1) < 0 && errno != EINTR)
+            {
+                THROW_LAST_ERROR();
+            }
+
+            if (pollDescriptors[1].revents != 0)
+            {
+                return;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock{m_lock};
+        m_buffered -= chunk.size();
+        m_changed.notify_all();
+    }
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+
+    std::lock_guard<std::mutex> lock{m_lock};
+    Fail(wil::ResultFromCaughtException());
+}
+
+void StreamBuffer::Fail(int error)
+{
+    m_error = error;
+    m_stop = true;
+    m_done = true;
+    eventfd_write(m_wake.get(), 1);
+    m_changed.notify_all();
+}
@@ -0,0 +1,80 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+// Copies a stream from one file descriptor to another through an in-memory buffer, with one thread reading and another
+// writing.
+//
+// The reader keeps draining the source while the writer waits for the destination (for example bsdtar waiting on the
+// disk, or decompressing), and the other way around, until the buffer is full.
+//
+// The destination is closed once the source reaches end of file and the buffer is written. If writing fails, the copy
+// stops. If the process reading the destination exits before the end of the stream, the copy fails with EPIPE.
+class StreamBuffer
+{
+public:
+    // Start copying.
+    //
+    // Arguments:
+    //    source - file descriptor to read from. Must stay open until the copy is stopped.
+    //    destination - file descriptor to write to.
+    //    capacity - maximum number of bytes buffered.
+    StreamBuffer(int source, wil::unique_fd&& destination, size_t capacity);
+
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer(StreamBuffer&&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(StreamBuffer&&) = delete;
+
+    // Wait for the copy to complete, fail, or be stopped.
+    void Wait();
+
+    // Stop the copy and wait for the threads to exit.
+    void Stop();
+
+    // Returns the number of bytes read from the source.
+    uint64_t BytesRead() const;
+
+    // Returns the errno of the failure that stopped the copy, or 0.
+    int Error();
+
+private:
+    void Read() noexcept;
+
+    void Write() noexcept;
+
+    // Stop both threads after a failure. Must be called with the lock held.
+    void Fail(int error);
+
+    int m_source = -1;
+    wil::unique_fd m_destination;
+    size_t m_capacity = 0;
+
+    // Wakes up the reader when the copy is stopped.
+    wil::unique_fd m_wake;
+
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+
+    std::deque<std::vector<char>> m_chunks;
+    size_t m_buffered = 0;
+    bool m_endOfFile = false;
+    bool m_done = false;
+    bool m_stop = false;
+    int m_error = 0;
+
+    std::atomic<uint64_t> m_bytesRead{0};
+
+    std::thread m_reader;
+    std::thread m_writer;
+};
@@ -0,0 +1,206 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <cassert>
+#include <format>
+#include <thread>
+#include "common.h"
+#include "util.h"
+#include "timeline.h"
+#include "TaskGraph.h"
+
+TaskGraph::TaskGraph(Name<c_maxGraphNameLength> name) : m_name(name.Value)
+{
+}
+
+TaskGraph::StepId TaskGraph::Add(Name<c_maxStepNameLength> name, std::vector<StepId> dependencies, Routine routine)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+
+    const StepId id = m_steps.size();
+    for (const auto dependency : dependencies)
+    {
+        assert(dependency < id);
+        m_steps[dependency].Dependents.emplace_back(id);
+    }
+
+    m_steps.emplace_back(Step{.Name = name.Value, .Dependencies = std::move(dependencies), .Body = std::move(routine)});
+
+    return id;
+}
+
+int TaskGraph::Run(size_t maxConcurrency)
+{
+    std::vector<std::thread> threads;
+
+    {
+        std::scoped_lock<std::mutex> lock{m_lock};
+        m_start = std::chrono::steady_clock::now();
+        m_pending = m_steps.size();
+        for (StepId id = 0; id < m_steps.size(); id += 1)
+        {
+            m_steps[id].RemainingDependencies = m_steps[id].Dependencies.size();
+            if (m_steps[id].RemainingDependencies == 0)
+            {
+                m_ready.emplace(id);
+            }
+        }
+
+        // The calling thread runs steps too.
+        m_threads = std::max(std::min(maxConcurrency, m_steps.size()), static_cast<size_t>(1));
+    }
+
+    for (size_t index = 1; index < m_threads; index += 1)
+    {
+        try
+        {
+            threads.emplace_back([this]() {
+                UtilSetThreadName(m_name.c_str());
+                Worker();
+            });
+        }
+        CATCH_LOG()
+    }
+
+    Worker();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::scoped_lock<std::mutex> lock{m_lock};
+    m_end = std::chrono::steady_clock::now();
+    for (const auto& step : m_steps)
+    {
+        if (step.Outcome != State::Succeeded)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+std::string TaskGraph::Dump()
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+
+    auto milliseconds = [](auto duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+
+    std::string output = std::format(
+        "{}: {} steps on {} threads in {:.1f}ms", m_name, m_steps.size(), m_threads, milliseconds(m_end - m_start));
+
+    for (const auto& step : m_steps)
+    {
+        output += std::format("\n    {}: {}", step.Name, StateName(step.Outcome));
+        if (step.Outcome == State::Succeeded || step.Outcome == State::Failed)
+        {
+            output += std::format(
+                ", started at {:.1f}ms, took {:.1f}ms", milliseconds(step.Start - m_start), milliseconds(step.End - step.Start));
+        }
+
+        if (!step.Dependencies.empty())
+        {
+            output += ", after ";
+            for (size_t index = 0; index < step.Dependencies.size(); index += 1)
+            {
+                output += std::format("{}{}", index > 0 ? ", " : "", m_steps[step.Dependencies[index]].Name);
+            }
+        }
+    }
+
+    return output;
+}
+
+void TaskGraph::Worker() noexcept
+{
+    std::unique_lock<std::mutex> lock{m_lock};
+    for (;;)
+    {
+        m_stepsChanged.wait(lock, [this]() { return !m_ready.empty() || m_pending == 0; });
+        if (m_ready.empty())
+        {
+            return;
+        }
+
+        const StepId id = *m_ready.begin();
+        m_ready.erase(m_ready.begin());
+
+        // Steps are never added while the graph runs, so the step can be accessed without holding the lock.
+        auto& step = m_steps[id];
+        step.Outcome = State::Running;
+        step.Start = std::chrono::steady_clock::now();
+        lock.unlock();
+
+        int result = -1;
+        try
+        {
+            result = step.Body();
+            if (result >= 0)
+            {
+                TimelineMark(std::format("{}: {}", m_name, step.Name).c_str());
+            }
+        }
+        CATCH_LOG()
+
+        lock.lock();
+        step.End = std::chrono::steady_clock::now();
+        if (result < 0)
+        {
+            LOG_ERROR("{}: step '{}' failed", m_name, step.Name);
+        }
+
+        Complete(id, result < 0 ? State::Failed : State::Succeeded);
+    }
+}
+
+void TaskGraph::Complete(StepId id, State state)
+{
+    auto& step = m_steps[id];
+    step.Outcome = state;
+    m_pending -= 1;
+
+    for (const auto dependent : step.Dependents)
+    {
+        auto& next = m_steps[dependent];
+        if (next.Outcome != State::Pending)
+        {
+            continue;
+        }
+
+        if (state != State::Succeeded)
+        {
+            Complete(dependent, State::Skipped);
+        }
+        else if (--next.RemainingDependencies == 0)
+        {
+            m_ready.emplace(dependent);
+        }
+    }
+
+    m_stepsChanged.notify_all();
+}
+
+const char* TaskGraph::StateName(State state)
+{
+    switch (state)
+    {
+    case State::Pending:
+        return "pending";
+
+    case State::Running:
+        return "running";
+
+    case State::Succeeded:
+        return "succeeded";
+
+    case State::Failed:
+        return "failed";
+
+    case State::Skipped:
+        return "skipped";
+
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,128 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "timeline.h"
+
+// Runs a set of steps that declare which other steps they depend on.
+//
+// A step starts as soon as all of its dependencies succeeded, so independent steps run concurrently on a bounded number
+// of threads. Steps that depend on a failed step are skipped. The graph and the timing of each step can be dumped once the
+// steps have run.
+//
+// N.B. Steps share the process state (root directory, current directory, signal dispositions). A step that changes it
+//      must be a dependency of every step that relies on it.
+class TaskGraph
+{
+public:
+    using StepId = size_t;
+
+    // Routine of a step. Returns < 0 on failure. Exceptions are logged and treated as failures.
+    using Routine = std::function<int()>;
+
+    // Each completed step is recorded in the timeline as "<graph>: <step>", which must fit in a timeline phase.
+    static constexpr size_t c_maxGraphNameLength = 16;
+    static constexpr size_t c_maxStepNameLength = TIMELINE_MAX_PHASE_LENGTH - 1 - c_maxGraphNameLength - 2;
+
+    // A string literal whose length is checked at compile time.
+    template <size_t MaxLength>
+    struct Name
+    {
+        template <size_t Size>
+        consteval Name(const char (&value)[Size]) : Value(value)
+        {
+            static_assert(Size - 1 <= MaxLength, "Name too long for the timeline");
+        }
+
+        const char* Value;
+    };
+
+    TaskGraph(Name<c_maxGraphNameLength> name);
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph(TaskGraph&&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+    TaskGraph& operator=(TaskGraph&&) = delete;
+
+    // Add a step.
+    //
+    // Arguments:
+    //    name - name of the step.
+    //    dependencies - steps that must succeed before this step runs. They must have been added before this step.
+    //    routine - routine of the step.
+    //
+    // Return Value:
+    //    The id of the step.
+    StepId Add(Name<c_maxStepNameLength> name, std::vector<StepId> dependencies, Routine routine);
+
+    // Run the steps and wait for them to complete.
+    //
+    // Arguments:
+    //    maxConcurrency - maximum number of steps running at the same time, including the step run by the calling thread.
+    //
+    // Return Value:
+    //    0 if all steps succeeded, -1 otherwise.
+    int Run(size_t maxConcurrency);
+
+    // Describe the graph and the outcome and timing of each step, one step per line.
+    std::string Dump();
+
+private:
+    enum class State
+    {
+        Pending,
+        Running,
+        Succeeded,
+        Failed,
+        Skipped
+    };
+
+    struct Step
+    {
+        std::string Name;
+        std::vector<StepId> Dependencies;
+        std::vector<StepId> Dependents;
+        size_t RemainingDependencies = 0;
+        Routine Body;
+        State Outcome = State::Pending;
+        std::chrono::steady_clock::time_point Start{};
+        std::chrono::steady_clock::time_point End{};
+    };
+
+    // Run ready steps until all steps completed.
+    void Worker() noexcept;
+
+    // Record the outcome of a step and release or skip its dependents. Requires m_lock.
+    void Complete(StepId id, State state);
+
+    static const char* StateName(State state);
+
+    std::string m_name;
+
+    std::mutex m_lock;
+
+    // Notified when a step becomes ready, and when all steps completed.
+    std::condition_variable m_stepsChanged;
+
+    // _Guarded_by_(m_lock)
+    std::vector<Step> m_steps;
+
+    // Steps whose dependencies all succeeded, run in the order they were added.
+    // _Guarded_by_(m_lock)
+    std::set<StepId> m_ready;
+
+    // Number of steps that didn't complete yet.
+    // _Guarded_by_(m_lock)
+    size_t m_pending = 0;
+
+    size_t m_threads = 0;
+    std::chrono::steady_clock::time_point m_start{};
+    std::chrono::steady_clock::time_point m_end{};
+};
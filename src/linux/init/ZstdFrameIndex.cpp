@@ -0,0 +1,196 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#include <algorithm>
+#include "ZstdFrameIndex.h"
+
+constexpr uint32_t c_frameMagic = 0xFD2FB528;
+constexpr uint32_t c_skippableFrameMagic = 0x184D2A50;
+constexpr uint32_t c_skippableFrameMagicMask = 0xFFFFFFF0;
+constexpr uint32_t c_indexFrameMagic = 0x184D2A5E;
+constexpr uint32_t c_indexMagic = 0x58444957;
+
+size_t ZstdFrameIndex::Append(gsl::span<const char> buffer)
+{
+    size_t offset = 0;
+    while (offset < buffer.size())
+    {
+        // No frame starts with a zero byte, so the padding starts at the first zero found instead of a frame.
+        if (m_state == State::Magic && m_skip == 0 && m_header.empty() && buffer[offset] == 0)
+        {
+            m_state = State::Padding;
+        }
+
+        if (m_state == State::Padding)
+        {
+            THROW_ERRNO_IF(EINVAL, std::any_of(buffer.begin() + offset, buffer.end(), [](char e) { return e != 0; }));
+            return offset;
+        }
+
+        size_t bytes = 0;
+        if (m_skip > 0)
+        {
+            bytes = static_cast<size_t>(std::min<uint64_t>(m_skip, buffer.size() - offset));
+            m_skip -= bytes;
+        }
+        else
+        {
+            bytes = std::min(m_headerSize - m_header.size(), buffer.size() - offset);
+            m_header.insert(m_header.end(), buffer.begin() + offset, buffer.begin() + offset + bytes);
+        }
+
+        offset += bytes;
+        m_position += bytes;
+        if (m_skip == 0 && m_header.size() == m_headerSize)
+        {
+            ParseHeader();
+        }
+    }
+
+    return offset;
+}
+
+std::vector<char> ZstdFrameIndex::Serialize() const
+{
+    THROW_ERRNO_IF(EINVAL, (m_state != State::Magic && m_state != State::Padding) || !m_header.empty() || m_skip != 0);
+
+    std::vector<char> index;
+    auto write = [&index](uint64_t value, size_t size) {
+        for (size_t byte = 0; byte < size; byte += 1)
+        {
+            index.emplace_back(static_cast<char>(value >> (byte * 8)));
+        }
+    };
+
+    write(c_indexFrameMagic, sizeof(uint32_t));
+    write((m_frames.size() * sizeof(uint64_t)) + (2 * sizeof(uint32_t)), sizeof(uint32_t));
+    for (const auto e : m_frames)
+    {
+        write(e, sizeof(uint64_t));
+    }
+
+    write(m_frames.size(), sizeof(uint32_t));
+    write(c_indexMagic, sizeof(uint32_t));
+    return index;
+}
+
+const std::vector<uint64_t>& ZstdFrameIndex::Frames() const
+{
+    return m_frames;
+}
+
+std::vector<uint64_t> ZstdFrameIndex::Read(gsl::span<const char> buffer)
+{
+    auto read = [&buffer](size_t offset, size_t size) {
+        uint64_t value = 0;
+        for (size_t byte = 0; byte < size; byte += 1)
+        {
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(buffer[offset + byte])) << (byte * 8);
+        }
+
+        return value;
+    };
+
+    // The index frame starts with the skippable frame magic and size, and ends with the number of frames and the index magic.
+    constexpr size_t headerSize = 2 * sizeof(uint32_t);
+    constexpr size_t footerSize = 2 * sizeof(uint32_t);
+    if (buffer.size() < footerSize || read(buffer.size() - sizeof(uint32_t), sizeof(uint32_t)) != c_indexMagic)
+    {
+        return {};
+    }
+
+    const uint64_t count = read(buffer.size() - footerSize, sizeof(uint32_t));
+    const uint64_t frameSize = (count * sizeof(uint64_t)) + footerSize;
+    THROW_ERRNO_IF(EINVAL, buffer.size() < headerSize + frameSize);
+
+    const size_t start = buffer.size() - frameSize - headerSize;
+    THROW_ERRNO_IF(EINVAL, read(start, sizeof(uint32_t)) != c_indexFrameMagic);
+    THROW_ERRNO_IF(EINVAL, read(start + sizeof(uint32_t), sizeof(uint32_t)) != frameSize);
+
+    // Frames are indexed in the order they were found, so the offsets increase.
+    std::vector<uint64_t> frames;
+    for (size_t offset = start + headerSize; offset < buffer.size() - footerSize; offset += sizeof(uint64_t))
+    {
+        const auto frame = read(offset, sizeof(uint64_t));
+        THROW_ERRNO_IF(EINVAL, !frames.empty() && frame <= frames.back());
+        frames.emplace_back(frame);
+    }
+
+    return frames;
+}
+
+void ZstdFrameIndex::ParseHeader()
+{
+    uint32_t value = 0;
+    for (size_t byte = 0; byte < m_header.size() && byte < sizeof(value); byte += 1)
+    {
+        value |= static_cast<uint32_t>(m_header[byte]) << (byte * 8);
+    }
+
+    switch (m_state)
+    {
+    case State::Magic:
+        if (value == c_frameMagic)
+        {
+            m_frames.emplace_back(m_position - m_header.size());
+            m_state = State::FrameHeaderDescriptor;
+            m_headerSize = 1;
+        }
+        else if ((value & c_skippableFrameMagicMask) == c_skippableFrameMagic)
+        {
+            m_state = State::SkippableFrameSize;
+            m_headerSize = 4;
+        }
+        else
+        {
+            THROW_ERRNO(EINVAL);
+        }
+
+        break;
+
+    case State::FrameHeaderDescriptor:
+    {
+        // Skip the rest of the frame header: window descriptor, dictionary ID and frame content size.
+        const unsigned int contentSizeFlag = value >> 6;
+        const bool singleSegment = (value & 0x20) != 0;
+        const unsigned int dictionaryIdFlag = value & 0x3;
+        THROW_ERRNO_IF(EINVAL, (value & 0x8) != 0);
+
+        constexpr unsigned int dictionaryIdSizes[] = {0, 1, 2, 4};
+        m_skip = (singleSegment ? 0 : 1) + dictionaryIdSizes[dictionaryIdFlag];
+        m_skip += contentSizeFlag == 0 ? (singleSegment ? 1 : 0) : (1 << contentSizeFlag);
+        m_checksum = (value & 0x4) != 0;
+        m_state = State::BlockHeader;
+        m_headerSize = 3;
+        break;
+    }
+
+    case State::BlockHeader:
+    {
+        // RLE blocks store a single byte, whatever their decompressed size. Type 3 is reserved.
+        const bool lastBlock = (value & 0x1) != 0;
+        const unsigned int type = (value >> 1) & 0x3;
+        THROW_ERRNO_IF(EINVAL, type == 3);
+
+        m_skip = type == 1 ? 1 : (value >> 3);
+        if (lastBlock)
+        {
+            m_skip += m_checksum ? 4 : 0;
+            m_state = State::Magic;
+            m_headerSize = 4;
+        }
+
+        break;
+    }
+
+    case State::SkippableFrameSize:
+        m_skip = value;
+        m_state = State::Magic;
+        m_headerSize = 4;
+        break;
+
+    default:
+        THROW_ERRNO(EINVAL);
+    }
+
+    m_header.clear();
+}
@@ -0,0 +1,69 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <vector>
+#include "common.h"
+
+// Finds the frames of a zstd stream from their headers, without decompressing them, so that an index of the frames can
+// be appended to the stream.
+//
+// The index is a skippable frame, which zstd decompressors ignore:
+//
+//    Magic_Number      4 bytes, 0x184D2A5E
+//    Frame_Size        4 bytes
+//    Frame_Offset      8 bytes for each frame: offset of the frame from the start of the stream
+//    Number_Of_Frames  4 bytes
+//    Index_Magic       4 bytes, 0x58444957 ("WIDX")
+//
+// All values are little endian. A reader finds the index from the last 8 bytes of the stream (see Read()), and can then
+// decompress any frame on its own. When bsdtar starts the frames at file boundaries, a file can be extracted from the
+// archive by only decompressing the frames that contain its header and its data.
+class ZstdFrameIndex
+{
+public:
+    // Parse the next bytes of the stream. Throws EINVAL if they aren't a zstd stream.
+    //
+    // bsdtar pads the last block of the archive with zeros, which zstd decompressors (including libarchive's) fail on.
+    // Returns the number of bytes before the padding, which is the size of the buffer until the padding starts.
+    size_t Append(gsl::span<const char> buffer);
+
+    // Returns the index frame. Throws EINVAL if the stream ends in the middle of a frame.
+    std::vector<char> Serialize() const;
+
+    // Returns the offsets of the frames found so far.
+    const std::vector<uint64_t>& Frames() const;
+
+    // Read the index at the end of a stream. The buffer holds the end of the stream, which must include the whole index
+    // frame: 16 bytes, plus 8 bytes for each frame in the count found in the last 8 bytes.
+    //
+    // Returns the offsets of the frames, or an empty vector if the stream doesn't end with an index. Throws EINVAL if the
+    // index is malformed or truncated.
+    static std::vector<uint64_t> Read(gsl::span<const char> buffer);
+
+private:
+    enum class State
+    {
+        Magic,
+        FrameHeaderDescriptor,
+        BlockHeader,
+        SkippableFrameSize,
+        Padding
+    };
+
+    // Parse a complete header, and determine the bytes to skip and the next header to read.
+    void ParseHeader();
+
+    State m_state = State::Magic;
+
+    // Bytes of the current header, and the size of the header.
+    std::vector<uint8_t> m_header;
+    size_t m_headerSize = 4;
+
+    // Bytes to skip before the next header.
+    uint64_t m_skip = 0;
+
+    bool m_checksum = false;
+    uint64_t m_position = 0;
+    std::vector<uint64_t> m_frames;
+};
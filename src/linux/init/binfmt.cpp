@@ -12,6 +12,7 @@ Abstract:
 
 --*/
 
+#include <algorithm>
 #include <lxbusapi.h>
 #include <sys/signalfd.h>
 #include <pty.h>
@@ -37,6 +38,8 @@ locale_t g_Locale;
 
 void CreateNtProcessConfigureConsole(PLX_INIT_CREATE_NT_PROCESS_COMMON Common);
 
+bool CreateNtProcessControlMessage(gsl::span<gsl::byte> Message, const char* Name, int* ExitCode, bool* Exited);
+
 std::vector<gsl::byte> CreateNtProcessMessage(LX_MESSAGE_TYPE MessageType, int Argc, char* Argv[]);
 
 int CreateNtProcessUtilityVm(int Argc, char* Argv[]);
@@ -47,7 +50,7 @@ bool HasOpenFileDescriptors(struct pollfd* PollDescriptors, int PollDescriptorSi
 
 void RestoreConsoleState(void);
 
-void WindowSizeChanged(int SignalChannelFd);
+void WindowSizeChanged(int SignalChannelFd, bool Multiplexed = false);
 
 int CreateNtProcess(int Argc, char* Argv[])
 
@@ -159,6 +162,7 @@ try
     auto Span = gsl::make_span(Buffer);
     auto* Message = gslhelpers::get_struct<LX_INIT_CREATE_NT_PROCESS_UTILITY_VM>(Span);
     Message->Port = SocketAddress.svm_port;
+    Message->Flags = LX_INIT_CREATE_NT_PROCESS_FLAG_MULTIPLEXED;
 
     //
     // Establish a connection to the interop server.
@@ -177,10 +181,23 @@ try
     channel.SendMessage<LX_INIT_CREATE_NT_PROCESS_UTILITY_VM>(Span);
 
     //
-    // Accept connections from the interop server.
+    // Accept connections from the interop server. A server that supports
+    // multiplexing connects once and immediately sends its stdin window on
+    // that connection; otherwise it connects the remaining sockets.
     //
 
-    for (int Index = 0; Index < COUNT_OF(Sockets); Index += 1)
+    Sockets[0] = UtilAcceptVsock(ListenSocket.get(), SocketAddress, ACCEPT_TIMEOUT);
+    if (!Sockets[0])
+    {
+        return ExitCode;
+    }
+
+    pollfd NegotiateDescriptors[] = {{ListenSocket.get(), POLLIN}, {Sockets[0].get(), POLLIN}};
+    int Result = TEMP_FAILURE_RETRY(poll(NegotiateDescriptors, COUNT_OF(NegotiateDescriptors), ACCEPT_TIMEOUT));
+    const bool Multiplexed =
+        (Result > 0) && ((NegotiateDescriptors[0].revents & POLLIN) == 0) && ((NegotiateDescriptors[1].revents & POLLIN) != 0);
+
+    for (int Index = 1; !Multiplexed && Index < COUNT_OF(Sockets); Index += 1)
     {
         Sockets[Index] = UtilAcceptVsock(ListenSocket.get(), SocketAddress, ACCEPT_TIMEOUT);
         if (!Sockets[Index])
@@ -203,7 +220,7 @@ try
     sigemptyset(&SignalMask);
     sigaddset(&SignalMask, SIGWINCH);
     sigaddset(&SignalMask, SIGINT);
-    int Result = sigprocmask(SIG_BLOCK, &SignalMask, NULL);
+    Result = sigprocmask(SIG_BLOCK, &SignalMask, NULL);
     if (Result < 0)
     {
         LOG_STDERR("sigprocmask failed %d", errno);
@@ -217,6 +234,11 @@ try
         return ExitCode;
     }
 
+    if (Multiplexed)
+    {
+        return CreateNtProcessRelayMultiplexed(Sockets[0].get(), 0, 1, 2, SignalFd.get(), Argv[0]);
+    }
+
     //
     // Fill output and poll file descriptors.
     //
@@ -284,59 +306,15 @@ try
                 continue;
             }
 
-            auto* Header = gslhelpers::get_struct<MESSAGE_HEADER>(PollMessage);
-            if (Header->MessageType == LxInitMessageCreateProcessResponse)
+            bool Exited = false;
+            if (!CreateNtProcessControlMessage(PollMessage, Argv[0], &ExitCode, &Exited))
             {
-                //
-                // Verify the process launch request was successful.
-                //
-
-                auto* Response = gslhelpers::try_get_struct<LX_INIT_CREATE_PROCESS_RESPONSE>(PollMessage);
-                if (!Response)
-                {
-                    LOG_STDERR("Invalid message size %zd", PollMessage.size());
-                    break;
-                }
-
-                if (Response->Result != 0)
-                {
-                    errno = Response->Result;
-                    LOG_STDERR("%s", Argv[0]);
-                    break;
-                }
-
-                //
-                // If the application was a GUI application and stdin is a console, restore
-                // the terminal mode. This allows ctrl-c and ctrl-z to function for
-                // graphical apps.
-                //
-
-                if ((Response->Flags & LX_INIT_CREATE_PROCESS_RESULT_FLAG_GUI_APPLICATION) != 0)
-                {
-                    RestoreConsoleState();
-                }
+                break;
             }
-            else if (Header->MessageType == LxInitMessageExitStatus)
-            {
-                //
-                // Set the process exit code and go through the relay loop until
-                // all data has been flushed.
-                //
 
-                auto* ExitStatus = gslhelpers::try_get_struct<LX_INIT_PROCESS_EXIT_STATUS>(PollMessage);
-                if (!ExitStatus)
-                {
-                    LOG_STDERR("Invalid message size %zd", PollMessage.size());
-                    break;
-                }
-
-                ExitCode = ExitStatus->ExitCode;
-                PollDescriptors[3].fd = -1;
-            }
-            else
+            if (Exited)
             {
-                LOG_STDERR("Unexpected message %d", Header->MessageType);
-                break;
+                PollDescriptors[3].fd = -1;
             }
         }
 
@@ -398,6 +376,418 @@ try
 }
 CATCH_RETURN_ERRNO()
 
+int CreateNtProcessRelayMultiplexed(int Socket, int InputFd, int OutputFd, int ErrorFd, int SignalFd, const char* Name)
+
+/*++
+
+Routine Description:
+
+    This routine relays stdin, stdout, stderr and the control channel of an NT
+    process over a single multiplexed interop connection.
+
+Arguments:
+
+    Socket - Supplies the connection to the interop server.
+
+    InputFd - Supplies the file descriptor to relay to the stdin of the
+        process.
+
+    OutputFd - Supplies the file descriptor to relay the stdout of the process
+        to.
+
+    ErrorFd - Supplies the file descriptor to relay the stderr of the process
+        to.
+
+    SignalFd - Supplies a signalfd for SIGWINCH and SIGINT, or -1.
+
+    Name - Supplies the name of the process, used in error messages.
+
+Return Value:
+
+    The exit code of the launched process on success, 1 on failure.
+
+--*/
+try
+{
+    int ExitCode = 1;
+    constexpr auto HeaderSize = sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER);
+
+    //
+    // Frames are sent from a single buffer; the data of a data frame is
+    // written after the header by the caller.
+    //
+
+    bool Connected = true;
+    std::vector<gsl::byte> SendBuffer(HeaderSize + LX_INIT_MULTIPLEXED_MAX_FRAME_DATA);
+    std::vector<gsl::byte> ReceiveBuffer;
+    auto SendFrame = [&](LX_INIT_MULTIPLEXED_FRAME_TYPE Type, LX_INIT_MULTIPLEXED_STREAM Stream, size_t Size) {
+        if (!Connected)
+        {
+            return;
+        }
+
+        auto* Header = gslhelpers::get_struct<LX_INIT_MULTIPLEXED_FRAME_HEADER>(gsl::make_span(SendBuffer));
+        *Header = {};
+        Header->Type = Type;
+        Header->Stream = Stream;
+        Header->Size = gsl::narrow_cast<uint32_t>(Size);
+        const auto FrameSize = HeaderSize + ((Type == LxInitMultiplexedFrameData) ? Size : 0);
+        THROW_LAST_ERROR_IF(UtilWriteBuffer(Socket, SendBuffer.data(), FrameSize) < 0);
+    };
+
+    //
+    // Stdout and stderr are written without blocking, so a slow reader of one
+    // stream doesn't stall the other streams, stdin or signals. The data that
+    // couldn't be written yet is queued per stream. The server can't send more
+    // than the window granted for the stream, and credit is only returned once
+    // the data was written, so a queue never grows beyond the window.
+    //
+    // N.B. The file status flags are shared with the other processes using
+    //      the same open file description, so they are restored on exit.
+    //
+
+    struct OutputStream
+    {
+        LX_INIT_MULTIPLEXED_STREAM Stream;
+        int Fd;
+        bool Open = true;
+        std::vector<gsl::byte> Pending{};
+        size_t Offset = 0;
+    };
+
+    OutputStream Outputs[] = {{LxInitMultiplexedStreamStdOut, OutputFd}, {LxInitMultiplexedStreamStdErr, ErrorFd}};
+    std::vector<std::pair<int, int>> RestoreFlags;
+    auto RestoreFlagsOnExit = wil::scope_exit([&]() {
+        for (const auto& [Fd, Flags] : RestoreFlags)
+        {
+            fcntl(Fd, F_SETFL, Flags);
+        }
+    });
+
+    for (const auto& Output : Outputs)
+    {
+        const int Flags = fcntl(Output.Fd, F_GETFL);
+        THROW_LAST_ERROR_IF(Flags < 0);
+        if ((Flags & O_NONBLOCK) == 0)
+        {
+            THROW_LAST_ERROR_IF(fcntl(Output.Fd, F_SETFL, Flags | O_NONBLOCK) < 0);
+            RestoreFlags.emplace_back(Output.Fd, Flags);
+        }
+    }
+
+    auto FlushOutput = [&](OutputStream& Output) {
+        size_t BytesWritten = 0;
+        while (Output.Offset < Output.Pending.size())
+        {
+            const auto Result =
+                TEMP_FAILURE_RETRY(write(Output.Fd, Output.Pending.data() + Output.Offset, Output.Pending.size() - Output.Offset));
+            if (Result < 0)
+            {
+                if (errno == EAGAIN)
+                {
+                    break;
+                }
+
+                //
+                // The destination can't be written anymore; drop the data so
+                // the server isn't left without credit.
+                //
+
+                LOG_STDERR("write failed %d", errno);
+                BytesWritten += Output.Pending.size() - Output.Offset;
+                Output.Offset = Output.Pending.size();
+                break;
+            }
+
+            Output.Offset += Result;
+            BytesWritten += Result;
+        }
+
+        if (Output.Offset == Output.Pending.size())
+        {
+            Output.Pending.clear();
+            Output.Offset = 0;
+        }
+
+        if (BytesWritten > 0)
+        {
+            SendFrame(LxInitMultiplexedFrameWindow, Output.Stream, BytesWritten);
+        }
+    };
+
+    auto OutputPending = [&]() {
+        return std::ranges::any_of(Outputs, [](const auto& Output) { return !Output.Pending.empty(); });
+    };
+
+    //
+    // Grant the initial stdout and stderr windows to the server.
+    //
+
+    SendFrame(LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdOut, LX_INIT_MULTIPLEXED_WINDOW);
+    SendFrame(LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdErr, LX_INIT_MULTIPLEXED_WINDOW);
+
+    size_t InputWindow = 0;
+    bool InputOpen = true;
+    bool ControlOpen = true;
+    auto CloseInput = [&]() {
+        if (InputOpen)
+        {
+            InputOpen = false;
+            SendFrame(LxInitMultiplexedFrameClose, LxInitMultiplexedStreamStdIn, 0);
+        }
+    };
+
+    pollfd PollDescriptors[] = {{InputFd, POLLIN}, {Socket, POLLIN}, {SignalFd, POLLIN}, {-1, POLLOUT}, {-1, POLLOUT}};
+    while (ControlOpen || Outputs[0].Open || Outputs[1].Open || OutputPending())
+    {
+        //
+        // Only read stdin while the server has room for it, and only wait for
+        // stdout and stderr to be writable while data is queued for them.
+        //
+
+        PollDescriptors[0].fd = (InputOpen && InputWindow > 0) ? InputFd : -1;
+        PollDescriptors[3].fd = Outputs[0].Pending.empty() ? -1 : Outputs[0].Fd;
+        PollDescriptors[4].fd = Outputs[1].Pending.empty() ? -1 : Outputs[1].Fd;
+        int Result = poll(PollDescriptors, COUNT_OF(PollDescriptors), -1);
+        if (Result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            LOG_STDERR("poll failed %d", errno);
+            break;
+        }
+
+        for (int Index = 0; Index < COUNT_OF(Outputs); Index += 1)
+        {
+            if (PollDescriptors[3 + Index].revents & (POLLOUT | POLLHUP | POLLERR))
+            {
+                FlushOutput(Outputs[Index]);
+            }
+        }
+
+        if (PollDescriptors[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            const auto Size = std::min<size_t>(InputWindow, LX_INIT_MULTIPLEXED_MAX_FRAME_DATA);
+            auto BytesRead = TEMP_FAILURE_RETRY(read(InputFd, SendBuffer.data() + HeaderSize, Size));
+            if (BytesRead <= 0)
+            {
+                if (BytesRead < 0)
+                {
+                    LOG_STDERR("read failed %d", errno);
+                }
+
+                CloseInput();
+            }
+            else
+            {
+                SendFrame(LxInitMultiplexedFrameData, LxInitMultiplexedStreamStdIn, BytesRead);
+                InputWindow -= BytesRead;
+            }
+        }
+
+        if (PollDescriptors[1].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            auto Frame = wsl::shared::socket::RecvMultiplexedFrame(Socket, ReceiveBuffer);
+            if (Frame.empty())
+            {
+                //
+                // The server is gone. Stop relaying, but still write the
+                // output that was already received.
+                //
+
+                Connected = false;
+                ControlOpen = false;
+                Outputs[0].Open = false;
+                Outputs[1].Open = false;
+                PollDescriptors[1].fd = -1;
+                PollDescriptors[2].fd = -1;
+                InputOpen = false;
+                continue;
+            }
+
+            const auto* Header = gslhelpers::get_struct<LX_INIT_MULTIPLEXED_FRAME_HEADER>(Frame);
+            const auto Data = Frame.subspan(HeaderSize);
+            const auto Stream = static_cast<LX_INIT_MULTIPLEXED_STREAM>(Header->Stream);
+            if ((Header->Type == LxInitMultiplexedFrameWindow) && (Stream == LxInitMultiplexedStreamStdIn))
+            {
+                InputWindow += Header->Size;
+            }
+            else if ((Stream == LxInitMultiplexedStreamStdOut) || (Stream == LxInitMultiplexedStreamStdErr))
+            {
+                auto& Output = Outputs[(Stream == LxInitMultiplexedStreamStdOut) ? 0 : 1];
+                if (Header->Type == LxInitMultiplexedFrameData)
+                {
+                    if (Output.Pending.size() - Output.Offset + Data.size() > LX_INIT_MULTIPLEXED_WINDOW)
+                    {
+                        LOG_STDERR("Stream %u exceeded its window", Header->Stream);
+                        break;
+                    }
+
+                    //
+                    // Queue the data and write as much as possible right away.
+                    // The credit is returned for the bytes actually written.
+                    //
+
+                    Output.Pending.insert(Output.Pending.end(), Data.begin(), Data.end());
+                    FlushOutput(Output);
+                }
+                else if (Header->Type == LxInitMultiplexedFrameClose)
+                {
+                    Output.Open = false;
+                }
+            }
+            else if (Stream == LxInitMultiplexedStreamControl)
+            {
+                bool Exited = (Header->Type == LxInitMultiplexedFrameClose);
+                if ((Header->Type == LxInitMultiplexedFrameData) &&
+                    (!CreateNtProcessControlMessage(Data, Name, &ExitCode, &Exited)))
+                {
+                    break;
+                }
+
+                //
+                // The windows process has exited. Close stdin and stop
+                // handling signals, but keep relaying stdout and stderr until
+                // the server closes them.
+                //
+
+                if (Exited)
+                {
+                    ControlOpen = false;
+                    CloseInput();
+                    PollDescriptors[2].fd = -1;
+                }
+            }
+            else
+            {
+                LOG_STDERR("Unexpected frame %u %u", Header->Type, Header->Stream);
+                break;
+            }
+        }
+
+        //
+        // Forward window resize events as control frames and handle sigint.
+        //
+
+        if (PollDescriptors[2].revents & POLLIN)
+        {
+            signalfd_siginfo SignalInfo;
+            auto BytesRead = TEMP_FAILURE_RETRY(read(PollDescriptors[2].fd, &SignalInfo, sizeof(SignalInfo)));
+            if (BytesRead != sizeof(SignalInfo))
+            {
+                LOG_STDERR("read failed %zd %d", BytesRead, errno);
+                break;
+            }
+
+            if (SignalInfo.ssi_signo == SIGWINCH)
+            {
+                WindowSizeChanged(Socket, true);
+            }
+            else if (SignalInfo.ssi_signo == SIGINT)
+            {
+                CloseInput();
+                break;
+            }
+            else
+            {
+                LOG_STDERR("Unexpected signal %u", SignalInfo.ssi_signo);
+                break;
+            }
+        }
+    }
+
+    return ExitCode;
+}
+CATCH_RETURN_ERRNO()
+
+bool CreateNtProcessControlMessage(gsl::span<gsl::byte> Message, const char* Name, int* ExitCode, bool* Exited)
+
+/*++
+
+Routine Description:
+
+    This routine handles a message received on the control channel of an NT
+    process.
+
+Arguments:
+
+    Message - Supplies the message.
+
+    Name - Supplies the name of the process, used in error messages.
+
+    ExitCode - Supplies a pointer that receives the exit code of the process.
+
+    Exited - Supplies a pointer that is set to true when the message is the
+        exit status of the process.
+
+Return Value:
+
+    true if relaying should continue, false otherwise.
+
+--*/
+
+{
+    auto* Header = gslhelpers::get_struct<MESSAGE_HEADER>(Message);
+    if (Header->MessageType == LxInitMessageCreateProcessResponse)
+    {
+        //
+        // Verify the process launch request was successful.
+        //
+
+        auto* Response = gslhelpers::try_get_struct<LX_INIT_CREATE_PROCESS_RESPONSE>(Message);
+        if (!Response)
+        {
+            LOG_STDERR("Invalid message size %zd", Message.size());
+            return false;
+        }
+
+        if (Response->Result != 0)
+        {
+            errno = Response->Result;
+            LOG_STDERR("%s", Name);
+            return false;
+        }
+
+        //
+        // If the application was a GUI application and stdin is a console, restore
+        // the terminal mode. This allows ctrl-c and ctrl-z to function for
+        // graphical apps.
+        //
+
+        if ((Response->Flags & LX_INIT_CREATE_PROCESS_RESULT_FLAG_GUI_APPLICATION) != 0)
+        {
+            RestoreConsoleState();
+        }
+    }
+    else if (Header->MessageType == LxInitMessageExitStatus)
+    {
+        //
+        // Set the process exit code. The caller goes through the relay loop
+        // until all data has been flushed.
+        //
+
+        auto* ExitStatus = gslhelpers::try_get_struct<LX_INIT_PROCESS_EXIT_STATUS>(Message);
+        if (!ExitStatus)
+        {
+            LOG_STDERR("Invalid message size %zd", Message.size());
+            return false;
+        }
+
+        *ExitCode = ExitStatus->ExitCode;
+        *Exited = true;
+    }
+    else
+    {
+        LOG_STDERR("Unexpected message %d", Header->MessageType);
+        return false;
+    }
+
+    return true;
+}
+
 int CreateNtProcessWsl(int Argc, char* Argv[])
 
 /*++
@@ -1015,7 +1405,7 @@ Return Value:
     }
 }
 
-void WindowSizeChanged(int SignalChannelFd)
+void WindowSizeChanged(int SignalChannelFd, bool Multiplexed)
 
 /*++
 
@@ -1028,6 +1418,10 @@ Arguments:
     SignalChannelFd - Supplies a file descriptor to write the window size
         message.
 
+    Multiplexed - Supplies true if the file descriptor is a multiplexed
+        interop connection, in which case the message is sent as a control
+        frame.
+
 Return Value:
 
     None.
@@ -1058,6 +1452,20 @@ Return Value:
     ResizeMessage.Header.MessageSize = sizeof(ResizeMessage);
     ResizeMessage.Columns = WindowSize.ws_col;
     ResizeMessage.Rows = WindowSize.ws_row;
+    if (Multiplexed)
+    {
+        LX_INIT_MULTIPLEXED_FRAME_HEADER Frame{};
+        Frame.Type = LxInitMultiplexedFrameData;
+        Frame.Stream = LxInitMultiplexedStreamControl;
+        Frame.Size = sizeof(ResizeMessage);
+        Result = UtilWriteBuffer(SignalChannelFd, gslhelpers::struct_as_bytes(Frame));
+        if (Result < 0)
+        {
+            LOG_STDERR("sending resize message failed");
+            return;
+        }
+    }
+
     Result = UtilWriteBuffer(SignalChannelFd, gslhelpers::struct_as_bytes(ResizeMessage));
     if (Result < 0)
     {
@@ -24,3 +24,5 @@ Abstract:
 #define BINFMT_INTEROP_REGISTRATION_STRING(Name) ":" Name ":M::MZ::" LX_INIT_PATH ":P"
 
 int CreateNtProcess(int Argc, char* Argv[]);
+
+int CreateNtProcessRelayMultiplexed(int Socket, int InputFd, int OutputFd, int ErrorFd, int SignalFd, const char* Name);
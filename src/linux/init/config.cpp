@@ -31,6 +31,7 @@ Abstract:
 #include "wslpath.h"
 #include "wslinfo.h"
 #include "drvfs.h"
+#include "timeline.h"
 #include "timezone.h"
 #include "message.h"
 #include "WslDistributionConfig.h"
@@ -42,6 +43,7 @@ Abstract:
 #define CGROUPS_FILE "/proc/cgroups"
 #define CGROUPS_NO_V1 "cgroup_no_v1="
 #define DEFAULT_CWD "/"
+#define DRVFS_MAX_CONCURRENT_MOUNTS 8
 #define DRVFS_MOUNT_OPTIONS (MS_NOATIME)
 #define DRVFS_SOURCE " :\\"
 #define DRVFS_TARGET_MODE 0777
@@ -450,6 +452,14 @@ try
         break;
     }
 
+    case LxInitMessageQueryStartupTimeline:
+    {
+        wsl::shared::MessageWriter<LX_INIT_QUERY_STARTUP_TIMELINE> Response(LxInitMessageQueryStartupTimeline);
+        Response.WriteString(TimelineFormat());
+        ResponseChannel.SendMessage<LX_INIT_QUERY_STARTUP_TIMELINE>(Response.Span());
+        break;
+    }
+
     default:
         LOG_ERROR("unexpected message {}", Header->MessageType);
         break;
@@ -479,6 +489,8 @@ Return Value:
     wil::unique_fd DevNullFd;
     unsigned int Index;
 
+    TimelineMark("init: started");
+
     //
     // Set the umask to 0 to ensure that devices and files that init creates
     // have the correct mode.
@@ -595,6 +607,7 @@ Return Value:
     // Initialization successful.
     //
 
+    TimelineMark("init: common initialization done");
     return Config;
 }
 
@@ -709,6 +722,7 @@ try
     if (Config.MountFsTab)
     {
         ConfigMountFsTab(Elevated);
+        TimelineMark("init: fstab mounted");
     }
 
     //
@@ -721,11 +735,14 @@ try
         {
             FATAL_ERROR("ConfigInitializeVmMode");
         }
+
+        TimelineMark("init: VM mode initialized");
     }
 
     if (Config.AutoMount && (Message->DrvfsMount != LxInitDrvfsMountNone))
     {
         ConfigMountDrvFsVolumes(Message->DrvFsVolumesBitmap, DefaultUid, Elevated, Config);
+        TimelineMark("init: DrvFs volumes mounted");
     }
 
     //
@@ -1002,6 +1019,12 @@ try
         });
     }
 
+    TimelineMark("init: instance initialized");
+    if (UtilIsUtilityVm())
+    {
+        TimelineEmit("init");
+    }
+
     return 0;
 }
 CATCH_RETURN_ERRNO()
@@ -2008,13 +2031,20 @@ try
         std::format("noatime,uid={},gid={},{}", OwnerUid, OwnerGid, Config.DrvFsOptions.has_value() ? Config.DrvFsOptions->c_str() : "");
 
     //
-    // Iterate over the bitmap and attempt to create a DrvFs mount for each
-    // drive letter.
+    // Iterate over the bitmap and build the list of DrvFs mounts to create.
     //
     // N.B. __builtin_ffsll returns a one-based index.
     //
 
-    char Source[] = DRVFS_SOURCE;
+    struct DrvFsMount
+    {
+        std::string Source;
+        std::string Target;
+        int Result = -1;
+        std::chrono::milliseconds Duration{};
+    };
+
+    std::vector<DrvFsMount> Mounts;
     for (int Index = __builtin_ffsll(DrvFsVolumes); Index != 0; Index = __builtin_ffsll(DrvFsVolumes))
     {
         //
@@ -2044,12 +2074,47 @@ try
             continue;
         }
 
+        std::string Source = DRVFS_SOURCE;
         Source[0] = 'A' + Index;
-        if (MountDrvfs(Source, Target.c_str(), Options.c_str(), Admin, Config) < 0)
+        Mounts.emplace_back(DrvFsMount{.Source = std::move(Source), .Target = std::move(Target)});
+    }
+
+    //
+    // Each mount is a round trip to the host, so the mounts are issued
+    // concurrently.
+    //
+    // N.B. UtilCreateProcessAndWait sets and restores the disposition of
+    //      SIGCHLD for each child. It is set once for all the mounts so
+    //      that a concurrent mount can't restore it while a child is running.
+    //
+
+    auto RestoreSigChld = signal(SIGCHLD, SIG_DFL);
+    auto RestoreSigChldOnExit = wil::scope_exit([&]() { signal(SIGCHLD, RestoreSigChld); });
+
+    const auto Start = std::chrono::steady_clock::now();
+    UtilParallelFor(Mounts.size(), DRVFS_MAX_CONCURRENT_MOUNTS, "DrvFsMount", [&](size_t Index) {
+        auto& Mount = Mounts[Index];
+        const auto MountStart = std::chrono::steady_clock::now();
+        Mount.Result = MountDrvfs(Mount.Source.c_str(), Mount.Target.c_str(), Options.c_str(), Admin, Config);
+        Mount.Duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - MountStart);
+    });
+
+    //
+    // Report the results in drive letter order.
+    //
+
+    std::string Timings;
+    for (const auto& Mount : Mounts)
+    {
+        Timings += std::format(" {:c}: {}ms{}", Mount.Source[0], Mount.Duration.count(), Mount.Result < 0 ? " (failed)" : "");
+        if (Mount.Result < 0)
         {
-            EMIT_USER_WARNING(wsl::shared::Localization::MessageDrvfsMountFailed(Source));
+            EMIT_USER_WARNING(wsl::shared::Localization::MessageDrvfsMountFailed(Mount.Source.c_str()));
         }
     }
+
+    const auto Duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - Start);
+    LOG_INFO("Mounted {} DrvFs volume(s) in {}ms:{}", Mounts.size(), Duration.count(), Timings);
 }
 CATCH_LOG()
 
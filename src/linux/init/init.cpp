@@ -33,6 +33,7 @@ Abstract:
 #include "common.h"
 #include "config.h"
 #include "util.h"
+#include "timeline.h"
 #include "timezone.h"
 #include "binfmt.h"
 #include "wslpath.h"
@@ -42,6 +43,8 @@ Abstract:
 #include "localhost.h"
 #include "telemetry.h"
 #include "GnsEngine.h"
+#include "SessionLauncher.h"
+#include "StdioRelay.h"
 #include "lxinitshared.h"
 #include "message.h"
 #include "configfile.h"
@@ -89,6 +92,14 @@ struct sigaction g_SavedSignalActions[_NSIG];
 
 volatile pid_t g_SessionGroup = -1;
 
+//
+// Users and base environment of the processes created by the session leader.
+// The session leader resolves them before forking, so its children inherit
+// them.
+//
+
+SessionLauncher g_SessionLauncher;
+
 //
 // Fallback passwd struct to use in case the /etc/passwd file is missing or
 // corrupt.
@@ -107,8 +118,12 @@ CREATE_PROCESS_PARSED CreateProcessParse(gsl::span<gsl::byte> Buffer, int Messag
 
 int CreateProcessParseCommon(PCREATE_PROCESS_PARSED_COMMON Parsed, gsl::span<gsl::byte> Buffer, const wsl::linux::WslDistributionConfig& Config);
 
+void CreateProcessPrepare(gsl::span<gsl::byte> Buffer, const wsl::linux::WslDistributionConfig& Config);
+
 int CreateProcessReplyToServer(PCREATE_PROCESS_PARSED Parsed, pid_t CreateProcessPid, int MessageFd);
 
+const passwd* CreateProcessResolveUser(gsl::span<gsl::byte> Buffer, const wsl::linux::WslDistributionConfig& Config);
+
 void CreateWslSystemdUnits(const wsl::linux::WslDistributionConfig& Config);
 
 int InitConnectToServer(int LxBusFd, bool WaitForServer);
@@ -564,16 +579,16 @@ try
     sigemptyset(&SignalMask);
     THROW_LAST_ERROR_IF(sigprocmask(SIG_SETMASK, &SignalMask, NULL) < 0);
 
-    auto AddEnvironmentVariable = [&](const char* Name) {
-        const auto Value = UtilGetEnvironmentVariable(Name);
-        if (!Value.empty())
-        {
-            Common->Environment.AddVariable(Name, Value.c_str());
-        }
-    };
+    //
+    // Add the base environment ($NAME, $WSL_DISTRO_NAME and $LANG).
+    //
+    // N.B. Failure to update the $LANG environment variable is non-fatal.
+    //
 
-    AddEnvironmentVariable(NAME_ENV);
-    AddEnvironmentVariable(WSL_DISTRO_NAME_ENV);
+    for (const auto& [Name, Value] : g_SessionLauncher.GetEnvironment())
+    {
+        Common->Environment.AddVariable(Name, Value);
+    }
 
     //
     // Get the password entry for the user. (root if the distribution is being installed)
@@ -582,7 +597,7 @@ try
     const passwd* PasswordEntry{};
 
     auto ConfigureUid = [&](uint32_t Uid) {
-        PasswordEntry = getpwuid(Uid);
+        PasswordEntry = g_SessionLauncher.GetUser(Uid);
         if (PasswordEntry == nullptr)
         {
             LOG_ERROR("getpwuid({}) failed {}", Uid, errno);
@@ -599,14 +614,6 @@ try
         Common->Environment.AddVariable(SHELL_ENV, PasswordEntry->pw_shell);
     };
 
-    //
-    // Set the $LANG environment variable.
-    //
-    // N.B. Failure to update $LANG environment variable is non-fatal.
-    //
-
-    ConfigUpdateLanguage(Common->Environment);
-
     //
     // Launch the OOBE command, if any
     //
@@ -767,7 +774,8 @@ try
     // Set the supplemental groups, gid, uid, and current working directory.
     //
 
-    UtilInitGroups(PasswordEntry->pw_name, PasswordEntry->pw_gid);
+    const auto Groups = g_SessionLauncher.GetGroups(*PasswordEntry);
+    THROW_LAST_ERROR_IF(setgroups(Groups.size(), Groups.data()) < 0);
     THROW_LAST_ERROR_IF(setgid(PasswordEntry->pw_gid) < 0);
     THROW_LAST_ERROR_IF(setuid(PasswordEntry->pw_uid) < 0);
 
@@ -982,37 +990,15 @@ try
     }
 
     //
-    // If a username was provided, get the password entry for the specified username.
-    // If no username was provided use the one specified in /etc/wsl.conf.
-    // Otherwise, use the default UID from the registry.
+    // Get the password entry of the user. A username that does not exist is
+    // fatal.
     //
 
-    struct passwd* PasswordEntry = nullptr;
+    const auto* PasswordEntry = CreateProcessResolveUser(Buffer, Config);
     auto Username = wsl::shared::string::FromSpan(Buffer, Common->UsernameOffset);
-    if (strlen(Username) != 0)
-    {
-        PasswordEntry = getpwnam(Username);
-        if (PasswordEntry == nullptr)
-        {
-            FATAL_ERROR_EX(EX_NOUSER, "getpwnam({}) failed {}", Username, errno);
-        }
-    }
-    else if (Config.DefaultUser.has_value())
+    if ((PasswordEntry == nullptr) && (strlen(Username) != 0))
     {
-        PasswordEntry = getpwnam(Config.DefaultUser->c_str());
-        if (PasswordEntry == nullptr)
-        {
-            LOG_ERROR("getpwnam({}) failed {}", Config.DefaultUser->c_str(), errno);
-        }
-    }
-
-    if (PasswordEntry == nullptr)
-    {
-        PasswordEntry = getpwuid(Common->DefaultUid);
-        if (PasswordEntry == nullptr)
-        {
-            LOG_ERROR("getpwuid({}) failed {}", Common->DefaultUid, errno);
-        }
+        FATAL_ERROR_EX(EX_NOUSER, "getpwnam({}) failed {}", Username, errno);
     }
 
     Parsed->CommandLine.emplace_back(nullptr);
@@ -1025,6 +1011,52 @@ try
 }
 CATCH_RETURN_ERRNO()
 
+void CreateProcessPrepare(gsl::span<gsl::byte> Buffer, const wsl::linux::WslDistributionConfig& Config)
+
+/*++
+
+Routine Description:
+
+    This routine resolves the user, supplementary groups and base environment
+    of a create process message in the session leader, before it forks. The
+    child process then finds them in the session launcher instead of
+    resolving them again.
+
+    N.B. Failures are non-fatal, the child resolves what is missing.
+
+Arguments:
+
+    Buffer - Supplies the common create process message data.
+
+    Config - Supplies the distribution configuration.
+
+Return Value:
+
+    None.
+
+--*/
+
+try
+{
+    g_SessionLauncher.Refresh();
+    g_SessionLauncher.GetEnvironment();
+
+    //
+    // The child looks the user up by uid once its name is resolved.
+    //
+
+    const auto* PasswordEntry = CreateProcessResolveUser(Buffer, Config);
+    if (PasswordEntry != nullptr)
+    {
+        PasswordEntry = g_SessionLauncher.GetUser(PasswordEntry->pw_uid);
+        if (PasswordEntry != nullptr)
+        {
+            g_SessionLauncher.GetGroups(*PasswordEntry);
+        }
+    }
+}
+CATCH_LOG()
+
 int CreateProcessReplyToServer(PCREATE_PROCESS_PARSED Parsed, pid_t CreateProcessPid, int MessageFd)
 
 /*++
@@ -1107,6 +1139,63 @@ Return Value:
     return 0;
 }
 
+const passwd* CreateProcessResolveUser(gsl::span<gsl::byte> Buffer, const wsl::linux::WslDistributionConfig& Config)
+
+/*++
+
+Routine Description:
+
+    This routine returns the password entry of the user a create process
+    message runs as.
+
+    If a username was provided, get the password entry for the specified username.
+    If no username was provided use the one specified in /etc/wsl.conf.
+    Otherwise, use the default UID from the registry.
+
+Arguments:
+
+    Buffer - Supplies the common create process message data.
+
+    Config - Supplies the distribution configuration.
+
+Return Value:
+
+    The password entry, or nullptr if the user was not found.
+
+--*/
+
+{
+    auto* Common = gslhelpers::try_get_struct<LX_INIT_CREATE_PROCESS_COMMON>(Buffer);
+    THROW_ERRNO_IF(EINVAL, !Common);
+
+    auto Username = wsl::shared::string::FromSpan(Buffer, Common->UsernameOffset);
+    if (strlen(Username) != 0)
+    {
+        return g_SessionLauncher.GetUser(Username);
+    }
+
+    const passwd* PasswordEntry = nullptr;
+    if (Config.DefaultUser.has_value())
+    {
+        PasswordEntry = g_SessionLauncher.GetUser(Config.DefaultUser->c_str());
+        if (PasswordEntry == nullptr)
+        {
+            LOG_ERROR("getpwnam({}) failed {}", Config.DefaultUser->c_str(), errno);
+        }
+    }
+
+    if (PasswordEntry == nullptr)
+    {
+        PasswordEntry = g_SessionLauncher.GetUser(Common->DefaultUid);
+        if (PasswordEntry == nullptr)
+        {
+            LOG_ERROR("getpwuid({}) failed {}", Common->DefaultUid, errno);
+        }
+    }
+
+    return PasswordEntry;
+}
+
 int InitCreateSessionLeader(gsl::span<gsl::byte> Buffer, wsl::shared::SocketChannel& Channel, int LxBusFd, wsl::linux::WslDistributionConfig& Config)
 
 /*++
@@ -1351,21 +1440,16 @@ Return Value:
 --*/
 
 {
-    std::vector<gsl::byte> Buffer;
     ssize_t BytesRead;
-    ssize_t BytesWritten;
     pid_t ChildPid;
     wsl::shared::SocketChannel ControlChannel;
 
     LX_INIT_PROCESS_EXIT_STATUS ExitStatus;
-    unsigned int Index;
     bool InteropEnabled;
     InteropServer InteropServer;
     int ListenSocket = -1;
     int Master = -1;
     CREATE_PROCESS_PARSED_COMMON Parsed = {nullptr};
-    std::vector<gsl::byte> PendingStdin;
-    struct pollfd PollDescriptors[7];
     pid_t RelayPid = -1;
     int Result;
     int SignalFd = -1;
@@ -1422,6 +1506,13 @@ Return Value:
         goto CreateProcessUtilityVmEnd;
     }
 
+    //
+    // Resolve what the child shares with the previous processes of the
+    // session, so the relay and child processes inherit it.
+    //
+
+    CreateProcessPrepare(Span.subspan(offsetof(LX_INIT_CREATE_PROCESS_UTILITY_VM, Common)), Config);
+
     //
     // Create a process to relay input and output via sockets. The parent
     // returns to continue processing messages.
@@ -1722,27 +1813,6 @@ Return Value:
 
     THROW_LAST_ERROR_IF(fcntl(StdIn, F_SETFL, O_NONBLOCK) < 0);
 
-    //
-    // Fill the poll descriptors.
-    //
-    // N.B. Any files descriptors that are -1 are ignored by poll.
-    //
-
-    PollDescriptors[0].fd = Sockets[0].get();
-    PollDescriptors[0].events = POLLIN;
-    PollDescriptors[1].fd = StdOutPipe.read().get();
-    PollDescriptors[1].events = POLLIN;
-    PollDescriptors[2].fd = StdErrPipe.read().get();
-    PollDescriptors[2].events = POLLIN;
-    PollDescriptors[3].fd = Master;
-    PollDescriptors[3].events = POLLIN;
-    PollDescriptors[4].fd = InteropServer.Socket();
-    PollDescriptors[4].events = POLLIN;
-    PollDescriptors[5].fd = SignalFd;
-    PollDescriptors[5].events = POLLIN;
-    PollDescriptors[6].fd = Sockets[3].get();
-    PollDescriptors[6].events = POLLIN;
-
     TerminalControlChannel = {{Sockets[3].get()}, "TerminalControl"};
 
     //
@@ -1758,206 +1828,133 @@ Return Value:
     // from the master PTY endpoint and output pipes to the stdout and stderr
     // sockets.
     //
+    // N.B. The relay services the streams before the other file descriptors, so
+    //      the output of the child is relayed before its exit is processed.
+    //
 
-    for (;;)
+    try
     {
-        BytesWritten = 0;
-
-        Result = poll(PollDescriptors, COUNT_OF(PollDescriptors), PendingStdin.empty() ? -1 : 100);
-        if (!PendingStdin.empty())
-        {
-            BytesWritten = write(StdIn, PendingStdin.data(), PendingStdin.size());
-            if (BytesWritten < 0)
-            {
-                if (errno != EAGAIN && errno != EWOULDBLOCK)
-                {
-                    LOG_ERROR("delayed stdin write failed {}, ChildPid={}", errno, ChildPid);
-                }
-            }
-            else if (BytesWritten <= PendingStdin.size()) // Partial or complete write
-            {
-                PendingStdin.erase(PendingStdin.begin(), PendingStdin.begin() + BytesWritten);
-            }
-            else
-            {
-                LOG_ERROR("Unexpected write result {}, pending={}", BytesWritten, PendingStdin.size());
-            }
-        }
-
-        if (Result < 0)
-        {
-            LOG_ERROR("poll failed {}", errno);
-            break;
-        }
+        StdioRelay Relay;
+        std::optional<StdioRelay::StreamId> PtyStream;
+        std::vector<StdioRelay::StreamId> OutputStreams;
+        const bool StdInConsole = WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdInConsole);
+        const bool StdOutConsole = WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdOutConsole);
+        const bool StdErrConsole = WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdErrConsole);
 
         //
-        // Relay input from the stdin socket to the stdin file descriptor.
+        // Relay input from the stdin socket to the stdin file descriptor. When
+        // the stdin socket closes, close the stdin file descriptor and, if stdin
+        // is a console, the pseudoterminal master.
         //
 
-        if (PollDescriptors[0].revents & (POLLIN | POLLHUP | POLLERR) && PendingStdin.empty())
-        {
-            BytesRead = UtilReadBuffer(Sockets[0].get(), Buffer);
-            if (BytesRead < 0)
+        Relay.AddStream(Sockets[0].get(), StdIn, [&](int Error) {
+            if (Error != 0)
             {
-                LOG_ERROR("read failed {}", errno);
-                break;
+                LOG_ERROR("stdin relay failed {}, ChildPid={}", Error, ChildPid);
+                Relay.Stop();
+                return;
             }
 
-            //
-            // A zero-byte read means that the stdin socket has closed. Close
-            // the corresponding stdin file descriptor and remove the stdin
-            // socket from the poll descriptors list.
-            //
-
-            if (BytesRead == 0)
+            CLOSE(StdIn);
+            StdIn = -1;
+            if (StdInConsole && (Master != -1))
             {
-                CLOSE(StdIn);
-                StdIn = -1;
-                PollDescriptors[0].fd = -1;
-
-                //
-                // If stdin is a console, close the pseudoterminal master.
-                //
-
-                if ((WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdInConsole)) && (Master != -1))
+                if (PtyStream.has_value())
                 {
-                    CLOSE(Master);
-                    Master = -1;
-                    PollDescriptors[3].fd = -1;
+                    Relay.RemoveStream(PtyStream.value());
                 }
-            }
-            else
-            {
-                BytesWritten = write(StdIn, Buffer.data(), BytesRead);
-                if (BytesWritten < 0)
+                else
                 {
-                    //
-                    // If writing on stdin's pipe would block, mark the write as pending and continue.
-                    // This is required blocking on the write() could lead to a deadlock if the child process
-                    // is blocking trying to write on stderr / stdout while the relay tries to write stdin.
-                    //
-
-                    if (errno == EWOULDBLOCK || errno == EAGAIN)
-                    {
-                        assert(PendingStdin.empty());
-                        PendingStdin.assign(Buffer.begin(), Buffer.begin() + BytesRead);
-                    }
-                    else
-                    {
-                        LOG_ERROR("write failed {}", errno);
-                        break;
-                    }
+                    Relay.RemoveHandler(Master);
                 }
+
+                CLOSE(Master);
+                Master = -1;
             }
-        }
+        });
 
         //
-        // Relay output from the stdout and stderr pipes.
+        // Relay output from the stdout and stderr pipes. If the socket is closed,
+        // close the pipe so the writers get SIGPIPE.
         //
 
-        for (Index = 1; Index < 3; Index += 1)
-        {
-            if (PollDescriptors[Index].revents & (POLLIN | POLLHUP | POLLERR))
+        auto RelayOutput = [&](wil::unique_pipe& Pipe, int Socket) {
+            if (!Pipe.read())
             {
-                BytesRead = UtilReadBuffer(PollDescriptors[Index].fd, Buffer);
-                if (BytesRead <= 0)
-                {
-                    if (BytesRead < 0)
-                    {
-                        LOG_ERROR("read failed {} {}", BytesRead, errno);
-                    }
+                return;
+            }
 
-                    PollDescriptors[Index].fd = -1;
-                    UtilSocketShutdown(Sockets[Index].get(), SHUT_WR);
-                    continue;
+            OutputStreams.emplace_back(Relay.AddStream(Pipe.read().get(), Socket, [&Pipe, &ChildPid, Socket](int Error) {
+                if (Error == EPIPE)
+                {
+                    Pipe.read().reset();
+                    return;
                 }
-
-                BytesWritten = UtilWriteBuffer(Sockets[Index].get(), Buffer.data(), BytesRead);
-                if (BytesWritten < 0)
+                else if (Error != 0)
                 {
-                    if (errno == EPIPE)
-                    {
-                        CLOSE(PollDescriptors[Index].fd);
-                        PollDescriptors[Index].fd = -1;
-
-                        if (Index == 1)
-                        {
-                            StdOutPipe.read().reset();
-                        }
-                        else if (Index == 2)
-                        {
-                            StdErrPipe.read().reset();
-                        }
-                    }
-                    else
-                    {
-                        LOG_ERROR("write failed {}, index={}, ChildPid={}, fd={}", errno, Index, ChildPid, Sockets[Index].get());
-                    }
+                    LOG_ERROR("output relay failed {}, ChildPid={}, fd={}", Error, ChildPid, Socket);
                 }
-            }
-        }
+
+                UtilSocketShutdown(Socket, SHUT_WR);
+            }));
+        };
+
+        RelayOutput(StdOutPipe, Sockets[1].get());
+        RelayOutput(StdErrPipe, Sockets[2].get());
 
         //
         // Relay output from the PTY master to the stdout or stderr socket.
         //
 
-        if (PollDescriptors[3].revents & (POLLIN | POLLHUP | POLLERR))
+        if (StdOutConsole || StdErrConsole)
         {
-            BytesRead = UtilReadBuffer(Master, Buffer);
+            PtyStream = Relay.AddStream(Master, StdOutConsole ? Sockets[1].get() : Sockets[2].get(), [&](int Error) {
+                //
+                // N.B. The pty will fail with EIO on read on hangup instead of
+                //      indicating EOF.
+                //
 
-            //
-            // N.B. The pty will fail with EIO on read on hangup instead of
-            //      indicating EOF.
-            //
+                if (Error != 0 && Error != EIO)
+                {
+                    LOG_ERROR("pty relay failed {}", Error);
+                    Relay.Stop();
+                    return;
+                }
 
-            if (BytesRead == 0 || (BytesRead < 0 && errno == EIO))
-            {
-                PollDescriptors[3].fd = -1;
-                if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdOutConsole))
+                if (StdOutConsole)
                 {
                     UtilSocketShutdown(Sockets[1].get(), SHUT_WR);
                 }
 
-                if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdErrConsole))
+                if (StdErrConsole)
                 {
                     UtilSocketShutdown(Sockets[2].get(), SHUT_WR);
                 }
-            }
-            else if (BytesRead < 0)
-            {
-                LOG_ERROR("read failed {} {}", BytesRead, errno);
-                break;
-            }
-            else
-            {
-                if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdOutConsole))
-                {
-                    BytesWritten = UtilWriteBuffer(Sockets[1].get(), Buffer.data(), BytesRead);
-                }
-                else if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdErrConsole))
+            });
+
+            OutputStreams.emplace_back(PtyStream.value());
+        }
+        else
+        {
+            Relay.AddHandler(Master, [&]() {
+                char Discard[256];
+                const auto BytesDiscarded = read(Master, Discard, sizeof(Discard));
+                if (BytesDiscarded > 0)
                 {
-                    BytesWritten = UtilWriteBuffer(Sockets[2].get(), Buffer.data(), BytesRead);
+                    LOG_ERROR("Unexpected output from PTY master");
                 }
-                else
+                else if (BytesDiscarded == 0 || errno == EIO)
                 {
-                    LOG_ERROR("Unexpected output from PTY master");
+                    Relay.RemoveHandler(Master);
                 }
-
-                if (BytesWritten < 0)
+                else if (errno != EAGAIN && errno != EINTR)
                 {
-                    LOG_ERROR("write failed {}", errno);
-                    break;
+                    LOG_ERROR("read failed {}", errno);
+                    return false;
                 }
-            }
-        }
-
-        //
-        // Ensure all data has been written.
-        //
 
-        if (BytesWritten > 0)
-        {
-            continue;
+                return true;
+            });
         }
 
         //
@@ -1965,44 +1962,51 @@ Return Value:
         // children over the control channel.
         //
 
-        if (PollDescriptors[4].revents & POLLIN)
+        if (InteropServer.Socket() >= 0)
         {
+            Relay.AddHandler(InteropServer.Socket(), [&]() {
+                wsl::shared::SocketChannel channel(InteropServer.Accept(), "InteropRelay");
+                if (channel.Socket() < 0)
+                {
+                    return true;
+                }
 
-            wsl::shared::SocketChannel channel(InteropServer.Accept(), "InteropRelay");
-            if (channel.Socket() < 0)
-            {
-                continue;
-            }
-
-            auto [Header, Span] = channel.ReceiveMessageOrClosed<MESSAGE_HEADER>();
-            if (Header != nullptr)
-            {
-                try
+                auto [Header, Span] = channel.ReceiveMessageOrClosed<MESSAGE_HEADER>();
+                if (Header != nullptr)
                 {
-                    ConfigHandleInteropMessage(
-                        channel, ControlChannel, WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsElevated), Span, Header, Config);
+                    try
+                    {
+                        ConfigHandleInteropMessage(
+                            channel,
+                            ControlChannel,
+                            WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsElevated),
+                            Span,
+                            Header,
+                            Config);
+                    }
+                    CATCH_LOG();
                 }
-                CATCH_LOG();
-            }
+
+                return true;
+            });
         }
 
         //
         // Handle signalfd.
         //
 
-        if (PollDescriptors[5].revents & POLLIN)
-        {
-            BytesRead = TEMP_FAILURE_RETRY(read(PollDescriptors[5].fd, &SignalInfo, sizeof(SignalInfo)));
+        Relay.AddHandler(SignalFd, [&]() {
+            BytesRead = TEMP_FAILURE_RETRY(read(SignalFd, &SignalInfo, sizeof(SignalInfo)));
             if (BytesRead != sizeof(SignalInfo))
             {
                 LOG_ERROR("read failed {} {}", BytesRead, errno);
-                break;
+                return false;
             }
 
             if (SignalInfo.ssi_signo != SIGCHLD)
             {
                 LOG_ERROR("Unexpected signal {}", SignalInfo.ssi_signo);
-                break;
+                return false;
             }
 
             //
@@ -2030,6 +2034,16 @@ Return Value:
                         Status = WEXITSTATUS(Status);
                     }
 
+                    //
+                    // Relay the output that the child left behind before
+                    // reporting its exit.
+                    //
+
+                    for (const auto Stream : OutputStreams)
+                    {
+                        Relay.Flush(Stream);
+                    }
+
                     try
                     {
 
@@ -2052,7 +2066,7 @@ Return Value:
                     UtilSocketShutdown(Sockets[0].get(), SHUT_RD);
                     UtilSocketShutdown(Sockets[1].get(), SHUT_WR);
                     UtilSocketShutdown(Sockets[2].get(), SHUT_WR);
-                    PollDescriptors[6].fd = -1;
+                    Relay.RemoveHandler(Sockets[3].get());
                 }
             }
 
@@ -2067,16 +2081,17 @@ Return Value:
                     LOG_ERROR("waitpid failed {}", errno);
                 }
 
-                break;
+                return false;
             }
-        }
+
+            return true;
+        });
 
         //
         // Process messages from wsl.exe / wslhost.exe.
         //
 
-        if (PollDescriptors[6].revents & POLLIN)
-        {
+        Relay.AddHandler(Sockets[3].get(), [&]() {
             auto [Message, _] = TerminalControlChannel.ReceiveMessageOrClosed<LX_INIT_WINDOW_SIZE_CHANGED>();
 
             //
@@ -2086,7 +2101,7 @@ Return Value:
 
             if (Message == nullptr)
             {
-                break;
+                return false;
             }
 
             memset(&WindowSize, 0, sizeof(WindowSize));
@@ -2097,7 +2112,15 @@ Return Value:
             {
                 LOG_ERROR("ioctl(TIOCSWINSZ) failed {}", errno);
             }
-        }
+
+            return true;
+        });
+
+        Relay.Run();
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION();
     }
 
     //
@@ -2257,6 +2280,13 @@ Return Value:
         unsetenv(LX_WSL2_NETWORKING_MODE_ENV);
     }
 
+    Value = getenv(LX_WSL2_STARTUP_TIMELINE_ENV);
+    if (Value != nullptr)
+    {
+        TimelineImport(Value);
+        unsetenv(LX_WSL2_STARTUP_TIMELINE_ENV);
+    }
+
     Value = getenv(LX_WSL2_VM_ID_ENV);
     if (Value != nullptr)
     {
@@ -2297,6 +2327,7 @@ Return Value:
     }
 
     channel.SendMessage<LX_MINI_INIT_CREATE_INSTANCE_RESULT>(message.Span());
+    TimelineMark("init: instance created");
 
     std::optional<pid_t> distroInitPid;
     const auto distroInitPidString = getenv(LX_WSL2_DISTRO_INIT_PID);
@@ -3239,7 +3270,8 @@ unsigned int StartGns(int Argc, char** Argv)
 {
     constexpr auto* Usage =
         "Usage: gns [" LX_INIT_GNS_SOCKET_ARG " fd] [" LX_INIT_GNS_DNS_SOCKET_ARG " fd] [" LX_INIT_GNS_ADAPTER_ARG
-        " guid] [" LX_INIT_GNS_MESSAGE_TYPE_ARG " int] [" LX_INIT_GNS_DNS_TUNNELING_IP " ip]\n";
+        " guid] [" LX_INIT_GNS_MESSAGE_TYPE_ARG " int] [" LX_INIT_GNS_DNS_TUNNELING_IP " ip] [" LX_INIT_GNS_DNS_TUNNELING_CACHE_ARG
+        "]\n";
 
     UtilSetThreadName("GNS");
 
@@ -3251,6 +3283,7 @@ unsigned int StartGns(int Argc, char** Argv)
     std::optional<GUID> AdapterId;
     std::optional<LX_MESSAGE_TYPE> MessageType;
     std::string DnsTunnelingIp;
+    bool DnsTunnelingCache = false;
     wil::unique_fd Socket;
 
     ArgumentParser parser(Argc, Argv);
@@ -3259,6 +3292,7 @@ unsigned int StartGns(int Argc, char** Argv)
     parser.AddArgument(AdapterId, LX_INIT_GNS_ADAPTER_ARG);
     parser.AddArgument(Integer{MessageType}, LX_INIT_GNS_MESSAGE_TYPE_ARG);
     parser.AddArgument(DnsTunnelingIp, LX_INIT_GNS_DNS_TUNNELING_IP);
+    parser.AddArgument(DnsTunnelingCache, LX_INIT_GNS_DNS_TUNNELING_CACHE_ARG);
 
     try
     {
@@ -3387,9 +3421,10 @@ unsigned int StartGns(int Argc, char** Argv)
         };
     }
 
-    RoutingTable routingTable(RT_TABLE_MAIN);
-    NetworkManager manager(routingTable);
-    GnsEngine engine(readNotification, returnStatus, manager, DnsFd, DnsTunnelingIp);
+    NetlinkStateCache netlinkState;
+    RoutingTable routingTable(RT_TABLE_MAIN, &netlinkState);
+    NetworkManager manager(routingTable, netlinkState);
+    GnsEngine engine(readNotification, returnStatus, manager, DnsFd, DnsTunnelingIp, DnsTunnelingCache);
 
     engine.run();
 
@@ -3417,6 +3452,7 @@ void WaitForBootProcess(wsl::linux::WslDistributionConfig& Config)
     }
 
     Config.BootStartWriteSocket.reset();
+    TimelineMark("init: boot process started");
     if (Config.BootInitTimeout > 0)
     {
         try
@@ -3435,6 +3471,8 @@ void WaitForBootProcess(wsl::linux::WslDistributionConfig& Config)
                 },
                 std::chrono::milliseconds{250},
                 std::chrono::milliseconds{Config.BootInitTimeout});
+
+            TimelineMark("init: boot process running");
         }
         catch (...)
         {
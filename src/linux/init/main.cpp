@@ -53,6 +53,8 @@ Abstract:
 #include <unistd.h>
 #include <utmp.h>
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
 #include "configfile.h"
 #include "lxfsshares.h"
 #include "common.h"
@@ -62,8 +64,15 @@ Abstract:
 #include "message.h"
 #include "binfmt.h"
 #include "address.h"
+#include "DeviceMonitor.h"
+#include "MemoryReclaimer.h"
 #include "SocketChannel.h"
+#include "StreamBuffer.h"
+#include "timeline.h"
+#include "TaskGraph.h"
+#include "ZstdFrameIndex.h"
 
+#define BOOT_MAX_CONCURRENT_STEPS 4
 #define BSDTAR_PATH "/usr/bin/bsdtar"
 #define BINFMT_REGISTER_STRING ":" LX_INIT_BINFMT_NAME ":M::MZ::" LX_INIT_PATH ":FP\n"
 #define BINFMT_PATH PROCFS_PATH "/sys/fs/binfmt_misc"
@@ -77,11 +86,17 @@ Abstract:
 
 #define DISTRO_PATH "/distro"
 #define ETC_PATH "/etc"
+#define EXPORT_PIPE_SIZE (1024 * 1024)
+#define EXPORT_ZSTD_LONG_WINDOW_LOG 27
+#define EXPORT_ZSTD_SEEKABLE_MAX_FRAME_SIZE (8 * 1024 * 1024)
 #define GPU_SHARE_PREFIX "/gpu_"
 #define GPU_SHARE_DRIVERS GPU_SHARE_PREFIX LXSS_GPU_DRIVERS_SHARE
 #define GPU_SHARE_LIB GPU_SHARE_PREFIX LXSS_GPU_LIB_SHARE
 #define GPU_SHARE_LIB_INBOX GPU_SHARE_LIB "_inbox"
 #define GPU_SHARE_LIB_PACKAGED GPU_SHARE_LIB "_packaged"
+#define IMPORT_BUFFER_SIZE (64 * 1024 * 1024)
+#define IMPORT_PIPE_SIZE (1024 * 1024)
+#define IMPORT_PROGRESS_INTERVAL_MS 5000
 #define KERNEL_MODULES_PATH "/lib/modules"
 #define KERNEL_MODULES_VHD_PATH "/modules"
 #define KERNEL_MODULES_OVERLAY "/modules_overlay"
@@ -89,7 +104,6 @@ Abstract:
 #define PROCFS_PATH "/proc"
 #define RESOLV_CONF_FILE "resolv.conf"
 #define RESOLV_CONF_PATH ETC_PATH "/" RESOLV_CONF_FILE
-#define RECLAIM_PATH "/sys/fs/cgroup/memory.reclaim"
 #define SCSI_DEVICE_PATH "/sys/bus/scsi/devices"
 #define SCSI_DEVICE_NAME_PREFIX "0:0:0:"
 #define SCSI_DEVICE_PREFIX SCSI_DEVICE_PATH "/" SCSI_DEVICE_NAME_PREFIX
@@ -120,9 +134,39 @@ int g_LogFd = STDERR_FILENO;
 int g_TelemetryFd = -1;
 std::optional<bool> g_EnableSocketLogging;
 
+//
+// Sockets on which the children that mount a distribution send a file
+// descriptor to its filesystem, indexed by pid. The file descriptor stays
+// queued on the socket until the child exits, which keeps the filesystem alive
+// so it can be flushed.
+//
+
+std::map<pid_t, wil::unique_fd> g_ChildFilesystemSockets;
+
+//
+// Serializes the child exit notifications, which are sent from the threads
+// that flush the filesystems.
+//
+
+std::mutex g_ChildExitNotifyLock;
+
+//
+// Number of threads that are flushing the filesystem of an exited child, and
+// the condition signaled when one of them is done. Shutdown waits for them
+// before the final sync.
+//
+// _Guarded_by_(g_ChildExitNotifyLock)
+//
+
+size_t g_ChildExitFlushes = 0;
+std::condition_variable g_ChildExitFlushDone;
+
+bool BsdtarAcceptsOptions(const char* Filter, const std::string& Options);
+
 int Chroot(const char* Target);
 
-void ConfigureMemoryReduction(int PageReportingOrder, LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode);
+void ConfigureMemoryReduction(
+    int PageReportingOrder, LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode, uint64_t ReclaimFloor, unsigned int ReclaimMaxPressure);
 
 void CreateSwap(unsigned int Lun);
 
@@ -138,6 +182,8 @@ int ExportToSocket(const char* Source, int Socket, int ErrorSocket, unsigned int
 
 int FormatDevice(unsigned int Lun);
 
+DeviceMonitor& GetDeviceMonitor();
+
 std::string GetLunDeviceName(unsigned int Lun);
 
 std::string GetLunDevicePath(unsigned int Lun);
@@ -146,11 +192,13 @@ int GetDiskPartitionIndex(const char* DiskPath, const char* PartitionName);
 
 std::string GetMountTarget(const char* Name);
 
-long long int GetUserCpuTime(void);
-
-ssize_t GetMemoryInUse(void);
-
-int ImportFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags);
+int ImportFromSocket(
+    const char* Destination,
+    int Socket,
+    int ErrorSocket,
+    unsigned int Flags,
+    uint64_t* BytesImported,
+    unsigned int* ImportTimeMs);
 
 int Initialize(const char* Hostname);
 
@@ -183,6 +231,8 @@ std::map<unsigned long, std::string> ListDiskPartitions(const std::string& Devic
 
 std::vector<unsigned int> ListScsiDisks();
 
+void LogBootSteps(TaskGraph& Steps) noexcept;
+
 void LogException(const char* Message, const char* Description) noexcept;
 
 int MountDevice(LX_MINI_INIT_MOUNT_DEVICE_TYPE DeviceType, unsigned int DeviceId, const char* Target, const char* FsType, unsigned int Flags, const char* Options);
@@ -193,14 +243,20 @@ int MountInit(const char* Target);
 
 int MountPlan9(const char* Name, const char* Target, bool ReadOnly, std::optional<int> BufferSize = {});
 
+void NotifyChildExit(int NotifyFd, pid_t Pid);
+
 int ProcessMessage(wsl::shared::SocketChannel& channel, LX_MESSAGE_TYPE Type, gsl::span<gsl::byte> Buffer, VmConfiguration& Config);
 
+wil::unique_fd ReceiveFilesystem(int Socket);
+
 wil::unique_fd RegisterSeccompHook();
 
 int ReportMountStatus(wsl::shared::SocketChannel& Channel, int Result, LX_MINI_MOUNT_STEP Step);
 
 int SendCapabilities(wsl::shared::SocketChannel& Channel);
 
+void SendFilesystem(int Socket, const char* Path);
+
 int SetCloseOnExec(int Fd, bool Enable);
 
 int SetEphemeralPortRange(uint16_t Start, uint16_t End);
@@ -209,7 +265,7 @@ void StartDebugShell();
 
 int StartDhcpClient(int DhcpTimeout);
 
-int StartGuestNetworkService(int GnsFd, wil::unique_fd&& DnsTunnelingFd, uint32_t DnsTunnelingIpAddress);
+int StartGuestNetworkService(int GnsFd, wil::unique_fd&& DnsTunnelingFd, uint32_t DnsTunnelingIpAddress, bool EnableDnsTunnelingCache);
 
 void StartPortTracker(LX_MINI_INIT_PORT_TRACKER_TYPE Type);
 
@@ -219,6 +275,38 @@ void WaitForBlockDevice(const char* Path);
 
 int WaitForChild(pid_t Pid, const char* Name);
 
+bool BsdtarAcceptsOptions(const char* Filter, const std::string& Options)
+
+/*++
+
+Routine Description:
+
+    This routine checks if bsdtar accepts the specified filter options, by
+    writing an empty archive with them.
+
+    N.B. libarchive fails on options it doesn't know, and the zstd options
+         were added over several releases.
+
+Arguments:
+
+    Filter - Supplies the bsdtar compression argument.
+
+    Options - Supplies the filter options.
+
+Return Value:
+
+    true if the options are accepted, false otherwise.
+
+--*/
+
+{
+    auto CommandLine =
+        std::format("{} -c {} --options '{}' -f {} -T {} 2>{}", BSDTAR_PATH, Filter, Options, DEVNULL_PATH, DEVNULL_PATH, DEVNULL_PATH);
+
+    std::string Output;
+    return UtilExecCommandLine(CommandLine.c_str(), &Output, 0, false) == 0;
+}
+
 int Chroot(const char* Target)
 
 /*++
@@ -265,13 +353,14 @@ Return Value:
     return 0;
 }
 
-void ConfigureMemoryReduction(int PageReportingOrder, LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode)
+void ConfigureMemoryReduction(
+    int PageReportingOrder, LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode, uint64_t ReclaimFloor, unsigned int ReclaimMaxPressure)
 
 /*++
 
 Routine Description:
 
-    This routine sets the page reporting order.
+    This routine sets the page reporting order and starts the memory reclaim thread.
 
 Arguments:
 
@@ -281,6 +370,10 @@ Arguments:
 
     Mode - Supplies the memory reclaim mode.
 
+    ReclaimFloor - Supplies the memory in use, in bytes, below which memory is not reclaimed (0 for the default).
+
+    ReclaimMaxPressure - Supplies the memory pressure, in percent, that suspends memory reclaim.
+
 Return Value:
 
     None.
@@ -304,8 +397,9 @@ try
     }
 
     //
-    // Create a worker thread to periodically check if the VM is idle and performs memory compaction.
-    // This ensures that the maximum number of pages can be discarded to the host.
+    // Create a worker thread that reclaims memory when the VM is idle, and compacts a NUMA node when too much of its free
+    // memory is in blocks smaller than the page reporting order (see MemoryReclaimer.h). This ensures that the maximum
+    // number of pages can be discarded to the host.
     //
     // N.B. Compaction is not needed if page reporting order is set to single page mode.
     //
@@ -315,130 +409,14 @@ try
         return;
     }
 
-    std::thread([PageReportingOrder = PageReportingOrder, Mode = Mode]() mutable {
+    const MemoryReclaimer::Settings Settings{
+        .Mode = Mode, .PageReportingOrder = PageReportingOrder, .Floor = ReclaimFloor, .MaxPressure = ReclaimMaxPressure};
+
+    std::thread([Settings]() {
         try
         {
-            //
-            // Set the thread's scheduling policy to idle.
-            //
-
-            sched_param Parameter{};
-            Parameter.sched_priority = 0;
-            THROW_LAST_ERROR_IF(pthread_setschedparam(pthread_self(), SCHED_IDLE, &Parameter) < 0);
-
-            //
-            // Periodically check if the machine is idle by querying procfs for CPU usage.
-            // Memory compaction will occur if both of the following conditions are true:
-            //     1. The CPU time since the last check is greater than the idle threshold.
-            //     2. The current CPU usage is below the idle threshold. This is measured by taking two readings one second apart.
-            //
-
-            double MemoryLow = 1024 * 1024 * 1024;
-            double MemoryHigh = 1.1 * 1024.0 * 1024.0 * 1024.0;
-            const int IdleThreshold = get_nprocs(); // Change math to adjust if sysconf(_SC_CLK_TCK) != 100? Is 1%
-            long long int Start, Stop = 0;
-            auto constexpr SleepDuration = std::chrono::seconds(30);
-            size_t ReclaimIndex = 0;
-            long long int const ReclaimThreshold = (get_nprocs() * sysconf(_SC_CLK_TCK) * SleepDuration / std::chrono::seconds(1)) / 200; // 0.5%
-            long long int ReclaimWindow[20] = {}; // 10 minutes
-            long long int ReclaimWindowLength = COUNT_OF(ReclaimWindow);
-            bool ReclaimIdling;
-
-            //
-            // Fall back to drop cache if the required cgroup path is not present.
-            //
-
-            if (Mode == LxMiniInitMemoryReclaimModeGradual && access(RECLAIM_PATH, W_OK) < 0)
-            {
-                LOG_WARNING("access({}, W_OK) failed {}, falling back to autoMemoryReclaim = dropcache", RECLAIM_PATH, errno);
-                Mode = LxMiniInitMemoryReclaimModeDropCache;
-            }
-
-            if (Mode == LxMiniInitMemoryReclaimModeGradual)
-            {
-                static_assert(COUNT_OF(ReclaimWindow) >= 6);
-                ReclaimWindowLength = 6; // Set to 3 minutes.
-            }
-
-            for (auto i = 1; i < ReclaimWindowLength; i++)
-            {
-                ReclaimWindow[i] = LLONG_MIN;
-            }
-
-            std::this_thread::sleep_for(SleepDuration);
-            for (;;)
-            {
-                auto const Target = std::chrono::steady_clock::now() + SleepDuration;
-                Start = GetUserCpuTime();
-                THROW_LAST_ERROR_IF(Start == -1);
-
-                if (Mode != LxMiniInitMemoryReclaimModeDisabled)
-                {
-                    //
-                    // Ensure that utilization is below 0.5% from the last 30 seconds, and last n minutes, of usage.
-                    //
-
-                    size_t const LastIndex = (ReclaimIndex + 1) % ReclaimWindowLength;
-                    if ((ReclaimWindow[LastIndex] > Start - ReclaimThreshold * (ReclaimWindowLength + 1)) &&
-                        (ReclaimWindow[ReclaimIndex] > Start - ReclaimThreshold))
-                    {
-                        if (Mode == LxMiniInitMemoryReclaimModeGradual)
-                        {
-                            double MemorySize = GetMemoryInUse();
-                            THROW_LAST_ERROR_IF(MemorySize < 0);
-
-                            if (MemorySize > MemoryHigh)
-                            {
-                                ReclaimIdling = false;
-                            }
-
-                            if (!ReclaimIdling && MemorySize > MemoryLow)
-                            {
-                                double MemoryTargetSize = MemorySize * 0.97;
-                                std::string MemoryToFree = std::to_string(size_t(MemorySize - MemoryTargetSize));
-                                // EAGAIN Means that it attempted, but was unable to evict sufficient pages.
-                                THROW_LAST_ERROR_IF(WriteToFile(RECLAIM_PATH, MemoryToFree.c_str()) < 0 && errno != EAGAIN);
-
-                                if (MemoryTargetSize < MemoryLow)
-                                {
-                                    ReclaimIdling = true;
-                                }
-                            }
-                        }
-                        else if (!ReclaimIdling)
-                        {
-                            ReclaimIdling = true;
-                            THROW_LAST_ERROR_IF(WriteToFile(PROCFS_PATH "/sys/vm/drop_caches", "1\n") < 0);
-                        }
-                    }
-                    else
-                    {
-                        ReclaimIdling = false;
-                    }
-
-                    ReclaimIndex = LastIndex;
-                    ReclaimWindow[ReclaimIndex] = Start;
-                }
-
-                //
-                // Perform memory compaction if the VM is idle.
-                //
-                // N.B. Memory compaction is not needed if the page reporting order is set to single page (0).
-                //
-
-                if (PageReportingOrder != 0 && (Start - Stop) > IdleThreshold)
-                {
-                    std::this_thread::sleep_for(std::chrono::seconds(1));
-                    const long long int Stop = GetUserCpuTime();
-                    THROW_LAST_ERROR_IF(Stop == -1);
-                    if ((Stop - Start) < IdleThreshold)
-                    {
-                        THROW_LAST_ERROR_IF(WriteToFile(PROCFS_PATH "/sys/vm/compact_memory", "1\n") < 0);
-                    }
-                }
-
-                std::this_thread::sleep_until(Target);
-            }
+            MemoryReclaimer Reclaimer{Settings};
+            Reclaimer.Run();
         }
         CATCH_LOG()
     }).detach();
@@ -565,45 +543,6 @@ Return Value:
     return 0;
 }
 
-dev_t GetBlockDeviceNumber(const std::string& BlockDeviceName)
-
-/*++
-
-Routine Description:
-
-    This method return the device number of a given block device.
-
-Arguments:
-
-    BlockDeviceName - Supplies the name of the block device.
-
-Return Value:
-
-    The device block number. Throws on error.
-
---*/
-
-{
-    std::string content = wsl::shared::string::ReadFile<char, char>(std::format("/sys/block/{}/dev", BlockDeviceName).c_str());
-    auto separator = content.find(':');
-
-    if (separator == 0 || separator - 1 >= content.size() || separator == std::string::npos)
-    {
-        LOG_ERROR("Failed to parse device number '{}' for device '{}'", content.c_str(), BlockDeviceName.c_str());
-        THROW_ERRNO(EINVAL);
-    }
-
-    try
-    {
-        return makedev(std::strtoul(content.c_str(), nullptr, 10), std::strtoul(content.substr(separator + 1).c_str(), nullptr, 10));
-    }
-    catch (...)
-    {
-        LOG_ERROR("Failed to parse device number '{}' for device '{}'", content.c_str(), BlockDeviceName.c_str());
-        THROW_ERRNO(EINVAL);
-    }
-}
-
 int DetachScsiDisk(unsigned int Lun)
 
 /*++
@@ -627,10 +566,10 @@ Return Value:
 
     try
     {
-        auto deviceNumbers = std::set<dev_t>{GetBlockDeviceNumber(deviceName)};
-        for (const auto& e : ListDiskPartitions(deviceName.c_str()))
+        std::set<dev_t> deviceNumbers;
+        for (const auto& e : GetDeviceMonitor().GetDiskAndPartitions(deviceName))
         {
-            deviceNumbers.insert(GetBlockDeviceNumber(std::format("{}/{}", deviceName, e.second)));
+            deviceNumbers.insert(e.Number);
         }
 
         mountutil::MountEnum mounts;
@@ -690,14 +629,7 @@ try
     // Wait for the block device to be available.
     //
 
-    wsl::shared::retry::RetryWithTimeout<void>(
-        [&]() { THROW_LAST_ERROR_IF(!wil::unique_fd{open(BlockDevice, O_RDONLY)}); },
-        c_defaultRetryPeriod,
-        c_defaultRetryTimeout,
-        []() {
-            auto err = wil::ResultFromCaughtException();
-            return err == ENOENT || err == ENXIO;
-        });
+    WaitForBlockDevice(BlockDevice);
 
     auto CommandLine = std::format("/usr/sbin/blkid '{}' -p -s TYPE -o value -u filesystem", BlockDevice);
     if (UtilExecCommandLine(CommandLine.c_str(), &Output) < 0)
@@ -822,7 +754,9 @@ Arguments:
 
     Socket - Supplies the socket to write to.
 
-    Flags - Additional compression flags.
+    ErrorSocket - Supplies the socket to write errors to.
+
+    Flags - Additional compression flags, and the zstd compression level.
 
 Return Value:
 
@@ -831,31 +765,122 @@ Return Value:
 --*/
 
 {
+    //
+    // zstd archives are written to a pipe instead of the socket, and copied to
+    // the socket without the padding bsdtar adds to the last block, which zstd
+    // decompressors fail on. The frames of seekable archives are indexed while
+    // they are copied.
+    //
+
+    const bool Zstd = WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd);
+    const bool Seekable = WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportZstdSeekable);
+    const unsigned int CompressionLevel = (Flags & LxMiniInitMessageFlagExportZstdLevelMask) >> LX_MINI_INIT_EXPORT_ZSTD_LEVEL_SHIFT;
+    wil::unique_pipe Pipe;
+    if (Zstd)
+    {
+        Pipe = wil::unique_pipe::create(O_CLOEXEC);
+        if (!Pipe.read() || !Pipe.write())
+        {
+            LOG_ERROR("pipe2 failed {}", errno);
+            return -1;
+        }
+
+        if (fcntl(Pipe.write().get(), F_SETPIPE_SZ, EXPORT_PIPE_SIZE) < 0)
+        {
+            LOG_ERROR("fcntl(F_SETPIPE_SZ) failed {}", errno);
+        }
+    }
+
     //
     // Create a child process running bsdtar with the socket set to stdout.
     //
 
-    int ChildPid = UtilCreateChildProcess("ExportDistro", [Source, TarFd = Socket, ErrorSocket = ErrorSocket, Flags = Flags]() {
+    const int TarFd = Zstd ? Pipe.write().get() : Socket;
+    int ChildPid = UtilCreateChildProcess("ExportDistro", [Source, TarFd, ErrorSocket, Flags, CompressionLevel]() {
         THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(TarFd, STDOUT_FILENO)) < 0);
         THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(ErrorSocket, STDERR_FILENO)) < 0);
 
+        //
+        // xz and zstd compress with one thread per processor.
+        //
+        // N.B. The gzip filter of bsdtar is single-threaded.
+        //
+
         std::string compressionArguments;
+        std::string compressionOptions;
+
+        assert(
+            WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd) ||
+            !WI_IsAnyFlagSet(Flags, (LxMiniInitMessageFlagExportZstdLong | LxMiniInitMessageFlagExportZstdSeekable)));
 
         if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressGzip))
         {
-            assert(!WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressXzip));
+            assert(!WI_IsAnyFlagSet(Flags, (LxMiniInitMessageFlagExportCompressXzip | LxMiniInitMessageFlagExportCompressZstd)));
 
             compressionArguments = "-cz";
         }
         else if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressXzip))
         {
+            assert(!WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd));
+
             compressionArguments = "-cJ";
+            compressionOptions = std::format("xz:threads={}", get_nprocs());
+        }
+        else if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd))
+        {
+            compressionArguments = "-c";
+            if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportZstdSeekable))
+            {
+                //
+                // Start a frame for each file, and split large files in
+                // several frames.
+                //
+                // N.B. bsdtar ignores frame-per-file when compressing with
+                //      several threads.
+                //
+
+                compressionOptions = std::format("zstd:frame-per-file,zstd:max-frame-in={}", EXPORT_ZSTD_SEEKABLE_MAX_FRAME_SIZE);
+            }
+            else
+            {
+                compressionOptions = std::format("zstd:threads={}", get_nprocs());
+            }
+
+            if (CompressionLevel != 0)
+            {
+                compressionOptions += std::format(",zstd:compression-level={}", CompressionLevel);
+            }
+
+            //
+            // N.B. A window larger than 128MB can't be decompressed by zstd
+            //      without raising its memory limit.
+            //
+
+            if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportZstdLong))
+            {
+                compressionOptions += std::format(",zstd:long={}", EXPORT_ZSTD_LONG_WINDOW_LOG);
+            }
         }
         else
         {
             compressionArguments = "-c";
         }
 
+        //
+        // Fall back to the default settings of the filter if this bsdtar
+        // predates one of the options.
+        //
+
+        if (!compressionOptions.empty())
+        {
+            const char* filter = WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd) ? "--zstd" : "-J";
+            if (!BsdtarAcceptsOptions(filter, compressionOptions))
+            {
+                LOG_ERROR("{} doesn't support --options {}, using the defaults", BSDTAR_PATH, compressionOptions);
+                compressionOptions.clear();
+            }
+        }
+
         if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagVerbose))
         {
             compressionArguments += "vv";
@@ -879,6 +904,20 @@ Return Value:
             arguments.emplace(arguments.begin() + 3, "--totals");
         }
 
+        //
+        // The compression options go before "-f - .".
+        //
+
+        if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd))
+        {
+            arguments.emplace(arguments.end() - 4, "--zstd");
+        }
+
+        if (!compressionOptions.empty())
+        {
+            arguments.insert(arguments.end() - 4, {"--options", compressionOptions.c_str()});
+        }
+
         execv(BSDTAR_PATH, const_cast<char**>(arguments.data()));
         LOG_ERROR("execl failed, {}", errno);
     });
@@ -889,10 +928,81 @@ Return Value:
     }
 
     //
-    // Wait for the child to exit and shut down the socket.
+    // Copy a zstd archive to the socket, and find its frames.
     //
+    // N.B. The socket is written with MSG_NOSIGNAL so that init isn't killed by
+    //      SIGPIPE if the other end closes it.
+    //
+
+    auto Send = [Socket](const char* Buffer, size_t Size) {
+        while (Size > 0)
+        {
+            const auto BytesWritten = TEMP_FAILURE_RETRY(send(Socket, Buffer, Size, MSG_NOSIGNAL));
+            THROW_LAST_ERROR_IF(BytesWritten < 0);
+
+            Buffer += BytesWritten;
+            Size -= BytesWritten;
+        }
+    };
+
+    bool CopyFailed = false;
+    ZstdFrameIndex Index;
+    if (Zstd)
+    {
+        Pipe.write().reset();
+        try
+        {
+            std::vector<char> Buffer(EXPORT_PIPE_SIZE);
+            for (;;)
+            {
+                const auto BytesRead = TEMP_FAILURE_RETRY(read(Pipe.read().get(), Buffer.data(), Buffer.size()));
+                THROW_LAST_ERROR_IF(BytesRead < 0);
+                if (BytesRead == 0)
+                {
+                    break;
+                }
+
+                Send(Buffer.data(), Index.Append(gsl::make_span(Buffer.data(), BytesRead)));
+            }
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            CopyFailed = true;
+        }
+
+        //
+        // Closing the pipe stops bsdtar if the copy failed.
+        //
+
+        Pipe.read().reset();
+    }
+
+    //
+    // Wait for the child to exit, append the index of a seekable archive, and
+    // shut down the socket.
+    //
+
+    int Result = WaitForChild(ChildPid, BSDTAR_PATH);
+    if (CopyFailed)
+    {
+        Result = -1;
+    }
+    else if (Result == 0 && Seekable)
+    {
+        try
+        {
+            const auto IndexFrame = Index.Serialize();
+            Send(IndexFrame.data(), IndexFrame.size());
+            LOG_INFO("Indexed {} zstd frames", Index.Frames().size());
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            Result = -1;
+        }
+    }
 
-    const int Result = WaitForChild(ChildPid, BSDTAR_PATH);
     if (shutdown(Socket, SHUT_WR) < 0)
     {
         LOG_ERROR("shutdown failed {}", errno);
@@ -937,6 +1047,53 @@ try
 }
 CATCH_RETURN_ERRNO()
 
+DeviceMonitor& GetDeviceMonitor()
+
+/*++
+
+Routine Description:
+
+    This routine returns the table of block devices of the calling process,
+    which is used to wait for hot-added devices to appear.
+
+    N.B. Children created with CLONE() don't run the pthread_atfork()
+         handlers, so they can inherit the lock of the parent's table held
+         by another thread. Each process creates its own table, and the one
+         inherited from the parent is never used (nor destroyed).
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    The device monitor.
+
+--*/
+
+{
+    struct ProcessDeviceMonitor
+    {
+        pid_t Pid;
+        DeviceMonitor Monitor;
+    };
+
+    static std::atomic<ProcessDeviceMonitor*> Current{nullptr};
+
+    auto* Entry = Current.load();
+    const pid_t Pid = getpid();
+    if (Entry == nullptr || Entry->Pid != Pid)
+    {
+        auto New = std::make_unique<ProcessDeviceMonitor>(Pid);
+        if (Current.compare_exchange_strong(Entry, New.get()))
+        {
+            Entry = New.release();
+        }
+    }
+
+    return Entry->Monitor;
+}
+
 std::string GetLunDeviceName(unsigned int Lun)
 
 /*++
@@ -957,37 +1114,21 @@ Return Value:
 
 {
     //
-    // Construct a path to the block directory which contains a single directory
-    // entry with the name of the device where the vhd is attached, for example: sda.
+    // Wait for the disk with the SCSI address of the LUN to be published.
     //
-    // N.B. A retry loop is needed because there is a delay between when the vhd
-    //      is hot-added from the host, and when the sysfs directory is
-    //      available in the guest.
+    // N.B. There is a delay between when the vhd is hot-added from the host, and
+    //      when the disk is available in the guest.
     //
 
-    std::string Path = std::format("{}{}/block", SCSI_DEVICE_PREFIX, Lun);
-    return wsl::shared::retry::RetryWithTimeout<std::string>(
-        [&]() {
-            wil::unique_dir Dir{opendir(Path.c_str())};
-            THROW_LAST_ERROR_IF(!Dir);
-
-            //
-            // Find the first directory entry that does not begin with a dot.
-            //
-
-            dirent64* Entry{};
-            while ((Entry = readdir64(Dir.get())) != nullptr)
-            {
-                if (Entry->d_name[0] != '.')
-                {
-                    return std::string(Entry->d_name);
-                }
-            }
+    const auto Address = std::format("{}{}", SCSI_DEVICE_NAME_PREFIX, Lun);
+    auto DeviceName = GetDeviceMonitor().WaitForScsiDisk(Address, c_defaultRetryTimeout);
+    if (!DeviceName.has_value())
+    {
+        LOG_ERROR("Timed out waiting for the disk of SCSI LUN {}", Lun);
+        THROW_ERRNO(ENXIO);
+    }
 
-            THROW_ERRNO(ENXIO);
-        },
-        c_defaultRetryPeriod,
-        c_defaultRetryTimeout);
+    return std::move(DeviceName.value());
 }
 
 std::string GetLunDevicePath(unsigned int Lun)
@@ -1057,107 +1198,89 @@ try
 }
 CATCH_RETURN_ERRNO()
 
-long long int GetUserCpuTime(void)
+int ImportFromSocket(
+    const char* Destination,
+    int Socket,
+    int ErrorSocket,
+    unsigned int Flags,
+    uint64_t* BytesImported,
+    unsigned int* ImportTimeMs)
 
 /*++
 
 Routine Description:
 
-    This routine parses /proc/stat to query a summary of all user CPU time.
+    This routine uses bsdtar to extract a tar file via a socket.
 
 Arguments:
 
-    None.
+    Destination - Supplies the path to extract the tar.
+
+    Socket - Supplies the socket to read from.
+
+    ErrorSocket - Supplies the socket to write errors and progress to.
+
+    Flags - Import flags.
+
+    BytesImported - Receives the number of bytes read from the socket.
+
+    ImportTimeMs - Receives the duration of the import, in milliseconds.
 
 Return Value:
 
-    The current user CPU counter for all cores.
+    0 on success, -1 on failure.
 
 --*/
 
 {
-    wil::unique_fd Fd{open(PROCFS_PATH "/stat", O_RDONLY)};
-    if (!Fd)
+    const auto Start = std::chrono::steady_clock::now();
+    *BytesImported = 0;
+    *ImportTimeMs = 0;
+
+    //
+    // Create a pipe for bsdtar's stdin. The socket is copied to it through a
+    // buffer, so that the socket keeps being drained while bsdtar waits on the
+    // disk, and so that bsdtar reads large blocks instead of socket sized ones.
+    //
+    // N.B. Failing to grow the pipe only makes the import slower.
+    //
+
+    auto Pipe = wil::unique_pipe::create(O_CLOEXEC);
+    if (!Pipe.read() || !Pipe.write())
     {
-        LOG_ERROR("open failed {}", errno);
+        LOG_ERROR("pipe2 failed {}", errno);
         return -1;
     }
 
-    char Buffer[32];
-    int Result = TEMP_FAILURE_RETRY(read(Fd.get(), Buffer, (sizeof(Buffer) - 1)));
-    if (Result < 0)
+    if (fcntl(Pipe.write().get(), F_SETPIPE_SZ, IMPORT_PIPE_SIZE) < 0)
     {
-        LOG_ERROR("read failed {}", errno);
-        return -1;
+        LOG_ERROR("fcntl(F_SETPIPE_SZ) failed {}", errno);
     }
 
     //
-    // Parse the first line of /proc/stat which is in the format
-    // "cpu  <counter>".
+    // bsdtar's stderr is relayed to the error socket, so that the progress
+    // lines don't land in the middle of its own.
     //
 
-    Buffer[Result] = '\0';
-    char* Sp1;
-    char* Info = strtok_r(Buffer, " \n", &Sp1);
-    Info = strtok_r(nullptr, " \n", &Sp1);
-    return strtoll(Info, nullptr, 10);
-}
-
-ssize_t GetMemoryInUse(void)
-
-/*++
-
-Routine Description:
-
-    This routine returns the amount memory in use in bytes.
-
-Arguments:
-
-    None.
-
-Return Value:
-
-    Total memory - Free memory. Includes that used by cache and buffers.
-
---*/
-try
-{
-    struct sysinfo Info = {};
-    THROW_LAST_ERROR_IF(sysinfo(&Info) < 0);
-    return Info.totalram - Info.freeram;
-}
-CATCH_RETURN_ERRNO()
-
-int ImportFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags)
-
-/*++
-
-Routine Description:
-
-    This routine uses bsdtar to extract a tar file via a socket.
-
-Arguments:
-
-    Destination - Supplies the path to extract the tar.
-
-    Socket - Supplies the socket to read from.
-
-    Flags - Import flags.
-
-Return Value:
-
-    0 on success, -1 on failure.
-
---*/
+    auto Output = wil::unique_pipe::create(O_CLOEXEC);
+    if (!Output.read() || !Output.write())
+    {
+        LOG_ERROR("pipe2 failed {}", errno);
+        return -1;
+    }
 
-{
     //
-    // Create a child process running bsdtar with the socket set to stdin.
+    // Create a child process running bsdtar with the pipe set to stdin.
+    //
+    // N.B. A blocking factor of 2048 makes bsdtar read 1MB per system call
+    //      instead of 10KB.
     //
 
-    int ChildPid = UtilCreateChildProcess("ImportDistro", [Destination, TarFd = Socket, ErrorSocket = ErrorSocket, Flags]() {
+    const int TarFd = Pipe.read().get();
+    const int OutputFd = Output.write().get();
+    int ChildPid = UtilCreateChildProcess("ImportDistro", [Destination, TarFd, OutputFd, Flags]() {
         THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(TarFd, STDIN_FILENO)) < 0);
-        THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(ErrorSocket, STDERR_FILENO)) < 0);
+        THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(OutputFd, STDERR_FILENO)) < 0);
 
         execl(
             BSDTAR_PATH,
@@ -1166,6 +1289,8 @@ Return Value:
             Destination,
             "-x",
             WI_IsFlagSet(Flags, LxMiniInitMessageFlagVerbose) ? "-vvp" : "-p",
+            "-b",
+            "2048",
             "--xattrs",
             "--numeric-owner",
             "-f",
@@ -1179,7 +1304,128 @@ Return Value:
         return -1;
     }
 
-    return WaitForChild(ChildPid, BSDTAR_PATH);
+    Pipe.read().reset();
+    Output.write().reset();
+
+    //
+    // Copy the socket to bsdtar. If the copy can't start, closing the pipe
+    // makes bsdtar fail on a truncated archive.
+    //
+
+    std::optional<StreamBuffer> Buffer;
+    try
+    {
+        Buffer.emplace(Socket, std::move(Pipe.write()), IMPORT_BUFFER_SIZE);
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION();
+        Pipe.write().reset();
+        WaitForChild(ChildPid, BSDTAR_PATH);
+        return -1;
+    }
+
+    //
+    // Relay bsdtar's output until it exits, and report the progress in verbose
+    // mode.
+    //
+    // N.B. bsdtar prints the name of an entry before extracting it, and ends
+    //      the line once it is extracted. Only complete lines are relayed, and
+    //      a progress line that falls due in between waits for the end of the
+    //      line.
+    //
+
+    const bool Verbose = WI_IsFlagSet(Flags, LxMiniInitMessageFlagVerbose);
+    auto Elapsed = [&Start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count(); };
+    auto NextProgress = Start + std::chrono::milliseconds(IMPORT_PROGRESS_INTERVAL_MS);
+    bool ProgressDue = false;
+    std::string Line;
+    std::vector<char> OutputBuffer(4096);
+    for (;;)
+    {
+        int Timeout = -1;
+        if (Verbose)
+        {
+            const auto Remaining = NextProgress - std::chrono::steady_clock::now();
+            Timeout = static_cast<int>(std::max<int64_t>(std::chrono::ceil<std::chrono::milliseconds>(Remaining).count(), 0));
+        }
+
+        pollfd PollDescriptor{.fd = Output.read().get(), .events = POLLIN, .revents = 0};
+        const int Ready = poll(&PollDescriptor, 1, Timeout);
+        if (Ready < 0 && errno != EINTR)
+        {
+            LOG_ERROR("poll failed {}", errno);
+            break;
+        }
+        else if (Ready > 0)
+        {
+            const auto BytesRead = TEMP_FAILURE_RETRY(read(Output.read().get(), OutputBuffer.data(), OutputBuffer.size()));
+            if (BytesRead <= 0)
+            {
+                break;
+            }
+
+            Line.append(OutputBuffer.data(), BytesRead);
+            const auto LineEnd = Line.rfind('\n');
+            if (LineEnd != std::string::npos)
+            {
+                UtilWriteBuffer(ErrorSocket, Line.data(), LineEnd + 1);
+                Line.erase(0, LineEnd + 1);
+            }
+        }
+
+        if (Verbose && std::chrono::steady_clock::now() >= NextProgress)
+        {
+            ProgressDue = true;
+            NextProgress += std::chrono::milliseconds(IMPORT_PROGRESS_INTERVAL_MS);
+        }
+
+        if (ProgressDue && Line.empty())
+        {
+            const double Megabytes = static_cast<double>(Buffer->BytesRead()) / (1024 * 1024);
+            UtilWriteStringView(ErrorSocket, std::format("Imported {:.0f} MB ({:.1f} MB/s)\n", Megabytes, Megabytes / Elapsed()));
+            ProgressDue = false;
+        }
+    }
+
+    if (!Line.empty())
+    {
+        UtilWriteStringView(ErrorSocket, Line);
+    }
+
+    Output.read().reset();
+
+    //
+    // Once bsdtar exited successfully, wait for the rest of the socket. The
+    // copy fails if bsdtar stopped before the end of the archive.
+    //
+
+    int Result = WaitForChild(ChildPid, BSDTAR_PATH);
+    if (Result == 0)
+    {
+        Buffer->Wait();
+    }
+
+    Buffer->Stop();
+    const int Error = Buffer->Error();
+    if (Result == 0 && Error != 0)
+    {
+        if (Error == EPIPE)
+        {
+            LOG_ERROR("{} exited before the end of the archive", BSDTAR_PATH);
+        }
+        else
+        {
+            LOG_ERROR("Copying the archive failed {}", Error);
+        }
+
+        Result = -1;
+    }
+
+    *BytesImported = Buffer->BytesRead();
+    *ImportTimeMs = static_cast<unsigned int>(Elapsed() * 1000);
+    LOG_INFO("Imported {} bytes in {}ms", *BytesImported, *ImportTimeMs);
+    return Result;
 }
 
 void StartDebugShell()
@@ -1270,7 +1516,7 @@ Return Value:
     return WaitForChild(ChildPid, DHCPCD_PATH);
 }
 
-int StartGuestNetworkService(int GnsFd, wil::unique_fd&& DnsTunnelingFd, uint32_t DnsTunnelingIpAddress)
+int StartGuestNetworkService(int GnsFd, wil::unique_fd&& DnsTunnelingFd, uint32_t DnsTunnelingIpAddress, bool EnableDnsTunnelingCache)
 
 /*++
 
@@ -1286,6 +1532,8 @@ Arguments:
 
     DnsTunnelingIpAddress - IP address to be used by the DNS tunneling listener.
 
+    EnableDnsTunnelingCache - Supplies a boolean specifying if the DNS tunneling listener should cache responses.
+
 Return Value:
 
     0 on success, -1 on failure.
@@ -1293,8 +1541,9 @@ Return Value:
 --*/
 
 {
-    const auto ChildPid =
-        UtilCreateChildProcess("GuestNetworkService", [GnsFd, DnsTunnelingFd = std::move(DnsTunnelingFd), DnsTunnelingIpAddress]() {
+    const auto ChildPid = UtilCreateChildProcess(
+        "GuestNetworkService",
+        [GnsFd, DnsTunnelingFd = std::move(DnsTunnelingFd), DnsTunnelingIpAddress, EnableDnsTunnelingCache]() {
             std::string GnsSocketArg = std::to_string(GnsFd);
             THROW_LAST_ERROR_IF(SetCloseOnExec(GnsFd, false) < 0);
 
@@ -1314,6 +1563,7 @@ Return Value:
                     DnsSocketArg.c_str(),
                     LX_INIT_GNS_DNS_TUNNELING_IP,
                     dnsIp.Addr().c_str(),
+                    EnableDnsTunnelingCache ? LX_INIT_GNS_DNS_TUNNELING_CACHE_ARG : nullptr,
                     nullptr);
             }
             else
@@ -1842,6 +2092,13 @@ try
         AddEnvironmentVariable(LX_WSL2_SAFE_MODE, c_trueString);
     }
 
+    //
+    // Pass the mini_init startup timeline so it can be merged with the timeline of init.
+    //
+
+    TimelineMark("mini_init: launching init");
+    AddEnvironmentVariable(LX_WSL2_STARTUP_TIMELINE_ENV, TimelineSerialize().c_str());
+
     //
     // If GPU support is enabled, move the GPU share mounts to temporary
     // mount points inside the distro. These will be moved by the distro init
@@ -2030,6 +2287,33 @@ std::vector<unsigned int> ListScsiDisks()
     return disks;
 }
 
+void LogBootSteps(TaskGraph& Steps) noexcept
+
+/*++
+
+Routine Description:
+
+    This routine logs the boot steps, with their dependencies and timing.
+
+Arguments:
+
+    Steps - Supplies the boot steps.
+
+Return Value:
+
+    None.
+
+--*/
+
+try
+{
+    for (const auto& Line : wsl::shared::string::Split(Steps.Dump(), '\n'))
+    {
+        LOG_INFO("{}", Line);
+    }
+}
+CATCH_LOG()
+
 void LogException(const char* Message, const char* Description) noexcept
 
 /*++
@@ -2432,30 +2716,121 @@ try
 
     return 0;
 }
-CATCH_RETURN_ERRNO()
+CATCH_RETURN_ERRNO()
+
+std::string GetMountTarget(const char* Name)
+
+/*++
+
+Routine Description:
+
+    Generate the path to a mount target.
+
+Arguments:
+
+    Name - Supplies the mount name.
+
+    Target - The buffer receiving the mountpoint target.
+
+Return Value:
+
+    0 on success, < 0 on failure.
+
+--*/
+
+{
+    return std::format("{}/{}", CROSS_DISTRO_SHARE_PATH, Name);
+}
 
-std::string GetMountTarget(const char* Name)
+void NotifyChildExit(int NotifyFd, pid_t Pid)
 
 /*++
 
 Routine Description:
 
-    Generate the path to a mount target.
+    This routine notifies the service that a child process exited.
+
+    If the child mounted a distribution, its filesystem is flushed first, so
+    the service does not detach the disk before the writes reach it. The flush
+    is done on a separate thread so other messages can be processed in the
+    meantime, and only flushes the filesystem of the child instead of every
+    filesystem in the VM.
 
 Arguments:
 
-    Name - Supplies the mount name.
+    NotifyFd - Supplies the socket to notify the service on.
 
-    Target - The buffer receiving the mountpoint target.
+    Pid - Supplies the pid of the child process.
 
 Return Value:
 
-    0 on success, < 0 on failure.
+    None.
 
 --*/
 
 {
-    return std::format("{}/{}", CROSS_DISTRO_SHARE_PATH, Name);
+    auto Notify = [NotifyFd, Pid]() {
+        LX_MINI_INIT_CHILD_EXIT_MESSAGE Message{};
+        Message.Header.MessageType = LxMiniInitMessageChildExit;
+        Message.Header.MessageSize = sizeof(Message);
+        Message.ChildPid = Pid;
+
+        std::lock_guard Lock{g_ChildExitNotifyLock};
+        if (UtilWriteBuffer(NotifyFd, gslhelpers::struct_as_bytes(Message)) < 0)
+        {
+            LOG_ERROR("write failed {}", errno);
+        }
+    };
+
+    wil::unique_fd Filesystem;
+    const auto Node = g_ChildFilesystemSockets.extract(Pid);
+    if (!Node.empty())
+    {
+        Filesystem = ReceiveFilesystem(Node.mapped().get());
+    }
+
+    if (!Filesystem)
+    {
+        Notify();
+        return;
+    }
+
+    auto FlushDone = []() {
+        std::lock_guard Lock{g_ChildExitNotifyLock};
+        g_ChildExitFlushes -= 1;
+        g_ChildExitFlushDone.notify_all();
+    };
+
+    {
+        std::lock_guard Lock{g_ChildExitNotifyLock};
+        g_ChildExitFlushes += 1;
+    }
+
+    try
+    {
+        std::thread([Filesystem = std::move(Filesystem), Notify, FlushDone, Pid]() mutable {
+            if (syncfs(Filesystem.get()) < 0)
+            {
+                LOG_ERROR("syncfs failed {}, pid {}", errno, Pid);
+            }
+
+            //
+            // N.B. If the mount namespace of the child is gone, closing the
+            //      last reference unmounts the filesystem before close
+            //      returns.
+            //
+
+            Filesystem.reset();
+            Notify();
+            FlushDone();
+        }).detach();
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION();
+        Notify();
+        FlushDone();
+    }
 }
 
 void ProcessLaunchInitMessage(
@@ -2463,6 +2838,7 @@ void ProcessLaunchInitMessage(
     gsl::span<gsl::byte> Buffer,
     wsl::shared::SocketChannel&& Channel,
     wil::unique_fd&& SystemDistroSocketFd,
+    wil::unique_fd&& FilesystemSocket,
     const VmConfiguration& Config)
 {
     //
@@ -2492,7 +2868,12 @@ void ProcessLaunchInitMessage(
         // Mount the device.
         //
 
+        TimelineMark("mini_init: launching distribution");
         THROW_LAST_ERROR_IF(MountDevice(Message->MountDeviceType, Message->DeviceId, DISTRO_PATH, FsType, Message->Flags, MountOptions) < 0);
+        TimelineMark("mini_init: distribution mounted");
+
+        SendFilesystem(FilesystemSocket.get(), DISTRO_PATH);
+        FilesystemSocket.reset();
 
         //
         // Allow /etc/wsl.conf in the user distro to opt-out of GUI support.
@@ -2712,7 +3093,8 @@ void PostProcessImportedDistribution(wsl::shared::MessageWriter<LX_MINI_INIT_IMP
     CATCH_LOG();
 }
 
-void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::SocketChannel&& Channel)
+void ProcessImportExportMessage(
+    gsl::span<gsl::byte> Buffer, wsl::shared::SocketChannel&& Channel, wil::unique_fd&& FilesystemSocket)
 {
     const LX_MINI_INIT_MESSAGE* Message{};
     sockaddr_vm ListenAddress{};
@@ -2747,6 +3129,9 @@ void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::Socket
             auto* MountOptions = wsl::shared::string::FromSpan(Buffer, Message->MountOptionsOffset);
             THROW_LAST_ERROR_IF(MountDevice(Message->MountDeviceType, Message->DeviceId, DISTRO_PATH, FsType, Message->Flags, MountOptions) < 0);
 
+            SendFilesystem(FilesystemSocket.get(), DISTRO_PATH);
+            FilesystemSocket.reset();
+
             Result = 0;
         }
         catch (...)
@@ -2762,7 +3147,9 @@ void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::Socket
     }
 
     Result = -1;
-    auto ReportStatus = wil::scope_exit([&Channel, &Result, MessageType = Message->Header.MessageType]() {
+    uint64_t BytesImported = 0;
+    unsigned int ImportTimeMs = 0;
+    auto ReportStatus = wil::scope_exit([&, MessageType = Message->Header.MessageType]() {
         if (MessageType == LxMiniInitMessageExport)
         {
             if (UtilWriteBuffer(Channel.Socket(), &Result, sizeof(Result)) < 0)
@@ -2774,6 +3161,8 @@ void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::Socket
         {
             wsl::shared::MessageWriter<LX_MINI_INIT_IMPORT_RESULT> message;
             message->Result = Result;
+            message->BytesImported = BytesImported;
+            message->ImportTimeMs = ImportTimeMs;
             if (Result == 0)
             {
                 PostProcessImportedDistribution(message, DISTRO_PATH);
@@ -2792,7 +3181,8 @@ void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::Socket
     switch (Message->Header.MessageType)
     {
     case LxMiniInitMessageImport:
-        Result = ImportFromSocket(DISTRO_PATH, DataSocket.get(), ErrorSocket.get(), Message->Flags);
+        Result = ImportFromSocket(
+            DISTRO_PATH, DataSocket.get(), ErrorSocket.get(), Message->Flags, &BytesImported, &ImportTimeMs);
         break;
 
     case LxMiniInitMessageExport:
@@ -3045,7 +3435,7 @@ int ProcessWaitForPmemDeviceMessage(PLX_MINI_INIT_WAIT_FOR_PMEM_DEVICE_MESSAGE M
 Routine Description:
 
     This routine processes a message that waits for a pmem device to appear under /dev.
-    The actual waiting is performed asynchronously.
+    The actual waiting is performed asynchronously, on a separate thread.
 
 Arguments:
 
@@ -3057,6 +3447,7 @@ Return Value:
 
 --*/
 
+try
 {
     wsl::shared::SocketChannel Channel{wil::unique_fd{UtilConnectVsock(LX_INIT_UTILITY_VM_INIT_PORT, true)}, "WaitForPmem"};
     if (Channel.Socket() < 0)
@@ -3064,42 +3455,40 @@ Return Value:
         return -1;
     }
 
-    const int ChildPid = UtilCreateChildProcess("PMemDeviceWait", [&Channel, PmemId = Message->PmemId]() {
-        int Result = -1;
-        auto ReportStatus = wil::scope_exit([&Channel, &Result]() { Channel.SendResultMessage<int32_t>(Result); });
-
-        //
-        // Construct the device path.
-        //
+    //
+    // Wait for the device to be published by the kernel on a separate thread, so
+    // other messages can be processed in the meantime.
+    //
 
-        std::string DevicePath = std::format("{}/pmem{}", DEVFS_PATH, PmemId);
+    std::thread([Channel = std::move(Channel), PmemId = Message->PmemId]() mutable {
+        int Result = -ENOENT;
+        try
+        {
+            if (GetDeviceMonitor().WaitForBlockDevice(std::format("pmem{}", PmemId), c_defaultRetryTimeout))
+            {
+                Result = 0;
+            }
+            else
+            {
+                LOG_ERROR("Timed out waiting for {}/pmem{}", DEVFS_PATH, PmemId);
+            }
+        }
+        CATCH_LOG()
 
         //
-        // Poll for the device to appear. Ideally we'd replace this with something
-        // like libudev so we can be notified when devices appear.
+        // N.B. This thread runs in mini_init, so errors are logged instead of thrown.
         //
 
-        struct stat Buffer;
-        wsl::shared::retry::RetryWithTimeout<void>(
-            [&]() { THROW_LAST_ERROR_IF(stat(DevicePath.c_str(), &Buffer) < 0); },
-            c_defaultRetryPeriod,
-            c_defaultRetryTimeout,
-            [&]() {
-                Result = -wil::ResultFromCaughtException();
-                return Result == -ENOENT;
-            });
-
-        Result = 0;
-    });
-
-    if (ChildPid < 0)
-    {
-        Channel.SendResultMessage<int32_t>(errno);
-        return -1;
-    }
+        try
+        {
+            Channel.SendResultMessage<int32_t>(Result);
+        }
+        CATCH_LOG()
+    }).detach();
 
     return 0;
 }
+CATCH_RETURN_ERRNO()
 
 int ProcessResizeDistributionMessage(gsl::span<gsl::byte> Buffer)
 try
@@ -3220,9 +3609,26 @@ try
                 }
             }
 
+            //
+            // Create a socket for the child to send a file descriptor to the
+            // filesystem it mounts, so the filesystem can be flushed when the
+            // child exits.
+            //
+
+            int FilesystemSockets[2];
+            THROW_LAST_ERROR_IF(socketpair(AF_UNIX, (SOCK_DGRAM | SOCK_CLOEXEC), 0, FilesystemSockets) < 0);
+
+            wil::unique_fd FilesystemSocket{FilesystemSockets[0]};
+            wil::unique_fd ChildFilesystemSocket{FilesystemSockets[1]};
             auto ChildPid = UtilCreateChildProcess(
                 "LaunchDistro",
-                [Type, Message, Buffer, Channel = std::move(Channel), SystemDistroSocketFd = std::move(SystemDistroSocketFd), &Config]() mutable {
+                [Type,
+                 Message,
+                 Buffer,
+                 Channel = std::move(Channel),
+                 SystemDistroSocketFd = std::move(SystemDistroSocketFd),
+                 ChildFilesystemSocket = std::move(ChildFilesystemSocket),
+                 &Config]() mutable {
                     //
                     // Restore the default signal flags so anything blocked by mini_init doesn't get
                     // inherited by init and session leaders.
@@ -3232,17 +3638,29 @@ try
 
                     if (Type == LxMiniInitMessageLaunchInit)
                     {
-                        ProcessLaunchInitMessage(Message, Buffer, std::move(Channel), std::move(SystemDistroSocketFd), Config);
+                        ProcessLaunchInitMessage(
+                            Message,
+                            Buffer,
+                            std::move(Channel),
+                            std::move(SystemDistroSocketFd),
+                            std::move(ChildFilesystemSocket),
+                            Config);
                         FATAL_ERROR("Unexpected return from ProcessLaunchInitMessage");
                     }
                     else
                     {
-                        ProcessImportExportMessage(Buffer, std::move(Channel));
+                        ProcessImportExportMessage(Buffer, std::move(Channel), std::move(ChildFilesystemSocket));
                     }
                 },
                 (CLONE_NEWIPC | CLONE_NEWNS | CLONE_NEWPID | CLONE_NEWUTS | SIGCHLD));
 
-            return (ChildPid < 0) ? -1 : 0;
+            if (ChildPid < 0)
+            {
+                return -1;
+            }
+
+            g_ChildFilesystemSockets.emplace(ChildPid, std::move(FilesystemSocket));
+            return 0;
         }
         CATCH_RETURN_ERRNO()
 
@@ -3272,6 +3690,7 @@ try
             return -1;
         }
 
+        TimelineMark("mini_init: early config received");
         if (EarlyConfig->EnableSafeMode)
         {
             LOG_WARNING("{} - many features will be disabled", WSL_SAFE_MODE_WARNING);
@@ -3279,41 +3698,52 @@ try
         }
 
         //
-        // Establish the connection for the guest network service.
+        // Run the boot steps. Steps that don't depend on each other run concurrently.
+        //
+        // N.B. Mounting the system distro moves the devtmpfs, procfs and sysfs mounts and changes the root directory,
+        //      so every step that accesses the file system depends on it.
         //
 
-        auto SocketFd = UtilConnectVsock(LX_INIT_UTILITY_VM_INIT_PORT, true);
-        if (!SocketFd)
-        {
-            return -1;
-        }
+        TaskGraph Steps{"mini_init early"};
+        wil::unique_fd SocketFd{};
+        wil::unique_fd DnsTunnelingSocketFd{};
 
         //
-        // If DNS tunneling is enabled, open a separate hvsocket connection for it.
+        // Establish the connection for the guest network service. If DNS tunneling is enabled, open a separate
+        // hvsocket connection for it.
+        //
+        // N.B. The service accepts these connections in this order, so they are established by the same step.
         //
 
-        wil::unique_fd DnsTunnelingSocketFd{};
-        if (EarlyConfig->EnableDnsTunneling)
-        {
-            DnsTunnelingSocketFd = UtilConnectVsock(LX_INIT_UTILITY_VM_INIT_PORT, true);
-            if (!DnsTunnelingSocketFd)
+        const auto Connect = Steps.Add("connect guest network service", {}, [&]() {
+            SocketFd = UtilConnectVsock(LX_INIT_UTILITY_VM_INIT_PORT, true);
+            if (!SocketFd)
             {
                 return -1;
             }
-        }
 
-        //
-        // Configure page reporting and memory reclamation.
-        //
+            if (EarlyConfig->EnableDnsTunneling)
+            {
+                DnsTunnelingSocketFd = UtilConnectVsock(LX_INIT_UTILITY_VM_INIT_PORT, true);
+                if (!DnsTunnelingSocketFd)
+                {
+                    return -1;
+                }
+            }
 
-        ConfigureMemoryReduction(EarlyConfig->PageReportingOrder, EarlyConfig->MemoryReclaimMode);
+            return 0;
+        });
 
         //
         // Initialize system distro if supported.
         //
 
-        if (EarlyConfig->SystemDistroDeviceId != UINT_MAX)
-        {
+        const auto SystemDistro = Steps.Add("mount system distro", {}, [&]() {
+            if (EarlyConfig->SystemDistroDeviceId == UINT_MAX)
+            {
+                return 0;
+            }
+
             if (MountSystemDistro(EarlyConfig->SystemDistroDeviceType, EarlyConfig->SystemDistroDeviceId) < 0)
             {
                 return -1;
@@ -3350,20 +3780,55 @@ try
                 StartDebugShell();
             }
 
+            return 0;
+        });
+
+        //
+        // Initialization required by mini_init.
+        //
+        // N.B. This sets the resource limits, the loopback interface and the hostname, which the processes started by the
+        //      next steps (chronyd, modprobe) inherit or use.
+        //
+
+        const auto Initialized = Steps.Add("initialize", {SystemDistro}, [&]() {
+            return Initialize(wsl::shared::string::FromSpan(Buffer, EarlyConfig->HostnameOffset));
+        });
+
+        //
+        // Configure page reporting and memory reclamation.
+        //
+
+        Steps.Add("configure memory reduction", {SystemDistro}, [&]() {
+            ConfigureMemoryReduction(
+                EarlyConfig->PageReportingOrder,
+                EarlyConfig->MemoryReclaimMode,
+                EarlyConfig->MemoryReclaimFloor,
+                EarlyConfig->MemoryReclaimMaxPressure);
+            return 0;
+        });
+
+        if (EarlyConfig->SystemDistroDeviceId != UINT_MAX)
+        {
             //
             // Configure swap space.
             //
 
             if (EarlyConfig->SwapLun != UINT_MAX)
             {
-                CreateSwap(EarlyConfig->SwapLun);
+                Steps.Add("create swap", {SystemDistro}, [&]() {
+                    CreateSwap(EarlyConfig->SwapLun);
+                    return 0;
+                });
             }
 
             //
             // Start the time sync agent (chronyd) to keep guest clock in sync with the host.
             //
 
-            StartTimeSyncAgent();
+            Steps.Add("start time sync agent", {Initialized}, [&]() {
+                StartTimeSyncAgent();
+                return 0;
+            });
         }
 
         //
@@ -3373,8 +3838,12 @@ try
         //      directory must be writable for tools like depmod to work.
         //
 
-        if (EarlyConfig->KernelModulesDeviceId != UINT_MAX)
-        {
+        const auto KernelModules = Steps.Add("load kernel modules", {Initialized}, [&]() {
+            if (EarlyConfig->KernelModulesDeviceId == UINT_MAX)
+            {
+                return 0;
+            }
+
             THROW_LAST_ERROR_IF(
                 MountDevice(LxMiniInitMountDeviceTypeLun, EarlyConfig->KernelModulesDeviceId, KERNEL_MODULES_VHD_PATH, "ext4", LxMiniInitMessageFlagMountReadOnly, nullptr) <
                 0);
@@ -3385,6 +3854,11 @@ try
             std::string Target = std::format("{}/{}", KERNEL_MODULES_PATH, UnameBuffer.release);
             THROW_LAST_ERROR_IF(UtilMountOverlayFs(Target.c_str(), KERNEL_MODULES_VHD_PATH, (MS_NOATIME | MS_NOSUID | MS_NODEV)) < 0);
 
+            //
+            // N.B. Modules are loaded in the order they were specified, since that order can be significant
+            //      (for example, for the naming of devices).
+            //
+
             const std::string KernelModulesList = wsl::shared::string::FromSpan(Buffer, EarlyConfig->KernelModulesListOffset);
             for (const auto& Module : wsl::shared::string::Split(KernelModulesList, ','))
             {
@@ -3398,27 +3872,29 @@ try
             }
 
             Config.KernelModulesPath = std::move(Target);
-        }
-
-        //
-        // Initialization required by mini_init.
-        //
-
-        if (Initialize(wsl::shared::string::FromSpan(Buffer, EarlyConfig->HostnameOffset)) < 0)
-        {
-            return -1;
-        }
+            return 0;
+        });
 
         //
         // Start the guest network service.
         //
+        // N.B. It needs the host connections, the network drivers loaded with the kernel modules, and the loopback
+        //      interface configured by Initialize(). It doesn't wait for the memory reduction, swap and time sync
+        //      steps.
+        //
 
-        if (StartGuestNetworkService(SocketFd.get(), std::move(DnsTunnelingSocketFd), EarlyConfig->DnsTunnelingIpAddress) < 0)
-        {
-            return -1;
-        }
+        Steps.Add("start guest network service", {Connect, KernelModules, Initialized}, [&]() {
+            return StartGuestNetworkService(
+                SocketFd.get(),
+                std::move(DnsTunnelingSocketFd),
+                EarlyConfig->DnsTunnelingIpAddress,
+                EarlyConfig->EnableDnsTunnelingCache);
+        });
 
-        return 0;
+        const auto Result = Steps.Run(BOOT_MAX_CONCURRENT_STEPS);
+        LogBootSteps(Steps);
+        TimelineEmit("mini_init");
+        return Result;
     }
 
     case LxMiniInitMessageInitialConfig:
@@ -3430,54 +3906,71 @@ try
             return -1;
         }
 
+        //
+        // None of these steps depend on each other, so they all run concurrently.
+        //
+
+        TaskGraph Steps{"mini_init config"};
         auto NetworkingConfiguration = &ConfigMessage->NetworkingConfiguration;
         Config.NetworkingMode = NetworkingConfiguration->NetworkingMode;
         if (NetworkingConfiguration->PortTrackerType != LxMiniInitPortTrackerTypeNone)
         {
-            StartPortTracker(NetworkingConfiguration->PortTrackerType);
+            Steps.Add("start port tracker", {}, [&]() {
+                StartPortTracker(NetworkingConfiguration->PortTrackerType);
+                return 0;
+            });
         }
 
         if (NetworkingConfiguration->DisableIpv6)
         {
-            WriteToFile("/proc/sys/net/ipv6/conf/all/disable_ipv6", c_trueString);
+            Steps.Add("disable IPv6", {}, [&]() {
+                WriteToFile("/proc/sys/net/ipv6/conf/all/disable_ipv6", c_trueString);
+                return 0;
+            });
         }
 
         if (NetworkingConfiguration->EnableDhcpClient)
         {
-            StartDhcpClient(NetworkingConfiguration->DhcpTimeout);
+            Steps.Add("start DHCP client", {}, [&]() {
+                StartDhcpClient(NetworkingConfiguration->DhcpTimeout);
+                return 0;
+            });
         }
 
-        if (SetEphemeralPortRange(NetworkingConfiguration->EphemeralPortRangeStart, NetworkingConfiguration->EphemeralPortRangeEnd) < 0)
-        {
-            return -1;
-        }
+        Steps.Add("set ephemeral port range", {}, [&]() {
+            return SetEphemeralPortRange(
+                NetworkingConfiguration->EphemeralPortRangeStart, NetworkingConfiguration->EphemeralPortRangeEnd);
+        });
 
         if (ConfigMessage->EntropySize > 0)
         {
-            InjectEntropy(Buffer.subspan(ConfigMessage->EntropyOffset, ConfigMessage->EntropySize));
+            Steps.Add("inject entropy", {}, [&]() {
+                InjectEntropy(Buffer.subspan(ConfigMessage->EntropyOffset, ConfigMessage->EntropySize));
+                return 0;
+            });
         }
 
         if (ConfigMessage->MountGpuShares)
         {
-            if (MountPlan9(LXSS_GPU_DRIVERS_SHARE, GPU_SHARE_DRIVERS, true) < 0)
-            {
-                return -1;
-            }
-
-            if (MountPlan9(LXSS_GPU_PACKAGED_LIB_SHARE, GPU_SHARE_LIB_PACKAGED, true) < 0)
-            {
-                return -1;
-            }
-
+            Steps.Add("mount GPU drivers", {}, [&]() { return MountPlan9(LXSS_GPU_DRIVERS_SHARE, GPU_SHARE_DRIVERS, true); });
+            Steps.Add("mount GPU libraries", {}, [&]() {
+                return MountPlan9(LXSS_GPU_PACKAGED_LIB_SHARE, GPU_SHARE_LIB_PACKAGED, true);
+            });
             if (ConfigMessage->EnableInboxGpuLibs)
             {
-                if (MountPlan9(LXSS_GPU_INBOX_LIB_SHARE, GPU_SHARE_LIB_INBOX, true) < 0)
-                {
-                    return -1;
-                }
+                Steps.Add("mount inbox GPU libraries", {}, [&]() {
+                    return MountPlan9(LXSS_GPU_INBOX_LIB_SHARE, GPU_SHARE_LIB_INBOX, true);
+                });
             }
         }
 
+        const auto Result = Steps.Run(BOOT_MAX_CONCURRENT_STEPS);
+        LogBootSteps(Steps);
+        if (Result < 0)
+        {
+            return -1;
+        }
+
         Config.EnableInboxGpuLibs = ConfigMessage->EnableInboxGpuLibs;
         Config.EnableGpuSupport = ConfigMessage->MountGpuShares;
         Config.EnableGuiApps = ConfigMessage->EnableGuiApps;
@@ -3534,6 +4027,54 @@ try
 }
 CATCH_RETURN_ERRNO();
 
+wil::unique_fd ReceiveFilesystem(int Socket)
+
+/*++
+
+Routine Description:
+
+    This routine receives the file descriptor sent by SendFilesystem, if any.
+
+Arguments:
+
+    Socket - Supplies the socket to receive from.
+
+Return Value:
+
+    The file descriptor, or an invalid file descriptor if none was sent.
+
+--*/
+
+{
+    char Data{};
+    iovec Vector{.iov_base = &Data, .iov_len = sizeof(Data)};
+    alignas(cmsghdr) char Control[CMSG_SPACE(sizeof(int))];
+    msghdr Header{};
+    Header.msg_iov = &Vector;
+    Header.msg_iovlen = 1;
+    Header.msg_control = Control;
+    Header.msg_controllen = sizeof(Control);
+    if (TEMP_FAILURE_RETRY(recvmsg(Socket, &Header, (MSG_DONTWAIT | MSG_CMSG_CLOEXEC))) < 0)
+    {
+        if (errno != EAGAIN)
+        {
+            LOG_ERROR("recvmsg failed {}", errno);
+        }
+
+        return {};
+    }
+
+    const auto* Message = CMSG_FIRSTHDR(&Header);
+    if (Message == nullptr || Message->cmsg_level != SOL_SOCKET || Message->cmsg_type != SCM_RIGHTS)
+    {
+        return {};
+    }
+
+    int Fd;
+    memcpy(&Fd, CMSG_DATA(Message), sizeof(Fd));
+    return wil::unique_fd{Fd};
+}
+
 wil::unique_fd RegisterSeccompHook()
 
 /*++
@@ -3670,6 +4211,59 @@ try
 }
 CATCH_RETURN_ERRNO();
 
+void SendFilesystem(int Socket, const char* Path)
+
+/*++
+
+Routine Description:
+
+    This routine sends a file descriptor to the filesystem mounted on the
+    specified path to mini_init, so it can flush the filesystem when the child
+    process exits.
+
+    N.B. Failures are non-fatal, mini_init then does not flush the filesystem.
+
+Arguments:
+
+    Socket - Supplies the socket to send the file descriptor on.
+
+    Path - Supplies the path of the mountpoint.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+    wil::unique_fd Fd{open(Path, (O_RDONLY | O_DIRECTORY | O_CLOEXEC))};
+    if (!Fd)
+    {
+        LOG_ERROR("open({}) failed {}", Path, errno);
+        return;
+    }
+
+    char Data{};
+    iovec Vector{.iov_base = &Data, .iov_len = sizeof(Data)};
+    alignas(cmsghdr) char Control[CMSG_SPACE(sizeof(int))]{};
+    msghdr Header{};
+    Header.msg_iov = &Vector;
+    Header.msg_iovlen = 1;
+    Header.msg_control = Control;
+    Header.msg_controllen = sizeof(Control);
+
+    auto* Message = CMSG_FIRSTHDR(&Header);
+    Message->cmsg_level = SOL_SOCKET;
+    Message->cmsg_type = SCM_RIGHTS;
+    Message->cmsg_len = CMSG_LEN(sizeof(int));
+    const int Value = Fd.get();
+    memcpy(CMSG_DATA(Message), &Value, sizeof(Value));
+    if (TEMP_FAILURE_RETRY(sendmsg(Socket, &Header, 0)) < 0)
+    {
+        LOG_ERROR("sendmsg failed {}", errno);
+    }
+}
+
 int SetCloseOnExec(int Fd, bool Enable)
 
 /*++
@@ -3816,17 +4410,24 @@ Return Value:
 --*/
 
 {
-    wsl::shared::retry::RetryWithTimeout<void>(
-        [&]() {
-            wil::unique_fd device{open(Path, O_RDONLY)};
-            THROW_LAST_ERROR_IF(!device);
-        },
-        c_defaultRetryPeriod,
-        c_defaultRetryTimeout,
-        [&]() {
-            errno = wil::ResultFromCaughtException();
-            return errno == ENOENT || errno == ENXIO || errno == EIO;
-        });
+    //
+    // Wait for the kernel to publish the device. The device node is created
+    // before the device is published, so it can be opened once it's present.
+    //
+
+    const std::string_view Name{Path};
+    const auto Prefix = std::string_view{DEVFS_PATH "/"};
+    if (!Name.starts_with(Prefix))
+    {
+        LOG_ERROR("Unexpected block device path: {}", Path);
+        THROW_ERRNO(EINVAL);
+    }
+
+    if (!GetDeviceMonitor().WaitForBlockDevice(std::string{Name.substr(Prefix.size())}, c_defaultRetryTimeout))
+    {
+        LOG_ERROR("Timed out waiting for block device {}", Path);
+        THROW_ERRNO(ENOENT);
+    }
 }
 
 int WaitForChild(pid_t Pid, const char* Name)
@@ -3990,6 +4591,7 @@ int main(int Argc, char* Argv[])
     //
 
     LOG_INFO("WSL version {}", WSL_PACKAGE_VERSION);
+    TimelineMark("mini_init: started");
 
     //
     // Ensure /dev/console is present and set as the controlling terminal.
@@ -4217,24 +4819,11 @@ int main(int Argc, char* Argv[])
                 else if (Result > 0)
                 {
                     //
-                    // Perform a sync to flush all writes.
-                    //
-
-                    sync();
-
-                    //
-                    // Send a message with the child's pid to the service.
+                    // Flush the filesystem of the child, if any, and send a
+                    // message with the child's pid to the service.
                     //
 
-                    LX_MINI_INIT_CHILD_EXIT_MESSAGE Message{};
-                    Message.Header.MessageType = LxMiniInitMessageChildExit;
-                    Message.Header.MessageSize = sizeof(Message);
-                    Message.ChildPid = Result;
-                    Result = UtilWriteBuffer(NotifyFd.get(), gslhelpers::struct_as_bytes(Message));
-                    if (Result < 0)
-                    {
-                        LOG_ERROR("write failed {}", errno);
-                    }
+                    NotifyChildExit(NotifyFd.get(), Result);
                 }
                 else
                 {
@@ -4284,6 +4873,19 @@ ErrorExit:
     }
     CATCH_LOG();
 
+    //
+    // Wait for the threads that flush the filesystems of exited children, so
+    // no filesystem is still being flushed or unmounted when the disks are
+    // detached, then release the filesystems of the remaining children before
+    // flushing all writes.
+    //
+
+    {
+        std::unique_lock Lock{g_ChildExitNotifyLock};
+        g_ChildExitFlushDone.wait(Lock, []() { return g_ChildExitFlushes == 0; });
+    }
+
+    g_ChildFilesystemSockets.clear();
     sync();
 
     try
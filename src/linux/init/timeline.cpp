@@ -0,0 +1,321 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    timeline.cpp
+
+Abstract:
+
+    This file contains the startup timeline recorder.
+
+    Each process records the time at which it reaches the phases of its
+    startup in a fixed-size array, so marking a phase doesn't allocate and
+    can't fail. Timestamps come from CLOCK_MONOTONIC, which is shared by all
+    processes of the VM and matches the timestamps of the kernel log, so the
+    timelines of mini_init and init can be merged.
+
+--*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <time.h>
+#include "common.h"
+#include "timeline.h"
+
+namespace {
+
+struct TimelineEntry
+{
+    std::atomic<bool> Valid;
+    uint64_t Timestamp;
+    char Phase[TIMELINE_MAX_PHASE_LENGTH];
+};
+
+struct TimelinePhase
+{
+    uint64_t Timestamp;
+    std::string Phase;
+};
+
+TimelineEntry g_TimelineEntries[TIMELINE_MAX_ENTRIES];
+std::atomic<size_t> g_TimelineCount{0};
+
+void TimelineRecord(uint64_t Timestamp, const char* Phase, size_t Length) noexcept
+
+/*++
+
+Routine Description:
+
+    This routine records a phase in the next free timeline entry.
+
+Arguments:
+
+    Timestamp - Supplies the CLOCK_MONOTONIC time of the phase, in nanoseconds.
+
+    Phase - Supplies the phase name.
+
+    Length - Supplies the length of the phase name.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+    const auto Index = g_TimelineCount.fetch_add(1, std::memory_order_relaxed);
+    if (Index >= TIMELINE_MAX_ENTRIES)
+    {
+        return;
+    }
+
+    auto& Entry = g_TimelineEntries[Index];
+    Entry.Timestamp = Timestamp;
+    Length = std::min(Length, sizeof(Entry.Phase) - 1);
+    memcpy(Entry.Phase, Phase, Length);
+    Entry.Phase[Length] = '\0';
+    Entry.Valid.store(true, std::memory_order_release);
+}
+
+std::vector<TimelinePhase> TimelineSnapshot()
+
+/*++
+
+Routine Description:
+
+    This routine returns the recorded phases, ordered by time.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    The recorded phases.
+
+--*/
+
+{
+    const auto Count = std::min(g_TimelineCount.load(std::memory_order_relaxed), static_cast<size_t>(TIMELINE_MAX_ENTRIES));
+
+    std::vector<TimelinePhase> Phases;
+    Phases.reserve(Count);
+    for (size_t Index = 0; Index < Count; Index += 1)
+    {
+        const auto& Entry = g_TimelineEntries[Index];
+        if (Entry.Valid.load(std::memory_order_acquire))
+        {
+            Phases.emplace_back(TimelinePhase{Entry.Timestamp, Entry.Phase});
+        }
+    }
+
+    std::ranges::stable_sort(Phases, {}, &TimelinePhase::Timestamp);
+    return Phases;
+}
+
+std::string TimelineFormatPhase(const TimelinePhase& Phase, uint64_t Previous)
+
+/*++
+
+Routine Description:
+
+    This routine formats a phase with its absolute time, in the format used by
+    the kernel log, and the time elapsed since the previous phase.
+
+Arguments:
+
+    Phase - Supplies the phase.
+
+    Previous - Supplies the timestamp of the previous phase.
+
+Return Value:
+
+    The formatted phase.
+
+--*/
+
+{
+    const auto Elapsed = Phase.Timestamp - std::min(Previous, Phase.Timestamp);
+    return std::format(
+        "[{:5}.{:06}] +{:6}.{:03}ms {}",
+        Phase.Timestamp / 1000000000,
+        (Phase.Timestamp % 1000000000) / 1000,
+        Elapsed / 1000000,
+        (Elapsed % 1000000) / 1000,
+        Phase.Phase);
+}
+
+} // namespace
+
+void TimelineEmit(const char* Name) noexcept
+
+/*++
+
+Routine Description:
+
+    This routine writes the timeline to the log.
+
+Arguments:
+
+    Name - Supplies the name of the timeline.
+
+Return Value:
+
+    None.
+
+--*/
+
+try
+{
+    const auto Phases = TimelineSnapshot();
+    LOG_INFO("{} startup timeline ({} phases)", Name, Phases.size());
+
+    uint64_t Previous = Phases.empty() ? 0 : Phases.front().Timestamp;
+    for (const auto& Phase : Phases)
+    {
+        LOG_INFO("{}", TimelineFormatPhase(Phase, Previous));
+        Previous = Phase.Timestamp;
+    }
+}
+CATCH_LOG()
+
+std::string TimelineFormat()
+
+/*++
+
+Routine Description:
+
+    This routine formats the timeline, one phase per line, without a trailing
+    newline.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    The formatted timeline.
+
+--*/
+
+{
+    const auto Phases = TimelineSnapshot();
+
+    std::string Output;
+    uint64_t Previous = Phases.empty() ? 0 : Phases.front().Timestamp;
+    for (const auto& Phase : Phases)
+    {
+        if (!Output.empty())
+        {
+            Output += '\n';
+        }
+
+        Output += TimelineFormatPhase(Phase, Previous);
+        Previous = Phase.Timestamp;
+    }
+
+    const auto Count = g_TimelineCount.load(std::memory_order_relaxed);
+    if (Count > TIMELINE_MAX_ENTRIES)
+    {
+        Output += std::format("\n{} phases were not recorded", Count - TIMELINE_MAX_ENTRIES);
+    }
+
+    return Output;
+}
+
+void TimelineImport(const char* Serialized) noexcept
+
+/*++
+
+Routine Description:
+
+    This routine records the phases of a timeline serialized by another
+    process, usually the parent process.
+
+Arguments:
+
+    Serialized - Supplies the timeline, in the format returned by TimelineSerialize.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+    while (*Serialized != '\0')
+    {
+        char* Separator{};
+        const uint64_t Timestamp = strtoull(Serialized, &Separator, 10);
+        if (*Separator != ':')
+        {
+            LOG_ERROR("Invalid startup timeline entry: {}", Serialized);
+            return;
+        }
+
+        const char* Phase = Separator + 1;
+        const char* End = strchrnul(Phase, ';');
+        TimelineRecord(Timestamp, Phase, End - Phase);
+        Serialized = (*End == ';') ? End + 1 : End;
+    }
+}
+
+void TimelineMark(const char* Phase) noexcept
+
+/*++
+
+Routine Description:
+
+    This routine records that the process has reached a phase of its startup.
+
+Arguments:
+
+    Phase - Supplies the phase name.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+    timespec Now{};
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    TimelineRecord((static_cast<uint64_t>(Now.tv_sec) * 1000000000) + Now.tv_nsec, Phase, strlen(Phase));
+}
+
+std::string TimelineSerialize()
+
+/*++
+
+Routine Description:
+
+    This routine serializes the timeline so it can be passed to another process.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    The timeline, as a list of 'timestamp:phase' entries separated by ';'.
+
+--*/
+
+{
+    std::string Output;
+    for (const auto& Phase : TimelineSnapshot())
+    {
+        if (!Output.empty())
+        {
+            Output += ';';
+        }
+
+        Output += std::format("{}:{}", Phase.Timestamp, Phase.Phase);
+    }
+
+    return Output;
+}
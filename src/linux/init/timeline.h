@@ -0,0 +1,34 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    timeline.h
+
+Abstract:
+
+    This file contains startup timeline function declarations.
+
+--*/
+
+#pragma once
+
+#include <string>
+
+//
+// Maximum number of phases recorded per process, and maximum length of a phase name.
+//
+
+#define TIMELINE_MAX_ENTRIES 64
+#define TIMELINE_MAX_PHASE_LENGTH 48
+
+void TimelineEmit(const char* Name) noexcept;
+
+std::string TimelineFormat();
+
+void TimelineImport(const char* Serialized) noexcept;
+
+void TimelineMark(const char* Phase) noexcept;
+
+std::string TimelineSerialize();
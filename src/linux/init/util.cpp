@@ -21,6 +21,7 @@ Abstract:
 #include <unistd.h>
 #include <sys/prctl.h>
 #include <ctype.h>
+#include <atomic>
 #include <optional>
 #include <fstream>
 #include <iostream>
@@ -1318,13 +1319,13 @@ Return Value:
     return Result;
 }
 
-std::string UtilGetVmId(void)
+std::string UtilGetStartupTimeline(void)
 
 /*++
 
 Routine Description:
 
-    This routine queries the VM ID from the init process.
+    This routine queries the startup timeline from the init process.
 
 Arguments:
 
@@ -1332,7 +1333,7 @@ Arguments:
 
 Return Value:
 
-    The VM ID if successful, an empty string otherwise.
+    The formatted timeline if successful, an empty string otherwise.
 
 --*/
 
@@ -1341,10 +1342,10 @@ try
     wsl::shared::SocketChannel channel{UtilConnectUnix(WSL_INIT_INTEROP_SOCKET), "wslinfo"};
     THROW_LAST_ERROR_IF(channel.Socket() < 0);
 
-    wsl::shared::MessageWriter<LX_INIT_QUERY_VM_ID> Message(LxInitMessageQueryVmId);
-    channel.SendMessage<LX_INIT_QUERY_VM_ID>(Message.Span());
+    wsl::shared::MessageWriter<LX_INIT_QUERY_STARTUP_TIMELINE> Message(LxInitMessageQueryStartupTimeline);
+    channel.SendMessage<LX_INIT_QUERY_STARTUP_TIMELINE>(Message.Span());
 
-    return channel.ReceiveMessage<LX_INIT_QUERY_VM_ID>().Buffer;
+    return channel.ReceiveMessage<LX_INIT_QUERY_STARTUP_TIMELINE>().Buffer;
 }
 catch (...)
 {
@@ -1352,37 +1353,38 @@ catch (...)
     return {};
 }
 
-void UtilInitGroups(const char* User, gid_t Gid)
+std::string UtilGetVmId(void)
 
 /*++
 
 Routine Description:
 
-    This routine initializes the groups for the current process.
-    N.B. This is needed because the musl version of initgroups has a hard-coded 32 group max.
+    This routine queries the VM ID from the init process.
 
 Arguments:
 
-    User - Supplies the user name.
-
-    Gid - Supplies the group id.
+    None.
 
 Return Value:
 
-    None.
+    The VM ID if successful, an empty string otherwise.
 
 --*/
 
+try
 {
-    if (initgroups(User, Gid) < 0)
-    {
-        int Count{};
-        getgrouplist(User, Gid, nullptr, &Count);
-        std::vector<gid_t> Groups(Count);
-        THROW_LAST_ERROR_IF(getgrouplist(User, Gid, Groups.data(), &Count) < 0);
+    wsl::shared::SocketChannel channel{UtilConnectUnix(WSL_INIT_INTEROP_SOCKET), "wslinfo"};
+    THROW_LAST_ERROR_IF(channel.Socket() < 0);
 
-        THROW_LAST_ERROR_IF(setgroups(Count, Groups.data()) < 0);
-    }
+    wsl::shared::MessageWriter<LX_INIT_QUERY_VM_ID> Message(LxInitMessageQueryVmId);
+    channel.SendMessage<LX_INIT_QUERY_VM_ID>(Message.Span());
+
+    return channel.ReceiveMessage<LX_INIT_QUERY_VM_ID>().Buffer;
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    return {};
 }
 
 void UtilInitializeMessageBuffer(std::vector<gsl::byte>& Buffer)
@@ -1889,6 +1891,75 @@ Return Value:
     return Fd;
 }
 
+void UtilParallelFor(size_t Count, size_t MaxConcurrency, const char* Name, const std::function<void(size_t)>& Routine)
+
+/*++
+
+Routine Description:
+
+    This routine runs a routine for each index in [0, Count), on a bounded
+    number of threads. The calling thread is one of the workers.
+
+    N.B. Exceptions thrown by the routine are logged and otherwise ignored.
+
+Arguments:
+
+    Count - Supplies the number of indices.
+
+    MaxConcurrency - Supplies the maximum number of threads to use.
+
+    Name - Supplies the name of the worker threads.
+
+    Routine - Supplies the routine to run for each index.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+    std::atomic<size_t> Next{0};
+    auto Worker = [&]() {
+        for (size_t Index = Next++; Index < Count; Index = Next++)
+        {
+            try
+            {
+                Routine(Index);
+            }
+            CATCH_LOG()
+        }
+    };
+
+    std::vector<std::thread> Threads;
+    auto JoinThreads = wil::scope_exit([&]() {
+        for (auto& Thread : Threads)
+        {
+            Thread.join();
+        }
+    });
+
+    //
+    // If a thread can't be created, the remaining indices are processed by the
+    // threads that are already running.
+    //
+
+    try
+    {
+        const auto ThreadCount = std::min(Count, MaxConcurrency);
+        for (size_t Index = 1; Index < ThreadCount; Index++)
+        {
+            Threads.emplace_back([&]() {
+                UtilSetThreadName(Name);
+                Worker();
+            });
+        }
+    }
+    CATCH_LOG()
+
+    Worker();
+}
+
 int UtilParseCgroupsLine(char* Line, char** SubsystemName, bool* Enabled)
 
 /*++
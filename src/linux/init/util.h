@@ -231,9 +231,9 @@ std::optional<LX_MINI_INIT_NETWORKING_MODE> UtilGetNetworkingMode(void);
 
 pid_t UtilGetPpid(pid_t Pid);
 
-std::string UtilGetVmId(void);
+std::string UtilGetStartupTimeline(void);
 
-void UtilInitGroups(const char* User, gid_t Gid);
+std::string UtilGetVmId(void);
 
 void UtilInitializeMessageBuffer(std::vector<gsl::byte>& Buffer);
 
@@ -255,6 +255,8 @@ int UtilMountOverlayFs(const char* Target, const char* Lower, unsigned long Moun
 
 int UtilOpenMountNamespace(void);
 
+void UtilParallelFor(size_t Count, size_t MaxConcurrency, const char* Name, const std::function<void(size_t)>& Routine);
+
 int UtilParseCgroupsLine(char* Line, char** SubsystemName, bool* Enabled);
 
 std::string UtilParsePlan9MountSource(std::string_view MountOptions);
@@ -30,7 +30,8 @@ enum class WslInfoMode
     GetNetworkingMode,
     MsalProxyPath,
     WslVersion,
-    VMId
+    VMId,
+    StartupTimeline
 };
 
 int WslInfoEntry(int Argc, char* Argv[])
@@ -68,6 +69,7 @@ Return Value:
     parser.AddArgument(UniqueSetValue<WslInfoMode, WslInfoMode::WslVersion>{Mode, Usage}, WSLINFO_WSL_VERSION);
     parser.AddArgument(UniqueSetValue<WslInfoMode, WslInfoMode::WslVersion>{Mode, Usage}, WSLINFO_WSL_VERSION_LEGACY);
     parser.AddArgument(UniqueSetValue<WslInfoMode, WslInfoMode::VMId>{Mode, Usage}, WSLINFO_WSL_VMID);
+    parser.AddArgument(UniqueSetValue<WslInfoMode, WslInfoMode::StartupTimeline>{Mode, Usage}, WSLINFO_STARTUP_TIMELINE);
     parser.AddArgument(NoOp{}, WSLINFO_WSL_HELP);
     parser.AddArgument(noNewLine, nullptr, WSLINFO_NO_NEWLINE);
 
@@ -165,6 +167,23 @@ Return Value:
             std::cout << "wsl1";
         }
     }
+    else if (Mode.value() == WslInfoMode::StartupTimeline)
+    {
+        if (!UtilIsUtilityVm())
+        {
+            std::cerr << Localization::MessageWsl2Needed() << "\n";
+            return 1;
+        }
+
+        auto Timeline = UtilGetStartupTimeline();
+        if (Timeline.empty())
+        {
+            std::cerr << Localization::MessageNoValueFound() << "\n";
+            return 1;
+        }
+
+        std::cout << Timeline;
+    }
     else
     {
         assert(false && "Unknown WslInfoMode");
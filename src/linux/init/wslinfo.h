@@ -18,6 +18,7 @@ Abstract:
 
 #define WSLINFO_MSAL_PROXY_PATH "--msal-proxy-path"
 #define WSLINFO_NETWORKING_MODE "--networking-mode"
+#define WSLINFO_STARTUP_TIMELINE "--startup-timeline"
 #define WSLINFO_WSL_VERSION "--version"
 #define WSLINFO_WSL_VERSION_LEGACY "--wsl-version"
 #define WSLINFO_WSL_VMID "--vm-id"
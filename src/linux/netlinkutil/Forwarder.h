@@ -3,10 +3,15 @@
 
 #pragma once
 
+#include <array>
 #include <stdint.h>
 #include <thread>
 #include <memory>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
 
+#include "lxwil.h"
 #include "Packet.h"
 
 class IForwarder
@@ -15,17 +20,52 @@ public:
     virtual ~IForwarder() {};
 };
 
+// Forwards packets from source fds to destination fds. Each packet read from a source is passed to Handler, and written
+// to the destination if Handler returns true.
+//
+// Packets are processed in batches: up to BatchSize packets are read per wakeup (with a single recvmmsg for datagram
+// sockets) and the forwarded ones are written together (with a single sendmmsg for datagram sockets). The packets of a
+// worker are preallocated and reused.
 template <typename ProcessingFunction, typename ExceptionHandler>
 class Forwarder : public IForwarder
 {
 public:
+    static constexpr size_t BatchSize = 32;
+
     Forwarder(int SourceFd, int DestinationFd, ProcessingFunction Handler, ExceptionHandler exceptionHandler);
+
+    // Forward each queue (pair of source and destination fds, e.g. the queues of an IFF_MULTI_QUEUE tun device) with its
+    // own worker thread. Each worker uses its own copy of Handler and exceptionHandler.
+    Forwarder(const std::vector<std::pair<int, int>>& Queues, ProcessingFunction Handler, ExceptionHandler exceptionHandler);
+
     ~Forwarder() override;
 
 private:
-    std::thread Worker;
-    int SourceFd;
-    int DestinationFd;
+    struct Batch
+    {
+        std::array<Packet, BatchSize> Packets;
+        std::array<iovec, BatchSize> Vectors;
+        std::array<mmsghdr, BatchSize> Messages;
+    };
+
+    void Run(int SourceFd, int DestinationFd, ProcessingFunction Handler, ExceptionHandler exceptionHandler);
+
+    bool WaitForFd(int Fd, short Event) const;
+
+    static bool IsDatagramSocket(int Fd);
+
+    static size_t Receive(int SourceFd, bool Datagram, Batch& Batch);
+
+    // Write a batch of packets, waiting for the destination fd whenever it's full. Returns false if the forwarder is
+    // stopping.
+    bool Send(int DestinationFd, bool Datagram, Batch& Batch, size_t Count) const;
+
+    // Handle a failed write to the destination fd: returns true if the write should be retried, after waiting for the
+    // fd to be writable if it was full, or false if the forwarder is stopping. Throws on other errors.
+    bool WaitToRetry(int DestinationFd, const char* Method) const;
+
+    std::vector<std::thread> Workers;
+    wil::unique_fd TerminateReadFd;
     int TerminateFd;
 };
 
@@ -15,94 +15,289 @@
 #define _countof(a) (sizeof(a) / sizeof(*(a)))
 
 template <typename ProcessingFunction, typename ExceptionHandler>
-Forwarder<ProcessingFunction, ExceptionHandler>::Forwarder(int SourceFd, int DestinationFd, ProcessingFunction Handler, ExceptionHandler exceptionHandler)
+Forwarder<ProcessingFunction, ExceptionHandler>::Forwarder(int SourceFd, int DestinationFd, ProcessingFunction Handler, ExceptionHandler exceptionHandler) :
+    Forwarder({{SourceFd, DestinationFd}}, std::move(Handler), std::move(exceptionHandler))
 {
-    // Create a pipe to signal the thread to stop.
+}
+
+template <typename ProcessingFunction, typename ExceptionHandler>
+Forwarder<ProcessingFunction, ExceptionHandler>::Forwarder(
+    const std::vector<std::pair<int, int>>& Queues, ProcessingFunction Handler, ExceptionHandler exceptionHandler)
+{
+    // Create a pipe to signal the threads to stop.
     int pipes[2];
     Syscall(pipe2, pipes, 0);
+    TerminateReadFd.reset(pipes[0]);
     TerminateFd = pipes[1];
 
-    Worker = std::thread([=]() {
-        try
+    try
+    {
+        for (const auto& [SourceFd, DestinationFd] : Queues)
         {
-            wil::unique_fd terminate = pipes[0];
-            auto wait_for_fd = [&terminate](int fd, int event) -> bool {
-                struct pollfd poll_fds[2];
-                poll_fds[0] = {.fd = fd, .events = event, .revents = 0};
-                poll_fds[1] = {.fd = terminate.get(), .events = POLLIN, .revents = 0};
-                for (;;)
-                {
-                    const int return_value = poll(poll_fds, _countof(poll_fds), -1);
-                    if (return_value < 0)
-                    {
-                        if (errno == EINTR)
-                        {
-                            continue;
-                        }
+            Workers.emplace_back([=, this]() { Run(SourceFd, DestinationFd, Handler, exceptionHandler); });
+        }
+    }
+    catch (...)
+    {
+        // The destructor doesn't run if the constructor throws. Stop the workers that were started, since destroying
+        // a joinable thread terminates the process.
+        close(TerminateFd);
+        for (auto& Worker : Workers)
+        {
+            Worker.join();
+        }
 
-                        throw std::runtime_error(std::string("poll returned ") + std::string(strerror(errno)));
-                    }
-                    else if (return_value == 0)
-                    {
-                        continue;
-                    }
-                    else if (poll_fds[1].revents)
-                    {
-                        return false;
-                    }
-                    else if (poll_fds[0].revents & event)
-                    {
-                        return true;
-                    }
-                }
-            };
+        throw;
+    }
+}
 
-            Packet packet;
-            for (;;)
+template <typename ProcessingFunction, typename ExceptionHandler>
+Forwarder<ProcessingFunction, ExceptionHandler>::~Forwarder()
+{
+    // Close the write end of the pipe to signal the threads to stop.
+    close(TerminateFd);
+    for (auto& Worker : Workers)
+    {
+        if (Worker.joinable())
+        {
+            Worker.join();
+        }
+    }
+}
+
+template <typename ProcessingFunction, typename ExceptionHandler>
+void Forwarder<ProcessingFunction, ExceptionHandler>::Run(
+    int SourceFd, int DestinationFd, ProcessingFunction Handler, ExceptionHandler exceptionHandler)
+{
+    try
+    {
+        const bool sourceDatagram = IsDatagramSocket(SourceFd);
+        const bool destinationDatagram = IsDatagramSocket(DestinationFd);
+
+        auto batch = std::make_unique<Batch>();
+        for (;;)
+        {
+            if (!WaitForFd(SourceFd, POLLIN))
             {
-                packet.reset();
+                break;
+            }
+
+            const size_t received = Receive(SourceFd, sourceDatagram, *batch);
 
-                // Grow the packet to provide space.
-                packet.adjust_tail(Packet::InitialPacketSize);
-                if (!wait_for_fd(SourceFd, POLLIN))
+            // Run the handler on each packet, and gather the packets to write to the destination fd.
+            size_t forwarded = 0;
+            for (size_t i = 0; i < received; i++)
+            {
+                auto& packet = batch->Packets[i];
+                if (Handler(packet))
                 {
-                    break;
+                    const auto length = static_cast<size_t>(packet.data_end() - packet.data());
+                    batch->Vectors[forwarded++] = {.iov_base = packet.data(), .iov_len = length};
                 }
+            }
 
-                int bytes_read = Syscall(read, SourceFd, packet.data(), packet.data_end() - packet.data());
+            if (forwarded == 0)
+            {
+                continue;
+            }
 
-                // Shrink packet to size of data read.
-                packet.adjust_tail(bytes_read - (packet.data_end() - packet.data()));
+            if (!WaitForFd(DestinationFd, POLLOUT))
+            {
+                break;
+            }
 
-                // If the handler returns true, write the packet to the destination fd.
-                if (Handler(packet))
+            if (!Send(DestinationFd, destinationDatagram, *batch, forwarded))
+            {
+                break;
+            }
+        }
+    }
+    catch (std::exception& e)
+    {
+        if (!exceptionHandler(e))
+        {
+            throw;
+        }
+    }
+}
+
+template <typename ProcessingFunction, typename ExceptionHandler>
+bool Forwarder<ProcessingFunction, ExceptionHandler>::WaitForFd(int Fd, short Event) const
+{
+    struct pollfd poll_fds[2];
+    poll_fds[0] = {.fd = Fd, .events = Event, .revents = 0};
+    poll_fds[1] = {.fd = TerminateReadFd.get(), .events = POLLIN, .revents = 0};
+    for (;;)
+    {
+        const int return_value = poll(poll_fds, _countof(poll_fds), -1);
+        if (return_value < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            throw std::runtime_error(std::string("poll returned ") + std::string(strerror(errno)));
+        }
+        else if (return_value == 0)
+        {
+            continue;
+        }
+        else if (poll_fds[1].revents)
+        {
+            return false;
+        }
+        else if (poll_fds[0].revents & Event)
+        {
+            return true;
+        }
+    }
+}
+
+template <typename ProcessingFunction, typename ExceptionHandler>
+bool Forwarder<ProcessingFunction, ExceptionHandler>::IsDatagramSocket(int Fd)
+{
+    // Packet boundaries are only preserved by recvmmsg / sendmmsg on message oriented sockets. Other fds (tun devices,
+    // pipes, stream sockets) are read and written one packet per syscall.
+    int type = 0;
+    socklen_t length = sizeof(type);
+    if (getsockopt(Fd, SOL_SOCKET, SO_TYPE, &type, &length) < 0)
+    {
+        return false;
+    }
+
+    return type == SOCK_DGRAM || type == SOCK_RAW || type == SOCK_SEQPACKET;
+}
+
+template <typename ProcessingFunction, typename ExceptionHandler>
+size_t Forwarder<ProcessingFunction, ExceptionHandler>::Receive(int SourceFd, bool Datagram, Batch& Batch)
+{
+    auto prepare = [&Batch](size_t index) {
+        auto& packet = Batch.Packets[index];
+        packet.reset();
+
+        // Grow the packet to provide space.
+        packet.adjust_tail(Packet::InitialPacketSize);
+        Batch.Vectors[index] = {.iov_base = packet.data(), .iov_len = static_cast<size_t>(packet.data_end() - packet.data())};
+    };
+
+    // Shrink packet to size of data read.
+    auto complete = [&Batch](size_t index, size_t bytes_read) {
+        auto& packet = Batch.Packets[index];
+        packet.adjust_tail(bytes_read - (packet.data_end() - packet.data()));
+    };
+
+    if (Datagram)
+    {
+        for (size_t i = 0; i < BatchSize; i++)
+        {
+            prepare(i);
+            Batch.Messages[i] = {};
+            Batch.Messages[i].msg_hdr.msg_iov = &Batch.Vectors[i];
+            Batch.Messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // Wait for the first packet only, then take the ones that are already queued.
+        const int received = Syscall(recvmmsg, SourceFd, Batch.Messages.data(), BatchSize, MSG_WAITFORONE, nullptr);
+        for (int i = 0; i < received; i++)
+        {
+            complete(i, Batch.Messages[i].msg_len);
+        }
+
+        return received;
+    }
+
+    // Read the packets that are already available, without blocking once the first one has been read.
+    size_t received = 0;
+    do
+    {
+        prepare(received);
+        const int bytes_read = Syscall(read, SourceFd, Batch.Vectors[received].iov_base, Batch.Vectors[received].iov_len);
+        complete(received, bytes_read);
+        received++;
+
+        pollfd poll_fd{.fd = SourceFd, .events = POLLIN, .revents = 0};
+        if (received == BatchSize || poll(&poll_fd, 1, 0) <= 0 || (poll_fd.revents & POLLIN) == 0)
+        {
+            break;
+        }
+    } while (true);
+
+    return received;
+}
+
+template <typename ProcessingFunction, typename ExceptionHandler>
+bool Forwarder<ProcessingFunction, ExceptionHandler>::Send(int DestinationFd, bool Datagram, Batch& Batch, size_t Count) const
+{
+    if (!Datagram)
+    {
+        for (size_t i = 0; i < Count; i++)
+        {
+            // A stream fd can accept part of a packet. Write the rest until the whole packet is written.
+            const auto* data = static_cast<const uint8_t*>(Batch.Vectors[i].iov_base);
+            size_t remaining = Batch.Vectors[i].iov_len;
+            while (remaining > 0)
+            {
+                const auto written = write(DestinationFd, data, remaining);
+                if (written < 0)
                 {
-                    if (!wait_for_fd(DestinationFd, POLLOUT))
+                    if (!WaitToRetry(DestinationFd, "write"))
                     {
-                        break;
+                        return false;
                     }
 
-                    Syscall(write, DestinationFd, packet.data(), packet.data_end() - packet.data());
+                    continue;
                 }
+
+                data += written;
+                remaining -= written;
             }
         }
-        catch (std::exception& e)
+
+        return true;
+    }
+
+    for (size_t i = 0; i < Count; i++)
+    {
+        Batch.Messages[i] = {};
+        Batch.Messages[i].msg_hdr.msg_iov = &Batch.Vectors[i];
+        Batch.Messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // sendmmsg can send less messages than requested, send the remaining ones until the whole batch is written.
+    size_t sent = 0;
+    while (sent < Count)
+    {
+        const int result = sendmmsg(DestinationFd, &Batch.Messages[sent], Count - sent, 0);
+        if (result < 0)
         {
-            if (!exceptionHandler(e))
+            if (!WaitToRetry(DestinationFd, "sendmmsg"))
             {
-                throw;
+                return false;
             }
+
+            continue;
         }
-    });
+
+        sent += result;
+    }
+
+    return true;
 }
 
 template <typename ProcessingFunction, typename ExceptionHandler>
-Forwarder<ProcessingFunction, ExceptionHandler>::~Forwarder()
+bool Forwarder<ProcessingFunction, ExceptionHandler>::WaitToRetry(int DestinationFd, const char* Method) const
 {
-    // Close the write end of the pipe to signal the thread to stop.
-    close(TerminateFd);
-    if (Worker.joinable())
+    const int error = errno;
+    if (error == EINTR)
     {
-        Worker.join();
+        return true;
     }
+    else if (error == EAGAIN || error == EWOULDBLOCK)
+    {
+        // The destination is full. Wait until it can accept more data.
+        return WaitForFd(DestinationFd, POLLOUT);
+    }
+
+    throw SyscallError(Method, std::to_string(DestinationFd), error, std::source_location::current());
 }
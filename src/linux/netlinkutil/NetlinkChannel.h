@@ -3,6 +3,8 @@
 
 #include "NetlinkResponse.h"
 #include "NetlinkTransaction.h"
+#include <chrono>
+#include <set>
 #include <sys/socket.h>
 #include "lxwil.h"
 
@@ -27,8 +29,28 @@ public:
 
     void SendMessage(const std::vector<char>& message);
 
+    // Send the requests of multiple transactions with a single sendmsg() call, then wait for the acknowledgement of each
+    // request, matched by sequence number. The kernel processes the requests in order and keeps going after a request fails.
+    //
+    // Returns the error reported for each transaction (0 on success, negative errno on failure), in the same order.
+    // Transactions that aren't acknowledged within ackTimeout fail with -ETIMEDOUT. Their acknowledgements, if they arrive
+    // later, are dropped by the following transactions (see ConsumeAbandonedResponse()).
+    std::vector<int> ExecuteBatch(
+        const std::vector<NetlinkTransaction>& transactions, std::chrono::milliseconds ackTimeout = c_defaultAckTimeout);
+
+    // Returns true if a response is the acknowledgement of a request that timed out in ExecuteBatch(). The request is
+    // forgotten, and the response must be dropped instead of being reported to an unrelated transaction.
+    bool ConsumeAbandonedResponse(const NetlinkResponse& response);
+
     NetlinkResponse ReceiveNetlinkResponse();
 
+    // Hand the buffer of a response that was processed back to the channel, to be reused by ReceiveNetlinkResponse().
+    void RecycleResponse(NetlinkResponse&& response);
+
+    // Enable NETLINK_GET_STRICT_CHK, so that the kernel validates dump requests and filters dumps on the attributes
+    // they contain. Returns false if the kernel doesn't support it.
+    bool EnableStrictChecking();
+
     int GetInterfaceIndex(const std::string& name);
 
     int GetInterfaceFlags(const std::string& name);
@@ -37,6 +59,11 @@ public:
 
     static NetlinkChannel FromFd(int fd);
 
+    int Socket() const;
+
+    // Max time to wait for the acknowledgements of each datagram sent by ExecuteBatch().
+    static constexpr std::chrono::milliseconds c_defaultAckTimeout = std::chrono::seconds(10);
+
 private:
     struct Tag
     {
@@ -49,6 +76,22 @@ private:
     wil::unique_fd m_socket;
 
     std::atomic<int> seqNumber;
+
+    // The kernel fills dump responses up to the size of the buffer passed to recvmsg(), capped at 32KB. The buffer is
+    // larger, so that the other responses (which aren't split) fit too.
+    static constexpr size_t c_defaultReceiveBufferSize = 64 * 1024;
+
+    // Buffer responses are received in, reused between responses (see RecycleResponse()).
+    std::vector<char> m_receiveBuffer;
+
+    // Size of the buffer responses are received in. Grows to fit the largest response received.
+    size_t m_receiveBufferSize = c_defaultReceiveBufferSize;
+
+    // Max number of abandoned requests remembered. The oldest are forgotten first.
+    static constexpr size_t c_maxAbandonedSequences = 1024;
+
+    // Sequence numbers of the requests that timed out in ExecuteBatch() and weren't acknowledged yet.
+    std::set<__u32> m_abandonedSequences;
 };
 
 #include "NetlinkChannel.hxx"
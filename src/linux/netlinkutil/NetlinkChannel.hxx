@@ -5,9 +5,13 @@
 #include <net/if.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
+#include <poll.h>
 #include <unistd.h>
 #include <string.h>
 #include <atomic>
+#include <chrono>
+#include <map>
+#include <utility>
 
 #include "NetlinkChannel.h"
 #include "Syscall.h"
@@ -31,6 +35,9 @@ inline NetlinkChannel::NetlinkChannel(NetlinkChannel&& other)
 inline const NetlinkChannel& NetlinkChannel::operator=(NetlinkChannel&& other)
 {
     m_socket = std::move(other.m_socket);
+    m_receiveBuffer = std::move(other.m_receiveBuffer);
+    m_receiveBufferSize = other.m_receiveBufferSize;
+    m_abandonedSequences = std::move(other.m_abandonedSequences);
 
     return *this;
 }
@@ -53,6 +60,11 @@ inline NetlinkChannel NetlinkChannel::FromFd(int fd)
     return channel;
 }
 
+inline int NetlinkChannel::Socket() const
+{
+    return m_socket.get();
+}
+
 inline NetlinkTransaction NetlinkChannel::CreateTransactionImpl(std::vector<char>&& message, int type, int flags)
 {
     auto header = reinterpret_cast<nlmsghdr*>(message.data());
@@ -69,6 +81,97 @@ inline void NetlinkChannel::SendMessage(const std::vector<char>& message)
     Syscall(sendto, m_socket.get(), message.data(), message.size(), 0, nullptr, 0);
 }
 
+inline std::vector<int> NetlinkChannel::ExecuteBatch(const std::vector<NetlinkTransaction>& transactions, std::chrono::milliseconds ackTimeout)
+{
+    // Max number of requests sent with a single sendmsg() call, to keep the datagram well under the socket buffer size.
+    constexpr size_t maxBatchedRequests = 64;
+
+    // Each request in a datagram must start on a NLMSG_ALIGNTO boundary.
+    static const char padding[NLMSG_ALIGNTO] = {};
+
+    std::vector<int> errors(transactions.size(), 0);
+
+    for (size_t begin = 0; begin < transactions.size(); begin += maxBatchedRequests)
+    {
+        const size_t end = std::min(transactions.size(), begin + maxBatchedRequests);
+
+        std::vector<iovec> buffers;
+        std::map<__u32, size_t> pendingRequests;
+        for (size_t index = begin; index < end; index++)
+        {
+            const auto& request = transactions[index].Request();
+            buffers.push_back({const_cast<char*>(request.data()), request.size()});
+
+            const size_t paddingSize = NLMSG_ALIGN(request.size()) - request.size();
+            if (paddingSize != 0)
+            {
+                buffers.push_back({const_cast<char*>(padding), paddingSize});
+            }
+
+            pendingRequests.emplace(transactions[index].Sequence(), index);
+        }
+
+        msghdr message = {};
+        message.msg_iov = buffers.data();
+        message.msg_iovlen = buffers.size();
+
+        Syscall(sendmsg, m_socket.get(), &message, 0);
+
+        const auto deadline = std::chrono::steady_clock::now() + ackTimeout;
+        while (!pendingRequests.empty())
+        {
+            const auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+            pollfd pollDescriptor{.fd = m_socket.get(), .events = POLLIN, .revents = 0};
+            const int result = remaining > 0 ? SyscallInterruptable(poll, &pollDescriptor, 1, static_cast<int>(remaining)) : 0;
+            if (result < 0)
+            {
+                continue;
+            }
+            else if (result == 0)
+            {
+                // Acknowledgements received after the timeout are dropped, here or by the following transactions.
+                for (const auto& e : pendingRequests)
+                {
+                    errors[e.second] = -ETIMEDOUT;
+
+                    m_abandonedSequences.insert(e.first);
+                    if (m_abandonedSequences.size() > c_maxAbandonedSequences)
+                    {
+                        m_abandonedSequences.erase(m_abandonedSequences.begin());
+                    }
+                }
+
+                break;
+            }
+
+            auto response = ReceiveNetlinkResponse();
+            for (const auto& e : response.Messages<nlmsgerr>(NLMSG_ERROR))
+            {
+                const auto it = pendingRequests.find(e.Header()->nlmsg_seq);
+                if (it == pendingRequests.end())
+                {
+                    m_abandonedSequences.erase(e.Header()->nlmsg_seq);
+                    continue;
+                }
+
+                errors[it->second] = e.Payload()->error;
+                pendingRequests.erase(it);
+            }
+
+            RecycleResponse(std::move(response));
+        }
+    }
+
+    return errors;
+}
+
+inline bool NetlinkChannel::ConsumeAbandonedResponse(const NetlinkResponse& response)
+{
+    return m_abandonedSequences.erase(response.Sequence()) != 0;
+}
+
 inline NetlinkTransaction NetlinkChannel::CreateTransaction(int type, int flags)
 {
     auto header = std::vector<char>(sizeof(nlmsghdr));
@@ -102,10 +205,20 @@ inline NetlinkTransaction NetlinkChannel::CreateTransaction(const void* message,
 
 inline NetlinkResponse NetlinkChannel::ReceiveNetlinkResponse()
 {
-    std::vector<char> buffer;
+    // Peek at the size of the next response first, so that the buffer can be grown before the response is received.
+    // With MSG_TRUNC, recvmsg() returns the real size of the response, even if it doesn't fit in the buffer.
+    msghdr peek = {};
+    const auto size = static_cast<size_t>(Syscall(recvmsg, m_socket.get(), &peek, MSG_PEEK | MSG_TRUNC));
+    m_receiveBufferSize = std::max(m_receiveBufferSize, size);
+
+    // Receive the response directly in the reusable buffer. Resizing doesn't allocate if the buffer was recycled. The
+    // whole buffer is passed even if the response is smaller, since the kernel sizes the next parts of a dump after it.
+    m_receiveBuffer.resize(m_receiveBufferSize);
 
     sockaddr_storage src = {};
     iovec iov = {};
+    iov.iov_base = m_receiveBuffer.data();
+    iov.iov_len = m_receiveBuffer.size();
 
     msghdr message = {};
     message.msg_name = &src;
@@ -113,16 +226,38 @@ inline NetlinkResponse NetlinkChannel::ReceiveNetlinkResponse()
     message.msg_iov = &iov;
     message.msg_iovlen = 1;
 
-    int size = Syscall(recvmsg, m_socket.get(), &message, MSG_PEEK | MSG_TRUNC);
-    buffer.resize(size);
+    const auto received = static_cast<size_t>(Syscall(recvmsg, m_socket.get(), &message, MSG_TRUNC));
+    if (WI_IsFlagSet(message.msg_flags, MSG_TRUNC))
+    {
+        // Only one thread receives from the channel, so the response received is the one that was peeked at. The
+        // truncated response can't be received again, so it's reported like a lost message (EMSGSIZE).
+        const auto bufferSize = m_receiveBuffer.size();
+        m_receiveBufferSize = std::max(m_receiveBufferSize * 2, received);
+        throw SyscallError(
+            "recvmsg",
+            std::format("truncated response: {} > {}", received, bufferSize),
+            EMSGSIZE,
+            std::source_location::current());
+    }
+
+    m_receiveBuffer.resize(received);
+
+    return {std::exchange(m_receiveBuffer, {})};
+}
 
-    size = Syscall(recvfrom, m_socket.get(), buffer.data(), buffer.size(), 0, nullptr, nullptr);
-    if (size != static_cast<int>(buffer.size()))
+inline void NetlinkChannel::RecycleResponse(NetlinkResponse&& response)
+{
+    auto buffer = response.ReleaseBuffer();
+    if (buffer.capacity() > m_receiveBuffer.capacity())
     {
-        throw RuntimeErrorWithSourceLocation(std::format("Unexpected response size: {} != {}", size, buffer.size()));
+        m_receiveBuffer = std::move(buffer);
     }
+}
 
-    return {std::move(buffer)};
+inline bool NetlinkChannel::EnableStrictChecking()
+{
+    const int enable = 1;
+    return setsockopt(m_socket.get(), SOL_NETLINK, NETLINK_GET_STRICT_CHK, &enable, sizeof(enable)) == 0;
 }
 
 inline int NetlinkChannel::GetInterfaceIndex(const std::string& name)
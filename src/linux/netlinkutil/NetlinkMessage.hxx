@@ -44,6 +44,12 @@ inline const rtattr* NetlinkMessage<ifaddrmsg>::FirstAttribute() const
     return IFA_RTA(NLMSG_DATA(&*m_begin));
 }
 
+template <>
+inline const rtattr* NetlinkMessage<ifinfomsg>::FirstAttribute() const
+{
+    return IFLA_RTA(NLMSG_DATA(&*m_begin));
+}
+
 template <typename TAttribute>
 const rtattr* NetlinkMessage<TAttribute>::FirstAttribute() const
 {
@@ -63,6 +63,11 @@ bool NetlinkResponse::Done() const
     return !doneMessages.empty();
 }
 
+std::vector<char> NetlinkResponse::ReleaseBuffer()
+{
+    return std::move(m_data);
+}
+
 std::ostream& operator<<(std::ostream& out, const NetlinkResponse& response)
 {
     const auto begin = &*response.Begin();
@@ -25,6 +25,9 @@ public:
 
     bool Done() const;
 
+    // Take ownership of the response buffer, so it can be reused to receive another response.
+    std::vector<char> ReleaseBuffer();
+
 private:
     std::vector<char> m_data;
 };
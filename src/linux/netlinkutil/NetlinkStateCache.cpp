@@ -0,0 +1,460 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <algorithm>
+#include <poll.h>
+#include <linux/rtnetlink.h>
+#include "NetlinkStateCache.h"
+#include "RuntimeErrorWithSourceLocation.h"
+#include "SyscallError.h"
+#include "common.h"
+#include "util.h"
+
+constexpr int c_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+
+NetlinkStateCache::NetlinkStateCache() : m_notifications(SOCK_RAW, NETLINK_ROUTE, c_groups)
+{
+    // The channel is subscribed before the dumps are made, so no change can be missed. Notifications for changes that
+    // are already part of the dumps are no-ops.
+    {
+        std::scoped_lock<std::mutex> lock{m_lock};
+        Resync();
+    }
+
+    m_shutdownPipe = wil::unique_pipe::create(0);
+    m_notificationThread = std::thread([this]() { NotificationLoop(); });
+}
+
+NetlinkStateCache::~NetlinkStateCache() noexcept
+{
+    m_shutdownPipe.write().reset();
+
+    if (m_notificationThread.joinable())
+    {
+        m_notificationThread.join();
+    }
+}
+
+std::optional<int> NetlinkStateCache::GetInterfaceIndex(const std::string& name)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+    Refresh();
+
+    const auto it = m_names.find(name);
+    if (it == m_names.end())
+    {
+        return {};
+    }
+
+    return it->second;
+}
+
+std::optional<unsigned int> NetlinkStateCache::GetInterfaceFlags(int index)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+    Refresh();
+
+    const auto it = m_links.find(index);
+    if (it == m_links.end())
+    {
+        return {};
+    }
+
+    return it->second.Flags;
+}
+
+std::vector<NetlinkStateCache::AddressEntry> NetlinkStateCache::ListAddresses(int index, int family)
+{
+    if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+    {
+        throw RuntimeErrorWithSourceLocation(std::format("Unexpected address family: {}", family));
+    }
+
+    std::scoped_lock<std::mutex> lock{m_lock};
+    Refresh();
+
+    std::vector<AddressEntry> addresses;
+    const auto it = m_addresses.find(index);
+    if (it != m_addresses.end())
+    {
+        for (const auto& e : it->second)
+        {
+            if (family == AF_UNSPEC || family == e.Value.Family())
+            {
+                addresses.emplace_back(e);
+            }
+        }
+    }
+
+    return addresses;
+}
+
+std::vector<Route> NetlinkStateCache::ListRoutes(int table, int family)
+{
+    if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+    {
+        throw RuntimeErrorWithSourceLocation(std::format("Unexpected address family: {}", family));
+    }
+
+    std::scoped_lock<std::mutex> lock{m_lock};
+    Refresh();
+
+    if (m_ipv4RoutesStale && family != AF_INET6)
+    {
+        DumpRoutes(AF_INET);
+    }
+
+    std::vector<Route> routes;
+    for (const auto& e : m_routes)
+    {
+        if (e.Table == table && (family == AF_UNSPEC || family == e.Value.family))
+        {
+            routes.emplace_back(e.Value);
+        }
+    }
+
+    return routes;
+}
+
+void NetlinkStateCache::SetLinkCallback(LinkCallback callback)
+{
+    std::scoped_lock<std::mutex> lock{m_lock};
+    Refresh();
+
+    m_linkCallback = std::move(callback);
+    NotifyLinks();
+}
+
+std::pair<int, Route> NetlinkStateCache::ParseRoute(const NetlinkMessage<rtmsg>& message)
+{
+    const auto* payload = message.Payload();
+
+    // The table id only fits in rtm_table if it's lower than 256.
+    const auto tableId = message.UniqueAttribute<int>(RTA_TABLE);
+    const int table = tableId.has_value() ? *tableId.value() : payload->rtm_table;
+
+    auto readOptionalAddress = [&](int type) -> std::optional<Address> {
+        auto attribute = message.UniqueAttribute<const void*>(type);
+        if (!attribute.has_value())
+        {
+            return {};
+        }
+
+        return Address::FromBinary(payload->rtm_family, payload->rtm_dst_len, attribute.value());
+    };
+
+    auto to = readOptionalAddress(RTA_DST);
+    auto device = message.UniqueAttribute<int>(RTA_OIF);
+    auto metric = message.UniqueAttribute<int>(RTA_PRIORITY);
+
+    return {
+        table,
+        Route{
+            payload->rtm_family,
+            readOptionalAddress(RTA_GATEWAY),
+            device.has_value() ? *device.value() : -1,
+            !to.has_value(),
+            to,
+            metric.has_value() ? *metric.value() : 0}};
+}
+
+std::optional<std::pair<int, NetlinkStateCache::AddressEntry>> NetlinkStateCache::ParseAddress(const NetlinkMessage<ifaddrmsg>& message)
+{
+    const auto* payload = message.Payload();
+
+    // IFA_LOCAL is the address of the interface. IFA_ADDRESS is the peer address on point-to-point links, and the
+    // only attribute of IPv6 addresses.
+    auto attribute = message.UniqueAttribute<const void*>(IFA_LOCAL);
+    if (!attribute.has_value())
+    {
+        attribute = message.UniqueAttribute<const void*>(IFA_ADDRESS);
+        if (!attribute.has_value())
+        {
+            return {};
+        }
+    }
+
+    AddressEntry entry{.Value = Address::FromBinary(payload->ifa_family, payload->ifa_prefixlen, attribute.value())};
+    const auto cacheInfo = message.UniqueAttribute<ifa_cacheinfo>(IFA_CACHEINFO);
+    if (cacheInfo.has_value())
+    {
+        entry.PreferredLifetime = cacheInfo.value()->ifa_prefered;
+    }
+
+    return std::make_pair(static_cast<int>(payload->ifa_index), std::move(entry));
+}
+
+void NetlinkStateCache::Refresh()
+{
+    bool linksChanged = false;
+
+    try
+    {
+        for (;;)
+        {
+            pollfd pollDescriptor{.fd = m_notifications.Socket(), .events = POLLIN, .revents = 0};
+            if (SyscallInterruptable(poll, &pollDescriptor, 1, 0) <= 0 || WI_IsFlagClear(pollDescriptor.revents, POLLIN))
+            {
+                break;
+            }
+
+            auto response = m_notifications.ReceiveNetlinkResponse();
+            linksChanged |= Apply(response);
+            m_notifications.RecycleResponse(std::move(response));
+        }
+    }
+    catch (const SyscallError& e)
+    {
+        if (e.GetErrno() != ENOBUFS && e.GetErrno() != EMSGSIZE)
+        {
+            throw;
+        }
+
+        // The socket buffer overflowed, or a notification didn't fit in the receive buffer: notifications were lost.
+        // Rebuild the mirror.
+        GNS_LOG_ERROR("rtnetlink notifications were lost, rebuilding the link and route state");
+        Resync();
+        return;
+    }
+
+    if (linksChanged)
+    {
+        NotifyLinks();
+    }
+}
+
+void NetlinkStateCache::DiscardNotifications()
+{
+    for (;;)
+    {
+        pollfd pollDescriptor{.fd = m_notifications.Socket(), .events = POLLIN, .revents = 0};
+        if (SyscallInterruptable(poll, &pollDescriptor, 1, 0) <= 0 || WI_IsFlagClear(pollDescriptor.revents, POLLIN))
+        {
+            return;
+        }
+
+        try
+        {
+            m_notifications.RecycleResponse(m_notifications.ReceiveNetlinkResponse());
+        }
+        catch (const SyscallError& e)
+        {
+            if (e.GetErrno() != ENOBUFS && e.GetErrno() != EMSGSIZE)
+            {
+                throw;
+            }
+        }
+    }
+}
+
+void NetlinkStateCache::Resync()
+{
+    // The notifications still queued describe changes that happened before the dumps, which already contain them.
+    // Applying them after the dumps could restore objects that were deleted while notifications were lost.
+    DiscardNotifications();
+
+    m_links.clear();
+    m_names.clear();
+    m_addresses.clear();
+
+    ifinfomsg link{};
+    m_requests.CreateTransaction(link, RTM_GETLINK, NLM_F_DUMP).Execute([this](const NetlinkResponse& response) {
+        Apply(response);
+    });
+
+    ifaddrmsg address{};
+    m_requests.CreateTransaction(address, RTM_GETADDR, NLM_F_DUMP).Execute([this](const NetlinkResponse& response) {
+        Apply(response);
+    });
+
+    DumpRoutes(AF_UNSPEC);
+    NotifyLinks();
+}
+
+void NetlinkStateCache::DumpRoutes(int family)
+{
+    std::erase_if(m_routes, [&](const auto& entry) { return family == AF_UNSPEC || entry.Value.family == family; });
+
+    rtmsg route{};
+    route.rtm_family = family;
+    m_requests.CreateTransaction(route, RTM_GETROUTE, NLM_F_DUMP).Execute([this](const NetlinkResponse& response) {
+        Apply(response);
+    });
+
+    if (family == AF_UNSPEC || family == AF_INET)
+    {
+        m_ipv4RoutesStale = false;
+    }
+}
+
+bool NetlinkStateCache::Apply(const NetlinkResponse& response)
+{
+    bool linksChanged = false;
+    for (const auto& e : response.Messages<ifinfomsg>(RTM_NEWLINK))
+    {
+        const auto* payload = e.Payload();
+        const auto name = e.UniqueAttribute<char>(IFLA_IFNAME);
+        if (!name.has_value())
+        {
+            continue;
+        }
+
+        auto& link = m_links[payload->ifi_index];
+        if (link.Name != name.value())
+        {
+            RemoveName(link.Name, payload->ifi_index);
+            link.Name = name.value();
+            m_names[link.Name] = payload->ifi_index;
+            linksChanged = true;
+        }
+
+        if (WI_IsFlagSet(link.Flags, IFF_UP) && WI_IsFlagClear(payload->ifi_flags, IFF_UP))
+        {
+            m_ipv4RoutesStale = true;
+        }
+
+        link.Flags = payload->ifi_flags;
+    }
+
+    for (const auto& e : response.Messages<ifinfomsg>(RTM_DELLINK))
+    {
+        const auto it = m_links.find(e.Payload()->ifi_index);
+        if (it != m_links.end())
+        {
+            RemoveName(it->second.Name, it->first);
+            m_addresses.erase(it->first);
+            m_links.erase(it);
+            m_ipv4RoutesStale = true;
+            linksChanged = true;
+        }
+    }
+
+    for (const auto& e : response.Messages<ifaddrmsg>(RTM_NEWADDR))
+    {
+        auto parsed = ParseAddress(e);
+        if (!parsed.has_value())
+        {
+            continue;
+        }
+
+        auto& entry = parsed->second;
+        auto& addresses = m_addresses[parsed->first];
+        const auto it = std::ranges::find_if(addresses, [&](const auto& existing) { return SameAddress(existing, entry.Value); });
+        if (it != addresses.end())
+        {
+            // The notification of an update carries the new lifetimes.
+            it->PreferredLifetime = entry.PreferredLifetime;
+        }
+        else
+        {
+            addresses.emplace_back(std::move(entry));
+        }
+    }
+
+    for (const auto& e : response.Messages<ifaddrmsg>(RTM_DELADDR))
+    {
+        if (e.Payload()->ifa_family == AF_INET)
+        {
+            m_ipv4RoutesStale = true;
+        }
+
+        const auto parsed = ParseAddress(e);
+        if (!parsed.has_value())
+        {
+            continue;
+        }
+
+        const auto it = m_addresses.find(parsed->first);
+        if (it != m_addresses.end())
+        {
+            std::erase_if(it->second, [&](const auto& existing) { return SameAddress(existing, parsed->second.Value); });
+        }
+    }
+
+    for (const auto& e : response.Messages<rtmsg>(RTM_NEWROUTE))
+    {
+        auto [table, route] = ParseRoute(e);
+
+        // A replaced route is only notified as the new route, flagged with NLM_F_REPLACE. The kernel identifies the
+        // replaced route by its table, destination and metric.
+        if (WI_IsFlagSet(e.Header()->nlmsg_flags, NLM_F_REPLACE))
+        {
+            std::erase_if(m_routes, [&](const auto& entry) {
+                return entry.Table == table && entry.Value.family == route.family && entry.Value.to == route.to &&
+                       entry.Value.metric == route.metric;
+            });
+        }
+
+        if (std::ranges::none_of(m_routes, [&](const auto& entry) { return SameRoute(entry, table, route); }))
+        {
+            m_routes.emplace_back(RouteEntry{.Table = table, .Value = std::move(route)});
+        }
+    }
+
+    for (const auto& e : response.Messages<rtmsg>(RTM_DELROUTE))
+    {
+        const auto [table, route] = ParseRoute(e);
+        std::erase_if(m_routes, [&](const auto& entry) { return SameRoute(entry, table, route); });
+    }
+
+    return linksChanged;
+}
+
+void NetlinkStateCache::RemoveName(const std::string& name, int index)
+{
+    // Names can be reused by another link before the notification of the rename is processed.
+    const auto it = m_names.find(name);
+    if (it != m_names.end() && it->second == index)
+    {
+        m_names.erase(it);
+    }
+}
+
+void NetlinkStateCache::NotifyLinks()
+{
+    if (m_linkCallback)
+    {
+        m_linkCallback(m_links);
+    }
+}
+
+bool NetlinkStateCache::SameAddress(const AddressEntry& left, const Address& right)
+{
+    return left.Value == right;
+}
+
+bool NetlinkStateCache::SameRoute(const RouteEntry& left, int table, const Route& right)
+{
+    return left.Table == table && left.Value.family == right.family && left.Value.to == right.to && left.Value.via == right.via &&
+           left.Value.dev == right.dev && left.Value.metric == right.metric;
+}
+
+void NetlinkStateCache::NotificationLoop() noexcept
+{
+    UtilSetThreadName("NetlinkState");
+
+    pollfd pollDescriptors[2];
+    pollDescriptors[0] = {.fd = m_notifications.Socket(), .events = POLLIN, .revents = 0};
+    pollDescriptors[1] = {.fd = m_shutdownPipe.read().get(), .events = POLLIN, .revents = 0};
+
+    for (;;)
+    {
+        try
+        {
+            if (SyscallInterruptable(poll, pollDescriptors, ARRAY_SIZE(pollDescriptors), -1) <= 0)
+            {
+                continue;
+            }
+
+            if (pollDescriptors[1].revents != 0)
+            {
+                return;
+            }
+
+            if (WI_IsFlagSet(pollDescriptors[0].revents, POLLIN))
+            {
+                std::scoped_lock<std::mutex> lock{m_lock};
+                Refresh();
+            }
+        }
+        CATCH_LOG()
+    }
+}
@@ -0,0 +1,159 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "NetlinkChannel.h"
+#include "Route.h"
+#include "address.h"
+
+/*
+    In-process mirror of the rtnetlink link, address and route state.
+
+    The mirror is built with one dump of each object type, then kept current by a single socket subscribed to the
+    rtnetlink link, address and route multicast groups. If notifications are lost (ENOBUFS), the mirror is rebuilt from new dumps.
+
+    The kernel doesn't send notifications for the IPv4 routes it flushes when a link goes down or is removed, or when
+    an IPv4 address is removed. The IPv4 routes are dumped again after any of these events, when they are next queried.
+
+    The kernel queues the notification of a change on the subscribed socket before it acknowledges the request that made
+    the change. Queries process the pending notifications first, so a query made after a netlink request returns always
+    reflects the change made by that request.
+*/
+class NetlinkStateCache
+{
+public:
+    struct Link
+    {
+        std::string Name;
+        unsigned int Flags = 0;
+    };
+
+    // Lifetime of an address that doesn't expire.
+    static constexpr uint32_t InfiniteLifetime = 0xFFFFFFFF;
+
+    struct AddressEntry
+    {
+        Address Value;
+
+        // Preferred lifetime left, in seconds.
+        uint32_t PreferredLifetime = InfiniteLifetime;
+    };
+
+    // Called with the current links each time they change. Runs with the cache locked: it must not call into the cache.
+    using LinkCallback = std::function<void(const std::map<int, Link>& links)>;
+
+    NetlinkStateCache();
+    ~NetlinkStateCache() noexcept;
+
+    NetlinkStateCache(const NetlinkStateCache&) = delete;
+    NetlinkStateCache(NetlinkStateCache&&) = delete;
+    NetlinkStateCache& operator=(const NetlinkStateCache&) = delete;
+    NetlinkStateCache& operator=(NetlinkStateCache&&) = delete;
+
+    std::optional<int> GetInterfaceIndex(const std::string& name);
+
+    std::optional<unsigned int> GetInterfaceFlags(int index);
+
+    /*
+        Returns the addresses of an interface. Family can be AF_UNSPEC, AF_INET or AF_INET6.
+    */
+    std::vector<AddressEntry> ListAddresses(int index, int family);
+
+    /*
+        Returns the routes of a routing table, in the same format as a route dump. Family can be
+        AF_UNSPEC, AF_INET or AF_INET6.
+    */
+    std::vector<Route> ListRoutes(int table, int family);
+
+    /*
+        Set the callback notified when the links change (or clear it, with an empty callback). The callback
+        is called once with the current links before this method returns.
+    */
+    void SetLinkCallback(LinkCallback callback);
+
+    /*
+        Parse a RTM_NEWROUTE / RTM_DELROUTE message. Returns the routing table of the route.
+    */
+    static std::pair<int, Route> ParseRoute(const NetlinkMessage<rtmsg>& message);
+
+    /*
+        Parse a RTM_NEWADDR / RTM_DELADDR message. Returns the interface index of the address, or nothing if the
+        message has no address.
+    */
+    static std::optional<std::pair<int, AddressEntry>> ParseAddress(const NetlinkMessage<ifaddrmsg>& message);
+
+private:
+    struct RouteEntry
+    {
+        int Table;
+        Route Value;
+    };
+
+    // Process the pending notifications, or rebuild the mirror if notifications were lost. Requires m_lock.
+    void Refresh();
+
+    // Rebuild the mirror from dumps. Requires m_lock.
+    void Resync();
+
+    // Replace the routes of an address family with a new dump. Requires m_lock.
+    void DumpRoutes(int family);
+
+    // Discard the notifications queued on m_notifications. Requires m_lock.
+    void DiscardNotifications();
+
+    // Apply the link, address and route messages of a notification or dump. Returns true if the links changed. Requires m_lock.
+    bool Apply(const NetlinkResponse& response);
+
+    // Remove a name from m_names, if it still refers to the link. Requires m_lock.
+    void RemoveName(const std::string& name, int index);
+
+    // Call m_linkCallback. Requires m_lock.
+    void NotifyLinks();
+
+    // Process notifications until the cache is destroyed.
+    void NotificationLoop() noexcept;
+
+    static bool SameAddress(const AddressEntry& left, const Address& right);
+
+    static bool SameRoute(const RouteEntry& left, int table, const Route& right);
+
+    // Channel subscribed to the link, address and route groups.
+    NetlinkChannel m_notifications;
+
+    // Channel used for dumps.
+    NetlinkChannel m_requests;
+
+    std::mutex m_lock;
+
+    // _Guarded_by_(m_lock)
+    std::map<int, Link> m_links;
+
+    // _Guarded_by_(m_lock)
+    std::map<std::string, int> m_names;
+
+    // Mapping interface index to its addresses.
+    // _Guarded_by_(m_lock)
+    std::map<int, std::vector<AddressEntry>> m_addresses;
+
+    // _Guarded_by_(m_lock)
+    std::vector<RouteEntry> m_routes;
+
+    // Set when the kernel may have removed IPv4 routes without notification.
+    // _Guarded_by_(m_lock)
+    bool m_ipv4RoutesStale = false;
+
+    // _Guarded_by_(m_lock)
+    LinkCallback m_linkCallback;
+
+    // Pipe used to stop m_notificationThread.
+    wil::unique_pipe m_shutdownPipe;
+
+    // Thread keeping the mirror current while no queries are made.
+    std::thread m_notificationThread;
+};
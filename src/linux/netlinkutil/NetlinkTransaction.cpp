@@ -2,6 +2,7 @@
 #include "NetlinkChannel.h"
 #include "NetlinkTransaction.h"
 #include "NetlinkTransactionError.h"
+#include "common.h"
 
 NetlinkTransaction::NetlinkTransaction(NetlinkChannel& channel, std::vector<char>&& request, __u32 seq) :
     m_channel(channel), m_request(std::move(request)), m_seq(seq)
@@ -12,16 +13,33 @@ void NetlinkTransaction::Execute(const std::function<void(const NetlinkResponse&
 {
     m_channel.SendMessage(m_request);
 
+    // Only the last part of the response is kept (for error reporting). The buffers of the previous parts are handed back
+    // to the channel, so that receiving a large dump doesn't allocate a buffer per part.
     std::vector<NetlinkResponse> responses;
 
     try
     {
         do
         {
+            if (!responses.empty())
+            {
+                m_channel.RecycleResponse(std::move(responses.back()));
+                responses.clear();
+            }
+
             NetlinkResponse response = m_channel.ReceiveNetlinkResponse();
             if (response.Sequence() != m_seq)
             {
+                // A late acknowledgement of a batched request that timed out doesn't concern this transaction.
+                if (m_channel.ConsumeAbandonedResponse(response))
+                {
+                    GNS_LOG_INFO("Dropping the late response of abandoned netlink request {}", response.Sequence());
+                    m_channel.RecycleResponse(std::move(response));
+                    continue;
+                }
+
                 response.ThrowIfErrorFound();
+                m_channel.RecycleResponse(std::move(response));
                 continue;
             }
             responses.emplace_back(std::move(response));
@@ -34,6 +52,18 @@ void NetlinkTransaction::Execute(const std::function<void(const NetlinkResponse&
     {
         throw NetlinkTransactionError(m_request, responses, e);
     }
+
+    m_channel.RecycleResponse(std::move(responses.back()));
+}
+
+const std::vector<char>& NetlinkTransaction::Request() const
+{
+    return m_request;
+}
+
+__u32 NetlinkTransaction::Sequence() const
+{
+    return m_seq;
 }
 
 void NetlinkTransaction::PrintRequest() const
@@ -12,6 +12,10 @@ public:
 
     void Execute(const std::function<void(const NetlinkResponse&)>& routine = [](const auto&) {});
 
+    const std::vector<char>& Request() const;
+
+    __u32 Sequence() const;
+
     // Useful for debugging how netlink requests are composed
     void PrintRequest() const;
     std::string GetRawRequestString() const;
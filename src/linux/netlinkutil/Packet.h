@@ -15,7 +15,12 @@ public:
     {
         data_offset = InitialReservedHeader;
         data_end_offset = data_offset + InitialPacketSize;
-        Buffer.resize(InitialReservedHeader + InitialPacketSize);
+
+        // Keep the buffer if it's already large enough, so packets can be reused without reallocating or clearing memory.
+        if (Buffer.size() < InitialReservedHeader + InitialPacketSize)
+        {
+            Buffer.resize(InitialReservedHeader + InitialPacketSize);
+        }
     }
 
     uint8_t* data()
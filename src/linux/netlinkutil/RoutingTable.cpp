@@ -2,14 +2,16 @@
 #include "RuntimeErrorWithSourceLocation.h"
 #include "RoutingTable.h"
 #include "NetlinkTransactionError.h"
+#include "NetlinkError.h"
 #include "NetLinkStrings.h"
 #include "Utils.h"
 #include "common.h"
 
 const Address c_ipv4LoopbackRouteSource = {AF_INET, 32, "127.0.0.1"};
 
-RoutingTable::RoutingTable(int table) : m_table(table)
+RoutingTable::RoutingTable(int table, NetlinkStateCache* cache) : m_table(table), m_cache(cache)
 {
+    m_strictChecking = m_channel.EnableStrictChecking();
 }
 
 void RoutingTable::ChangeTableId(int newTableId)
@@ -24,44 +26,48 @@ std::vector<Route> RoutingTable::ListRoutes(int family)
         throw RuntimeErrorWithSourceLocation(std::format("Unexpected address family: {}", family));
     }
 
+    if (m_cache != nullptr)
+    {
+        return m_cache->ListRoutes(m_table, family);
+    }
+
     std::vector<Route> routes;
     auto processRoute = [&](const NetlinkResponse& response) {
         for (const auto& e : response.Messages<rtmsg>(RTM_NEWROUTE))
         {
-            const auto* message = e.Payload();
-            auto tableId = e.UniqueAttribute<int>(RTA_TABLE);
-            if ((family != AF_UNSPEC && family != message->rtm_family) || !tableId.has_value() || *tableId.value() != m_table)
+            auto [table, route] = NetlinkStateCache::ParseRoute(e);
+            if ((family != AF_UNSPEC && family != route.family) || table != m_table)
             {
                 continue;
             }
 
-            auto readOptionalAddress = [&](int type) -> std::optional<Address> {
-                auto attribute = e.UniqueAttribute<const void*>(type);
-                if (!attribute.has_value())
-                {
-                    return {};
-                }
-
-                return Address::FromBinary(message->rtm_family, message->rtm_dst_len, attribute.value());
-            };
-
-            auto to = readOptionalAddress(RTA_DST);
-            auto device = e.UniqueAttribute<int>(RTA_OIF);
-            auto metric = e.UniqueAttribute<int>(RTA_PRIORITY);
-            routes.emplace_back(
-                message->rtm_family,
-                readOptionalAddress(RTA_GATEWAY),
-                device.has_value() ? *device.value() : -1,
-                !to.has_value(),
-                to,
-                metric.has_value() ? *metric.value() : 0);
+            routes.emplace_back(std::move(route));
         }
     };
 
-    rtmsg message{};
-    message.rtm_family = family;
-    auto transaction = m_channel.CreateTransaction(message, RTM_GETROUTE, NLM_F_DUMP);
-    transaction.Execute(processRoute);
+    if (m_strictChecking)
+    {
+        // Only dump the routes of this table. The table filter in processRoute() still applies, since the kernel
+        // returns the routes of all tables if it doesn't support filtering for this family.
+        struct
+        {
+            rtmsg route;
+            utils::IntegerAttribute tableId;
+        } __attribute__((packed)) message{};
+
+        message.route.rtm_family = family;
+        utils::InitializeIntegerAttribute(message.tableId, m_table, RTA_TABLE);
+
+        auto transaction = m_channel.CreateTransaction(message, RTM_GETROUTE, NLM_F_DUMP);
+        transaction.Execute(processRoute);
+    }
+    else
+    {
+        rtmsg message{};
+        message.rtm_family = family;
+        auto transaction = m_channel.CreateTransaction(message, RTM_GETROUTE, NLM_F_DUMP);
+        transaction.Execute(processRoute);
+    }
 
     return routes;
 }
@@ -85,6 +91,52 @@ void RoutingTable::ModifyRoute(const Route& route, Operation action)
     }
 }
 
+std::vector<int> RoutingTable::ModifyRoutes(const std::vector<Route>& routes, Operation action)
+{
+    std::vector<NetlinkTransaction> transactions;
+    std::vector<int> operations;
+
+    // Build all the requests first, so that a route that fails validation doesn't leave the batch half applied
+    {
+        m_batchTransactions = &transactions;
+        m_batchOperations = &operations;
+        auto resetBatch = wil::scope_exit([&] {
+            m_batchTransactions = nullptr;
+            m_batchOperations = nullptr;
+        });
+
+        for (const auto& route : routes)
+        {
+            ModifyRoute(route, action);
+        }
+    }
+
+    auto errors = m_channel.ExecuteBatch(transactions);
+    for (size_t index = 0; index < errors.size(); index++)
+    {
+        if (errors[index] != 0 && IsIgnoredError(operations[index], errors[index]))
+        {
+            errors[index] = 0;
+        }
+    }
+
+    return errors;
+}
+
+bool RoutingTable::IsIgnoredError(int operation, int error)
+{
+    if (operation == RTM_DELROUTE)
+    {
+        // If the route already doesn't exist, we'll receive error "no such process".  Ignore that error and return success.
+        return error == -ESRCH;
+    }
+
+    // Errors "file exists", "file not found", "no such process" are ignored in order to avoid keeping
+    // track in GnsDaemon of what routes were added/updated and allow the same route to be
+    // added/updated multiple times.
+    return error == -EEXIST || error == -ENOENT || error == -ESRCH;
+}
+
 template <typename TAddr>
 void RoutingTable::ModifyRouteImpl(const Route& route, Operation action)
 {
@@ -143,6 +195,13 @@ void RoutingTable::SendMessage(const Route& route, int operation, int flags, con
     routine(message);
 
     auto transaction = m_channel.CreateTransaction(message, operation, flags);
+    if (m_batchTransactions != nullptr)
+    {
+        m_batchTransactions->emplace_back(std::move(transaction));
+        m_batchOperations->emplace_back(operation);
+        return;
+    }
+
     try
     {
         transaction.Execute();
@@ -150,26 +209,9 @@ void RoutingTable::SendMessage(const Route& route, int operation, int flags, con
     catch (const NetlinkTransactionError& transactionErr)
     {
         auto errorCode = transactionErr.Error();
-        if (errorCode.has_value())
+        if (errorCode.has_value() && IsIgnoredError(operation, errorCode.value()))
         {
-            if (operation == RTM_DELROUTE)
-            {
-                // If the route already doesn't exist, we'll receive error "no such process".  Ignore that error and return success.
-                if (errorCode.value() == -ESRCH)
-                {
-                    return;
-                }
-            }
-            else
-            {
-                // Errors "file exists", "file not found", "no such process" are ignored in order to avoid keeping
-                // track in GnsDaemon of what routes were added/updated and allow the same route to be
-                // added/updated multiple times.
-                if (errorCode.value() == -EEXIST || errorCode.value() == -ENOENT || errorCode.value() == -ESRCH)
-                {
-                    return;
-                }
-            }
+            return;
         }
 
         throw;
@@ -324,8 +366,11 @@ void RoutingTable::ModifyOfflinkRouteImpl(const Route& route, int operation, int
 // Delete all routes from the specified address family
 void RoutingTable::RemoveAll(int addressFamily)
 {
-    for (const auto& route : ListRoutes(addressFamily))
+    for (const auto error : ModifyRoutes(ListRoutes(addressFamily), Remove))
     {
-        ModifyRoute(route, Remove);
+        if (error != 0)
+        {
+            throw NetlinkError(error);
+        }
     }
 }
@@ -3,6 +3,7 @@
 
 #include <functional>
 #include "NetlinkChannel.h"
+#include "NetlinkStateCache.h"
 #include "Route.h"
 #include "Operation.h"
 
@@ -22,7 +23,11 @@ concept DerivedRouteMessage = std::is_base_of<RouteMessage, TMessage>::value;
 class RoutingTable
 {
 public:
-    RoutingTable(int table);
+    /*
+        If cache is set, routes are listed from the cache instead of a dump. The cache must outlive the
+        routing table.
+    */
+    RoutingTable(int table, NetlinkStateCache* cache = nullptr);
     RoutingTable(const RoutingTable&) = delete;
     RoutingTable(RoutingTable&&) = delete;
 
@@ -33,6 +38,14 @@ public:
 
     void ModifyRoute(const Route& route, Operation action);
 
+    /*
+        Apply the same operation to multiple routes with a single netlink round trip. Errors are ignored
+        the same way as in ModifyRoute().
+
+        Returns the netlink error of each route (0 on success), in the same order as routes.
+    */
+    std::vector<int> ModifyRoutes(const std::vector<Route>& routes, Operation action);
+
     std::vector<Route> ListRoutes(int family);
 
     void RemoveAll(int addressFamily);
@@ -72,6 +85,26 @@ private:
     template <DerivedRouteMessage TMessage>
     void SendMessage(const Route& route, int operation, int flags, const std::function<void(TMessage&)>& routine = [](auto&) {});
 
+    /*
+        Returns true if the netlink error returned for an operation means that the routing table
+        is already in the desired state.
+    */
+    static bool IsIgnoredError(int operation, int error);
+
     NetlinkChannel m_channel;
     int m_table;
+    NetlinkStateCache* m_cache = nullptr;
+
+    /*
+        Whether the kernel supports strict checking of dump requests, in which case
+        route dumps are filtered by table in the kernel.
+    */
+    bool m_strictChecking = false;
+
+    /*
+        Set while ModifyRoutes() builds a batch: SendMessage() queues the transactions (and their
+        operation) there instead of executing them.
+    */
+    std::vector<NetlinkTransaction>* m_batchTransactions = nullptr;
+    std::vector<int>* m_batchOperations = nullptr;
 };
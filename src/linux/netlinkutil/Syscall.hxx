@@ -34,7 +34,8 @@ static const std::map<const void*, const char*> syscalls{
     X(bind),     X(ioctl),   X(socket),        X(inet_pton), X(send),       X(sendto), X(recv),   X(sendto),
     X(recvfrom), X(recvmsg), X(read),          X(lseek),     X(open),       X(prctl),  X(fork),   X(execl),
     X(poll),     X(pipe),    X(socketpair),    X(readlink),  X(getxattr),   X(dup),    X(write),  X(pipe2),
-    X(syscall),  X(stat),    X(epoll_create1), X(epoll_ctl), X(epoll_wait), X(listen), X(accept4)};
+    X(syscall),  X(stat),    X(epoll_create1), X(epoll_ctl), X(epoll_wait), X(listen), X(accept4), X(recvmmsg),
+    X(sendmmsg), X(sendmsg)};
 #undef X
 
 inline std::string ArgumentToString(const std::nullptr_t&)
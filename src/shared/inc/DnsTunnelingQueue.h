@@ -0,0 +1,255 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    DnsTunnelingQueue.h
+
+Abstract:
+
+    This file contains the queue used to send DNS messages on the DNS tunneling channel.
+
+--*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifndef WIN32
+#include <signal.h>
+#endif
+#include "lxinitshared.h"
+#include "message.h"
+#include "SocketChannel.h"
+
+namespace wsl::shared {
+
+// Max number of DNS messages waiting to be sent. Messages queued past that limit are dropped, DNS clients will retry.
+constexpr size_t c_dnsTunnelingMaxQueuedMessages = 1024;
+
+// Max number of bytes of DNS messages waiting to be sent.
+constexpr size_t c_dnsTunnelingMaxQueuedBytes = 4 * 1024 * 1024;
+
+// Max number of DNS messages packed in a single LX_GNS_DNS_TUNNELING_BATCH_MESSAGE.
+constexpr size_t c_dnsTunnelingMaxBatchCount = 64;
+
+// Max number of bytes of DNS messages packed in a single LX_GNS_DNS_TUNNELING_BATCH_MESSAGE. A larger DNS message is sent
+// on its own.
+constexpr size_t c_dnsTunnelingMaxBatchBytes = 64 * 1024;
+
+using DnsTunnelingMessageCallback = std::function<void(const gsl::span<gsl::byte>, const LX_GNS_DNS_CLIENT_IDENTIFIER&)>;
+
+// Queue decoupling the producers of DNS messages from the writes on the DNS tunneling channel. Messages are sent in order
+// by a dedicated thread. When several messages are queued, they are packed in a single LX_GNS_DNS_TUNNELING_BATCH_MESSAGE.
+class DnsTunnelingQueue
+{
+public:
+    DnsTunnelingQueue(SocketChannel& channel) : m_channel(channel)
+    {
+        m_sendWorkerThread = std::thread([this]() { SendLoop(); });
+    }
+
+    ~DnsTunnelingQueue()
+    {
+        Stop();
+    }
+
+    DnsTunnelingQueue(const DnsTunnelingQueue&) = delete;
+    DnsTunnelingQueue(DnsTunnelingQueue&&) = delete;
+    DnsTunnelingQueue& operator=(const DnsTunnelingQueue&) = delete;
+    DnsTunnelingQueue& operator=(DnsTunnelingQueue&&) = delete;
+
+    // Queue a DNS message to be sent on the channel. Can be called from any thread.
+    //
+    // Arguments:
+    //    dnsBuffer - buffer containing the DNS request or response.
+    //    dnsClientIdentifier - struct containing protocol (TCP/UDP) and unique id of the Linux DNS client.
+    //
+    // Return Value:
+    //    false if the message was dropped because the queue is full or stopped.
+    bool Push(const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier)
+    {
+        std::scoped_lock<std::mutex> lock{m_lock};
+
+        if (m_stopped || m_messages.size() >= c_dnsTunnelingMaxQueuedMessages ||
+            m_queuedBytes + dnsBuffer.size() > c_dnsTunnelingMaxQueuedBytes)
+        {
+            return false;
+        }
+
+        m_messages.push_back({{dnsBuffer.begin(), dnsBuffer.end()}, dnsClientIdentifier});
+        m_queuedBytes += dnsBuffer.size();
+
+        m_messageAvailable.notify_one();
+        return true;
+    }
+
+    // Stop the send thread. Messages that were not sent yet are dropped.
+    //
+    // N.B. A send blocked on the channel isn't interrupted: the owner of the channel must make it fail first (the exit
+    //      event of the channel on Windows, shutting down the socket on Linux).
+    void Stop() noexcept
+    {
+        {
+            std::scoped_lock<std::mutex> lock{m_lock};
+            m_stopped = true;
+            m_messageAvailable.notify_one();
+        }
+
+        if (m_sendWorkerThread.joinable())
+        {
+            m_sendWorkerThread.join();
+        }
+    }
+
+    // Invoke a callback for each DNS message packed in a LX_GNS_DNS_TUNNELING_BATCH_MESSAGE.
+    //
+    // Arguments:
+    //    span - buffer containing the whole LX_GNS_DNS_TUNNELING_BATCH_MESSAGE.
+    //    callback - callback invoked for each DNS message, in order.
+    //
+    // Return Value:
+    //    false if the message is malformed. Callbacks may have been invoked for the DNS messages preceding the malformed one.
+    static bool ParseBatch(gsl::span<gsl::byte> span, const DnsTunnelingMessageCallback& callback)
+    {
+        const auto* batchMessage = gslhelpers::try_get_struct<LX_GNS_DNS_TUNNELING_BATCH_MESSAGE>(span);
+        if (batchMessage == nullptr)
+        {
+            return false;
+        }
+
+        auto remaining = span.subspan(offsetof(LX_GNS_DNS_TUNNELING_BATCH_MESSAGE, Buffer));
+        for (uint32_t index = 0; index < batchMessage->Count; index++)
+        {
+            LX_GNS_DNS_TUNNELING_BATCH_ENTRY entry{};
+            if (remaining.size() < sizeof(entry))
+            {
+                return false;
+            }
+
+            memcpy(&entry, remaining.data(), sizeof(entry));
+            remaining = remaining.subspan(sizeof(entry));
+
+            if (remaining.size() < entry.BufferSize)
+            {
+                return false;
+            }
+
+            callback(remaining.subspan(0, entry.BufferSize), entry.DnsClientIdentifier);
+            remaining = remaining.subspan(entry.BufferSize);
+        }
+
+        return remaining.empty();
+    }
+
+private:
+    struct QueuedMessage
+    {
+        std::vector<gsl::byte> DnsBuffer;
+        LX_GNS_DNS_CLIENT_IDENTIFIER DnsClientIdentifier;
+    };
+
+    void SendLoop() noexcept
+    {
+#ifndef WIN32
+        UtilSetThreadName("DnsTunnelingSend");
+
+        // When the channel is shut down, a write fails with EPIPE instead of raising SIGPIPE.
+        sigset_t signals{};
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif
+
+        std::vector<QueuedMessage> batch;
+
+        for (;;)
+        {
+            try
+            {
+                batch.clear();
+
+                // Scoped m_lock
+                {
+                    std::unique_lock<std::mutex> lock{m_lock};
+                    m_messageAvailable.wait(lock, [this]() { return m_stopped || !m_messages.empty(); });
+
+                    if (m_stopped)
+                    {
+                        return;
+                    }
+
+                    // Take all the messages that fit in a batch. The first message is always taken, even if it's larger than
+                    // the batch size limit.
+                    size_t batchBytes = 0;
+                    while (!m_messages.empty() && batch.size() < c_dnsTunnelingMaxBatchCount &&
+                           (batch.empty() || batchBytes + m_messages.front().DnsBuffer.size() <= c_dnsTunnelingMaxBatchBytes))
+                    {
+                        batchBytes += m_messages.front().DnsBuffer.size();
+                        m_queuedBytes -= m_messages.front().DnsBuffer.size();
+                        batch.emplace_back(std::move(m_messages.front()));
+                        m_messages.pop_front();
+                    }
+                }
+
+                Send(batch);
+            }
+            CATCH_LOG()
+        }
+    }
+
+    void Send(std::vector<QueuedMessage>& batch)
+    {
+        if (batch.size() == 1)
+        {
+            MessageWriter<LX_GNS_DNS_TUNNELING_MESSAGE> message(LxGnsMessageDnsTunneling);
+            message->DnsClientIdentifier = batch[0].DnsClientIdentifier;
+            message.WriteSpan(gsl::make_span(batch[0].DnsBuffer));
+
+            m_channel.SendMessage<LX_GNS_DNS_TUNNELING_MESSAGE>(message.Span());
+            return;
+        }
+
+        MessageWriter<LX_GNS_DNS_TUNNELING_BATCH_MESSAGE> message(LxGnsMessageDnsTunnelingBatch);
+        message->Count = static_cast<uint32_t>(batch.size());
+
+        for (auto& queuedMessage : batch)
+        {
+            LX_GNS_DNS_TUNNELING_BATCH_ENTRY entry{};
+            entry.DnsClientIdentifier = queuedMessage.DnsClientIdentifier;
+            entry.BufferSize = static_cast<uint32_t>(queuedMessage.DnsBuffer.size());
+
+            gsl::copy(gslhelpers::struct_as_bytes(entry), message.InsertBuffer(sizeof(entry)));
+            message.WriteSpan(gsl::make_span(queuedMessage.DnsBuffer));
+        }
+
+        m_channel.SendMessage<LX_GNS_DNS_TUNNELING_BATCH_MESSAGE>(message.Span());
+    }
+
+    SocketChannel& m_channel;
+
+    std::mutex m_lock;
+
+    // Signaled when a message is queued or the queue is stopped.
+    std::condition_variable m_messageAvailable;
+
+    // _Guarded_by_(m_lock)
+    std::deque<QueuedMessage> m_messages;
+
+    // Total size of the queued DNS messages.
+    // _Guarded_by_(m_lock)
+    size_t m_queuedBytes = 0;
+
+    // _Guarded_by_(m_lock)
+    bool m_stopped = false;
+
+    // Thread sending the queued messages.
+    std::thread m_sendWorkerThread;
+};
+
+} // namespace wsl::shared
@@ -0,0 +1,473 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    JsonReader.h
+
+Abstract:
+
+    This file contains a streaming JSON deserializer, reading JSON documents directly into C++ structs.
+
+--*/
+
+#pragma once
+
+#include <concepts>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "JsonUtils.h"
+
+namespace wsl::shared::json {
+
+// Scalar JSON value. Strings point into the buffer of the parser.
+using Scalar = std::variant<std::nullptr_t, bool, int64_t, uint64_t, double, const std::string*>;
+
+struct TargetOps;
+
+// Destination of a JSON value.
+struct Target
+{
+    void* Value = nullptr;
+
+    // nullptr if the JSON value is skipped (unknown key).
+    const TargetOps* Ops = nullptr;
+};
+
+// Type-erased operations on a destination. Exactly one of them is set, depending on the kind of the destination.
+struct TargetOps
+{
+    // Assign a scalar value. Returns false if the value doesn't match the destination type.
+    bool (*Assign)(void* value, const Scalar& scalar) = nullptr;
+
+    // Return the destination of an object member (empty target if the member is unknown).
+    Target (*Member)(void* value, std::string_view key) = nullptr;
+
+    // Return the destination of an array element.
+    Target (*Element)(void* value, size_t index) = nullptr;
+
+    // Construct the value of an optional and return its destination.
+    Target (*Emplace)(void* value) = nullptr;
+};
+
+template <typename T>
+Target MakeTarget(T& value);
+
+template <typename T>
+concept ObjectType = requires(T& value, std::string_view key) {
+    { JsonMember(value, key) } -> std::same_as<Target>;
+};
+
+template <typename T>
+struct IsOptional : std::false_type
+{
+};
+
+template <typename T>
+struct IsOptional<std::optional<T>> : std::true_type
+{
+};
+
+template <typename T>
+struct IsVector : std::false_type
+{
+};
+
+template <typename T>
+struct IsVector<std::vector<T>> : std::true_type
+{
+};
+
+template <typename T>
+bool AssignScalar(T& value, const Scalar& scalar)
+{
+    if constexpr (std::is_same_v<T, bool>)
+    {
+        const auto* boolean = std::get_if<bool>(&scalar);
+        if (boolean == nullptr)
+        {
+            return false;
+        }
+
+        value = *boolean;
+        return true;
+    }
+    else if constexpr (std::is_arithmetic_v<T>)
+    {
+        // Same conversions as nlohmann: any number or boolean can be read as an arithmetic type.
+        return std::visit(
+            [&value](const auto& e) {
+                if constexpr (std::is_arithmetic_v<std::decay_t<decltype(e)>>)
+                {
+                    value = static_cast<T>(e);
+                    return true;
+                }
+                else
+                {
+                    return false;
+                }
+            },
+            scalar);
+    }
+    else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::wstring> || std::is_same_v<T, GUID>)
+    {
+        const auto* const* string = std::get_if<const std::string*>(&scalar);
+        if (string == nullptr)
+        {
+            return false;
+        }
+
+        if constexpr (std::is_same_v<T, std::string>)
+        {
+            value.assign(**string);
+        }
+        else if constexpr (std::is_same_v<T, std::wstring>)
+        {
+            value = wsl::shared::string::MultiByteToWide(**string);
+        }
+        else
+        {
+            // Unlike the nlohmann serializer, which leaves the value unchanged, an invalid GUID fails the document.
+            const auto parsed = wsl::shared::string::ToGuid(**string);
+            if (!parsed.has_value())
+            {
+                return false;
+            }
+
+            value = parsed.value();
+        }
+
+        return true;
+    }
+    else
+    {
+        // Other scalar types (enums, MAC addresses) go through their nlohmann serializer. Strings are copied into a value
+        // that is reused by the thread, so that reading an enum doesn't allocate once the value is large enough.
+        // Numbers, booleans and null are stored in the value itself.
+        if (const auto* const* string = std::get_if<const std::string*>(&scalar))
+        {
+            thread_local nlohmann::json stringValue = std::string{};
+            stringValue.get_ref<std::string&>().assign(**string);
+            stringValue.get_to(value);
+            return true;
+        }
+
+        std::visit(
+            [&value](const auto& e) {
+                if constexpr (!std::is_same_v<std::decay_t<decltype(e)>, const std::string*>)
+                {
+                    nlohmann::json(e).get_to(value);
+                }
+            },
+            scalar);
+
+        return true;
+    }
+}
+
+template <typename T>
+constexpr TargetOps MakeTargetOps()
+{
+    TargetOps ops{};
+    if constexpr (IsOptional<T>::value)
+    {
+        ops.Emplace = [](void* value) { return MakeTarget(static_cast<T*>(value)->emplace()); };
+    }
+    else if constexpr (IsVector<T>::value)
+    {
+        ops.Element = [](void* value, size_t index) {
+            auto* vector = static_cast<T*>(value);
+            if (index == 0)
+            {
+                vector->clear();
+            }
+
+            return MakeTarget(vector->emplace_back());
+        };
+    }
+    else if constexpr (ObjectType<T>)
+    {
+        ops.Member = [](void* value, std::string_view key) { return JsonMember(*static_cast<T*>(value), key); };
+    }
+    else
+    {
+        ops.Assign = [](void* value, const Scalar& scalar) { return AssignScalar(*static_cast<T*>(value), scalar); };
+    }
+
+    return ops;
+}
+
+template <typename T>
+inline constexpr TargetOps c_targetOps = MakeTargetOps<T>();
+
+template <typename T>
+Target MakeTarget(T& value)
+{
+    return {&value, &c_targetOps<T>};
+}
+
+// SAX handler writing the values of a JSON document to their destination, without building a DOM.
+class Reader
+{
+public:
+    using json = nlohmann::json;
+
+    explicit Reader(Target root) : m_root(root)
+    {
+    }
+
+    bool null()
+    {
+        const auto target = NextTarget();
+        if (target.Ops != nullptr && target.Ops->Emplace != nullptr)
+        {
+            return true; // null optional, leave it empty.
+        }
+
+        return Assign(target, nullptr);
+    }
+
+    bool boolean(bool value)
+    {
+        return Assign(NextTarget(), value);
+    }
+
+    bool number_integer(json::number_integer_t value)
+    {
+        return Assign(NextTarget(), static_cast<int64_t>(value));
+    }
+
+    bool number_unsigned(json::number_unsigned_t value)
+    {
+        return Assign(NextTarget(), static_cast<uint64_t>(value));
+    }
+
+    bool number_float(json::number_float_t value, const json::string_t&)
+    {
+        return Assign(NextTarget(), static_cast<double>(value));
+    }
+
+    bool string(json::string_t& value)
+    {
+        return Assign(NextTarget(), &value);
+    }
+
+    bool binary(json::binary_t&)
+    {
+        m_error = "unexpected binary value";
+        return false;
+    }
+
+    bool start_object(std::size_t)
+    {
+        auto target = Resolve(NextTarget());
+        if (target.Ops != nullptr && target.Ops->Member == nullptr)
+        {
+            m_error = "unexpected object";
+            return false;
+        }
+
+        return Push(target, FrameKind::Object);
+    }
+
+    bool key(json::string_t& key)
+    {
+        auto& frame = m_stack[m_depth - 1];
+        frame.Pending = frame.Destination.Ops != nullptr ? frame.Destination.Ops->Member(frame.Destination.Value, key) : Target{};
+        return true;
+    }
+
+    bool end_object()
+    {
+        m_depth--;
+        return true;
+    }
+
+    bool start_array(std::size_t)
+    {
+        auto target = Resolve(NextTarget());
+        if (target.Ops != nullptr && target.Ops->Element == nullptr)
+        {
+            m_error = "unexpected array";
+            return false;
+        }
+
+        return Push(target, FrameKind::Array);
+    }
+
+    bool end_array()
+    {
+        m_depth--;
+        return true;
+    }
+
+    template <typename TException>
+    bool parse_error(std::size_t, const std::string&, const TException& exception)
+    {
+        m_error = exception.what();
+        return false;
+    }
+
+    const std::string& Error() const noexcept
+    {
+        return m_error;
+    }
+
+private:
+    static constexpr size_t c_maxDepth = 32;
+
+    enum class FrameKind
+    {
+        Object,
+        Array
+    };
+
+    struct Frame
+    {
+        Target Destination;
+        FrameKind Kind{};
+
+        // Destination of the next member value (objects) or number of elements read (arrays).
+        Target Pending;
+        size_t Count = 0;
+    };
+
+    // Construct the optionals on the way to the destination of a non-null value.
+    static Target Resolve(Target target)
+    {
+        while (target.Ops != nullptr && target.Ops->Emplace != nullptr)
+        {
+            target = target.Ops->Emplace(target.Value);
+        }
+
+        return target;
+    }
+
+    bool Assign(Target target, const Scalar& scalar)
+    {
+        target = std::holds_alternative<std::nullptr_t>(scalar) ? target : Resolve(target);
+        if (target.Ops == nullptr)
+        {
+            return true; // Skipped value.
+        }
+
+        if (target.Ops->Assign == nullptr || !target.Ops->Assign(target.Value, scalar))
+        {
+            m_error = "unexpected value type";
+            return false;
+        }
+
+        return true;
+    }
+
+    Target NextTarget()
+    {
+        if (m_depth == 0)
+        {
+            return std::exchange(m_root, {});
+        }
+
+        auto& frame = m_stack[m_depth - 1];
+        if (frame.Kind == FrameKind::Object)
+        {
+            return std::exchange(frame.Pending, {});
+        }
+
+        if (frame.Destination.Ops == nullptr)
+        {
+            return {};
+        }
+
+        return frame.Destination.Ops->Element(frame.Destination.Value, frame.Count++);
+    }
+
+    bool Push(Target target, FrameKind kind)
+    {
+        if (m_depth == c_maxDepth)
+        {
+            m_error = "maximum depth exceeded";
+            return false;
+        }
+
+        m_stack[m_depth++] = {target, kind};
+        return true;
+    }
+
+    Target m_root;
+    Frame m_stack[c_maxDepth];
+    size_t m_depth = 0;
+    std::string m_error;
+};
+
+} // namespace wsl::shared::json
+
+#define WSL_JSON_READ_MEMBER(Field) \
+    if (key == #Field) \
+    { \
+        return wsl::shared::json::MakeTarget(value.Field); \
+    }
+
+// Define the streaming deserializer of a type, from the list of its fields.
+#define WSL_DEFINE_JSON_READER(Type, ...) \
+    inline wsl::shared::json::Target JsonMember(Type& value, std::string_view key) \
+    { \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(WSL_JSON_READ_MEMBER, __VA_ARGS__)) \
+        return {}; \
+    }
+
+#define WSL_DEFINE_JSON_READER_INTRUSIVE(Type, ...) \
+    friend wsl::shared::json::Target JsonMember(Type& value, std::string_view key) \
+    { \
+        NLOHMANN_JSON_EXPAND(NLOHMANN_JSON_PASTE(WSL_JSON_READ_MEMBER, __VA_ARGS__)) \
+        return {}; \
+    }
+
+// Same as NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT, also defining the streaming deserializer of the type.
+#define WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(Type, ...) \
+    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(Type, __VA_ARGS__) \
+    WSL_DEFINE_JSON_READER_INTRUSIVE(Type, __VA_ARGS__)
+
+namespace wsl::shared {
+
+// Deserialize a JSON document in a single pass, without building a DOM. Only the members declared with
+// WSL_DEFINE_JSON_READER / WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT are read, unknown members are skipped.
+template <typename T>
+T FromJsonStreaming(std::string_view Value)
+{
+    T object{};
+    std::string error;
+
+    try
+    {
+        json::Reader reader(json::MakeTarget(object));
+        if (nlohmann::json::sax_parse(Value.begin(), Value.end(), &reader))
+        {
+            return object;
+        }
+
+        error = reader.Error();
+    }
+    catch (const nlohmann::json::exception& e)
+    {
+        // Thrown by the nlohmann serializers of scalar types.
+        error = e.what();
+    }
+
+#ifdef WIN32
+
+    THROW_HR_WITH_USER_ERROR(WSL_E_INVALID_JSON, wsl::shared::Localization::MessageInvalidJson(error.c_str()));
+
+#else
+
+    LOG_ERROR("Failed to deserialize json: '{}'. Error: {}", std::string{Value}, error);
+    THROW_ERRNO(EINVAL);
+
+#endif
+}
+
+} // namespace wsl::shared
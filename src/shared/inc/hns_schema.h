@@ -14,6 +14,7 @@ Abstract:
 
 #pragma once
 #include <variant>
+#include "JsonReader.h"
 #include "JsonUtils.h"
 
 namespace wsl::shared::hns {
@@ -132,7 +133,7 @@ struct InterfaceConstraint
     uint32_t InterfaceMediaType{};
     std::wstring InterfaceAlias{};
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(InterfaceConstraint, InterfaceGuid, InterfaceIndex, InterfaceMediaType, InterfaceAlias);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(InterfaceConstraint, InterfaceGuid, InterfaceIndex, InterfaceMediaType, InterfaceAlias);
 };
 
 struct HNSEndpoint
@@ -149,7 +150,7 @@ struct HNSEndpoint
     InterfaceConstraint InterfaceConstraint{};
     std::wstring DNSServerList;
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(
         HNSEndpoint, IPAddress, MacAddress, GatewayAddress, PortFriendlyName, VirtualNetwork, VirtualNetworkName, Name, ID, PrefixLength, InterfaceConstraint, DNSServerList);
 };
 
@@ -161,7 +162,7 @@ struct Route
     uint32_t Metric{};
     uint16_t Family{};
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(Route, NextHop, DestinationPrefix, SitePrefixLength, Metric, Family);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(Route, NextHop, DestinationPrefix, SitePrefixLength, Metric, Family);
 };
 
 enum class ModifyRequestType
@@ -213,7 +214,7 @@ struct DNS
     std::wstring ServerList;
     std::wstring Options;
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(DNS, Domain, Search, ServerList, Options);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(DNS, Domain, Search, ServerList, Options);
 };
 
 struct IPAddress
@@ -225,7 +226,7 @@ struct IPAddress
     uint8_t SuffixOrigin{};
     uint32_t PreferredLifetime{};
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(IPAddress, Address, Family, OnLinkPrefixLength, PrefixOrigin, SuffixOrigin, PreferredLifetime);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(IPAddress, Address, Family, OnLinkPrefixLength, PrefixOrigin, SuffixOrigin, PreferredLifetime);
 };
 
 enum class OperationType
@@ -245,7 +246,7 @@ struct LoopbackRoutesRequest
     uint32_t family{};
     std::wstring ipAddress;
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(LoopbackRoutesRequest, operation, targetDeviceName, family, ipAddress);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(LoopbackRoutesRequest, operation, targetDeviceName, family, ipAddress);
 };
 
 struct NetworkInterface
@@ -254,7 +255,7 @@ struct NetworkInterface
     uint32_t NlMtu{};
     uint32_t Metric{};
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(NetworkInterface, Connected, NlMtu, Metric);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(NetworkInterface, Connected, NlMtu, Metric);
 };
 
 enum class InitialIpConfigurationNotificationFlags
@@ -271,14 +272,14 @@ struct InitialIpConfigurationNotification
     std::wstring targetDeviceName;
     InitialIpConfigurationNotificationFlags flags{};
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(InitialIpConfigurationNotification, targetDeviceName, flags);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(InitialIpConfigurationNotification, targetDeviceName, flags);
 };
 
 struct VmNicCreatedNotification
 {
     GUID adapterId{};
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(VmNicCreatedNotification, adapterId);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(VmNicCreatedNotification, adapterId);
 };
 
 enum class DeviceType
@@ -309,6 +310,7 @@ struct CreateDeviceRequest
 };
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT_FROM_ONLY(CreateDeviceRequest, type, deviceName, lowerEdgeAdapterId, lowerEdgeDeviceName);
+WSL_DEFINE_JSON_READER(CreateDeviceRequest, type, deviceName, lowerEdgeAdapterId, lowerEdgeDeviceName);
 
 inline void to_json(nlohmann::json& j, const CreateDeviceRequest& request)
 {
@@ -329,7 +331,7 @@ struct ModifyGuestDeviceSettingRequest
 {
     std::wstring targetDeviceName;
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(ModifyGuestDeviceSettingRequest, targetDeviceName);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(ModifyGuestDeviceSettingRequest, targetDeviceName);
 };
 
 struct InterfaceNetFilterRequest
@@ -339,14 +341,14 @@ struct InterfaceNetFilterRequest
     uint16_t ephemeralPortRangeStart{};
     uint16_t ephemeralPortRangeEnd{};
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(InterfaceNetFilterRequest, targetDeviceName, operation, ephemeralPortRangeStart, ephemeralPortRangeEnd);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(InterfaceNetFilterRequest, targetDeviceName, operation, ephemeralPortRangeStart, ephemeralPortRangeEnd);
 };
 
 struct MacAddress
 {
     std::string PhysicalAddress;
 
-    NLOHMANN_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(MacAddress, PhysicalAddress);
+    WSL_DEFINE_TYPE_INTRUSIVE_WITH_DEFAULT(MacAddress, PhysicalAddress);
 };
 
 template <typename T>
@@ -372,6 +374,21 @@ struct ModifyGuestEndpointSettingRequest<void>
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT_FROM_ONLY(ModifyGuestEndpointSettingRequest<void>, RequestType, ResourceType, targetDeviceName);
 
+template <typename T>
+inline wsl::shared::json::Target JsonMember(ModifyGuestEndpointSettingRequest<T>& value, std::string_view key)
+{
+    WSL_JSON_READ_MEMBER(RequestType)
+    WSL_JSON_READ_MEMBER(ResourceType)
+    WSL_JSON_READ_MEMBER(targetDeviceName)
+
+    if constexpr (!std::is_same_v<T, void>)
+    {
+        WSL_JSON_READ_MEMBER(Settings)
+    }
+
+    return {};
+}
+
 template <typename T>
 inline void to_json(nlohmann::json& j, const ModifyGuestEndpointSettingRequest<T>& request)
 {
@@ -218,6 +218,7 @@ Abstract:
 #define LX_INIT_GNS_SOCKET_ARG "--socket"
 #define LX_INIT_GNS_DNS_SOCKET_ARG "--dns_socket"
 #define LX_INIT_GNS_DNS_TUNNELING_IP "--dns_tunneling_ip"
+#define LX_INIT_GNS_DNS_TUNNELING_CACHE_ARG "--dns_tunneling_cache"
 #define LX_INIT_GNS_MESSAGE_TYPE_ARG "--msg_type"
 
 //
@@ -264,6 +265,7 @@ Abstract:
 #define LX_WSL2_DISTRO_READ_ONLY_ENV "WSL_DISTRO_READ_ONLY"
 #define LX_WSL2_NETWORKING_MODE_ENV "WSL2_NETWORKING_MODE"
 #define LX_WSL2_DISTRO_INIT_PID "WSL2_DISTRO_INIT_PID"
+#define LX_WSL2_STARTUP_TIMELINE_ENV "WSL2_STARTUP_TIMELINE"
 
 //
 // Command line arguments shared between init & mini_init
@@ -360,7 +362,9 @@ typedef enum _LX_MESSAGE_TYPE
     LxMessageResultBool,
     LxMessageResultInt32,
     LxMessageResultUint32,
-    LxMessageResultUint8
+    LxMessageResultUint8,
+    LxGnsMessageDnsTunnelingBatch,
+    LxInitMessageQueryStartupTimeline
 } LX_MESSAGE_TYPE,
     *PLX_MESSAGE_TYPE;
 
@@ -449,6 +453,8 @@ inline auto ToString(LX_MESSAGE_TYPE messageType)
         X(LxMessageResultUint32)
         X(LxMiniInitTelemetryMessage)
         X(LxMessageResultUint8)
+        X(LxGnsMessageDnsTunnelingBatch)
+        X(LxInitMessageQueryStartupTimeline)
 
     default:
         return "<unexpected LX_MESSAGE_TYPE>";
@@ -659,13 +665,67 @@ typedef struct _LX_INIT_CREATE_NT_PROCESS_UTILITY_VM
 
     MESSAGE_HEADER Header;
     unsigned int Port;
+    unsigned int Flags;
     LX_INIT_CREATE_NT_PROCESS_COMMON Common;
 
-    PRETTY_PRINT(FIELD(Header), FIELD(Port), FIELD(Common));
+    PRETTY_PRINT(FIELD(Header), FIELD(Port), FIELD(Flags), FIELD(Common));
 } LX_INIT_CREATE_NT_PROCESS_UTILITY_VM, *PLX_INIT_CREATE_NT_PROCESS_UTILITY_VM;
 
 using PCLX_INIT_CREATE_NT_PROCESS_UTILITY_VM = const LX_INIT_CREATE_NT_PROCESS_UTILITY_VM*;
 
+//
+// When LX_INIT_CREATE_NT_PROCESS_FLAG_MULTIPLEXED is set, the interop server may
+// connect a single socket that carries stdin, stdout, stderr and the control
+// channel, instead of LX_INIT_CREATE_NT_PROCESS_SOCKETS sockets. Each frame
+// starts with a LX_INIT_MULTIPLEXED_FRAME_HEADER.
+//
+// Stdin, stdout and stderr are flow controlled: a sender may only send as much
+// data as it was granted with window frames. Each receiver grants
+// LX_INIT_MULTIPLEXED_WINDOW bytes per stream when the connection is
+// established (the server's stdin grant is the first frame on the connection),
+// then returns credit once data was written to its destination, so a slow
+// reader never blocks the other streams. Each data frame of the control stream
+// carries exactly one message and isn't flow controlled.
+//
+
+#define LX_INIT_CREATE_NT_PROCESS_FLAG_MULTIPLEXED 0x1
+
+#define LX_INIT_MULTIPLEXED_MAX_FRAME_DATA (64 * 1024)
+#define LX_INIT_MULTIPLEXED_WINDOW (256 * 1024)
+
+typedef enum _LX_INIT_MULTIPLEXED_STREAM
+{
+    LxInitMultiplexedStreamStdIn = 0,
+    LxInitMultiplexedStreamStdOut,
+    LxInitMultiplexedStreamStdErr,
+    LxInitMultiplexedStreamControl,
+    LxInitMultiplexedStreamCount
+} LX_INIT_MULTIPLEXED_STREAM,
+    *PLX_INIT_MULTIPLEXED_STREAM;
+
+typedef enum _LX_INIT_MULTIPLEXED_FRAME_TYPE
+{
+    // Size bytes of data follow the header.
+    LxInitMultiplexedFrameData = 0,
+
+    // The sender won't send more data on the stream.
+    LxInitMultiplexedFrameClose,
+
+    // The receiver consumed Size bytes of the stream; the sender may send that much more.
+    LxInitMultiplexedFrameWindow
+} LX_INIT_MULTIPLEXED_FRAME_TYPE,
+    *PLX_INIT_MULTIPLEXED_FRAME_TYPE;
+
+typedef struct _LX_INIT_MULTIPLEXED_FRAME_HEADER
+{
+    uint8_t Type;
+    uint8_t Stream;
+    uint16_t Reserved;
+    uint32_t Size;
+} LX_INIT_MULTIPLEXED_FRAME_HEADER, *PLX_INIT_MULTIPLEXED_FRAME_HEADER;
+
+static_assert(sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER) == 8);
+
 //
 // The data communicating networking information. The structure is variable
 // size and the FileContents member contains the string to write to the
@@ -830,6 +890,28 @@ typedef struct _LX_GNS_DNS_TUNNELING_MESSAGE
 // Verify there is no padding in the LX_GNS_DNS_TUNNELING_MESSAGE structure before the variable length Buffer field.
 static_assert(offsetof(LX_GNS_DNS_TUNNELING_MESSAGE, Buffer) == sizeof(MESSAGE_HEADER) + sizeof(LX_GNS_DNS_CLIENT_IDENTIFIER));
 
+typedef struct _LX_GNS_DNS_TUNNELING_BATCH_ENTRY
+{
+    LX_GNS_DNS_CLIENT_IDENTIFIER DnsClientIdentifier;
+    // Size of the raw DNS request or response following the entry.
+    uint32_t BufferSize;
+} LX_GNS_DNS_TUNNELING_BATCH_ENTRY, *PLX_GNS_DNS_TUNNELING_BATCH_ENTRY;
+
+// Several DNS requests or responses packed in a single message, sent when DNS messages are queued faster than the channel
+// can send them.
+typedef struct _LX_GNS_DNS_TUNNELING_BATCH_MESSAGE
+{
+    static inline auto Type = LxGnsMessageDnsTunnelingBatch;
+
+    MESSAGE_HEADER Header;
+    uint32_t Count;
+    // Count LX_GNS_DNS_TUNNELING_BATCH_ENTRY structures, each followed by the raw DNS request or response it describes
+    // (variable length). The entries are not aligned.
+    char Buffer[];
+
+    PRETTY_PRINT(FIELD(Header), FIELD(Count));
+} LX_GNS_DNS_TUNNELING_BATCH_MESSAGE, *PLX_GNS_DNS_TUNNELING_BATCH_MESSAGE;
+
 typedef struct _LX_GNS_JSON_MESSAGE
 {
     static inline auto Type = LxMiniInitMessageAny;
@@ -1129,9 +1211,20 @@ typedef enum _LX_MINI_INIT_MESSAGE_FLAGS
     LxMiniInitMessageFlagExportCompressGzip = 0x8,
     LxMiniInitMessageFlagExportCompressXzip = 0x10,
     LxMiniInitMessageFlagVerbose = 0x20,
+    LxMiniInitMessageFlagExportCompressZstd = 0x40,
+    LxMiniInitMessageFlagExportZstdLong = 0x80,
+    LxMiniInitMessageFlagExportZstdSeekable = 0x100,
+    LxMiniInitMessageFlagExportZstdLevelMask = 0x1F0000,
 } LX_MINI_INIT_MESSAGE_FLAGS,
     *PLX_MINI_INIT_MESSAGE_FLAGS;
 
+//
+// The zstd compression level of an export, or 0 for the default, is stored in
+// the LxMiniInitMessageFlagExportZstdLevelMask bits of the flags.
+//
+
+#define LX_MINI_INIT_EXPORT_ZSTD_LEVEL_SHIFT 16
+
 typedef enum _LX_MINI_INIT_MOUNT_DEVICE_TYPE
 {
     LxMiniInitMountDeviceTypeInvalid = 0,
@@ -1193,10 +1286,13 @@ typedef struct _LX_MINI_INIT_EARLY_CONFIG_MESSAGE
     unsigned int SystemDistroDeviceId;
     int PageReportingOrder;
     LX_MINI_INIT_MEMORY_RECLAIM_MODE MemoryReclaimMode;
+    uint64_t MemoryReclaimFloor;
+    unsigned int MemoryReclaimMaxPressure;
     // IPv4 address stored in network byte order
     uint32_t DnsTunnelingIpAddress = 0;
     bool EnableDebugShell;
     bool EnableDnsTunneling;
+    bool EnableDnsTunnelingCache;
     bool EnableSafeMode;
     bool DefaultKernel;
     unsigned int KernelModulesDeviceId;
@@ -1211,9 +1307,12 @@ typedef struct _LX_MINI_INIT_EARLY_CONFIG_MESSAGE
         FIELD(SystemDistroDeviceId),
         FIELD(PageReportingOrder),
         FIELD(MemoryReclaimMode),
+        FIELD(MemoryReclaimFloor),
+        FIELD(MemoryReclaimMaxPressure),
         FIELD(DnsTunnelingIpAddress),
         FIELD(EnableDebugShell),
         FIELD(EnableDnsTunneling),
+        FIELD(EnableDnsTunnelingCache),
         FIELD(EnableSafeMode),
         FIELD(DefaultKernel),
         FIELD(KernelModulesDeviceId),
@@ -1495,9 +1594,11 @@ typedef struct _LX_MINI_INIT_IMPORT_RESULT
     unsigned int TerminalProfileSize;
     bool GenerateTerminalProfile;
     bool GenerateShortcut;
+    uint64_t BytesImported;
+    unsigned int ImportTimeMs;
     char Buffer[];
 
-    PRETTY_PRINT(FIELD(Header), FIELD(Result), STRING_FIELD(FlavorIndex), STRING_FIELD(VersionIndex), STRING_FIELD(DefaultNameIndex), FIELD(ShortcutIconIndex), FIELD(TerminalProfileIndex));
+    PRETTY_PRINT(FIELD(Header), FIELD(Result), STRING_FIELD(FlavorIndex), STRING_FIELD(VersionIndex), STRING_FIELD(DefaultNameIndex), FIELD(ShortcutIconIndex), FIELD(TerminalProfileIndex), FIELD(BytesImported), FIELD(ImportTimeMs));
 } LX_MINI_INIT_IMPORT_RESULT, *PLX_MINI_INIT_IMPORT_RESULT;
 
 typedef struct _LX_INIT_OOBE_RESULT
@@ -1521,6 +1622,16 @@ typedef struct _LX_INIT_QUERY_VM_ID
     PRETTY_PRINT(FIELD(Header), FIELD(Buffer));
 } LX_INIT_QUERY_VM_ID, *PLX_INIT_QUERY_VM_ID;
 
+typedef struct _LX_INIT_QUERY_STARTUP_TIMELINE
+{
+    static inline auto Type = LxInitMessageQueryStartupTimeline;
+
+    MESSAGE_HEADER Header;
+    char Buffer[];
+
+    PRETTY_PRINT(FIELD(Header), FIELD(Buffer));
+} LX_INIT_QUERY_STARTUP_TIMELINE, *PLX_INIT_QUERY_STARTUP_TIMELINE;
+
 template <>
 struct std::formatter<LX_MESSAGE_TYPE, char>
 {
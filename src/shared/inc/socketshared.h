@@ -116,4 +116,59 @@ catch (...)
     return {};
 }
 
+// Receive a frame from a multiplexed interop connection (see LX_INIT_CREATE_NT_PROCESS_FLAG_MULTIPLEXED). Returns the
+// header followed by the data of the frame, or an empty span if the connection was closed.
+#if defined(_MSC_VER)
+inline gsl::span<gsl::byte> RecvMultiplexedFrame(
+    SOCKET Socket, std::vector<gsl::byte>& Buffer, std::optional<HANDLE> ExitHandle = {})
+#elif defined(__GNUC__)
+inline gsl::span<gsl::byte> RecvMultiplexedFrame(int Socket, std::vector<gsl::byte>& Buffer)
+#endif
+{
+    constexpr auto HeaderSize = sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER);
+    if (Buffer.size() < HeaderSize + LX_INIT_MULTIPLEXED_MAX_FRAME_DATA)
+    {
+        Buffer.resize(HeaderSize + LX_INIT_MULTIPLEXED_MAX_FRAME_DATA);
+    }
+
+    size_t FrameSize = HeaderSize;
+    size_t Offset = 0;
+    while (Offset < FrameSize)
+    {
+        auto Remaining = gsl::make_span(Buffer.data() + Offset, FrameSize - Offset);
+#if defined(_MSC_VER)
+        const auto BytesRead =
+            wsl::windows::common::socket::Receive(Socket, Remaining, ExitHandle.value_or(nullptr), MSG_WAITALL);
+#elif defined(__GNUC__)
+        const auto BytesRead = TEMP_FAILURE_RETRY(recv(Socket, Remaining.data(), Remaining.size(), MSG_WAITALL));
+        THROW_LAST_ERROR_IF(BytesRead < 0);
+#endif
+        if (BytesRead == 0)
+        {
+            return {};
+        }
+
+        Offset += BytesRead;
+        if (Offset == HeaderSize)
+        {
+            const auto* Header = reinterpret_cast<const LX_INIT_MULTIPLEXED_FRAME_HEADER*>(Buffer.data());
+            if (Header->Type == LxInitMultiplexedFrameData)
+            {
+                if (Header->Size > LX_INIT_MULTIPLEXED_MAX_FRAME_DATA)
+                {
+#if defined(_MSC_VER)
+                    THROW_HR_MSG(E_UNEXPECTED, "Unexpected frame size: %u", Header->Size);
+#elif defined(__GNUC__)
+                    THROW_UNEXCEPTED();
+#endif
+                }
+
+                FrameSize += Header->Size;
+            }
+        }
+    }
+
+    return gsl::make_span(Buffer.data(), FrameSize);
+}
+
 } // namespace wsl::shared::socket
@@ -28,11 +28,13 @@ try
         return;
     }
 
-    wsl::shared::MessageWriter<LX_GNS_DNS_TUNNELING_MESSAGE> message(LxGnsMessageDnsTunneling);
-    message->DnsClientIdentifier = dnsClientIdentifier;
-    message.WriteSpan(dnsBuffer);
-
-    m_channel.SendMessage<LX_GNS_DNS_TUNNELING_MESSAGE>(message.Span());
+    if (!m_sendQueue.Push(dnsBuffer, dnsClientIdentifier))
+    {
+        WSL_LOG(
+            "DnsTunnelingChannel::SendDnsMessage [Windows] - send queue is full, dropping DNS message",
+            TraceLoggingValue(dnsClientIdentifier.Protocol == IPPROTO_UDP ? "UDP" : "TCP", "Protocol"),
+            TraceLoggingValue(dnsClientIdentifier.DnsClientId, "DNS client id"));
+    }
 }
 CATCH_LOG()
 
@@ -89,6 +91,29 @@ void DnsTunnelingChannel::ReceiveLoop() noexcept
                 break;
             }
 
+            case LxGnsMessageDnsTunnelingBatch:
+            {
+                const auto parsed = wsl::shared::DnsTunnelingQueue::ParseBatch(
+                    span, [this](const gsl::span<gsl::byte> dnsBuffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& dnsClientIdentifier) {
+                        WSL_LOG_DEBUG(
+                            "DnsTunnelingChannel::ReceiveLoop [Windows] - received batched DNS message",
+                            TraceLoggingValue(dnsBuffer.size(), "DNS buffer size"),
+                            TraceLoggingValue(dnsClientIdentifier.Protocol == IPPROTO_UDP ? "UDP" : "TCP", "Protocol"),
+                            TraceLoggingValue(dnsClientIdentifier.DnsClientId, "DNS client id"));
+
+                        // Invoke callback to notify about the new DNS request
+                        m_reportDnsRequest(dnsBuffer, dnsClientIdentifier);
+                    });
+
+                if (!parsed)
+                {
+                    WSL_LOG("DnsTunnelingChannel::ReceiveLoop [Windows] - failed to parse LX_GNS_DNS_TUNNELING_BATCH_MESSAGE");
+                    return;
+                }
+
+                break;
+            }
+
             default:
             {
                 THROW_HR_MSG(E_UNEXPECTED, "Unexpected LX_MESSAGE_TYPE : %i", message->MessageType);
@@ -106,6 +131,9 @@ try
 
     m_stopEvent.SetEvent();
 
+    // Stop sending queued DNS responses
+    m_sendQueue.Stop();
+
     // Stop receive loop
     if (m_receiveWorkerThread.joinable())
     {
@@ -5,6 +5,7 @@
 #include <wil/resource.h>
 #include "lxinitshared.h"
 #include "SocketChannel.h"
+#include "DnsTunnelingQueue.h"
 
 namespace wsl::core::networking {
 
@@ -22,8 +23,8 @@ public:
     DnsTunnelingChannel(DnsTunnelingChannel&&) = delete;
     DnsTunnelingChannel& operator=(DnsTunnelingChannel&&) = delete;
 
-    // Construct and send a LX_GNS_DNS_TUNNELING_MESSAGE message on the channel.
-    // Note: Callers are responsible for sequencing calls to this method.
+    // Queue a DNS response to be sent on the channel. Responses queued together are sent in a single
+    // LX_GNS_DNS_TUNNELING_BATCH_MESSAGE, so a slow channel doesn't block the caller.
     //
     // Arguments:
     // dnsBuffer - buffer containing DNS response.
@@ -41,6 +42,9 @@ private:
 
     wsl::shared::SocketChannel m_channel;
 
+    // Queue of DNS responses waiting to be sent on m_channel. Declared after m_channel so it's destroyed first.
+    wsl::shared::DnsTunnelingQueue m_sendQueue{m_channel};
+
     std::thread m_receiveWorkerThread;
 
     // Callback used to notify when there is a new DNS request message on the channel.
@@ -229,6 +229,7 @@ int ExportDistribution(_In_ std::wstring_view commandLine)
     ArgumentParser parser(std::wstring{commandLine}, WSL_BINARY_NAME);
     std::filesystem::path filePath;
     LPCWSTR name{};
+    std::optional<int> compressionLevel;
 
     auto parseFormat = [&flags](LPCWSTR Value) {
         if (Value == nullptr)
@@ -244,6 +245,10 @@ int ExportDistribution(_In_ std::wstring_view commandLine)
         {
             WI_SetFlag(flags, LXSS_EXPORT_DISTRO_FLAGS_XZIP);
         }
+        else if (wsl::shared::string::IsEqual(L"tar.zst", Value))
+        {
+            WI_SetFlag(flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD);
+        }
         else if (wsl::shared::string::IsEqual(L"vhd", Value))
         {
             WI_SetFlag(flags, LXSS_EXPORT_DISTRO_FLAGS_VHD);
@@ -260,12 +265,28 @@ int ExportDistribution(_In_ std::wstring_view commandLine)
     parser.AddPositionalArgument(filePath, 1);
     parser.AddArgument(SetFlag<ULONG, LXSS_EXPORT_DISTRO_FLAGS_VHD>(flags), WSL_EXPORT_ARG_VHD_OPTION);
     parser.AddArgument(parseFormat, WSL_EXPORT_ARG_FORMAT_OPTION);
+    parser.AddArgument(Integer(compressionLevel), WSL_EXPORT_ARG_COMPRESSION_LEVEL_OPTION);
+    parser.AddArgument(SetFlag<ULONG, LXSS_EXPORT_DISTRO_FLAGS_ZSTD_LONG>(flags), WSL_EXPORT_ARG_LONG_OPTION);
+    parser.AddArgument(SetFlag<ULONG, LXSS_EXPORT_DISTRO_FLAGS_ZSTD_SEEKABLE>(flags), WSL_EXPORT_ARG_SEEKABLE_OPTION);
     parser.Parse();
 
     THROW_HR_IF(
         WSL_E_INVALID_USAGE,
         filePath.empty() || (WI_IsFlagSet(flags, LXSS_EXPORT_DISTRO_FLAGS_GZIP) && WI_IsFlagSet(flags, LXSS_EXPORT_DISTRO_FLAGS_VHD)));
 
+    // The compression level, long distance matching and seekable frames are only supported by tar.zst.
+    // N.B. Levels above 19 need more memory to decompress than zstd allows by default.
+    if (compressionLevel.has_value())
+    {
+        THROW_HR_IF(WSL_E_INVALID_USAGE, compressionLevel.value() < 1 || compressionLevel.value() > LXSS_EXPORT_DISTRO_ZSTD_MAX_LEVEL);
+
+        flags |= (compressionLevel.value() << LXSS_EXPORT_DISTRO_FLAGS_ZSTD_LEVEL_SHIFT);
+    }
+
+    THROW_HR_IF(
+        WSL_E_INVALID_USAGE,
+        WI_IsAnyFlagSet(flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD_OPTIONS) && WI_IsFlagClear(flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD));
+
     // Determine if the target is stdout, or an on-disk file.
     wil::unique_hfile file;
     HANDLE fileHandle;
@@ -118,9 +118,12 @@ void wsl::core::Config::ParseConfigFile(_In_opt_ LPCWSTR ConfigFilePath, _In_opt
 
         // Experimental features.
         ConfigKey(ConfigSetting::Experimental::AutoMemoryReclaim, wsl::core::MemoryReclaimModes, MemoryReclaim),
+        ConfigKey(ConfigSetting::Experimental::AutoMemoryReclaimFloor, MemoryString(MemoryReclaimFloorBytes)),
+        ConfigKey(ConfigSetting::Experimental::AutoMemoryReclaimMaxPressure, MemoryReclaimMaxPressure),
         ConfigKey(ConfigSetting::Experimental::SparseVhd, EnableSparseVhd),
         ConfigKey(ConfigSetting::Experimental::BestEffortDnsParsing, BestEffortDnsParsing),
         ConfigKey(ConfigSetting::Experimental::DnsTunnelingIpAddress, std::move(parseDnsTunnelingIp)),
+        ConfigKey(ConfigSetting::Experimental::DnsTunnelingCache, EnableDnsTunnelingCache),
         ConfigKey(ConfigSetting::Experimental::InitialAutoProxyTimeout, InitialAutoProxyTimeout),
         ConfigKey(ConfigSetting::Experimental::IgnoredPorts, std::move(parseIgnoredPorts)),
         ConfigKey(ConfigSetting::Experimental::HostAddressLoopback, EnableHostAddressLoopback),
@@ -326,6 +329,8 @@ void wsl::core::Config::Initialize(_In_opt_ HANDLE UserToken)
         SwapSizeBytes = ((MemorySizeBytes / 4 + _1GB - 1) & ~(_1GB - 1));
     }
 
+    MemoryReclaimMaxPressure = std::clamp(MemoryReclaimMaxPressure, 1, 100);
+
     // Apply machine-wide policies to the configuration.
     auto key = wsl::windows::policies::OpenPoliciesKey();
     auto applyOverride = [&key](LPCWSTR ValueName, LPCWSTR SettingName, auto& value) {
@@ -23,6 +23,7 @@ Abstract:
 #define CONFIG_TELEMETRY(c) \
     T_VALUE(c, BestEffortDnsParsing), T_VALUE(c, DhcpTimeout), T_VALUE(c, EnableAutoProxy), T_VALUE(c, EnableDebugConsole), \
         T_VALUE(c, EnableDebugShell), T_VALUE(c, EnableDhcp), T_VALUE(c, EnableDnsProxy), T_VALUE(c, EnableDnsTunneling), \
+        T_VALUE(c, EnableDnsTunnelingCache), \
         T_VALUE(c, EnableGpuSupport), T_VALUE(c, EnableGuiApps), T_VALUE(c, EnableHardwarePerformanceCounters), \
         T_VALUE(c, EnableHostAddressLoopback), T_VALUE(c, EnableHostFileSystemAccess), T_VALUE(c, EnableIpv6), \
         T_VALUE(c, EnableLocalhostRelay), T_VALUE(c, EnableNestedVirtualization), T_VALUE(c, EnableSafeMode), \
@@ -30,7 +31,8 @@ Abstract:
         T_ENUM(c, FirewallConfigPresence), T_VALUE(c, KernelBootTimeout), T_SET(c, KernelCommandLine), \
         T_VALUE(c, KernelDebugPort), T_SET(c, KernelModulesPath), T_STRING(c, KernelModulesList), T_SET(c, KernelPath), \
         T_VALUE(c, LoadDefaultKernelModules), T_PRESENT(c, LoadKernelModulesPresence), T_VALUE(c, MaximumMemorySizeBytes), \
-        T_VALUE(c, MaximumProcessorCount), T_ENUM(c, MemoryReclaim), T_VALUE(c, MemorySizeBytes), T_VALUE(c, MountDeviceTimeout), \
+        T_VALUE(c, MaximumProcessorCount), T_ENUM(c, MemoryReclaim), T_VALUE(c, MemoryReclaimFloorBytes), \
+        T_VALUE(c, MemoryReclaimMaxPressure), T_VALUE(c, MemorySizeBytes), T_VALUE(c, MountDeviceTimeout), \
         T_ENUM(c, NetworkingMode), T_VALUE(c, ProcessorCount), T_SET(c, SwapFilePath), T_VALUE(c, SwapSizeBytes), \
         T_SET(c, SystemDistroPath), T_VALUE(c, VhdSizeBytes), T_VALUE(c, VmIdleTimeout), T_SET(c, VmSwitch)
 
@@ -279,10 +281,13 @@ namespace ConfigSetting {
     namespace Experimental {
         static constexpr auto NetworkingMode = "experimental.networkingMode";
         static constexpr auto AutoMemoryReclaim = "experimental.autoMemoryReclaim";
+        static constexpr auto AutoMemoryReclaimFloor = "experimental.autoMemoryReclaimFloor";
+        static constexpr auto AutoMemoryReclaimMaxPressure = "experimental.autoMemoryReclaimMaxPressure";
         static constexpr auto SparseVhd = "experimental.sparseVhd";
         static constexpr auto DnsTunneling = "experimental.dnsTunneling";
         static constexpr auto BestEffortDnsParsing = "experimental.bestEffortDnsParsing";
         static constexpr auto DnsTunnelingIpAddress = "experimental.dnsTunnelingIpAddress";
+        static constexpr auto DnsTunnelingCache = "experimental.dnsTunnelingCache";
         static constexpr auto Firewall = "experimental.firewall";
         static constexpr auto AutoProxy = "experimental.autoProxy";
         static constexpr auto InitialAutoProxyTimeout = "experimental.initialAutoProxyTimeout";
@@ -357,10 +362,18 @@ struct Config
     // IP address that will be used by the DNS listener/proxy used for DNS tunneling. Some scenarios (such as native Docker)
     // require Linux nameserver to be an IP that is not in the range 127.0.0.0/8. This config is intended for those scenarios.
     std::optional<uint32_t> DnsTunnelingIpAddress;
+    // Only applicable when DNS tunneling is enabled
+    // When enabled, the DNS listener used for DNS tunneling caches responses (honoring their TTL) and coalesces identical
+    // in-flight requests, instead of tunneling every request to Windows.
+    bool EnableDnsTunnelingCache = false;
     bool EnableHardwarePerformanceCounters = !shared::Arm64;
     bool EnableAutoProxy = true;
     int InitialAutoProxyTimeout = 1000;
     MemoryReclaimMode MemoryReclaim = MemoryReclaimMode::DropCache;
+    // Memory in use below which memory is not reclaimed. 0 lets the VM derive it from its memory size.
+    UINT64 MemoryReclaimFloorBytes = 0;
+    // Percentage of time that tasks can stall on memory before memory reclaim is suspended.
+    int MemoryReclaimMaxPressure = 5;
     bool EnableSparseVhd = false;
     UINT64 VhdSizeBytes = 0x10000000000; // 1TB
 
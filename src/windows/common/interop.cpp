@@ -109,6 +109,345 @@ struct CreateProcessVmModeContext
     std::vector<gsl::byte> Buffer{};
 };
 
+// Relays stdin, stdout, stderr and the control channel of a process over a single multiplexed connection (see
+// LX_INIT_CREATE_NT_PROCESS_FLAG_MULTIPLEXED).
+//
+// The process is given pipes. Stdin data is queued by the receive thread and written to the process by its own thread,
+// so a process that doesn't read its stdin never stops the window frames of stdout and stderr from being processed.
+// Stdin writes are overlapped so that they can be abandoned once the relay is done.
+class MultiplexedRelay
+{
+public:
+    MultiplexedRelay(_In_ wil::unique_socket&& Socket) : m_socket(std::move(Socket))
+    {
+        auto Pipe = wsl::windows::common::wslutil::OpenAnonymousPipe(0, false, true);
+        m_stdIn.reset(Pipe.first.release());
+        m_input.reset(Pipe.second.release());
+
+        Pipe = wsl::windows::common::wslutil::OpenAnonymousPipe(0, false, false);
+        m_output[LxInitMultiplexedStreamStdOut].reset(Pipe.first.release());
+        m_stdOut.reset(Pipe.second.release());
+
+        Pipe = wsl::windows::common::wslutil::OpenAnonymousPipe(0, false, false);
+        m_output[LxInitMultiplexedStreamStdErr].reset(Pipe.first.release());
+        m_stdErr.reset(Pipe.second.release());
+
+        // ProcessInteropMessages uses overlapped reads.
+        Pipe = wsl::windows::common::wslutil::OpenAnonymousPipe(0, true, false);
+        m_control.reset(Pipe.first.release());
+        m_controlWrite.reset(Pipe.second.release());
+
+        // Grant the initial stdin window. This is the first frame, which tells the client that the connection is
+        // multiplexed.
+        SendFrame(LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdIn, LX_INIT_MULTIPLEXED_WINDOW);
+    }
+
+    ~MultiplexedRelay()
+    {
+        // Stdout and stderr end when the process closes them. The send direction of the connection is then shut down,
+        // and the client closes the connection once it has received everything.
+        m_stdIn.reset();
+        m_stdOut.reset();
+        m_stdErr.reset();
+        for (auto& Thread : m_outputThreads)
+        {
+            if (Thread.joinable())
+            {
+                Thread.join();
+            }
+        }
+
+        LOG_LAST_ERROR_IF(shutdown(m_socket.get(), SD_SEND) == SOCKET_ERROR);
+        if (m_receiveThread.joinable())
+        {
+            m_receiveThread.join();
+        }
+
+        // The process has exited, but stdin may have been inherited by a process that doesn't read it. Abandon the
+        // pending write instead of waiting for it.
+        m_exitEvent.SetEvent();
+        if (m_inputThread.joinable())
+        {
+            m_inputThread.join();
+        }
+    }
+
+    MultiplexedRelay(const MultiplexedRelay&) = delete;
+    MultiplexedRelay(MultiplexedRelay&&) = delete;
+    MultiplexedRelay& operator=(const MultiplexedRelay&) = delete;
+    MultiplexedRelay& operator=(MultiplexedRelay&&) = delete;
+
+    // Handles to give to the process.
+    HANDLE StdIn() const
+    {
+        return m_stdIn.get();
+    }
+
+    HANDLE StdOut() const
+    {
+        return m_stdOut.get();
+    }
+
+    HANDLE StdErr() const
+    {
+        return m_stdErr.get();
+    }
+
+    // Handle that receives the messages sent by the client on the control channel.
+    HANDLE Control() const
+    {
+        return m_control.get();
+    }
+
+    // Start relaying, once the process was created. The process side of the pipes is closed.
+    void Start()
+    {
+        m_stdIn.reset();
+        m_stdOut.reset();
+        m_stdErr.reset();
+
+        m_receiveThread = std::thread([this]() { Receive(); });
+        m_inputThread = std::thread([this]() { RelayInput(); });
+        for (const auto Stream : {LxInitMultiplexedStreamStdOut, LxInitMultiplexedStreamStdErr})
+        {
+            m_outputThreads[Stream - LxInitMultiplexedStreamStdOut] = std::thread([this, Stream]() { RelayOutput(Stream); });
+        }
+    }
+
+    // Send a message on the control channel.
+    void SendMessage(_In_ gsl::span<const gsl::byte> Message)
+    {
+        std::vector<gsl::byte> Buffer(sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER) + Message.size());
+        gsl::copy(Message, gsl::make_span(Buffer).subspan(sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER)));
+        SendFrame(LxInitMultiplexedFrameData, LxInitMultiplexedStreamControl, Message.size(), Buffer);
+    }
+
+private:
+    // Send a frame. The data of a data frame is read from Buffer, after the room left for the header.
+    void SendFrame(
+        _In_ LX_INIT_MULTIPLEXED_FRAME_TYPE Type,
+        _In_ LX_INIT_MULTIPLEXED_STREAM Stream,
+        _In_ size_t Size,
+        _Inout_ std::vector<gsl::byte>& Buffer)
+    {
+        auto* Header = gslhelpers::get_struct<LX_INIT_MULTIPLEXED_FRAME_HEADER>(gsl::make_span(Buffer));
+        *Header = {};
+        Header->Type = Type;
+        Header->Stream = Stream;
+        Header->Size = gsl::narrow_cast<uint32_t>(Size);
+        const auto FrameSize = sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER) + ((Type == LxInitMultiplexedFrameData) ? Size : 0);
+
+        std::lock_guard Lock(m_sendLock);
+        wsl::windows::common::socket::Send(m_socket.get(), gsl::make_span(Buffer).first(FrameSize));
+    }
+
+    void SendFrame(_In_ LX_INIT_MULTIPLEXED_FRAME_TYPE Type, _In_ LX_INIT_MULTIPLEXED_STREAM Stream, _In_ size_t Size)
+    {
+        std::vector<gsl::byte> Buffer(sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER));
+        SendFrame(Type, Stream, Size, Buffer);
+    }
+
+    // Dispatch the frames sent by the client until it closes the connection.
+    void Receive()
+    {
+        try
+        {
+            std::vector<gsl::byte> Buffer;
+            for (;;)
+            {
+                const auto Frame = wsl::shared::socket::RecvMultiplexedFrame(m_socket.get(), Buffer);
+                if (Frame.empty())
+                {
+                    break;
+                }
+
+                const auto* Header = gslhelpers::get_struct<LX_INIT_MULTIPLEXED_FRAME_HEADER>(Frame);
+                const auto Data = Frame.subspan(sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER));
+                const auto Stream = static_cast<LX_INIT_MULTIPLEXED_STREAM>(Header->Stream);
+                if ((Stream == LxInitMultiplexedStreamStdOut) || (Stream == LxInitMultiplexedStreamStdErr))
+                {
+                    THROW_HR_IF(E_UNEXPECTED, Header->Type != LxInitMultiplexedFrameWindow);
+
+                    std::lock_guard Lock(m_lock);
+                    m_window[Stream] += Header->Size;
+                    m_changed.notify_all();
+                }
+                else if (Stream == LxInitMultiplexedStreamStdIn)
+                {
+                    THROW_HR_IF(E_UNEXPECTED, Header->Type == LxInitMultiplexedFrameWindow);
+
+                    std::lock_guard Lock(m_lock);
+                    if (Header->Type == LxInitMultiplexedFrameData)
+                    {
+                        m_inputQueue.emplace_back(Data.begin(), Data.end());
+                    }
+                    else
+                    {
+                        m_inputClosed = true;
+                    }
+
+                    m_changed.notify_all();
+                }
+                else if (Stream == LxInitMultiplexedStreamControl)
+                {
+                    // Closing the control channel is handled like a closed control socket: ProcessInteropMessages
+                    // returns once the pipe is broken.
+                    if (Header->Type == LxInitMultiplexedFrameClose)
+                    {
+                        m_controlWrite.reset();
+                    }
+                    else if (m_controlWrite && (Header->Type == LxInitMultiplexedFrameData))
+                    {
+                        const auto* Message = gslhelpers::try_get_struct<LX_INIT_WINDOW_SIZE_CHANGED>(Data);
+                        THROW_HR_IF(E_UNEXPECTED, !Message || (Message->Header.MessageType != LxInitMessageWindowSizeChanged));
+
+                        DWORD BytesWritten;
+                        THROW_IF_WIN32_BOOL_FALSE(
+                            WriteFile(m_controlWrite.get(), Message, sizeof(*Message), &BytesWritten, nullptr));
+                    }
+                }
+                else
+                {
+                    THROW_HR_MSG(E_UNEXPECTED, "Unexpected frame %u %u", Header->Type, Header->Stream);
+                }
+            }
+        }
+        CATCH_LOG()
+
+        m_controlWrite.reset();
+
+        std::lock_guard Lock(m_lock);
+        m_closed = true;
+        m_inputClosed = true;
+        m_changed.notify_all();
+    }
+
+    // Write the queued stdin data to the process, returning the window to the client.
+    void RelayInput()
+    {
+        try
+        {
+            OVERLAPPED Overlapped{};
+            const wil::unique_event OverlappedEvent{wil::EventOptions::ManualReset};
+            Overlapped.hEvent = OverlappedEvent.get();
+            for (;;)
+            {
+                std::vector<gsl::byte> Data;
+                {
+                    std::unique_lock Lock(m_lock);
+                    m_changed.wait(Lock, [this]() { return !m_inputQueue.empty() || m_inputClosed; });
+                    if (m_inputQueue.empty())
+                    {
+                        break;
+                    }
+
+                    Data = std::move(m_inputQueue.front());
+                    m_inputQueue.pop_front();
+                }
+
+                // Stop if the process closed its stdin or the relay is done.
+                OverlappedEvent.ResetEvent();
+                const auto BytesWritten =
+                    wsl::windows::common::relay::InterruptableWrite(m_input.get(), Data, {m_exitEvent.get()}, &Overlapped);
+
+                if (BytesWritten != Data.size())
+                {
+                    break;
+                }
+
+                SendFrame(LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdIn, Data.size());
+            }
+        }
+        CATCH_LOG()
+
+        m_input.reset();
+    }
+
+    // Send the output of the process to the client, as long as it has granted a window.
+    void RelayOutput(_In_ LX_INIT_MULTIPLEXED_STREAM Stream)
+    {
+        try
+        {
+            const auto& Pipe = m_output[Stream];
+            std::vector<gsl::byte> Buffer(sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER) + LX_INIT_MULTIPLEXED_MAX_FRAME_DATA);
+            for (;;)
+            {
+                size_t Size;
+                {
+                    std::unique_lock Lock(m_lock);
+                    m_changed.wait(Lock, [&]() { return m_closed || (m_window[Stream] > 0); });
+                    if (m_closed)
+                    {
+                        return;
+                    }
+
+                    Size = std::min<size_t>(m_window[Stream], LX_INIT_MULTIPLEXED_MAX_FRAME_DATA);
+                }
+
+                DWORD BytesRead;
+                auto* Data = Buffer.data() + sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER);
+                if (!ReadFile(Pipe.get(), Data, gsl::narrow_cast<DWORD>(Size), &BytesRead, nullptr))
+                {
+                    // The process closed its output.
+                    LOG_LAST_ERROR_IF(GetLastError() != ERROR_BROKEN_PIPE);
+                    break;
+                }
+                else if (BytesRead == 0)
+                {
+                    continue;
+                }
+
+                {
+                    std::lock_guard Lock(m_lock);
+                    m_window[Stream] -= BytesRead;
+                }
+
+                SendFrame(LxInitMultiplexedFrameData, Stream, BytesRead, Buffer);
+            }
+
+            SendFrame(LxInitMultiplexedFrameClose, Stream, 0);
+        }
+        CATCH_LOG()
+    }
+
+    wil::unique_socket m_socket;
+    std::mutex m_sendLock;
+
+    // Process side of the pipes, closed once the process is created.
+    wil::unique_hfile m_stdIn;
+    wil::unique_hfile m_stdOut;
+    wil::unique_hfile m_stdErr;
+
+    wil::unique_hfile m_input;
+    wil::unique_hfile m_output[LxInitMultiplexedStreamCount];
+    wil::unique_hfile m_control;
+    wil::unique_hfile m_controlWrite;
+
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+
+    // Window granted by the client, by stream.
+    // _Guarded_by_(m_lock)
+    size_t m_window[LxInitMultiplexedStreamCount]{};
+
+    // _Guarded_by_(m_lock)
+    std::deque<std::vector<gsl::byte>> m_inputQueue;
+
+    // _Guarded_by_(m_lock)
+    bool m_inputClosed = false;
+
+    // Set once the client closed the connection.
+    // _Guarded_by_(m_lock)
+    bool m_closed = false;
+
+    // Set when the relay is destroyed, to interrupt a pending stdin write.
+    wil::unique_event m_exitEvent{wil::EventOptions::ManualReset};
+
+    std::thread m_receiveThread;
+    std::thread m_inputThread;
+    std::thread m_outputThreads[2];
+};
+
 std::wstring BuildEnvironment(gsl::span<gsl::byte> EnvironmentData)
 {
     std::map<std::wstring, std::wstring> Environment;
@@ -276,6 +615,34 @@ void CreateProcessVmMode(_In_ const GUID& VmId, _In_ const gsl::span<gsl::byte>&
             // Parse the message.
             CreateProcessParsed Parsed(Message.subspan(offsetof(LX_INIT_CREATE_NT_PROCESS_UTILITY_VM, Common)));
 
+            // If requested, relay stdin, stdout, stderr and the control channel over a single connection.
+            if (WI_IsFlagSet(Params->Flags, LX_INIT_CREATE_NT_PROCESS_FLAG_MULTIPLEXED))
+            {
+                MultiplexedRelay Relay{wsl::windows::common::hvsocket::Connect(Arguments->VmId, Params->Port)};
+
+                // N.B. The result must be declared after the relay so the pseudoconsole is closed before the relay
+                //      waits for the output of the process.
+                auto Result = CreateProcess(&Parsed, Relay.StdIn(), Relay.StdOut(), Relay.StdErr());
+                Relay.Start();
+
+                LX_INIT_CREATE_PROCESS_RESPONSE Response{};
+                Response.Header.MessageType = LxInitMessageCreateProcessResponse;
+                Response.Header.MessageSize = sizeof(Response);
+                Response.Flags = Result.Flags;
+                Response.Result = Result.Status;
+                Relay.SendMessage(gslhelpers::struct_as_bytes(Response));
+                if (Result.Status == 0)
+                {
+                    LX_INIT_PROCESS_EXIT_STATUS ExitStatus;
+                    ExitStatus.Header.MessageType = LxInitMessageExitStatus;
+                    ExitStatus.Header.MessageSize = sizeof(ExitStatus);
+                    ExitStatus.ExitCode = ProcessInteropMessages(Relay.Control(), &Result);
+                    Relay.SendMessage(gslhelpers::struct_as_bytes(ExitStatus));
+                }
+
+                return;
+            }
+
             // Establish connections on the specified port.
             static_assert(LX_INIT_CREATE_NT_PROCESS_SOCKETS == 4);
 
@@ -25,7 +25,10 @@ Abstract:
 #define WSL_EXEC_ARG_LONG L"--exec"
 #define WSL_EXPORT_ARG L"--export"
 #define WSL_EXPORT_ARG_STDOUT L"-"
+#define WSL_EXPORT_ARG_COMPRESSION_LEVEL_OPTION L"--compression-level"
 #define WSL_EXPORT_ARG_FORMAT_OPTION L"--format"
+#define WSL_EXPORT_ARG_LONG_OPTION L"--long"
+#define WSL_EXPORT_ARG_SEEKABLE_OPTION L"--seekable"
 #define WSL_EXPORT_ARG_VHD_OPTION L"--vhd"
 #define WSL_HELP_ARG L"--help"
 #define WSL_IMPORT_ARG L"--import"
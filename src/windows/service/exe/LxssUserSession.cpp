@@ -1024,6 +1024,14 @@ HRESULT LxssUserSessionImpl::EnumerateDistributions(_Out_ PULONG DistributionCou
 HRESULT LxssUserSessionImpl::ExportDistribution(_In_opt_ LPCGUID DistroGuid, _In_ HANDLE FileHandle, _In_ HANDLE ErrorHandle, _In_ ULONG Flags)
 {
     RETURN_HR_IF(E_INVALIDARG, (WI_IsAnyFlagSet(Flags, ~LXSS_EXPORT_DISTRO_FLAGS_ALL)));
+    RETURN_HR_IF(
+        E_INVALIDARG,
+        (WI_IsAnyFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD_OPTIONS) && WI_IsFlagClear(Flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD)));
+
+    // The level mask allows levels up to 31, but init ignores the zstd options if bsdtar rejects any of them.
+    RETURN_HR_IF(
+        E_INVALIDARG,
+        ((Flags & LXSS_EXPORT_DISTRO_FLAGS_ZSTD_LEVEL_MASK) >> LXSS_EXPORT_DISTRO_FLAGS_ZSTD_LEVEL_SHIFT) > LXSS_EXPORT_DISTRO_ZSTD_MAX_LEVEL);
 
     LXSS_DISTRO_CONFIGURATION configuration;
     wil::unique_hkey distroKey;
@@ -1041,6 +1049,11 @@ HRESULT LxssUserSessionImpl::ExportDistribution(_In_opt_ LPCGUID DistroGuid, _In
         // Exporting a WSL1 distro is not possible if the VHD flag is specified.
         RETURN_HR_IF(WSL_E_WSL2_NEEDED, WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_VHD) && WI_IsFlagClear(configuration.Flags, LXSS_DISTRO_FLAGS_VM_MODE));
 
+        // tar.zst exports are copied through init, which removes the padding bsdtar writes after the last zstd frame.
+        RETURN_HR_IF(
+            WSL_E_WSL2_NEEDED,
+            WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD) && WI_IsFlagClear(configuration.Flags, LXSS_DISTRO_FLAGS_VM_MODE));
+
         // Exporting a WSL1 distro is not possible if the lxcore driver is not present.
         RETURN_HR_IF(WSL_E_WSL1_NOT_SUPPORTED, WI_IsFlagClear(configuration.Flags, LXSS_DISTRO_FLAGS_VM_MODE) && !g_lxcoreInitialized);
 
@@ -1571,6 +1584,12 @@ HRESULT LxssUserSessionImpl::RegisterDistribution(
                     errorRelay->Sync();
                 }
 
+                WSL_LOG(
+                    "ImportDistributionResult",
+                    TraceLoggingValue(message.Result, "Result"),
+                    TraceLoggingValue(message.BytesImported, "BytesImported"),
+                    TraceLoggingValue(message.ImportTimeMs, "ImportTimeMs"));
+
                 // Process the import result message.
                 THROW_HR_IF(WSL_E_IMPORT_FAILED, (message.Result != 0));
 
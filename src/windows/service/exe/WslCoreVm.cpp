@@ -518,9 +518,12 @@ void WslCoreVm::Initialize(const GUID& VmId, const wil::shared_handle& UserToken
     message->SystemDistroDeviceId = m_systemDistroDeviceId;
     message->PageReportingOrder = m_coldDiscardShiftSize;
     message->MemoryReclaimMode = static_cast<LX_MINI_INIT_MEMORY_RECLAIM_MODE>(m_vmConfig.MemoryReclaim);
+    message->MemoryReclaimFloor = m_vmConfig.MemoryReclaimFloorBytes;
+    message->MemoryReclaimMaxPressure = m_vmConfig.MemoryReclaimMaxPressure;
     message->EnableDebugShell = m_vmConfig.EnableDebugShell;
     message->EnableSafeMode = m_vmConfig.EnableSafeMode;
     message->EnableDnsTunneling = m_vmConfig.EnableDnsTunneling;
+    message->EnableDnsTunnelingCache = m_vmConfig.EnableDnsTunneling && m_vmConfig.EnableDnsTunnelingCache;
     message->DefaultKernel = m_defaultKernel;
     message->KernelModulesDeviceId = m_kernelModulesDeviceId;
     message.WriteString(message->HostnameOffset, wsl::windows::common::filesystem::GetLinuxHostName());
@@ -1193,7 +1196,13 @@ std::shared_ptr<LxssRunningInstance> WslCoreVm::CreateInstance(
 
     WI_SetFlagIf(flags, LxMiniInitMessageFlagExportCompressGzip, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_GZIP));
     WI_SetFlagIf(flags, LxMiniInitMessageFlagExportCompressXzip, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_XZIP));
+    WI_SetFlagIf(flags, LxMiniInitMessageFlagExportCompressZstd, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD));
+    WI_SetFlagIf(flags, LxMiniInitMessageFlagExportZstdLong, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD_LONG));
+    WI_SetFlagIf(
+        flags, LxMiniInitMessageFlagExportZstdSeekable, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD_SEEKABLE));
     WI_SetFlagIf(flags, LxMiniInitMessageFlagVerbose, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_VERBOSE));
+    flags |= ((ExportFlags & LXSS_EXPORT_DISTRO_FLAGS_ZSTD_LEVEL_MASK) >> LXSS_EXPORT_DISTRO_FLAGS_ZSTD_LEVEL_SHIFT)
+             << LX_MINI_INIT_EXPORT_ZSTD_LEVEL_SHIFT;
 
     wsl::shared::MessageWriter<LX_MINI_INIT_MESSAGE> message(MessageType);
     message->MountDeviceType = LxMiniInitMountDeviceTypeLun;
@@ -0,0 +1,157 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    DeviceMonitorTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the block device table.
+
+--*/
+
+#include <sys/sysmacros.h>
+#include "InitTests.h"
+#include "DeviceMonitor.h"
+
+namespace {
+
+// Sysfs path of the SCSI host used by the tests. Host 255 doesn't exist in the VM, so the devices of the tests can't
+// collide with real ones.
+constexpr auto c_testHost = "/devices/LNXSYSTM:00/LNXSYBUS:00/ACPI0004:00/VMBUS:00/fd1d2cbd-ce7c-535c-966b-eb5f811c95f0/host255";
+
+// Build a uevent as sent by the kernel: a "<action>@<devpath>" header followed by KEY=VALUE strings, separated by
+// null characters.
+std::string Uevent(const std::string& action, const std::string& devPath, const std::vector<std::string>& values)
+{
+    std::string event = action + "@" + devPath;
+    event.push_back('\0');
+    event += "ACTION=" + action;
+    event.push_back('\0');
+    event += "DEVPATH=" + devPath;
+    for (const auto& e : values)
+    {
+        event.push_back('\0');
+        event += e;
+    }
+
+    return event;
+}
+
+std::string TestDiskPath(const std::string& address, const std::string& name)
+{
+    return std::string{c_testHost} + "/target255:0:0/" + address + "/block/" + name;
+}
+
+bool DiskNotFound(DeviceMonitor& monitor, const std::string& disk)
+{
+    try
+    {
+        monitor.GetDiskAndPartitions(disk);
+    }
+    catch (const wil::ResultException& exception)
+    {
+        return exception.GetErrorCode() == ENOENT;
+    }
+
+    return false;
+}
+
+} // namespace
+
+INIT_TEST(DeviceMonitorScsiAddress)
+{
+    VERIFY_ARE_EQUAL(std::string{"255:0:0:3"}, DeviceMonitor::GetScsiAddress(TestDiskPath("255:0:0:3", "sdzz")));
+    VERIFY_ARE_EQUAL(std::string{"0:0:0:12"}, DeviceMonitor::GetScsiAddress("/devices/host0/target0:0:0/0:0:0:12/block/sdb"));
+
+    // Devices that aren't SCSI disks.
+    VERIFY_ARE_EQUAL(std::string{}, DeviceMonitor::GetScsiAddress("/devices/virtual/block/loop0"));
+    VERIFY_ARE_EQUAL(
+        std::string{}, DeviceMonitor::GetScsiAddress("/devices/LNXSYSTM:00/ndbus0/region0/namespace0.0/block/pmem0"));
+    VERIFY_ARE_EQUAL(std::string{}, DeviceMonitor::GetScsiAddress("/devices/host0/0:0:0/block/sdb"));
+    VERIFY_ARE_EQUAL(std::string{}, DeviceMonitor::GetScsiAddress("/devices/host0/0:0:0:x/block/sdb"));
+    VERIFY_ARE_EQUAL(std::string{}, DeviceMonitor::GetScsiAddress("/block/sdb"));
+    VERIFY_ARE_EQUAL(std::string{}, DeviceMonitor::GetScsiAddress("sdb"));
+}
+
+INIT_TEST(DeviceMonitorPartitionDisk)
+{
+    VERIFY_ARE_EQUAL(std::string{"sdb"}, DeviceMonitor::GetPartitionDisk("/devices/host0/target0:0:0/0:0:0:1/block/sdb/sdb1"));
+    VERIFY_ARE_EQUAL(std::string{"nvme0n1"}, DeviceMonitor::GetPartitionDisk("/devices/pci0000:00/nvme/nvme0/nvme0n1/nvme0n1p2"));
+
+    // '!' stands for '/' in the sysfs names.
+    VERIFY_ARE_EQUAL(std::string{"cciss/c0d0"}, DeviceMonitor::GetPartitionDisk("/devices/pci0000:00/cciss!c0d0/cciss!c0d0p1"));
+
+    VERIFY_ARE_EQUAL(std::string{}, DeviceMonitor::GetPartitionDisk("sdb1"));
+    VERIFY_ARE_EQUAL(std::string{}, DeviceMonitor::GetPartitionDisk("/sdb1"));
+}
+
+INIT_TEST(DeviceMonitorApply)
+{
+    DeviceMonitor monitor;
+
+    const auto diskPath = TestDiskPath("255:0:0:3", "sdzz");
+    monitor.Apply(Uevent("add", diskPath, {"SUBSYSTEM=block", "MAJOR=65", "MINOR=240", "DEVNAME=sdzz", "DEVTYPE=disk"}));
+    VERIFY_IS_TRUE(monitor.WaitForBlockDevice("sdzz", std::chrono::milliseconds{0}));
+    VERIFY_IS_TRUE(monitor.WaitForScsiDisk("255:0:0:3", std::chrono::milliseconds{0}) == std::string{"sdzz"});
+
+    // Uevents of other subsystems are ignored.
+    monitor.Apply(Uevent("add", std::string{c_testHost} + "/target255:0:0/255:0:0:4", {"SUBSYSTEM=scsi", "DEVNAME=sdzx"}));
+    VERIFY_IS_FALSE(monitor.WaitForBlockDevice("sdzx", std::chrono::milliseconds{0}));
+    VERIFY_IS_FALSE(monitor.WaitForScsiDisk("255:0:0:4", std::chrono::milliseconds{0}).has_value());
+
+    // A renamed disk replaces the old one.
+    const auto movedPath = TestDiskPath("255:0:0:3", "sdzy");
+    monitor.Apply(Uevent(
+        "move",
+        movedPath,
+        {"SUBSYSTEM=block", "DEVPATH_OLD=" + diskPath, "MAJOR=65", "MINOR=240", "DEVNAME=sdzy", "DEVTYPE=disk"}));
+    VERIFY_IS_FALSE(monitor.WaitForBlockDevice("sdzz", std::chrono::milliseconds{0}));
+    VERIFY_IS_TRUE(monitor.WaitForScsiDisk("255:0:0:3", std::chrono::milliseconds{0}) == std::string{"sdzy"});
+
+    const auto partitionPath = movedPath + "/sdzy1";
+    monitor.Apply(Uevent(
+        "add", partitionPath, {"SUBSYSTEM=block", "MAJOR=65", "MINOR=241", "DEVNAME=sdzy1", "DEVTYPE=partition", "PARTN=1"}));
+
+    auto devices = monitor.GetDiskAndPartitions("sdzy");
+    VERIFY_ARE_EQUAL(2, devices.size());
+    VERIFY_ARE_EQUAL(std::string{"sdzy"}, devices[0].Name);
+    VERIFY_ARE_EQUAL(std::string{"255:0:0:3"}, devices[0].ScsiAddress);
+    VERIFY_ARE_EQUAL(movedPath, devices[0].DevPath);
+    VERIFY_IS_TRUE(devices[0].Disk.empty());
+    VERIFY_ARE_EQUAL(std::string{"sdzy1"}, devices[1].Name);
+    VERIFY_ARE_EQUAL(std::string{"sdzy"}, devices[1].Disk);
+    VERIFY_IS_TRUE(devices[1].ScsiAddress.empty());
+    VERIFY_IS_TRUE(devices[1].Number == makedev(65, 241));
+
+    // Partitions aren't disks.
+    VERIFY_IS_TRUE(DiskNotFound(monitor, "sdzy1"));
+
+    monitor.Apply(Uevent(
+        "remove", partitionPath, {"SUBSYSTEM=block", "MAJOR=65", "MINOR=241", "DEVNAME=sdzy1", "DEVTYPE=partition"}));
+    VERIFY_ARE_EQUAL(1, monitor.GetDiskAndPartitions("sdzy").size());
+
+    monitor.Apply(Uevent("remove", movedPath, {"SUBSYSTEM=block", "MAJOR=65", "MINOR=240", "DEVNAME=sdzy", "DEVTYPE=disk"}));
+    VERIFY_IS_FALSE(monitor.WaitForBlockDevice("sdzy", std::chrono::milliseconds{0}));
+    VERIFY_IS_FALSE(monitor.WaitForScsiDisk("255:0:0:3", std::chrono::milliseconds{0}).has_value());
+    VERIFY_IS_TRUE(DiskNotFound(monitor, "sdzy"));
+}
+
+INIT_TEST(DeviceMonitorWait)
+{
+    DeviceMonitor monitor;
+
+    // A device that appears while a thread waits wakes it up.
+    std::thread publisher([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        const auto diskPath = TestDiskPath("255:0:0:5", "sdzw");
+        monitor.Apply(Uevent("add", diskPath, {"SUBSYSTEM=block", "MAJOR=65", "MINOR=224", "DEVNAME=sdzw", "DEVTYPE=disk"}));
+    });
+
+    auto joinPublisher = wil::scope_exit([&]() { publisher.join(); });
+
+    VERIFY_IS_TRUE(monitor.WaitForScsiDisk("255:0:0:5", std::chrono::seconds{30}) == std::string{"sdzw"});
+    VERIFY_IS_FALSE(monitor.WaitForBlockDevice("sdzv", std::chrono::milliseconds{10}));
+}
@@ -0,0 +1,244 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    DnsCacheTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the DNS cache.
+
+--*/
+
+#include <algorithm>
+#include <netinet/in.h>
+#include "InitTests.h"
+#include "DnsCache.h"
+
+namespace {
+
+constexpr uint16_t c_typeA = 1;
+constexpr uint16_t c_typeOpt = 41;
+constexpr uint16_t c_classIn = 1;
+constexpr uint16_t c_flagResponse = 0x8000;
+constexpr uint16_t c_flagRecursionDesired = 0x0100;
+
+void AppendUint16(std::vector<gsl::byte>& Buffer, uint16_t Value)
+{
+    Buffer.push_back(static_cast<gsl::byte>(Value >> 8));
+    Buffer.push_back(static_cast<gsl::byte>(Value & 0xFF));
+}
+
+void AppendUint32(std::vector<gsl::byte>& Buffer, uint32_t Value)
+{
+    AppendUint16(Buffer, static_cast<uint16_t>(Value >> 16));
+    AppendUint16(Buffer, static_cast<uint16_t>(Value & 0xFFFF));
+}
+
+uint16_t ReadUint16(const std::vector<gsl::byte>& Buffer, size_t Offset)
+{
+    return (static_cast<uint16_t>(Buffer.at(Offset)) << 8) | static_cast<uint16_t>(Buffer.at(Offset + 1));
+}
+
+uint32_t ReadUint32(const std::vector<gsl::byte>& Buffer, size_t Offset)
+{
+    return (static_cast<uint32_t>(ReadUint16(Buffer, Offset)) << 16) | ReadUint16(Buffer, Offset + 2);
+}
+
+// Build a DNS message with a single A question for Name, and optionally an answer and an OPT pseudo-record.
+std::vector<gsl::byte> BuildMessage(
+    uint16_t TransactionId, uint16_t Flags, const char* Name, std::optional<uint32_t> AnswerTtl, bool Edns)
+{
+    std::vector<gsl::byte> Message;
+    AppendUint16(Message, TransactionId);
+    AppendUint16(Message, Flags);
+    AppendUint16(Message, 1);
+    AppendUint16(Message, AnswerTtl.has_value() ? 1 : 0);
+    AppendUint16(Message, 0);
+    AppendUint16(Message, Edns ? 1 : 0);
+
+    for (std::string_view Remaining = Name; !Remaining.empty();)
+    {
+        const auto Label = Remaining.substr(0, Remaining.find('.'));
+        Message.push_back(static_cast<gsl::byte>(Label.size()));
+        for (const auto Character : Label)
+        {
+            Message.push_back(static_cast<gsl::byte>(Character));
+        }
+
+        Remaining.remove_prefix(std::min(Label.size() + 1, Remaining.size()));
+    }
+
+    Message.push_back(gsl::byte{0});
+    AppendUint16(Message, c_typeA);
+    AppendUint16(Message, c_classIn);
+
+    if (AnswerTtl.has_value())
+    {
+        // Compression pointer to the name of the question.
+        AppendUint16(Message, 0xC00C);
+        AppendUint16(Message, c_typeA);
+        AppendUint16(Message, c_classIn);
+        AppendUint32(Message, AnswerTtl.value());
+        AppendUint16(Message, 4);
+        AppendUint32(Message, 0x0A000001);
+    }
+
+    if (Edns)
+    {
+        Message.push_back(gsl::byte{0});
+        AppendUint16(Message, c_typeOpt);
+        AppendUint16(Message, 1232);
+        AppendUint32(Message, 0);
+        AppendUint16(Message, 0);
+    }
+
+    return Message;
+}
+
+std::vector<gsl::byte> BuildQuery(uint16_t TransactionId, const char* Name, bool Edns = false)
+{
+    return BuildMessage(TransactionId, c_flagRecursionDesired, Name, {}, Edns);
+}
+
+std::vector<gsl::byte> BuildResponse(uint16_t TransactionId, const char* Name, uint32_t Ttl, bool Edns = false)
+{
+    return BuildMessage(TransactionId, c_flagResponse | c_flagRecursionDesired, Name, Ttl, Edns);
+}
+
+// Offset of the TTL of the answer of a message built by BuildMessage.
+size_t AnswerTtlOffset(const char* Name)
+{
+    return 12 + strlen(Name) + 2 + 4 + 6;
+}
+
+DnsCache::Question ParseQuestion(const std::vector<gsl::byte>& Request)
+{
+    auto Question = DnsCache::ParseRequest(gsl::make_span(Request));
+    VERIFY_IS_TRUE(Question.has_value());
+    return Question.value();
+}
+
+LX_GNS_DNS_CLIENT_IDENTIFIER Client(uint32_t Id)
+{
+    LX_GNS_DNS_CLIENT_IDENTIFIER Identifier{};
+    Identifier.Protocol = IPPROTO_UDP;
+    Identifier.DnsClientId = Id;
+    return Identifier;
+}
+
+// Tunnel a request for Name through the cache and complete it with a response with the given TTL.
+void Populate(DnsCache& Cache, const char* Name, uint32_t Ttl, bool Edns = false)
+{
+    const auto Question = ParseQuestion(BuildQuery(1, Name, Edns));
+    VERIFY_IS_TRUE(Cache.BeginRequest(Question, Client(1)));
+    VERIFY_IS_TRUE(Cache.CompleteRequest(gsl::make_span(BuildResponse(1, Name, Ttl, Edns)), Client(1)).empty());
+}
+
+} // namespace
+
+INIT_TEST(DnsCacheMiss)
+{
+    DnsCache Cache;
+    VERIFY_IS_TRUE(Cache.Lookup(ParseQuestion(BuildQuery(1, "example.com")), IPPROTO_UDP).empty());
+
+    Populate(Cache, "example.com", 300);
+    VERIFY_IS_TRUE(Cache.Lookup(ParseQuestion(BuildQuery(2, "example.org")), IPPROTO_UDP).empty());
+
+    // Responses with a TTL of 0 are not cached.
+    Populate(Cache, "zero.example.com", 0);
+    VERIFY_IS_TRUE(Cache.Lookup(ParseQuestion(BuildQuery(3, "zero.example.com")), IPPROTO_UDP).empty());
+}
+
+INIT_TEST(DnsCacheHit)
+{
+    DnsCache Cache;
+    Populate(Cache, "example.com", 300);
+
+    // The cached response is served with the transaction id of the request, regardless of the case of the name.
+    const auto Query = BuildQuery(0x1234, "EXAMPLE.com");
+    const auto Response = Cache.Lookup(ParseQuestion(Query), IPPROTO_UDP);
+    VERIFY_IS_FALSE(Response.empty());
+    VERIFY_ARE_EQUAL(0x1234, ReadUint16(Response, 0));
+    VERIFY_ARE_EQUAL(BuildResponse(1, "example.com", 300).size(), Response.size());
+
+    // The question name is echoed with the case of the request.
+    const size_t NameLength = strlen("EXAMPLE.com") + 2;
+    VERIFY_IS_TRUE(std::equal(Query.begin() + 12, Query.begin() + 12 + NameLength, Response.begin() + 12));
+
+    const auto Ttl = ReadUint32(Response, AnswerTtlOffset("example.com"));
+    VERIFY_IS_TRUE(Ttl <= 300 && Ttl >= 299);
+}
+
+INIT_TEST(DnsCacheTtlExpiry)
+{
+    DnsCache Cache;
+    Populate(Cache, "example.com", 2);
+
+    const auto Question = ParseQuestion(BuildQuery(2, "example.com"));
+    VERIFY_IS_FALSE(Cache.Lookup(Question, IPPROTO_UDP).empty());
+
+    // TTLs are decremented by the age of the entry.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    const auto Response = Cache.Lookup(Question, IPPROTO_UDP);
+    VERIFY_IS_FALSE(Response.empty());
+    VERIFY_ARE_EQUAL(1, ReadUint32(Response, AnswerTtlOffset("example.com")));
+
+    // The entry expires with its record.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    VERIFY_IS_TRUE(Cache.Lookup(Question, IPPROTO_UDP).empty());
+}
+
+INIT_TEST(DnsCacheCoalescing)
+{
+    DnsCache Cache;
+
+    // Only the first of identical in-flight requests is tunneled.
+    VERIFY_IS_TRUE(Cache.BeginRequest(ParseQuestion(BuildQuery(1, "example.com")), Client(1)));
+    VERIFY_IS_FALSE(Cache.BeginRequest(ParseQuestion(BuildQuery(2, "example.com")), Client(2)));
+    VERIFY_IS_FALSE(Cache.BeginRequest(ParseQuestion(BuildQuery(3, "Example.COM")), Client(3)));
+
+    // Different questions are not coalesced.
+    VERIFY_IS_TRUE(Cache.BeginRequest(ParseQuestion(BuildQuery(4, "example.org")), Client(4)));
+
+    // The coalesced clients are returned with their transaction id when the response arrives.
+    const auto Waiters = Cache.CompleteRequest(gsl::make_span(BuildResponse(1, "example.com", 300)), Client(1));
+    VERIFY_ARE_EQUAL(2, Waiters.size());
+    VERIFY_ARE_EQUAL(2, Waiters[0].DnsClientIdentifier.DnsClientId);
+    VERIFY_ARE_EQUAL(2, Waiters[0].TransactionId);
+    VERIFY_ARE_EQUAL(3, Waiters[1].DnsClientIdentifier.DnsClientId);
+    VERIFY_ARE_EQUAL(3, Waiters[1].TransactionId);
+
+    // Each response gets the question name of its own request.
+    auto Response = BuildResponse(1, "example.com", 300);
+    DnsCache::CopyQuestionName(gsl::make_span(Response), Waiters[1].QuestionName);
+    VERIFY_IS_TRUE(BuildResponse(1, "Example.COM", 300) == Response);
+
+    // Once completed, the request is not in flight anymore.
+    VERIFY_IS_TRUE(Cache.BeginRequest(ParseQuestion(BuildQuery(5, "example.com")), Client(5)));
+
+    // An aborted request drops its waiters.
+    VERIFY_IS_FALSE(Cache.BeginRequest(ParseQuestion(BuildQuery(6, "example.org")), Client(6)));
+    Cache.AbortRequest(Client(4));
+    VERIFY_IS_TRUE(Cache.CompleteRequest(gsl::make_span(BuildResponse(4, "example.org", 300)), Client(4)).empty());
+}
+
+INIT_TEST(DnsCacheEdns)
+{
+    DnsCache Cache;
+
+    // A response to an EDNS request carries an OPT pseudo-record and can't be served to a client that didn't use EDNS.
+    Populate(Cache, "example.com", 300, true);
+    VERIFY_IS_TRUE(Cache.Lookup(ParseQuestion(BuildQuery(2, "example.com")), IPPROTO_UDP).empty());
+
+    const auto Response = Cache.Lookup(ParseQuestion(BuildQuery(3, "example.com", true)), IPPROTO_UDP);
+    VERIFY_IS_FALSE(Response.empty());
+    VERIFY_ARE_EQUAL(1, ReadUint16(Response, 10));
+
+    // And the other way around.
+    Populate(Cache, "example.org", 300);
+    VERIFY_IS_TRUE(Cache.Lookup(ParseQuestion(BuildQuery(4, "example.org", true)), IPPROTO_UDP).empty());
+    VERIFY_IS_FALSE(Cache.Lookup(ParseQuestion(BuildQuery(5, "example.org")), IPPROTO_UDP).empty());
+}
@@ -0,0 +1,170 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    DnsTunnelingChannelTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the DNS tunneling channel.
+
+--*/
+
+#include <condition_variable>
+#include <future>
+#include <netinet/in.h>
+#include <poll.h>
+#include "InitTests.h"
+#include "DnsTunnelingChannel.h"
+
+namespace {
+
+// Wait until the socket buffer of the channel is full, so that its send thread is blocked writing to it.
+void WaitForChannelFull(int ChannelFd)
+{
+    const auto Deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    for (;;)
+    {
+        pollfd PollDescriptor{.fd = ChannelFd, .events = POLLOUT, .revents = 0};
+        THROW_LAST_ERROR_IF(poll(&PollDescriptor, 1, 0) < 0);
+        if ((PollDescriptor.revents & POLLOUT) == 0)
+        {
+            return;
+        }
+
+        if (std::chrono::steady_clock::now() >= Deadline)
+        {
+            VERIFY_FAILED("The channel didn't fill up");
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+LX_GNS_DNS_CLIENT_IDENTIFIER ClientIdentifier(uint32_t Id)
+{
+    LX_GNS_DNS_CLIENT_IDENTIFIER Identifier{};
+    Identifier.Protocol = IPPROTO_UDP;
+    Identifier.DnsClientId = Id;
+    return Identifier;
+}
+
+std::string AsString(gsl::span<gsl::byte> Buffer)
+{
+    return std::string(reinterpret_cast<const char*>(Buffer.data()), Buffer.size());
+}
+
+gsl::span<gsl::byte> ToSpan(std::string& Buffer)
+{
+    return gsl::make_span(reinterpret_cast<gsl::byte*>(Buffer.data()), Buffer.size());
+}
+
+} // namespace
+
+INIT_TEST(DnsTunnelingChannelStopWhilePeerNotReading)
+{
+    int Sockets[2];
+    THROW_LAST_ERROR_IF(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, Sockets) < 0);
+    wil::unique_fd Peer{Sockets[0]};
+
+    DnsTunnelingChannel Channel{Sockets[1], [](const gsl::span<gsl::byte>, const LX_GNS_DNS_CLIENT_IDENTIFIER&) {}};
+
+    // Queue more requests than the socket buffer can hold. The peer never reads, so the send thread blocks on the channel.
+    std::vector<gsl::byte> Request(wsl::shared::c_dnsTunnelingMaxBatchBytes);
+    LX_GNS_DNS_CLIENT_IDENTIFIER Identifier{};
+    Identifier.Protocol = IPPROTO_TCP;
+    Identifier.DnsClientId = 1;
+    for (int Index = 0; Index < 32; Index += 1)
+    {
+        Channel.SendDnsMessage(gsl::make_span(Request), Identifier);
+    }
+
+    WaitForChannelFull(Sockets[1]);
+
+    // Stopping the channel must not wait for the peer to read.
+    auto Stopped = std::async(std::launch::async, [&]() { Channel.Stop(); });
+    VERIFY_IS_TRUE(Stopped.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+}
+
+INIT_TEST(DnsTunnelingChannelBatch)
+{
+    int Sockets[2];
+    THROW_LAST_ERROR_IF(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, Sockets) < 0);
+    wsl::shared::SocketChannel Peer{wil::unique_fd{Sockets[0]}, "DnsTunnelingPeer"};
+
+    std::mutex Lock;
+    std::condition_variable ResponsesChanged;
+    std::vector<std::pair<uint32_t, std::string>> Responses;
+    DnsTunnelingChannel Channel{Sockets[1], [&](const gsl::span<gsl::byte> Buffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& Identifier) {
+                                    std::lock_guard<std::mutex> Guard{Lock};
+                                    Responses.emplace_back(Identifier.DnsClientId, AsString(Buffer));
+                                    ResponsesChanged.notify_all();
+                                }};
+
+    // Block the send thread with a request larger than the socket buffer, so that the next requests are queued together.
+    std::vector<gsl::byte> Large(1024 * 1024);
+    Channel.SendDnsMessage(gsl::make_span(Large), ClientIdentifier(0));
+    WaitForChannelFull(Sockets[1]);
+
+    constexpr uint32_t Count = 5;
+    for (uint32_t Index = 1; Index <= Count; Index += 1)
+    {
+        auto Request = std::format("request {}", Index);
+        Channel.SendDnsMessage(ToSpan(Request), ClientIdentifier(Index));
+    }
+
+    auto [Message, Span] = Peer.ReceiveMessageOrClosed<MESSAGE_HEADER>();
+    VERIFY_IS_TRUE(Message != nullptr);
+    VERIFY_ARE_EQUAL(LxGnsMessageDnsTunneling, Message->MessageType);
+    VERIFY_ARE_EQUAL(sizeof(LX_GNS_DNS_TUNNELING_MESSAGE) + Large.size(), Span.size());
+
+    // The queued requests arrive in a single batch, in order.
+    std::tie(Message, Span) = Peer.ReceiveMessageOrClosed<MESSAGE_HEADER>();
+    VERIFY_IS_TRUE(Message != nullptr);
+    VERIFY_ARE_EQUAL(LxGnsMessageDnsTunnelingBatch, Message->MessageType);
+
+    std::vector<std::pair<uint32_t, std::string>> Requests;
+    VERIFY_IS_TRUE(wsl::shared::DnsTunnelingQueue::ParseBatch(
+        Span, [&](const gsl::span<gsl::byte> Buffer, const LX_GNS_DNS_CLIENT_IDENTIFIER& Identifier) {
+            Requests.emplace_back(Identifier.DnsClientId, AsString(Buffer));
+        }));
+
+    VERIFY_ARE_EQUAL(Count, Requests.size());
+    for (uint32_t Index = 1; Index <= Count; Index += 1)
+    {
+        VERIFY_ARE_EQUAL(Index, Requests[Index - 1].first);
+        VERIFY_ARE_EQUAL(std::format("request {}", Index), Requests[Index - 1].second);
+    }
+
+    // Reply with a batch, followed by a single response. Each response is reported with the client it's for.
+    wsl::shared::MessageWriter<LX_GNS_DNS_TUNNELING_BATCH_MESSAGE> Batch(LxGnsMessageDnsTunnelingBatch);
+    Batch->Count = Count;
+    for (uint32_t Index = 1; Index <= Count; Index += 1)
+    {
+        auto Response = std::format("response {}", Index);
+        LX_GNS_DNS_TUNNELING_BATCH_ENTRY Entry{};
+        Entry.DnsClientIdentifier = ClientIdentifier(Index);
+        Entry.BufferSize = static_cast<uint32_t>(Response.size());
+        gsl::copy(gslhelpers::struct_as_bytes(Entry), Batch.InsertBuffer(sizeof(Entry)));
+        Batch.WriteSpan(ToSpan(Response));
+    }
+
+    Peer.SendMessage<LX_GNS_DNS_TUNNELING_BATCH_MESSAGE>(Batch.Span());
+
+    wsl::shared::MessageWriter<LX_GNS_DNS_TUNNELING_MESSAGE> Single(LxGnsMessageDnsTunneling);
+    Single->DnsClientIdentifier = ClientIdentifier(0);
+    auto Response = std::string{"response 0"};
+    Single.WriteSpan(ToSpan(Response));
+    Peer.SendMessage<LX_GNS_DNS_TUNNELING_MESSAGE>(Single.Span());
+
+    std::unique_lock<std::mutex> Guard{Lock};
+    VERIFY_IS_TRUE(ResponsesChanged.wait_for(Guard, std::chrono::seconds(10), [&]() { return Responses.size() == Count + 1; }));
+    for (uint32_t Index = 0; Index <= Count; Index += 1)
+    {
+        const auto Id = (Index + 1) % (Count + 1);
+        VERIFY_ARE_EQUAL(Id, Responses[Index].first);
+        VERIFY_ARE_EQUAL(std::format("response {}", Id), Responses[Index].second);
+    }
+}
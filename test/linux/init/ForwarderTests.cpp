@@ -0,0 +1,144 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    ForwarderTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the packet forwarder.
+
+--*/
+
+#include <atomic>
+#include <fcntl.h>
+#include <numeric>
+#include <poll.h>
+#include <sys/socket.h>
+#include "InitTests.h"
+#include "Forwarder.h"
+
+namespace {
+
+struct SocketPair
+{
+    SocketPair(int Type)
+    {
+        int Sockets[2];
+        THROW_LAST_ERROR_IF(socketpair(AF_UNIX, (Type | SOCK_CLOEXEC), 0, Sockets) < 0);
+        First.reset(Sockets[0]);
+        Second.reset(Sockets[1]);
+    }
+
+    wil::unique_fd First;
+    wil::unique_fd Second;
+};
+
+// Forward all packets, except the ones that start with 'x'.
+auto c_dropX = [](Packet& Packet) { return Packet.data_end() == Packet.data() || *Packet.data() != 'x'; };
+
+auto c_noThrow = [](const std::exception&) { return true; };
+
+// Read from a socket, failing if nothing is received within 10 seconds.
+size_t ReadWithTimeout(int Fd, void* Buffer, size_t Size)
+{
+    pollfd PollDescriptor{.fd = Fd, .events = POLLIN, .revents = 0};
+    const int Result = poll(&PollDescriptor, 1, 10 * 1000);
+    THROW_LAST_ERROR_IF(Result < 0);
+    if (Result == 0)
+    {
+        VERIFY_FAILED("No data received");
+    }
+
+    const auto Bytes = read(Fd, Buffer, Size);
+    THROW_LAST_ERROR_IF(Bytes < 0);
+    return Bytes;
+}
+
+} // namespace
+
+INIT_TEST(ForwarderDatagramRoundTrip)
+{
+    SocketPair Source(SOCK_DGRAM);
+    SocketPair Destination(SOCK_DGRAM);
+    Forwarder Relay(Source.Second.get(), Destination.First.get(), c_dropX, c_noThrow);
+
+    // Queue more packets than a batch, so that several batches are forwarded.
+    constexpr int Count = 100;
+    for (int Index = 0; Index < Count; Index++)
+    {
+        const auto Message = std::format("{}{}", Index % 10 == 0 ? 'x' : 'p', Index);
+        THROW_LAST_ERROR_IF(write(Source.First.get(), Message.data(), Message.size()) < 0);
+    }
+
+    // Packet boundaries and order are preserved.
+    for (int Index = 0; Index < Count; Index++)
+    {
+        if (Index % 10 == 0)
+        {
+            continue;
+        }
+
+        char Buffer[64];
+        const auto Bytes = ReadWithTimeout(Destination.Second.get(), Buffer, sizeof(Buffer));
+        VERIFY_ARE_EQUAL(std::format("p{}", Index), std::string(Buffer, Bytes));
+    }
+}
+
+INIT_TEST(ForwarderStreamFullDestination)
+{
+    SocketPair Source(SOCK_STREAM);
+    SocketPair Destination(SOCK_STREAM);
+
+    // Make the destination non-blocking with a small buffer, so that writes are short or fail with EAGAIN.
+    const int BufferSize = 4096;
+    THROW_LAST_ERROR_IF(setsockopt(Destination.First.get(), SOL_SOCKET, SO_SNDBUF, &BufferSize, sizeof(BufferSize)) < 0);
+    THROW_LAST_ERROR_IF(fcntl(Destination.First.get(), F_SETFL, O_NONBLOCK) < 0);
+
+    std::atomic<bool> Failed = false;
+    Forwarder Relay(
+        Source.Second.get(),
+        Destination.First.get(),
+        [](Packet&) { return true; },
+        [&Failed](const std::exception&) {
+            Failed = true;
+            return true;
+        });
+
+    std::vector<char> Data(1024 * 1024);
+    std::iota(Data.begin(), Data.end(), 0);
+    std::thread Writer([&]() {
+        for (size_t Offset = 0; Offset < Data.size();)
+        {
+            const auto Bytes = send(Source.First.get(), Data.data() + Offset, Data.size() - Offset, MSG_NOSIGNAL);
+            if (Bytes < 0)
+            {
+                return;
+            }
+
+            Offset += Bytes;
+        }
+    });
+
+    // Unblock the writer if the test fails before reading everything.
+    auto JoinWriter = wil::scope_exit([&]() {
+        shutdown(Source.First.get(), SHUT_RDWR);
+        Writer.join();
+    });
+
+    // Let the destination fill up before reading it.
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<char> Received(Data.size());
+    for (size_t Offset = 0; Offset < Received.size();)
+    {
+        const auto Bytes = ReadWithTimeout(Destination.Second.get(), Received.data() + Offset, Received.size() - Offset);
+        VERIFY_IS_TRUE(Bytes > 0);
+        Offset += Bytes;
+    }
+
+    VERIFY_IS_TRUE(Received == Data);
+    VERIFY_IS_FALSE(Failed);
+}
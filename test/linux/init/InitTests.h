@@ -0,0 +1,96 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    InitTests.h
+
+Abstract:
+
+    This file contains the definitions used by the unit tests of the init daemon classes.
+
+--*/
+
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "common.h"
+
+struct InitTestCase
+{
+    const char* Name;
+    void (*Routine)();
+};
+
+std::vector<InitTestCase>& InitTestCases();
+
+struct InitTestRegistration
+{
+    InitTestRegistration(const char* Name, void (*Routine)())
+    {
+        InitTestCases().push_back({Name, Routine});
+    }
+};
+
+// Compare integers of different types by value, like the verification macros of TAEF.
+template <typename TExpected, typename TActual>
+bool InitTestAreEqual(const TExpected& Expected, const TActual& Actual)
+{
+    if constexpr (std::is_integral_v<TExpected> && std::is_integral_v<TActual> && !std::is_same_v<TExpected, bool>)
+    {
+        return std::cmp_equal(Expected, Actual);
+    }
+    else
+    {
+        return Expected == Actual;
+    }
+}
+
+//
+// Define a test case. Test cases are run in the order they are defined by the runner in main.cpp.
+//
+
+#define INIT_TEST(_name) \
+    static void _name(); \
+    static InitTestRegistration _name##Registration(#_name, _name); \
+    static void _name()
+
+//
+// Verification macros. A failed verification throws, which fails the current test case.
+//
+
+#define VERIFY_FAILED(_message) \
+    { \
+        std::stringstream _stream; \
+        _stream << __FILE__ << ":" << __LINE__ << ": " << _message; \
+        throw std::runtime_error(_stream.str()); \
+    }
+
+#define VERIFY_IS_TRUE(_expression) \
+    if (!(_expression)) \
+    { \
+        VERIFY_FAILED("VERIFY_IS_TRUE(" #_expression ")"); \
+    }
+
+#define VERIFY_IS_FALSE(_expression) \
+    if (_expression) \
+    { \
+        VERIFY_FAILED("VERIFY_IS_FALSE(" #_expression ")"); \
+    }
+
+#define VERIFY_ARE_EQUAL(_expected, _actual) \
+    { \
+        const auto& _expectedValue = (_expected); \
+        const auto& _actualValue = (_actual); \
+        if (!InitTestAreEqual(_expectedValue, _actualValue)) \
+        { \
+            VERIFY_FAILED( \
+                "VERIFY_ARE_EQUAL(" #_expected ", " #_actual ") - expected " << _expectedValue << ", got " << _actualValue); \
+        } \
+    }
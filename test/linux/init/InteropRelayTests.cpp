@@ -0,0 +1,288 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    InteropRelayTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the multiplexed interop relay.
+
+    The relay is connected to a stand-in interop server over a socketpair and
+    its stdin, stdout and stderr are pipes.
+
+--*/
+
+#include <future>
+#include "InitTests.h"
+#include "binfmt.h"
+#include "util.h"
+
+namespace {
+
+constexpr auto c_frameHeaderSize = sizeof(LX_INIT_MULTIPLEXED_FRAME_HEADER);
+constexpr int c_noDataTimeoutMs = 100;
+
+// N.B. The relay thread is joined when the future is destroyed. It is declared first so that the descriptors are closed
+//      before, which unblocks the relay if a test fails.
+struct TestRelay
+{
+    std::future<int> ExitCode;
+    wil::unique_fd Server;
+    wil::unique_fd Input;
+    wil::unique_fd Output;
+    wil::unique_fd Error;
+};
+
+// Start the relay on a separate thread. The test acts as the interop server on the returned socket and writes the
+// stdin of the relay / reads its stdout and stderr through the returned pipes.
+TestRelay StartRelay()
+{
+    int Sockets[2];
+    THROW_LAST_ERROR_IF(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, Sockets) < 0);
+
+    wil::unique_fd RelaySocket{Sockets[1]};
+    TestRelay Relay{.Server = wil::unique_fd{Sockets[0]}};
+
+    int InputPipe[2];
+    int OutputPipe[2];
+    int ErrorPipe[2];
+    THROW_LAST_ERROR_IF(pipe2(InputPipe, O_CLOEXEC) < 0);
+    wil::unique_fd InputRead{InputPipe[0]};
+    Relay.Input.reset(InputPipe[1]);
+    THROW_LAST_ERROR_IF(pipe2(OutputPipe, O_CLOEXEC) < 0);
+    wil::unique_fd OutputWrite{OutputPipe[1]};
+    Relay.Output.reset(OutputPipe[0]);
+    THROW_LAST_ERROR_IF(pipe2(ErrorPipe, O_CLOEXEC) < 0);
+    wil::unique_fd ErrorWrite{ErrorPipe[1]};
+    Relay.Error.reset(ErrorPipe[0]);
+
+    Relay.ExitCode = std::async(
+        std::launch::async,
+        [RelaySocket = std::move(RelaySocket),
+         InputRead = std::move(InputRead),
+         OutputWrite = std::move(OutputWrite),
+         ErrorWrite = std::move(ErrorWrite)]() {
+            return CreateNtProcessRelayMultiplexed(
+                RelaySocket.get(), InputRead.get(), OutputWrite.get(), ErrorWrite.get(), -1, "test");
+        });
+
+    return Relay;
+}
+
+void SendFrame(
+    int Socket,
+    LX_INIT_MULTIPLEXED_FRAME_TYPE Type,
+    LX_INIT_MULTIPLEXED_STREAM Stream,
+    uint32_t Size,
+    gsl::span<const gsl::byte> Data = {})
+{
+    std::vector<gsl::byte> Frame(c_frameHeaderSize);
+    auto* Header = gslhelpers::get_struct<LX_INIT_MULTIPLEXED_FRAME_HEADER>(gsl::make_span(Frame));
+    Header->Type = Type;
+    Header->Stream = Stream;
+    Header->Size = Size;
+    Frame.insert(Frame.end(), Data.begin(), Data.end());
+    THROW_LAST_ERROR_IF(UtilWriteBuffer(Socket, Frame.data(), Frame.size()) < 0);
+}
+
+void SendData(int Socket, LX_INIT_MULTIPLEXED_STREAM Stream, std::string_view Data)
+{
+    SendFrame(
+        Socket, LxInitMultiplexedFrameData, Stream, gsl::narrow_cast<uint32_t>(Data.size()), gsl::as_bytes(gsl::make_span(Data)));
+}
+
+// Returns whether data is available on a file descriptor within the no data timeout.
+bool HasData(int Fd)
+{
+    pollfd PollDescriptor{Fd, POLLIN};
+    const int Result = TEMP_FAILURE_RETRY(poll(&PollDescriptor, 1, c_noDataTimeoutMs));
+    THROW_LAST_ERROR_IF(Result < 0);
+    return Result > 0;
+}
+
+// Receive a frame from the relay and verify its type, stream and size. Returns the data of data frames.
+std::string ExpectFrame(int Socket, LX_INIT_MULTIPLEXED_FRAME_TYPE Type, LX_INIT_MULTIPLEXED_STREAM Stream, uint32_t Size)
+{
+    std::vector<gsl::byte> Buffer;
+    const auto Frame = wsl::shared::socket::RecvMultiplexedFrame(Socket, Buffer);
+    VERIFY_IS_FALSE(Frame.empty());
+
+    const auto* Header = gslhelpers::get_struct<LX_INIT_MULTIPLEXED_FRAME_HEADER>(Frame);
+    VERIFY_ARE_EQUAL(Type, Header->Type);
+    VERIFY_ARE_EQUAL(Stream, Header->Stream);
+    VERIFY_ARE_EQUAL(Size, Header->Size);
+
+    const auto Data = Frame.subspan(c_frameHeaderSize);
+    return {reinterpret_cast<const char*>(Data.data()), Data.size()};
+}
+
+std::string ReadPipe(int Fd, size_t Size)
+{
+    std::string Data(Size, '\0');
+    size_t Offset = 0;
+    while (Offset < Size)
+    {
+        const auto BytesRead = TEMP_FAILURE_RETRY(read(Fd, Data.data() + Offset, Size - Offset));
+        THROW_LAST_ERROR_IF(BytesRead < 0);
+        VERIFY_IS_TRUE(BytesRead > 0);
+        Offset += BytesRead;
+    }
+
+    return Data;
+}
+
+void ExpectInitialWindows(int Socket)
+{
+    ExpectFrame(Socket, LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdOut, LX_INIT_MULTIPLEXED_WINDOW);
+    ExpectFrame(Socket, LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdErr, LX_INIT_MULTIPLEXED_WINDOW);
+}
+
+void SendExitStatus(int Socket, int ExitCode)
+{
+    LX_INIT_PROCESS_EXIT_STATUS ExitStatus{};
+    ExitStatus.Header.MessageType = LxInitMessageExitStatus;
+    ExitStatus.Header.MessageSize = sizeof(ExitStatus);
+    ExitStatus.ExitCode = ExitCode;
+    SendFrame(
+        Socket,
+        LxInitMultiplexedFrameData,
+        LxInitMultiplexedStreamControl,
+        sizeof(ExitStatus),
+        gsl::as_bytes(gsl::make_span(&ExitStatus, 1)));
+}
+
+// Close stdout and stderr; the relay returns once the exit status was received and both streams are closed.
+void CloseOutput(int Socket)
+{
+    SendFrame(Socket, LxInitMultiplexedFrameClose, LxInitMultiplexedStreamStdOut, 0);
+    SendFrame(Socket, LxInitMultiplexedFrameClose, LxInitMultiplexedStreamStdErr, 0);
+}
+
+} // namespace
+
+INIT_TEST(InteropRelayOutput)
+{
+    auto Relay = StartRelay();
+    ExpectInitialWindows(Relay.Server.get());
+
+    // Output is written to the matching pipe and its credit is returned to the server once written.
+    SendData(Relay.Server.get(), LxInitMultiplexedStreamStdOut, "stdout data");
+    VERIFY_ARE_EQUAL(std::string{"stdout data"}, ReadPipe(Relay.Output.get(), 11));
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdOut, 11);
+
+    SendData(Relay.Server.get(), LxInitMultiplexedStreamStdErr, "err");
+    VERIFY_ARE_EQUAL(std::string{"err"}, ReadPipe(Relay.Error.get(), 3));
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdErr, 3);
+
+    // The exit status closes stdin.
+    SendExitStatus(Relay.Server.get(), 42);
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameClose, LxInitMultiplexedStreamStdIn, 0);
+    CloseOutput(Relay.Server.get());
+    VERIFY_ARE_EQUAL(42, Relay.ExitCode.get());
+}
+
+INIT_TEST(InteropRelayInputWindow)
+{
+    auto Relay = StartRelay();
+    ExpectInitialWindows(Relay.Server.get());
+
+    // Stdin isn't read until the server grants a window.
+    VERIFY_ARE_EQUAL(5, write(Relay.Input.get(), "input", 5));
+    VERIFY_IS_FALSE(HasData(Relay.Server.get()));
+
+    // The relay sends no more than the window, then waits for more credit.
+    SendFrame(Relay.Server.get(), LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdIn, 3);
+    auto Data = ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameData, LxInitMultiplexedStreamStdIn, 3);
+    VERIFY_ARE_EQUAL(std::string{"inp"}, Data);
+    VERIFY_IS_FALSE(HasData(Relay.Server.get()));
+
+    SendFrame(Relay.Server.get(), LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdIn, LX_INIT_MULTIPLEXED_WINDOW);
+    Data = ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameData, LxInitMultiplexedStreamStdIn, 2);
+    VERIFY_ARE_EQUAL(std::string{"ut"}, Data);
+
+    // End of stdin is forwarded as a close frame.
+    Relay.Input.reset();
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameClose, LxInitMultiplexedStreamStdIn, 0);
+
+    SendExitStatus(Relay.Server.get(), 0);
+    CloseOutput(Relay.Server.get());
+    VERIFY_ARE_EQUAL(0, Relay.ExitCode.get());
+}
+
+INIT_TEST(InteropRelayOutputAfterExit)
+{
+    auto Relay = StartRelay();
+    ExpectInitialWindows(Relay.Server.get());
+
+    // Output sent after the exit status is still relayed until the server closes the streams.
+    SendExitStatus(Relay.Server.get(), 3);
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameClose, LxInitMultiplexedStreamStdIn, 0);
+
+    SendData(Relay.Server.get(), LxInitMultiplexedStreamStdOut, "late");
+    VERIFY_ARE_EQUAL(std::string{"late"}, ReadPipe(Relay.Output.get(), 4));
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdOut, 4);
+
+    CloseOutput(Relay.Server.get());
+    VERIFY_ARE_EQUAL(3, Relay.ExitCode.get());
+}
+
+INIT_TEST(InteropRelaySlowOutput)
+{
+    auto Relay = StartRelay();
+    ExpectInitialWindows(Relay.Server.get());
+
+    // Fill the stdout window while nothing reads the stdout pipe. The first frame fits in the pipe and its credit is
+    // returned; the rest is queued by the relay without credit.
+    const std::string Chunk(LX_INIT_MULTIPLEXED_MAX_FRAME_DATA, 'o');
+    constexpr size_t ChunkCount = LX_INIT_MULTIPLEXED_WINDOW / LX_INIT_MULTIPLEXED_MAX_FRAME_DATA;
+    for (size_t Index = 0; Index < ChunkCount; Index += 1)
+    {
+        SendData(Relay.Server.get(), LxInitMultiplexedStreamStdOut, Chunk);
+    }
+
+    size_t Credit = 0;
+    std::vector<gsl::byte> Buffer;
+    auto ReceiveStdOutCredit = [&]() {
+        while (HasData(Relay.Server.get()))
+        {
+            const auto Frame = wsl::shared::socket::RecvMultiplexedFrame(Relay.Server.get(), Buffer);
+            VERIFY_IS_FALSE(Frame.empty());
+
+            const auto* Header = gslhelpers::get_struct<LX_INIT_MULTIPLEXED_FRAME_HEADER>(Frame);
+            VERIFY_ARE_EQUAL(LxInitMultiplexedFrameWindow, Header->Type);
+            VERIFY_ARE_EQUAL(LxInitMultiplexedStreamStdOut, Header->Stream);
+            Credit += Header->Size;
+        }
+    };
+
+    ReceiveStdOutCredit();
+    VERIFY_IS_TRUE(Credit < LX_INIT_MULTIPLEXED_WINDOW);
+
+    // Stderr is still relayed while stdout is blocked.
+    SendData(Relay.Server.get(), LxInitMultiplexedStreamStdErr, "err");
+    VERIFY_ARE_EQUAL(std::string{"err"}, ReadPipe(Relay.Error.get(), 3));
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameWindow, LxInitMultiplexedStreamStdErr, 3);
+
+    // Once stdout is read, the queued data is written and the rest of the credit is returned.
+    for (size_t Index = 0; Index < ChunkCount; Index += 1)
+    {
+        VERIFY_ARE_EQUAL(Chunk, ReadPipe(Relay.Output.get(), Chunk.size()));
+    }
+
+    while (Credit < LX_INIT_MULTIPLEXED_WINDOW)
+    {
+        const auto Before = Credit;
+        ReceiveStdOutCredit();
+        VERIFY_IS_TRUE(Credit > Before);
+    }
+
+    VERIFY_ARE_EQUAL(LX_INIT_MULTIPLEXED_WINDOW, Credit);
+
+    SendExitStatus(Relay.Server.get(), 0);
+    ExpectFrame(Relay.Server.get(), LxInitMultiplexedFrameClose, LxInitMultiplexedStreamStdIn, 0);
+    CloseOutput(Relay.Server.get());
+    VERIFY_ARE_EQUAL(0, Relay.ExitCode.get());
+}
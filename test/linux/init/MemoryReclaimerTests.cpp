@@ -0,0 +1,115 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    MemoryReclaimerTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the memory reclaimer parsers.
+
+--*/
+
+#include <sstream>
+#include "InitTests.h"
+#include "MemoryReclaimer.h"
+
+namespace {
+
+// Samples of /proc/buddyinfo, /proc/pressure, the root cgroup's memory.stat and /proc/meminfo read on a 6GB VM. The
+// second node of the buddyinfo sample is made up.
+constexpr auto c_buddyInfo =
+    "Node 0, zone      DMA      0      0      0      0      0      0      0      0      1      1      3 \n"
+    "Node 0, zone    DMA32    248    180    156    125    108     91     80     67     64     60    681 \n"
+    "Node 0, zone   Normal   3012    967   7632   4938   2724   1236    528    298    113      6    201 \n"
+    "Node 1, zone   Normal    512    256    128     64     32     16      8      4      2      1      0 \n";
+
+constexpr auto c_pressure =
+    "some avg10=1.24 avg60=5.34 avg300=3.54 total=94558562\n"
+    "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+
+constexpr auto c_memoryStat =
+    "anon 219545600\n"
+    "file 763428864\n"
+    "kernel 62713856\n"
+    "kernel_stack 3342336\n"
+    "pagetables 4702208\n"
+    "shmem 9711616\n"
+    "file_mapped 148885504\n"
+    "file_dirty 323584\n"
+    "file_writeback 0\n"
+    "inactive_anon 213700608\n"
+    "active_anon 20480\n"
+    "inactive_file 564232192\n"
+    "active_file 173076480\n"
+    "unevictable 14282752\n"
+    "slab_reclaimable 12083200\n";
+
+constexpr auto c_meminfo =
+    "MemTotal:        6158152 kB\n"
+    "MemFree:         4965116 kB\n"
+    "Cached:           701932 kB\n"
+    "Active:           169040 kB\n"
+    "Inactive:         759700 kB\n"
+    "Active(anon):         20 kB\n"
+    "Inactive(anon):   208692 kB\n"
+    "Active(file):     169020 kB\n"
+    "Inactive(file):   551008 kB\n"
+    "Unevictable:       13948 kB\n";
+
+} // namespace
+
+INIT_TEST(MemoryReclaimerBuddyInfo)
+{
+    std::istringstream file{c_buddyInfo};
+    auto nodes = MemoryReclaimer::ReadBuddyInfo(file, 9);
+    VERIFY_ARE_EQUAL(2, nodes.size());
+    VERIFY_ARE_EQUAL(1236730, nodes[0].Total);
+    VERIFY_ARE_EQUAL(940544, nodes[0].Reportable);
+    VERIFY_ARE_EQUAL(5120, nodes[1].Total);
+    VERIFY_ARE_EQUAL(512, nodes[1].Reportable);
+
+    // With single page reporting, all the free pages are reportable.
+    file = std::istringstream{c_buddyInfo};
+    nodes = MemoryReclaimer::ReadBuddyInfo(file, 0);
+    VERIFY_ARE_EQUAL(nodes[0].Total, nodes[0].Reportable);
+
+    // Malformed lines are skipped.
+    file = std::istringstream{"Node 0 zone Normal 1 2\nNode x, zone Normal 1\nNode 2, zone Normal 4 2\n"};
+    nodes = MemoryReclaimer::ReadBuddyInfo(file, 1);
+    VERIFY_ARE_EQUAL(1, nodes.size());
+    VERIFY_ARE_EQUAL(8, nodes[2].Total);
+    VERIFY_ARE_EQUAL(4, nodes[2].Reportable);
+}
+
+INIT_TEST(MemoryReclaimerPressure)
+{
+    std::istringstream file{c_pressure};
+    VERIFY_IS_TRUE(MemoryReclaimer::ReadPressure(file) == 1.24);
+
+    // Kernels before 5.13 don't have the "full" line for the CPU.
+    file = std::istringstream{"some avg10=0.00 avg60=0.00 avg300=0.00 total=0\n"};
+    VERIFY_IS_TRUE(MemoryReclaimer::ReadPressure(file) == 0.0);
+
+    file = std::istringstream{"full avg10=1.00 avg60=0.00 avg300=0.00 total=0\n"};
+    VERIFY_IS_FALSE(MemoryReclaimer::ReadPressure(file).has_value());
+
+    file = std::istringstream{""};
+    VERIFY_IS_FALSE(MemoryReclaimer::ReadPressure(file).has_value());
+}
+
+INIT_TEST(MemoryReclaimerMemoryStat)
+{
+    std::istringstream file{c_memoryStat};
+    auto stat = MemoryReclaimer::ReadMemoryStat(file, false);
+    VERIFY_ARE_EQUAL(173076480, stat.ActiveFile);
+    VERIFY_ARE_EQUAL(564232192, stat.InactiveFile);
+
+    // /proc/meminfo reports the sizes in kB.
+    file = std::istringstream{c_meminfo};
+    stat = MemoryReclaimer::ReadMemoryStat(file, true);
+    VERIFY_ARE_EQUAL(169020ull * 1024, stat.ActiveFile);
+    VERIFY_ARE_EQUAL(551008ull * 1024, stat.InactiveFile);
+}
@@ -0,0 +1,90 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    NetlinkChannelTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the netlink channel.
+
+--*/
+
+#include <linux/rtnetlink.h>
+#include "InitTests.h"
+#include "NetlinkChannel.h"
+
+INIT_TEST(NetlinkChannelLateBatchAcknowledgement)
+{
+    NetlinkChannel channel;
+
+    // Query a link that doesn't exist, so that the kernel acknowledges the request with an error. With no time to wait,
+    // the batch times out and the acknowledgement stays queued on the socket.
+    ifinfomsg missingLink{};
+    missingLink.ifi_index = 0x7fffffff;
+    std::vector<NetlinkTransaction> transactions;
+    transactions.emplace_back(channel.CreateTransaction(missingLink, RTM_GETLINK, 0));
+
+    const auto errors = channel.ExecuteBatch(transactions, std::chrono::milliseconds(0));
+    VERIFY_ARE_EQUAL(1, errors.size());
+    VERIFY_ARE_EQUAL(-ETIMEDOUT, errors[0]);
+
+    // The late error acknowledgement must not fail the next, unrelated transaction.
+    size_t links = 0;
+    ifinfomsg link{};
+    channel.CreateTransaction(link, RTM_GETLINK, NLM_F_DUMP).Execute([&](const NetlinkResponse& response) {
+        links += response.Messages<ifinfomsg>(RTM_NEWLINK).size();
+    });
+
+    VERIFY_IS_TRUE(links > 0);
+}
+
+INIT_TEST(NetlinkChannelLargeResponse)
+{
+    // Send a multipart response larger than the default receive buffer of the channel (64KB) from another netlink socket.
+    NetlinkChannel channel(SOCK_RAW, NETLINK_USERSOCK);
+
+    sockaddr_nl address{};
+    socklen_t addressLength = sizeof(address);
+    THROW_LAST_ERROR_IF(getsockname(channel.Socket(), reinterpret_cast<sockaddr*>(&address), &addressLength) < 0);
+
+    wil::unique_fd sender{socket(AF_NETLINK, (SOCK_RAW | SOCK_CLOEXEC), NETLINK_USERSOCK)};
+    THROW_LAST_ERROR_IF(!sender);
+
+    constexpr size_t messageCount = 48;
+    constexpr size_t payloadSize = 2048;
+    std::vector<char> datagram;
+    for (size_t i = 0; i <= messageCount; i++)
+    {
+        const bool done = i == messageCount;
+        nlmsghdr header{};
+        header.nlmsg_len = NLMSG_LENGTH(done ? sizeof(int) : payloadSize);
+        header.nlmsg_type = done ? NLMSG_DONE : RTM_NEWLINK;
+        header.nlmsg_flags = NLM_F_MULTI;
+        header.nlmsg_seq = 1;
+
+        const auto offset = datagram.size();
+        datagram.resize(offset + NLMSG_ALIGN(header.nlmsg_len));
+        memcpy(datagram.data() + offset, &header, sizeof(header));
+    }
+
+    VERIFY_IS_TRUE(datagram.size() > 64 * 1024);
+
+    // Send the response twice, to check that the channel keeps receiving responses of that size.
+    for (int i = 0; i < 2; i++)
+    {
+        THROW_LAST_ERROR_IF(
+            sendto(sender.get(), datagram.data(), datagram.size(), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0);
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        auto response = channel.ReceiveNetlinkResponse();
+        VERIFY_ARE_EQUAL(messageCount, response.Messages<ifinfomsg>(RTM_NEWLINK).size());
+        VERIFY_IS_TRUE(response.MultiMessage());
+        VERIFY_IS_TRUE(response.Done());
+        channel.RecycleResponse(std::move(response));
+    }
+}
@@ -0,0 +1,112 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    NetlinkStateCacheTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the rtnetlink mirror.
+
+--*/
+
+#include <algorithm>
+#include <sched.h>
+#include <net/if.h>
+#include "InitTests.h"
+#include "Interface.h"
+#include "NetlinkStateCache.h"
+#include "RoutingTable.h"
+
+namespace {
+
+constexpr int c_testRoutingTable = 100;
+
+// Move the test process to a new network namespace, so that the tests don't change the network configuration
+// of the distribution. The loopback interface is brought up with an address that can be used as a gateway.
+Interface& TestNetwork()
+{
+    static Interface loopback = []() {
+        THROW_LAST_ERROR_IF(unshare(CLONE_NEWNET) < 0);
+
+        auto loopback = Interface::Open("lo");
+        loopback.SetUp();
+        loopback.ModifyIpAddress(Address{AF_INET, 24, "192.168.50.1"}, Operation::Create);
+        return loopback;
+    }();
+
+    return loopback;
+}
+
+} // namespace
+
+INIT_TEST(NetlinkStateCacheRoutes)
+{
+    const auto& loopback = TestNetwork();
+    RoutingTable table(c_testRoutingTable);
+    NetlinkStateCache cache;
+
+    const Route route{AF_INET, {}, loopback.Index(), false, Address{AF_INET, 24, "10.0.1.0"}, 5};
+    table.ModifyRoute(route, Operation::Create);
+
+    auto routes = cache.ListRoutes(c_testRoutingTable, AF_INET);
+    VERIFY_ARE_EQUAL(1, routes.size());
+    VERIFY_IS_TRUE(routes[0].to == route.to);
+    VERIFY_ARE_EQUAL(5, routes[0].metric);
+    VERIFY_IS_FALSE(routes[0].via.has_value());
+
+    table.ModifyRoute(route, Operation::Remove);
+    VERIFY_ARE_EQUAL(0, cache.ListRoutes(c_testRoutingTable, AF_INET).size());
+}
+
+INIT_TEST(NetlinkStateCacheAddresses)
+{
+    auto& loopback = TestNetwork();
+    NetlinkStateCache cache;
+
+    const auto isSet = [&](const Address& address) {
+        return std::ranges::any_of(cache.ListAddresses(loopback.Index(), AF_INET), [&](const auto& e) {
+            return e.Value == address && e.PreferredLifetime == NetlinkStateCache::InfiniteLifetime;
+        });
+    };
+
+    VERIFY_IS_TRUE(isSet(Address{AF_INET, 24, "192.168.50.1"}));
+
+    const Address address{AF_INET, 24, "192.168.51.1"};
+    loopback.ModifyIpAddress(address, Operation::Create);
+    VERIFY_IS_TRUE(isSet(address));
+
+    // Addresses removed outside of the cache must disappear from the mirror.
+    loopback.ModifyIpAddress(address, Operation::Remove);
+    VERIFY_IS_FALSE(isSet(address));
+}
+
+INIT_TEST(NetlinkStateCacheRouteReplace)
+{
+    const auto& loopback = TestNetwork();
+    RoutingTable table(c_testRoutingTable);
+    NetlinkStateCache cache;
+
+    const Address destination{AF_INET, 24, "10.0.2.0"};
+    table.ModifyRoute(Route{AF_INET, {}, loopback.Index(), false, destination, 5}, Operation::Create);
+    VERIFY_ARE_EQUAL(1, cache.ListRoutes(c_testRoutingTable, AF_INET).size());
+
+    // Replacing the route changes its gateway. The mirror must only contain the new route.
+    const Route replacement{AF_INET, Address{AF_INET, 32, "192.168.50.2"}, loopback.Index(), false, destination, 5};
+    table.ModifyRoute(replacement, Operation::Update);
+
+    auto routes = cache.ListRoutes(c_testRoutingTable, AF_INET);
+    VERIFY_ARE_EQUAL(1, routes.size());
+    VERIFY_IS_TRUE(routes[0].via.has_value());
+    VERIFY_ARE_EQUAL(std::string{"192.168.50.2"}, routes[0].via->Addr());
+
+    // A route to the same destination with another metric is a different route.
+    table.ModifyRoute(Route{AF_INET, {}, loopback.Index(), false, destination, 10}, Operation::Update);
+    VERIFY_ARE_EQUAL(2, cache.ListRoutes(c_testRoutingTable, AF_INET).size());
+
+    table.ModifyRoute(replacement, Operation::Remove);
+    table.ModifyRoute(Route{AF_INET, {}, loopback.Index(), false, destination, 10}, Operation::Remove);
+    VERIFY_ARE_EQUAL(0, cache.ListRoutes(c_testRoutingTable, AF_INET).size());
+}
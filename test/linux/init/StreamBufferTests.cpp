@@ -0,0 +1,141 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    StreamBufferTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the stream buffer used to import distributions.
+
+--*/
+
+#include <fcntl.h>
+#include <numeric>
+#include <poll.h>
+#include "InitTests.h"
+#include "StreamBuffer.h"
+
+namespace {
+
+// Write a buffer to a pipe, stopping early if the pipe is closed.
+void WriteAll(int Fd, const std::vector<char>& Data)
+{
+    for (size_t Offset = 0; Offset < Data.size();)
+    {
+        const auto Bytes = write(Fd, Data.data() + Offset, Data.size() - Offset);
+        if (Bytes < 0)
+        {
+            return;
+        }
+
+        Offset += Bytes;
+    }
+}
+
+// Read a pipe until end of file, failing if nothing is received within 10 seconds.
+std::vector<char> ReadAll(int Fd)
+{
+    std::vector<char> Data;
+    for (;;)
+    {
+        pollfd PollDescriptor{.fd = Fd, .events = POLLIN, .revents = 0};
+        const int Result = poll(&PollDescriptor, 1, 10 * 1000);
+        THROW_LAST_ERROR_IF(Result < 0);
+        if (Result == 0)
+        {
+            VERIFY_FAILED("No data received");
+        }
+
+        char Buffer[64 * 1024];
+        const auto Bytes = read(Fd, Buffer, sizeof(Buffer));
+        THROW_LAST_ERROR_IF(Bytes < 0);
+        if (Bytes == 0)
+        {
+            return Data;
+        }
+
+        Data.insert(Data.end(), Buffer, Buffer + Bytes);
+    }
+}
+
+std::vector<char> TestData(size_t Size)
+{
+    std::vector<char> Data(Size);
+    std::iota(Data.begin(), Data.end(), 0);
+    return Data;
+}
+
+} // namespace
+
+INIT_TEST(StreamBufferEndOfFile)
+{
+    auto Source = wil::unique_pipe::create(O_CLOEXEC);
+    auto Destination = wil::unique_pipe::create(O_CLOEXEC);
+
+    // More data than the buffer holds, so that the reader waits for the writer.
+    const auto Data = TestData(8 * 1024 * 1024 + 123);
+    StreamBuffer Buffer(Source.read().get(), std::move(Destination.write()), 2 * 1024 * 1024);
+
+    std::thread Writer([&]() {
+        WriteAll(Source.write().get(), Data);
+        Source.write().reset();
+    });
+
+    auto JoinWriter = wil::scope_exit([&]() { Writer.join(); });
+
+    // The destination is closed once the whole source is copied.
+    const auto Received = ReadAll(Destination.read().get());
+    Buffer.Wait();
+
+    VERIFY_IS_TRUE(Received == Data);
+    VERIFY_ARE_EQUAL(0, Buffer.Error());
+    VERIFY_ARE_EQUAL(Data.size(), Buffer.BytesRead());
+}
+
+INIT_TEST(StreamBufferReaderExit)
+{
+    auto Source = wil::unique_pipe::create(O_CLOEXEC);
+    auto Destination = wil::unique_pipe::create(O_CLOEXEC);
+    StreamBuffer Buffer(Source.read().get(), std::move(Destination.write()), 1024 * 1024);
+
+    // The process reading the destination exits before the end of the stream.
+    Destination.read().reset();
+
+    // N.B. The data fits in the source pipe, since the copy stops reading it once it fails.
+    const auto Data = TestData(4096);
+    VERIFY_ARE_EQUAL(static_cast<ssize_t>(Data.size()), write(Source.write().get(), Data.data(), Data.size()));
+
+    Buffer.Wait();
+    VERIFY_ARE_EQUAL(EPIPE, Buffer.Error());
+}
+
+INIT_TEST(StreamBufferStop)
+{
+    auto Source = wil::unique_pipe::create(O_CLOEXEC);
+    auto Destination = wil::unique_pipe::create(O_CLOEXEC);
+    StreamBuffer Buffer(Source.read().get(), std::move(Destination.write()), 1024 * 1024);
+
+    // Nothing reads the destination, so the copy blocks once the buffer and the destination pipe are full.
+    THROW_LAST_ERROR_IF(fcntl(Source.write().get(), F_SETFL, O_NONBLOCK) < 0);
+    const auto Data = TestData(64 * 1024);
+    while (Buffer.BytesRead() < 1024 * 1024)
+    {
+        if (write(Source.write().get(), Data.data(), Data.size()) < 0)
+        {
+            VERIFY_ARE_EQUAL(EAGAIN, errno);
+            pollfd PollDescriptor{.fd = Source.write().get(), .events = POLLOUT, .revents = 0};
+            THROW_LAST_ERROR_IF(poll(&PollDescriptor, 1, 100) < 0);
+        }
+    }
+
+    // Stopping unblocks both the copy and the threads waiting on it.
+    std::thread Waiter([&]() { Buffer.Wait(); });
+    Buffer.Stop();
+    Waiter.join();
+
+    VERIFY_ARE_EQUAL(0, Buffer.Error());
+    VERIFY_IS_TRUE(Buffer.BytesRead() >= 1024 * 1024);
+}
@@ -0,0 +1,133 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    TaskGraphTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the boot step graph.
+
+--*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include "InitTests.h"
+#include "TaskGraph.h"
+
+namespace {
+
+// Records the order in which steps ran.
+struct Recorder
+{
+    TaskGraph::Routine Step(std::string Name, int Result = 0)
+    {
+        return [this, Name, Result]() {
+            std::lock_guard<std::mutex> Lock{Mutex};
+            Order.emplace_back(Name);
+            return Result;
+        };
+    }
+
+    bool RanBefore(const std::string& First, const std::string& Second)
+    {
+        const auto FirstPosition = std::find(Order.begin(), Order.end(), First);
+        const auto SecondPosition = std::find(Order.begin(), Order.end(), Second);
+        return FirstPosition < SecondPosition && SecondPosition != Order.end();
+    }
+
+    bool Ran(const std::string& Name)
+    {
+        return std::find(Order.begin(), Order.end(), Name) != Order.end();
+    }
+
+    std::mutex Mutex;
+    std::vector<std::string> Order;
+};
+
+} // namespace
+
+INIT_TEST(TaskGraphDependencyOrder)
+{
+    Recorder Steps;
+    TaskGraph Graph{"test"};
+    const auto First = Graph.Add("first", {}, Steps.Step("first"));
+    const auto Left = Graph.Add("left", {First}, Steps.Step("left"));
+    const auto Right = Graph.Add("right", {First}, Steps.Step("right"));
+    const auto Last = Graph.Add("last", {Left, Right}, Steps.Step("last"));
+    Graph.Add("after last", {Last}, Steps.Step("after last"));
+    Graph.Add("independent", {}, Steps.Step("independent"));
+
+    VERIFY_ARE_EQUAL(0, Graph.Run(4));
+    VERIFY_ARE_EQUAL(6, Steps.Order.size());
+    VERIFY_IS_TRUE(Steps.RanBefore("first", "left"));
+    VERIFY_IS_TRUE(Steps.RanBefore("first", "right"));
+    VERIFY_IS_TRUE(Steps.RanBefore("left", "last"));
+    VERIFY_IS_TRUE(Steps.RanBefore("right", "last"));
+    VERIFY_IS_TRUE(Steps.RanBefore("last", "after last"));
+
+    const auto Dump = Graph.Dump();
+    VERIFY_IS_TRUE(Dump.find("last: succeeded") != std::string::npos);
+    VERIFY_IS_TRUE(Dump.find("after left, right") != std::string::npos);
+}
+
+INIT_TEST(TaskGraphFailure)
+{
+    Recorder Steps;
+    TaskGraph Graph{"test"};
+    const auto Failed = Graph.Add("failed", {}, Steps.Step("failed", -1));
+    const auto Thrown = Graph.Add("thrown", {}, []() -> int { THROW_ERRNO(EINVAL); });
+    const auto Succeeded = Graph.Add("succeeded", {}, Steps.Step("succeeded"));
+
+    // Steps that depend on a failed step are skipped, as well as the steps that depend on them.
+    const auto Skipped = Graph.Add("skipped", {Succeeded, Failed}, Steps.Step("skipped"));
+    Graph.Add("skipped transitively", {Skipped}, Steps.Step("skipped transitively"));
+    Graph.Add("skipped after throw", {Thrown}, Steps.Step("skipped after throw"));
+    Graph.Add("independent", {Succeeded}, Steps.Step("independent"));
+
+    VERIFY_ARE_EQUAL(-1, Graph.Run(4));
+    VERIFY_IS_TRUE(Steps.Ran("failed"));
+    VERIFY_IS_TRUE(Steps.Ran("independent"));
+    VERIFY_IS_FALSE(Steps.Ran("skipped"));
+    VERIFY_IS_FALSE(Steps.Ran("skipped transitively"));
+    VERIFY_IS_FALSE(Steps.Ran("skipped after throw"));
+
+    const auto Dump = Graph.Dump();
+    VERIFY_IS_TRUE(Dump.find("thrown: failed") != std::string::npos);
+    VERIFY_IS_TRUE(Dump.find("skipped transitively: skipped") != std::string::npos);
+    VERIFY_IS_TRUE(Dump.find("independent: succeeded") != std::string::npos);
+}
+
+INIT_TEST(TaskGraphConcurrencyLimit)
+{
+    // N.B. mini_init runs its boot steps with a limit of 4 (BOOT_MAX_CONCURRENT_STEPS).
+    for (const size_t Limit : {1, 2, 4})
+    {
+        std::mutex Mutex;
+        std::condition_variable Changed;
+        size_t Running = 0;
+        size_t MaxRunning = 0;
+
+        // Each step waits for the limit to be reached, so that steps overlap as much as the graph allows.
+        TaskGraph Graph{"test"};
+        for (int Index = 0; Index < 12; Index += 1)
+        {
+            Graph.Add("step", {}, [&]() {
+                std::unique_lock<std::mutex> Lock{Mutex};
+                Running += 1;
+                MaxRunning = std::max(MaxRunning, Running);
+                Changed.notify_all();
+                Changed.wait_for(Lock, std::chrono::seconds(10), [&]() { return MaxRunning >= Limit; });
+                Running -= 1;
+                return 0;
+            });
+        }
+
+        VERIFY_ARE_EQUAL(0, Graph.Run(Limit));
+        VERIFY_ARE_EQUAL(Limit, MaxRunning);
+        VERIFY_IS_TRUE(Graph.Dump().find(std::format("12 steps on {} threads", Limit)) != std::string::npos);
+    }
+}
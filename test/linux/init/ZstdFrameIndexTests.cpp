@@ -0,0 +1,178 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    ZstdFrameIndexTests.cpp
+
+Abstract:
+
+    This file contains the unit tests of the zstd frame index of seekable
+    exports.
+
+--*/
+
+#include "InitTests.h"
+#include "ZstdFrameIndex.h"
+
+namespace {
+
+//
+// A zstd stream that decompresses to "hello world\n", 1000 'a', "xxxxx" and
+// "seekable". It holds:
+//
+//    0   frame with a raw block, written by zstd --no-check
+//    21  skippable frame with 3 bytes of data
+//    32  frame with a compressed block and a checksum, written by zstd -C
+//    54  frame with a content size and an RLE block
+//    64  frame with a compressed block and a checksum, without content size
+//
+
+constexpr uint8_t c_knownStream[] = {
+    0x28, 0xb5, 0x2f, 0xfd, 0x00, 0x58, 0x61, 0x00, 0x00, 0x68, 0x65, 0x6c, 0x6c, 0x6f, 0x20, 0x77, 0x6f, 0x72, 0x6c, 0x64,
+    0x0a, 0x50, 0x2a, 0x4d, 0x18, 0x03, 0x00, 0x00, 0x00, 0x61, 0x62, 0x63, 0x28, 0xb5, 0x2f, 0xfd, 0x04, 0x58, 0x4d, 0x00,
+    0x00, 0x10, 0x61, 0x61, 0x01, 0x00, 0xe3, 0x2b, 0x80, 0x05, 0x23, 0x42, 0xda, 0x2e, 0x28, 0xb5, 0x2f, 0xfd, 0x20, 0x05,
+    0x2b, 0x00, 0x00, 0x78, 0x28, 0xb5, 0x2f, 0xfd, 0x04, 0x58, 0x41, 0x00, 0x00, 0x73, 0x65, 0x65, 0x6b, 0x61, 0x62, 0x6c,
+    0x65, 0x0f, 0x90, 0xde, 0x6c};
+
+const std::vector<uint64_t> c_knownFrames{0, 32, 54, 64};
+
+// Index frame of the known stream.
+constexpr uint8_t c_knownIndex[] = {
+    0x5e, 0x2a, 0x4d, 0x18, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x57, 0x49, 0x44, 0x58};
+
+std::vector<char> Bytes(gsl::span<const uint8_t> Buffer)
+{
+    return {Buffer.begin(), Buffer.end()};
+}
+
+// Returns the errno of the exception thrown by Routine, or 0 if it didn't throw.
+template <typename TRoutine>
+int CaughtErrno(TRoutine&& Routine)
+{
+    try
+    {
+        Routine();
+    }
+    catch (const wil::ResultException& Exception)
+    {
+        return Exception.GetErrorCode();
+    }
+
+    return 0;
+}
+
+} // namespace
+
+INIT_TEST(ZstdFrameIndexKnownStream)
+{
+    const auto Stream = Bytes(c_knownStream);
+    ZstdFrameIndex Index;
+    VERIFY_ARE_EQUAL(Stream.size(), Index.Append(Stream));
+    VERIFY_IS_TRUE(Index.Frames() == c_knownFrames);
+    VERIFY_IS_TRUE(Index.Serialize() == Bytes(c_knownIndex));
+}
+
+INIT_TEST(ZstdFrameIndexSplitBuffers)
+{
+    // Headers split across buffers are parsed the same.
+    const auto Stream = Bytes(c_knownStream);
+    ZstdFrameIndex Index;
+    for (size_t Offset = 0; Offset < Stream.size(); Offset += 1)
+    {
+        VERIFY_ARE_EQUAL(1, Index.Append(gsl::make_span(Stream).subspan(Offset, 1)));
+    }
+
+    VERIFY_IS_TRUE(Index.Frames() == c_knownFrames);
+    VERIFY_IS_TRUE(Index.Serialize() == Bytes(c_knownIndex));
+}
+
+INIT_TEST(ZstdFrameIndexPadding)
+{
+    // The zeros that bsdtar writes after the last frame aren't returned.
+    auto Stream = Bytes(c_knownStream);
+    const auto StreamSize = Stream.size();
+    Stream.resize(StreamSize + 100);
+
+    ZstdFrameIndex Index;
+    VERIFY_ARE_EQUAL(StreamSize, Index.Append(Stream));
+
+    const std::vector<char> Zeros(512);
+    VERIFY_ARE_EQUAL(0, Index.Append(Zeros));
+    VERIFY_IS_TRUE(Index.Frames() == c_knownFrames);
+    VERIFY_IS_TRUE(Index.Serialize() == Bytes(c_knownIndex));
+
+    // Anything but zeros after the padding is invalid.
+    VERIFY_ARE_EQUAL(EINVAL, CaughtErrno([&]() { Index.Append(Bytes(c_knownStream)); }));
+}
+
+INIT_TEST(ZstdFrameIndexInvalid)
+{
+    const std::vector<char> NotZstd{'t', 'a', 'r', '\0'};
+    VERIFY_ARE_EQUAL(EINVAL, CaughtErrno([&]() { ZstdFrameIndex{}.Append(NotZstd); }));
+
+    // A stream that ends in the middle of a frame can't be indexed.
+    auto Truncated = Bytes(c_knownStream);
+    Truncated.pop_back();
+
+    ZstdFrameIndex Index;
+    VERIFY_ARE_EQUAL(Truncated.size(), Index.Append(Truncated));
+    VERIFY_ARE_EQUAL(EINVAL, CaughtErrno([&]() { Index.Serialize(); }));
+
+    // Block type 3 is reserved.
+    auto Reserved = Bytes(c_knownStream);
+    Reserved[6] |= 0x6;
+    VERIFY_ARE_EQUAL(EINVAL, CaughtErrno([&]() { ZstdFrameIndex{}.Append(Reserved); }));
+}
+
+INIT_TEST(ZstdFrameIndexRoundTrip)
+{
+    ZstdFrameIndex Index;
+    auto Archive = Bytes(c_knownStream);
+    Index.Append(Archive);
+    const auto IndexFrame = Index.Serialize();
+    Archive.insert(Archive.end(), IndexFrame.begin(), IndexFrame.end());
+
+    // The index is read back from the end of the archive, or from a buffer that only holds the index frame.
+    VERIFY_IS_TRUE(ZstdFrameIndex::Read(Archive) == c_knownFrames);
+    VERIFY_IS_TRUE(ZstdFrameIndex::Read(IndexFrame) == c_knownFrames);
+    VERIFY_IS_TRUE(ZstdFrameIndex::Read(Bytes(c_knownStream)).empty());
+
+    // Decompressors skip the index: parsing the archive again finds the same frames.
+    ZstdFrameIndex Reindex;
+    VERIFY_ARE_EQUAL(Archive.size(), Reindex.Append(Archive));
+    VERIFY_IS_TRUE(Reindex.Frames() == c_knownFrames);
+
+    // Each indexed frame is a complete frame on its own, so it can be decompressed without the rest of the archive.
+    auto Frames = ZstdFrameIndex::Read(Archive);
+    Frames.emplace_back(sizeof(c_knownStream));
+    for (size_t Frame = 0; Frame + 1 < Frames.size(); Frame += 1)
+    {
+        const auto Data = gsl::make_span(Archive).subspan(Frames[Frame], Frames[Frame + 1] - Frames[Frame]);
+        ZstdFrameIndex FrameIndex;
+        VERIFY_ARE_EQUAL(Data.size(), FrameIndex.Append(Data));
+        VERIFY_ARE_EQUAL(0, FrameIndex.Frames().at(0));
+        VERIFY_ARE_EQUAL(0, CaughtErrno([&]() { FrameIndex.Serialize(); }));
+    }
+}
+
+INIT_TEST(ZstdFrameIndexReadInvalid)
+{
+    // An index that claims more frames than the buffer holds.
+    auto IndexFrame = Bytes(c_knownIndex);
+    IndexFrame[sizeof(c_knownIndex) - 8] = 5;
+    VERIFY_ARE_EQUAL(EINVAL, CaughtErrno([&]() { ZstdFrameIndex::Read(IndexFrame); }));
+
+    // Offsets that don't increase.
+    IndexFrame = Bytes(c_knownIndex);
+    IndexFrame[16] = 0;
+    VERIFY_ARE_EQUAL(EINVAL, CaughtErrno([&]() { ZstdFrameIndex::Read(IndexFrame); }));
+
+    // A frame size that doesn't match the number of frames.
+    IndexFrame = Bytes(c_knownIndex);
+    IndexFrame[4] = 0x20;
+    VERIFY_ARE_EQUAL(EINVAL, CaughtErrno([&]() { ZstdFrameIndex::Read(IndexFrame); }));
+}
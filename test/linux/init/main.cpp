@@ -0,0 +1,66 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    main.cpp
+
+Abstract:
+
+    This file contains the runner of the unit tests of the init daemon classes.
+
+    The tests run inside the test distribution (see test/windows/UnitTests.cpp). If arguments are passed, only the
+    test cases whose name contains one of them are run.
+
+--*/
+
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include "InitTests.h"
+
+//
+// Globals of the init daemon (see src/linux/init/main.cpp and init.cpp) referenced by the code under test.
+//
+
+int g_LogFd = STDERR_FILENO;
+int g_TelemetryFd = -1;
+std::optional<bool> g_EnableSocketLogging;
+struct sigaction g_SavedSignalActions[_NSIG];
+
+std::vector<InitTestCase>& InitTestCases()
+{
+    static std::vector<InitTestCase> TestCases;
+    return TestCases;
+}
+
+int main(int Argc, char** Argv)
+{
+    size_t Failed = 0;
+    size_t Run = 0;
+    for (const auto& TestCase : InitTestCases())
+    {
+        if (Argc > 1 && std::none_of(Argv + 1, Argv + Argc, [&](const char* Filter) {
+                return std::string_view{TestCase.Name}.find(Filter) != std::string_view::npos;
+            }))
+        {
+            continue;
+        }
+
+        Run += 1;
+        try
+        {
+            TestCase.Routine();
+            std::cout << "[PASSED] " << TestCase.Name << std::endl;
+        }
+        catch (const std::exception& Exception)
+        {
+            Failed += 1;
+            std::cout << "[FAILED] " << TestCase.Name << ": " << Exception.what() << std::endl;
+        }
+    }
+
+    std::cout << Run - Failed << "/" << Run << " tests passed" << std::endl;
+    return (Run == 0 || Failed != 0) ? 1 : 0;
+}
@@ -28,6 +28,7 @@ Abstract:
 #include "Distribution.h"
 #include "WslCoreConfigInterface.h"
 #include "CommandLine.h"
+#include "hns_schema.h"
 
 #define LXSST_TEST_USERNAME L"kerneltest"
 
@@ -145,6 +146,87 @@ class UnitTests
             VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"xz -t {}", tarPath)), 0L);
         }
 
+        // Verify that zstd compression works, and that the archive can be imported
+        if (LxsstuVmMode())
+        {
+            constexpr auto importedName = L"zstd-test-distro";
+            constexpr auto importedPath = L"zstd-test-distro";
+
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(
+                std::format(L"--export {} {} --format tar.zst", LXSS_DISTRO_NAME_TEST_L, tarPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+            VERIFY_ARE_EQUAL(err, L"");
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"zstd -t {}", tarPath)), 0L);
+
+            auto cleanupImport = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [&]() {
+                LxsstuLaunchWsl(std::format(L"--unregister {}", importedName));
+                std::filesystem::remove_all(importedPath);
+            });
+
+            VERIFY_ARE_EQUAL(
+                LxsstuLaunchWsl(std::format(L"--import {} {} {} --version 2", importedName, importedPath, tarPath)), 0L);
+
+            auto [bashrc, _] = LxsstuLaunchWslAndCaptureOutput(std::format(L"-d {} ls /root/.bashrc", importedName));
+            VERIFY_ARE_EQUAL(bashrc, L"/root/.bashrc\n");
+        }
+        else
+        {
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(
+                std::format(L"--export {} {} --format tar.zst", LXSS_DISTRO_NAME_TEST_L, tarPath), -1);
+
+            VERIFY_ARE_EQUAL(out, L"This operation is only supported by WSL2.\r\nError code: Wsl/Service/WSL_E_WSL2_NEEDED\r\n");
+            VERIFY_ARE_EQUAL(err, L"");
+        }
+
+        // Verify that seekable zstd compression works, that the archive can be imported, and that a file can be extracted
+        // by only decompressing the frames found with the index at the end of the archive
+        if (LxsstuVmMode())
+        {
+            constexpr auto importedName = L"zstd-seekable-test-distro";
+            constexpr auto importedPath = L"zstd-seekable-test-distro";
+
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(std::format(
+                L"--export {} {} --format tar.zst --compression-level 19 --long --seekable", LXSS_DISTRO_NAME_TEST_L, tarPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+            VERIFY_ARE_EQUAL(err, L"");
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"zstd -t {}", tarPath)), 0L);
+
+            auto [indexMagic, _] =
+                LxsstuLaunchWslAndCaptureOutput(std::format(L"bash -c 'tail -c 4 {} | od -An -tx1'", tarPath));
+            VERIFY_ARE_EQUAL(indexMagic, L" 57 49 44 58\n");
+
+            // Read the frame offsets from the index, check that each frame decompresses on its own, then list the
+            // frames one at a time and extract /root/.bashrc from the first frame that lists it and the next one.
+            auto [extracted, __] = LxsstuLaunchWslAndCaptureOutput(std::format(
+                L"bash -c 'f={}; n=$(tail -c 8 $f | od -An -tu4 -N4); s=$((8 * n + 16)); "
+                L"o=($(tail -c $((s - 8)) $f | od -An -tu8 -w8 -N$((8 * n))) $(($(stat -c %s $f) - s))); "
+                L"frames() {{ tail -c +$((o[$1] + 1)) $f | head -c $((o[$2] - o[$1])); }}; "
+                L"for ((k = 0; k < n; k++)); do frames $k $((k + 1)) | zstd -tq - || exit 1; done; "
+                L"for ((k = 0; k < n; k++)); do "
+                L"if frames $k $((k + 1)) | zstd -dc | tar -t 2>/dev/null | grep -qx ./root/.bashrc; "
+                L"then frames $k $((k + 2 > n ? n : k + 2)) | zstd -dc | tar -xO ./root/.bashrc 2>/dev/null; exit 0; fi; done; "
+                L"exit 1'",
+                tarPath));
+
+            auto [bashrc, ___] = LxsstuLaunchWslAndCaptureOutput(L"-u root cat /root/.bashrc");
+            VERIFY_ARE_EQUAL(extracted, bashrc);
+
+            auto cleanupImport = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [&]() {
+                LxsstuLaunchWsl(std::format(L"--unregister {}", importedName));
+                std::filesystem::remove_all(importedPath);
+            });
+
+            VERIFY_ARE_EQUAL(
+                LxsstuLaunchWsl(std::format(L"--import {} {} {} --version 2", importedName, importedPath, tarPath)), 0L);
+
+            auto [importedBashrc, ____] = LxsstuLaunchWslAndCaptureOutput(std::format(L"-d {} cat /root/.bashrc", importedName));
+            VERIFY_ARE_EQUAL(importedBashrc, bashrc);
+        }
+
         // Validate that exporting as vhd works
         if (LxsstuVmMode())
         {
@@ -545,6 +627,19 @@ class UnitTests
         VERIFY_NO_THROW(LxsstuRunTest(L"/data/test/wsl_unit_tests vfsaccess", L"vfsaccess"));
     }
 
+    TEST_METHOD(InitClasses)
+    {
+        WSL2_TEST_ONLY();
+
+        // Run the unit tests of the init daemon classes, which are built next to this dll. The tests run as root since
+        // some of them create a network namespace.
+        const auto currentDll = std::filesystem::path(wil::GetModuleFileNameW<std::wstring>(wil::GetModuleInstanceHandle()));
+        const auto initTestsPath = currentDll.parent_path() / L"init_tests";
+        VERIFY_IS_TRUE(std::filesystem::exists(initTestsPath));
+
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"-u root $(wslpath '{}')", initTestsPath.wstring())), 0L);
+    }
+
     TEST_METHOD(DevPt)
     {
         WSL1_TEST_ONLY();
@@ -882,6 +977,20 @@ class UnitTests
                 VERIFY_ARE_EQUAL(out, L"wsl1");
             }
         }
+
+        if (LxsstuVmMode())
+        {
+            // Ensure that the startup timeline contains the phases of both mini_init and init.
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(L"wslinfo --startup-timeline");
+            VERIFY_ARE_EQUAL(err, L"");
+            VERIFY_IS_TRUE(out.find(L"mini_init: launching init") != std::wstring::npos);
+            VERIFY_IS_TRUE(out.find(L"init: instance initialized") != std::wstring::npos);
+
+            // Validate that the timeline is not propagated to user commands.
+            std::tie(out, err) = LxsstuLaunchWslAndCaptureOutput(L"echo -n \"$WSL2_STARTUP_TIMELINE\"");
+            VERIFY_ARE_EQUAL(out, L"");
+            VERIFY_ARE_EQUAL(err, L"");
+        }
     }
 
     TEST_METHOD(FsTab)
@@ -1640,7 +1749,17 @@ Arguments for managing distributions in Windows Subsystem for Linux:
 
         Options:
             --format <Format>
-                Specifies the export format. Supported values: tar, tar.gz, tar.xz, vhd.
+                Specifies the export format. Supported values: tar, tar.gz, tar.xz, tar.zst, vhd.
+
+            --compression-level <Level>
+                Specifies the tar.zst compression level, from 1 to 19.
+
+            --long
+                Enables long distance matching for tar.zst, which improves the compression of large distributions.
+
+            --seekable
+                Compresses a tar.zst in independent frames that start at file boundaries, and appends an index
+                of the frames, so that a single file can be extracted without decompressing the whole archive.
 
     --import <Distro> <InstallLocation> <FileName> [Options]
         Imports the specified tar file as a new distribution.
@@ -2115,6 +2234,7 @@ Error code: Wsl/InstallDistro/WSL_E_DISTRO_NOT_FOUND
                 // Verify DNS tunneling settings are parsed correctly
                 validateWarnings(L"[experimental]\ndnsTunneling=true\nbestEffortDnsParsing=true", L"");
                 validateWarnings(L"[experimental]\ndnsTunneling=true\ndnsTunnelingIpAddress=10.255.255.1", L"");
+                validateWarnings(L"[experimental]\ndnsTunneling=true\ndnsTunnelingCache=true", L"");
 
                 validateWarnings(
                     L"[experimental]\ndnsTunneling=true\ndnsTunnelingIpAddress=1.2.3",
@@ -4976,6 +5096,98 @@ Error code: Wsl/Service/RegisterDistro/E_INVALIDARG\r\n";
             wsl::shared::string::MultiByteToWide("01:23:45:67:89:AB"));
     }
 
+    TEST_METHOD(HnsSchemaStreamingDeserialization)
+    {
+        using namespace wsl::shared;
+
+        constexpr auto endpointJson =
+            R"({"IPAddress":"172.20.1.2","MacAddress":"00-15-5D-01-02-03","GatewayAddress":"172.20.0.1",)"
+            R"("PortFriendlyName":"eth0","VirtualNetwork":"{ebfda100-7464-4629-9da5-12de5470cb4f}",)"
+            R"("ID":"6b4c4ae1-33e5-4fd5-a6a8-5f4ed8c6d0a5","PrefixLength":20,"DNSServerList":"1.1.1.1",)"
+            R"("InterfaceConstraint":{"InterfaceIndex":4,"InterfaceMediaType":6,"InterfaceAlias":"Wi-Fi"},)"
+            R"("Policies":[{"Type":"PortName","Settings":{"Name":"x"}}],"Unknown":null})";
+
+        constexpr auto routeJson =
+            R"({"ResourceType":"Route","RequestType":"Update","targetDeviceName":"eth0",)"
+            R"("Settings":{"NextHop":"0.0.0.0","DestinationPrefix":"10.0.0.0/8","SitePrefixLength":0,"Metric":256,"Family":2}})";
+
+        constexpr auto interfaceJson =
+            R"({"ResourceType":"Interface","RequestType":"Update","Settings":{"Connected":true,"NlMtu":1500,"Metric":5}})";
+
+        // Validate that the streaming deserializer produces the same objects as the nlohmann one.
+        const auto endpoint = FromJson<hns::HNSEndpoint>(endpointJson);
+        const auto streamedEndpoint = FromJsonStreaming<hns::HNSEndpoint>(endpointJson);
+        VERIFY_ARE_EQUAL(endpoint.IPAddress, streamedEndpoint.IPAddress);
+        VERIFY_ARE_EQUAL(endpoint.MacAddress, streamedEndpoint.MacAddress);
+        VERIFY_ARE_EQUAL(endpoint.GatewayAddress, streamedEndpoint.GatewayAddress);
+        VERIFY_ARE_EQUAL(endpoint.PortFriendlyName, streamedEndpoint.PortFriendlyName);
+        VERIFY_ARE_EQUAL(endpoint.VirtualNetwork, streamedEndpoint.VirtualNetwork);
+        VERIFY_ARE_EQUAL(endpoint.ID, streamedEndpoint.ID);
+        VERIFY_ARE_EQUAL(endpoint.PrefixLength, streamedEndpoint.PrefixLength);
+        VERIFY_ARE_EQUAL(endpoint.InterfaceConstraint.InterfaceIndex, streamedEndpoint.InterfaceConstraint.InterfaceIndex);
+        VERIFY_ARE_EQUAL(endpoint.InterfaceConstraint.InterfaceAlias, streamedEndpoint.InterfaceConstraint.InterfaceAlias);
+        VERIFY_ARE_EQUAL(endpoint.DNSServerList, streamedEndpoint.DNSServerList);
+
+        const auto route = FromJsonStreaming<hns::ModifyGuestEndpointSettingRequest<hns::Route>>(routeJson);
+        VERIFY_IS_TRUE(route.ResourceType == hns::GuestEndpointResourceType::Route);
+        VERIFY_IS_TRUE(route.RequestType == hns::ModifyRequestType::Update);
+        VERIFY_ARE_EQUAL(route.targetDeviceName.value_or(L""), L"eth0");
+        VERIFY_ARE_EQUAL(route.Settings.NextHop, L"0.0.0.0");
+        VERIFY_ARE_EQUAL(route.Settings.DestinationPrefix, L"10.0.0.0/8");
+        VERIFY_ARE_EQUAL(route.Settings.Metric, 256u);
+        VERIFY_ARE_EQUAL(route.Settings.Family, static_cast<uint16_t>(AF_INET));
+
+        const auto link = FromJson<hns::ModifyGuestEndpointSettingRequest<hns::NetworkInterface>>(interfaceJson);
+        const auto streamedLink =
+            FromJsonStreaming<hns::ModifyGuestEndpointSettingRequest<hns::NetworkInterface>>(interfaceJson);
+        VERIFY_IS_TRUE(link.ResourceType == streamedLink.ResourceType);
+        VERIFY_ARE_EQUAL(link.Settings.Connected, streamedLink.Settings.Connected);
+        VERIFY_ARE_EQUAL(link.Settings.NlMtu, streamedLink.Settings.NlMtu);
+        VERIFY_ARE_EQUAL(link.Settings.Metric, streamedLink.Settings.Metric);
+        VERIFY_IS_FALSE(streamedLink.targetDeviceName.has_value());
+
+        // Validate that invalid documents are rejected.
+        for (const auto* invalid : {R"({"Connected":1})", R"({"NlMtu":"1500"})", R"({"Connected":true)", R"([true])"})
+        {
+            VERIFY_THROWS(FromJsonStreaming<hns::NetworkInterface>(invalid), wil::ResultException);
+        }
+
+        VERIFY_THROWS(FromJsonStreaming<hns::HNSEndpoint>(R"({"ID":"not-a-guid"})"), wil::ResultException);
+
+        // Compare the cost of both deserializers.
+        constexpr auto iterations = 10000;
+        auto measure = [](const auto& routine) {
+            const auto start = std::chrono::steady_clock::now();
+            for (auto i = 0; i < iterations; i++)
+            {
+                routine();
+            }
+
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        const auto nlohmannTime = measure([&]() { FromJson<hns::HNSEndpoint>(endpointJson); });
+        const auto streamingTime = measure([&]() { FromJsonStreaming<hns::HNSEndpoint>(endpointJson); });
+        LogInfo("HNSEndpoint x %d: nlohmann %lld us, streaming %lld us", iterations, nlohmannTime, streamingTime);
+
+        // Route notifications, read the way GnsEngine reads them: the DOM queried by key, or the header read first and
+        // then the whole request.
+        const auto nlohmannRouteTime = measure([&]() {
+            const auto json = nlohmann::json::parse(routeJson);
+            json["ResourceType"].get<hns::GuestEndpointResourceType>();
+            hns::Route settings;
+            nlohmann::from_json(json.at("Settings"), settings);
+            json["RequestType"].get<hns::ModifyRequestType>();
+        });
+
+        const auto streamingRouteTime = measure([&]() {
+            FromJsonStreaming<hns::ModifyGuestEndpointSettingRequest<void>>(routeJson);
+            FromJsonStreaming<hns::ModifyGuestEndpointSettingRequest<hns::Route>>(routeJson);
+        });
+
+        LogInfo("Route notification x %d: nlohmann %lld us, streaming %lld us", iterations, nlohmannRouteTime, streamingRouteTime);
+    }
+
     TEST_METHOD(ModernDistroInstall)
     {
         auto tarPath = "file://" + wsl::shared::string::WideToMultiByte(EscapePath(g_testDistroPath));